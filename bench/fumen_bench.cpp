@@ -0,0 +1,350 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include <algorithm>
+#include <functional>
+
+#include <sys/resource.h>
+
+#include <fumen.hpp>
+
+#include "generator.hpp"
+
+/*
+ * Allocation accounting. Every allocation made through operator new is
+ * prefixed with its size and header length, so live and peak bytes can
+ * be tracked.
+ */
+namespace {
+
+struct alloc_stats {
+    std::atomic<u64> m_count { 0 }, m_bytes { 0 }, m_live { 0 }, m_peak { 0 };
+};
+
+alloc_stats g_alloc;
+
+constexpr std::size_t s_header = alignof(std::max_align_t);
+
+void* tracked_alloc(std::size_t _size, std::size_t _align = s_header) {
+    std::size_t _header = std::max(_align, s_header),
+        _total = (_size + _header + _header - 1) / _header * _header;
+
+    char* _raw = static_cast<char*>(std::aligned_alloc(_header, _total));
+    if (!_raw) throw std::bad_alloc();
+
+    char* _ptr = _raw + _header;
+    reinterpret_cast<std::size_t*>(_ptr)[-1] = _size;
+    reinterpret_cast<std::size_t*>(_ptr)[-2] = _header;
+
+    g_alloc.m_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc.m_bytes.fetch_add(_size, std::memory_order_relaxed);
+
+    u64 _live = g_alloc.m_live.fetch_add(_size, std::memory_order_relaxed) + _size,
+        _peak = g_alloc.m_peak.load(std::memory_order_relaxed);
+    while (_live > _peak && !g_alloc.m_peak.compare_exchange_weak(_peak, _live));
+
+    return _ptr;
+}
+
+void tracked_free(void* _ptr) {
+    if (!_ptr) return;
+
+    std::size_t* _info = reinterpret_cast<std::size_t*>(_ptr);
+    g_alloc.m_live.fetch_sub(_info[-1], std::memory_order_relaxed);
+
+    std::free(static_cast<char*>(_ptr) - _info[-2]);
+}
+
+}
+
+void* operator new(std::size_t _size) { return tracked_alloc(_size); }
+void* operator new[](std::size_t _size) { return tracked_alloc(_size); }
+void operator delete(void* _ptr) noexcept { tracked_free(_ptr); }
+void operator delete[](void* _ptr) noexcept { tracked_free(_ptr); }
+void operator delete(void* _ptr, std::size_t) noexcept { tracked_free(_ptr); }
+void operator delete[](void* _ptr, std::size_t) noexcept { tracked_free(_ptr); }
+
+// std::pmr::new_delete_resource() allocates through the aligned forms
+void* operator new(std::size_t _size, std::align_val_t _align)
+{ return tracked_alloc(_size, static_cast<std::size_t>(_align)); }
+void* operator new[](std::size_t _size, std::align_val_t _align)
+{ return tracked_alloc(_size, static_cast<std::size_t>(_align)); }
+void operator delete(void* _ptr, std::align_val_t) noexcept { tracked_free(_ptr); }
+void operator delete[](void* _ptr, std::align_val_t) noexcept { tracked_free(_ptr); }
+void operator delete(void* _ptr, std::size_t, std::align_val_t) noexcept { tracked_free(_ptr); }
+void operator delete[](void* _ptr, std::size_t, std::align_val_t) noexcept { tracked_free(_ptr); }
+
+namespace fumen::bench {
+
+struct options {
+    u64 m_seed = 20240601;
+    u32 m_iterations = 5;
+    double m_scale = 1.0;
+    std::string m_out;
+    std::vector<corpus_kind> m_kinds;
+};
+
+struct result {
+    std::string m_kind, m_op;
+    u64 m_calls = 0, m_pages = 0, m_bytes = 0, m_total_ns = 0;
+    std::vector<u64> m_call_ns;
+    std::vector<double> m_page_ns;
+    u64 m_allocs = 0, m_alloc_bytes = 0, m_peak_bytes = 0;
+    // Filled only for decodes when built with FUMEN_INSTRUMENT
+    decode_stats m_stats;
+};
+
+// Number of fumens per kind at scale 1
+u32 corpus_size(corpus_kind _kind) {
+    switch (_kind) {
+        case corpus_kind::opener:   return 400;
+        case corpus_kind::replay:   return 8;
+        case corpus_kind::tutorial: return 100;
+        case corpus_kind::quiz:     return 400;
+    }
+
+    return 0;
+}
+
+template <typename T>
+T percentile(std::vector<T> _values, double _p) {
+    if (_values.empty()) return T();
+
+    std::size_t _idx = std::min<std::size_t>(_values.size() - 1, _p * _values.size());
+    std::nth_element(_values.begin(), _values.begin() + _idx, _values.end());
+
+    return _values[_idx];
+}
+
+/*
+ * Runs _call(i) for every item of the corpus _iterations times. _call
+ * returns the number of pages it handled.
+ */
+result measure(
+    const std::string& _kind, const std::string& _op,
+    std::size_t _count, u32 _iterations, u64 _bytes,
+    const std::function<std::size_t(std::size_t)>& _call
+) {
+    result _result;
+    _result.m_kind = _kind;
+    _result.m_op = _op;
+
+    for (u32 _it = 0; _it < _iterations; _it++) {
+        for (std::size_t _i = 0; _i < _count; _i++) {
+            u64 _allocs = g_alloc.m_count.load(), _alloc_bytes = g_alloc.m_bytes.load(),
+                _live = g_alloc.m_live.load();
+            g_alloc.m_peak.store(_live);
+
+            auto _begin = std::chrono::steady_clock::now();
+            std::size_t _pages = _call(_i);
+            auto _end = std::chrono::steady_clock::now();
+
+            u64 _ns = std::chrono::duration_cast<std::chrono::nanoseconds>(_end - _begin).count();
+
+            _result.m_calls++;
+            _result.m_pages += _pages;
+            _result.m_total_ns += _ns;
+            _result.m_call_ns.push_back(_ns);
+            if (_pages) _result.m_page_ns.push_back((double)_ns / _pages);
+
+            _result.m_allocs += g_alloc.m_count.load() - _allocs;
+            _result.m_alloc_bytes += g_alloc.m_bytes.load() - _alloc_bytes;
+            _result.m_peak_bytes = std::max<u64>(_result.m_peak_bytes, g_alloc.m_peak.load() - _live);
+        }
+    }
+
+    _result.m_bytes = _bytes * _iterations;
+
+    return _result;
+}
+
+void write_json(std::ostream& _os, const options& _opts, const std::vector<result>& _results) {
+    rusage _usage {};
+    getrusage(RUSAGE_SELF, &_usage);
+
+    _os << "{\n"
+        << "  \"seed\": " << _opts.m_seed << ",\n"
+        << "  \"iterations\": " << _opts.m_iterations << ",\n"
+        << "  \"scale\": " << _opts.m_scale << ",\n"
+        << "  \"max_rss_kb\": " << _usage.ru_maxrss << ",\n"
+        << "  \"results\": [";
+
+    for (std::size_t _i = 0; _i < _results.size(); _i++) {
+        const result& _r = _results[_i];
+        double _seconds = _r.m_total_ns / 1e9;
+
+        _os << (_i ? "," : "") << "\n    {\n"
+            << "      \"kind\": \"" << _r.m_kind << "\",\n"
+            << "      \"op\": \"" << _r.m_op << "\",\n"
+            << "      \"calls\": " << _r.m_calls << ",\n"
+            << "      \"pages\": " << _r.m_pages << ",\n"
+            << "      \"bytes\": " << _r.m_bytes << ",\n"
+            << "      \"total_ns\": " << _r.m_total_ns << ",\n"
+            << "      \"mb_per_s\": " << (_seconds > 0 ? _r.m_bytes / 1e6 / _seconds : 0) << ",\n"
+            << "      \"pages_per_s\": " << (_seconds > 0 ? _r.m_pages / _seconds : 0) << ",\n"
+            << "      \"call_ns\": { \"p50\": " << percentile(_r.m_call_ns, 0.5)
+            << ", \"p90\": " << percentile(_r.m_call_ns, 0.9)
+            << ", \"p99\": " << percentile(_r.m_call_ns, 0.99)
+            << ", \"max\": " << percentile(_r.m_call_ns, 1.0) << " },\n"
+            << "      \"page_ns\": { \"p50\": " << percentile(_r.m_page_ns, 0.5)
+            << ", \"p99\": " << percentile(_r.m_page_ns, 0.99) << " },\n"
+            << "      \"allocs_per_call\": " << (double)_r.m_allocs / std::max<u64>(1, _r.m_calls) << ",\n"
+            << "      \"alloc_bytes_per_call\": " << (double)_r.m_alloc_bytes / std::max<u64>(1, _r.m_calls) << ",\n"
+            << "      \"peak_bytes\": " << _r.m_peak_bytes;
+
+        if (_r.m_stats.m_calls) {
+            const decode_stats& _st = _r.m_stats;
+
+            _os << ",\n      \"stages\": {\n";
+            for (u32 _s = 0; _s < details::decode_stage_count; _s++) {
+                decode_stage _stage = static_cast<decode_stage>(_s);
+
+                _os << "        \"" << details::to_string(_stage) << "\": { \"calls\": " << _st[_stage].m_calls
+                    << ", \"cycles\": " << _st[_stage].m_cycles
+                    << ", \"allocs\": " << _st[_stage].m_allocs << " },\n";
+            }
+            _os << "        \"total\": { \"calls\": " << _st.m_total.m_calls
+                << ", \"cycles\": " << _st.m_total.m_cycles
+                << ", \"allocs\": " << _st.m_total.m_allocs << " }\n      }";
+        }
+
+        _os << "\n    }";
+    }
+
+    _os << "\n  ]\n}\n";
+}
+
+int run(const options& _opts) {
+    std::vector<result> _results;
+
+    for (corpus_kind _kind : _opts.m_kinds) {
+        generator _gen(_opts.m_seed + static_cast<u64>(_kind));
+
+        u32 _count = std::max<u32>(1, corpus_size(_kind) * _opts.m_scale);
+        std::vector<std::string> _corpus = _gen.corpus(_kind, _count);
+
+        u64 _bytes = 0;
+        for (const std::string& _str : _corpus) _bytes += _str.size();
+
+        std::vector<fumen_pages> _decoded;
+        _decoded.reserve(_corpus.size());
+        for (const std::string& _str : _corpus) _decoded.push_back(fumen::decode(_str));
+
+        const char* _name = to_string(_kind);
+
+        decode_stats _stats;
+        _results.push_back(measure(_name, "decode", _corpus.size(), _opts.m_iterations, _bytes,
+            [&] (std::size_t _i) {
+                std::size_t _pages = fumen::decode(_corpus[_i]).size();
+                if (instrument::enabled) _stats += instrument::last();
+                return _pages;
+            }));
+        _results.back().m_stats = _stats;
+
+        _results.push_back(measure(_name, "decode_history", _corpus.size(), _opts.m_iterations, _bytes,
+            [&] (std::size_t _i) { return fumen::decode_history(_corpus[_i]).size(); }));
+
+        _results.push_back(measure(_name, "decode_operations", _corpus.size(), _opts.m_iterations, _bytes,
+            [&] (std::size_t _i) { return fumen::decode<fumen::decode_parts::operations>(_corpus[_i]).size(); }));
+
+        _results.push_back(measure(_name, "decode_last_page", _corpus.size(), _opts.m_iterations, _bytes,
+            [&] (std::size_t _i) {
+                return fumen::decode<fumen::decode_parts::all | fumen::decode_parts::last_page>(_corpus[_i]).size();
+            }));
+
+        _results.push_back(measure(_name, "replay_stats", _corpus.size(), _opts.m_iterations, _bytes,
+            [&] (std::size_t _i) {
+                fumen::replay_stats _replay;
+                _replay.decode(_corpus[_i]);
+                return _replay.page_count();
+            }));
+
+        // One arena per call, released at once like a per-thread batch arena
+        std::vector<std::byte> _arena(1 << 20);
+        _results.push_back(measure(_name, "decode_pmr", _corpus.size(), _opts.m_iterations, _bytes,
+            [&] (std::size_t _i) {
+                std::pmr::monotonic_buffer_resource _resource(_arena.data(), _arena.size());
+                return fumen::pmr::decode(_corpus[_i], &_resource).size();
+            }));
+
+        _results.push_back(measure(_name, "encode", _decoded.size(), _opts.m_iterations, _bytes,
+            [&] (std::size_t _i) { fumen::encode(_decoded[_i]); return _decoded[_i].size(); }));
+
+        std::cerr << _name << ": " << _corpus.size() << " fumens, " << _bytes << " bytes\n";
+    }
+
+    if (_opts.m_out.empty())
+        write_json(std::cout, _opts, _results);
+    else {
+        std::ofstream _file(_opts.m_out);
+        if (!_file) {
+            std::cerr << "cannot open " << _opts.m_out << "\n";
+            return 1;
+        }
+
+        write_json(_file, _opts, _results);
+    }
+
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    using namespace fumen::bench;
+
+    options _opts;
+
+    fumen::instrument::set_alloc_counter([] () -> u64 { return g_alloc.m_count.load(); });
+
+    for (int _i = 1; _i < argc; _i++) {
+        std::string _arg = argv[_i];
+        const char* _value = _i + 1 < argc ? argv[_i + 1] : nullptr;
+
+        if (_arg == "--help" || _arg == "-h") {
+            std::cout <<
+                "usage: fumen_bench [--seed N] [--iterations N] [--scale F]\n"
+                "                   [--kind opener|replay|tutorial|quiz]... [--out FILE]\n";
+            return 0;
+        }
+
+        if (!_value) {
+            std::cerr << "missing value for " << _arg << "\n";
+            return 1;
+        }
+
+        if (_arg == "--seed") _opts.m_seed = std::strtoull(_value, nullptr, 10);
+        else if (_arg == "--iterations") _opts.m_iterations = std::strtoul(_value, nullptr, 10);
+        else if (_arg == "--scale") _opts.m_scale = std::strtod(_value, nullptr);
+        else if (_arg == "--out") _opts.m_out = _value;
+        else if (_arg == "--kind") {
+            auto _it = std::find_if(corpus_kinds.begin(), corpus_kinds.end(),
+                [&] (corpus_kind _kind) { return std::strcmp(to_string(_kind), _value) == 0; });
+
+            if (_it == corpus_kinds.end()) {
+                std::cerr << "unknown kind " << _value << "\n";
+                return 1;
+            }
+
+            _opts.m_kinds.push_back(*_it);
+        } else {
+            std::cerr << "unknown option " << _arg << "\n";
+            return 1;
+        }
+
+        _i++;
+    }
+
+    if (_opts.m_kinds.empty())
+        _opts.m_kinds.assign(corpus_kinds.begin(), corpus_kinds.end());
+
+    return run(_opts);
+}
\ No newline at end of file
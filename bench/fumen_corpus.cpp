@@ -0,0 +1,45 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fumen.hpp>
+
+#include "generator.hpp"
+
+// Writes a generated corpus to stdout, one fumen per line
+int main(int argc, char** argv) {
+    using namespace fumen::bench;
+
+    u64 _seed = 20240601;
+    u32 _count = 100;
+    corpus_kind _kind = corpus_kind::opener;
+    bool _mixed = true;
+
+    for (int _i = 1; _i + 1 < argc; _i += 2) {
+        std::string _arg = argv[_i];
+        const char* _value = argv[_i + 1];
+
+        if (_arg == "--seed") _seed = std::strtoull(_value, nullptr, 10);
+        else if (_arg == "--count") _count = std::strtoul(_value, nullptr, 10);
+        else if (_arg == "--kind") {
+            _mixed = std::strcmp(_value, "mixed") == 0;
+
+            for (corpus_kind _k : corpus_kinds)
+                if (std::strcmp(to_string(_k), _value) == 0) _kind = _k;
+        } else {
+            std::cerr << "usage: fumen_corpus [--seed N] [--count N]"
+                         " [--kind mixed|opener|replay|tutorial|quiz]\n";
+            return 1;
+        }
+    }
+
+    generator _gen(_seed);
+
+    for (u32 _i = 0; _i < _count; _i++) {
+        corpus_kind _k = _mixed ? corpus_kinds[_i % corpus_kinds.size()] : _kind;
+        std::cout << fumen::encode(_gen.make(_k)) << '\n';
+    }
+
+    return 0;
+}
\ No newline at end of file
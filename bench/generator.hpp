@@ -0,0 +1,271 @@
+#pragma once
+
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <algorithm>
+
+#include <fumen.hpp>
+
+namespace fumen::bench {
+
+enum class corpus_kind : u8 {
+    opener, replay, tutorial, quiz
+};
+
+inline constexpr std::array<corpus_kind, 4> corpus_kinds = {
+    corpus_kind::opener, corpus_kind::replay, corpus_kind::tutorial, corpus_kind::quiz
+};
+
+inline const char* to_string(corpus_kind _kind) {
+    switch (_kind) {
+        case corpus_kind::opener:   return "opener";
+        case corpus_kind::replay:   return "replay";
+        case corpus_kind::tutorial: return "tutorial";
+        case corpus_kind::quiz:     return "quiz";
+    }
+
+    return "unknown";
+}
+
+/*
+ * Seeded generator of fumens resembling real traffic. Pieces are hard
+ * dropped into the field and locked, so fields evolve like in a game:
+ * lines clear, garbage rises and consecutive pages share most rows.
+ */
+class generator {
+public:
+    explicit generator(u64 _seed) : m_rng(_seed) {}
+
+private:
+    std::mt19937_64 m_rng;
+
+    static constexpr std::array<piece_type, 7> s_minos = {
+        piece_type::I, piece_type::L, piece_type::O, piece_type::Z,
+        piece_type::T, piece_type::J, piece_type::S
+    };
+
+    static constexpr std::array<const char*, 8> s_opener_names = {
+        "TKI", "DT Cannon", "PCO", "Albatross", "Mountainous Stacking",
+        "Hachispin", "Perfect Clear Opener", "Stray Cannon"
+    };
+
+    static constexpr std::array<const char*, 12> s_words = {
+        "place", "the", "T piece", "into", "slot", "and", "keep", "stack",
+        "flat", "for", "the next bag", "PC"
+    };
+
+    static constexpr std::array<const char*, 6> s_jp_words = {
+        "テトリス", "開幕", "パフェ", "ミノ", "ホールド", "次は"
+    };
+
+    u32 m_uniform(u32 _n) { return std::uniform_int_distribution<u32>(0, _n - 1)(m_rng); }
+
+    bool m_chance(u32 _percent) { return m_uniform(100) < _percent; }
+
+    piece_type m_random_mino() { return s_minos[m_uniform(s_minos.size())]; }
+
+    std::vector<piece_type> m_bag() {
+        std::vector<piece_type> _bag(s_minos.begin(), s_minos.end());
+        std::shuffle(_bag.begin(), _bag.end(), m_rng);
+        return _bag;
+    }
+
+    // Lowest resting position of the piece dropped from the top, if any
+    static std::optional<operation> s_drop(const field& _field, piece_type _piece, rotation _rot, u32 _x) {
+        operation _op { _piece, _rot, _x, 20 };
+
+        if (!details::mino(_op).is_valid() || !_field.can_fill(_op))
+            return std::nullopt;
+
+        while (_op.m_y > 0) {
+            operation _below = _op; _below.m_y--;
+
+            if (!details::mino(_below).is_valid() || !_field.can_fill(_below))
+                break;
+
+            _op = _below;
+        }
+
+        return _op;
+    }
+
+    std::optional<operation> m_place(const field& _field, piece_type _piece) {
+        for (u32 _try = 0; _try < 16; _try++) {
+            auto _op = s_drop(_field, _piece, static_cast<rotation>(m_uniform(4)), m_uniform(details::FIELD_WIDTH));
+            if (_op) return _op;
+        }
+
+        return std::nullopt;
+    }
+
+    // Applies what the decoder does after a page with the lock flag
+    static field s_after_lock(const fumen_page& _page) {
+        details::inner_field _field = static_cast<details::inner_field>(_page.m_field);
+
+        if (_page.m_flags.lock_bit) {
+            if (_page.m_operation) {
+                const operation& _op = *_page.m_operation;
+                _field.fill({ _op.m_piece, _op.m_rotation, _op.m_x, _op.m_y });
+            }
+
+            _field.clear_line();
+
+            if (_page.m_flags.rise_bit) _field.rise_garbage();
+            if (_page.m_flags.mirror_bit) _field.mirror();
+        }
+
+        return field(_field);
+    }
+
+    std::string m_sentence(u32 _words, bool _japanese) {
+        std::string _text;
+
+        for (u32 _i = 0; _i < _words; _i++) {
+            if (_i) _text += ' ';
+
+            if (_japanese && m_chance(40))
+                _text += s_jp_words[m_uniform(s_jp_words.size())];
+            else
+                _text += s_words[m_uniform(s_words.size())];
+        }
+
+        return _text;
+    }
+
+    fumen_pages m_play(u32 _count, const std::vector<piece_type>& _sequence, bool _garbage) {
+        fumen_pages _pages;
+        field _current;
+
+        for (u32 _i = 0; _i < _count; _i++) {
+            fumen_page _page;
+            _page.m_field = _current;
+            _page.m_flags.lock_bit = true;
+
+            if (_garbage && m_chance(5)) {
+                u32 _hole = m_uniform(details::FIELD_WIDTH);
+                for (u32 _x = 0; _x < details::FIELD_WIDTH; _x++)
+                    _page.m_field.set(_x, -1, _x == _hole ? piece_type::empty : piece_type::gray);
+                _page.m_flags.rise_bit = true;
+            }
+
+            piece_type _piece = _sequence.empty() ?
+                m_random_mino() : _sequence[_i % _sequence.size()];
+
+            _page.m_operation = m_place(_page.m_field, _piece);
+
+            // Topped out, start over from an empty field
+            if (!_page.m_operation) {
+                _page.m_field = field();
+                _page.m_flags.rise_bit = false;
+                _page.m_operation = m_place(_page.m_field, _piece);
+            }
+
+            _current = s_after_lock(_page);
+            _pages.push_back(std::move(_page));
+        }
+
+        return _pages;
+    }
+
+public:
+    fumen_pages opener() {
+        std::vector<piece_type> _sequence = m_bag();
+        fumen_pages _pages = m_play(3 + m_uniform(8), _sequence, false);
+
+        _pages.front().m_comment = s_opener_names[m_uniform(s_opener_names.size())];
+
+        return _pages;
+    }
+
+    fumen_pages replay(u32 _count) {
+        std::vector<piece_type> _sequence;
+        while (_sequence.size() < _count) {
+            std::vector<piece_type> _bag = m_bag();
+            _sequence.insert(_sequence.end(), _bag.begin(), _bag.end());
+        }
+
+        return m_play(_count, _sequence, true);
+    }
+
+    fumen_pages tutorial() {
+        fumen_pages _pages = m_play(10 + m_uniform(20), {}, false);
+
+        bool _japanese = m_chance(50);
+        for (fumen_page& _page : _pages) {
+            // Some pages keep the previous explanation
+            if (&_page != &_pages.front() && m_chance(30)) {
+                _page.m_comment = (&_page - 1)->m_comment;
+                continue;
+            }
+
+            _page.m_comment = m_sentence(30 + m_uniform(120), _japanese);
+        }
+
+        return _pages;
+    }
+
+    fumen_pages quiz() {
+        std::vector<piece_type> _sequence = m_bag();
+        fumen_pages _pages = m_play(_sequence.size(), _sequence, false);
+
+        std::string _comment = "#Q=[](";
+        _comment += piece_to_char(_sequence.front());
+        _comment += ')';
+        for (u32 _i = 1; _i < _sequence.size(); _i++)
+            _comment += piece_to_char(_sequence[_i]);
+
+        if (m_chance(50)) {
+            std::vector<piece_type> _next = m_bag();
+
+            _comment += ";#Q=[](";
+            _comment += piece_to_char(_next.front());
+            _comment += ')';
+            for (u32 _i = 1; _i < _next.size(); _i++)
+                _comment += piece_to_char(_next[_i]);
+        }
+
+        // Later pages show the quiz as the decoder advances it per lock,
+        // so the encoder emits the comment only once
+        details::quiz _quiz(_comment);
+        for (fumen_page& _page : _pages) {
+            _page.m_comment = &_page == &_pages.front() ? _comment : _quiz.format().to_string();
+
+            if (!_quiz.can_operate() || !_page.m_operation) continue;
+
+            try {
+                details::quiz _next = _quiz.next_if_end();
+                _quiz = _next.operate(_next.get_operation(_page.m_operation->m_piece));
+            } catch (const std::exception&) {
+                _quiz = _quiz.format();
+            }
+        }
+
+        return _pages;
+    }
+
+    fumen_pages make(corpus_kind _kind) {
+        switch (_kind) {
+            case corpus_kind::opener:   return opener();
+            case corpus_kind::replay:   return replay(500 + m_uniform(1500));
+            case corpus_kind::tutorial: return tutorial();
+            case corpus_kind::quiz:     return quiz();
+        }
+
+        return {};
+    }
+
+    std::vector<std::string> corpus(corpus_kind _kind, u32 _count) {
+        std::vector<std::string> _corpus;
+        _corpus.reserve(_count);
+
+        for (u32 _i = 0; _i < _count; _i++)
+            _corpus.push_back(fumen::encode(make(_kind)));
+
+        return _corpus;
+    }
+};
+
+}
\ No newline at end of file
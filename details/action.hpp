@@ -1,7 +1,12 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <algorithm>
+
 #include <details/intdef.hpp>
 #include <details/defs.hpp>
+#include <details/inner_field.hpp>
 
 namespace fumen::details {
 
@@ -10,9 +15,37 @@ struct action {
     bool m_rise = false, m_mirror = false, m_colorize = false, m_comment = false, m_lock = false;
 };
 
+/*
+ * Fumen stores the position of some rotated pieces one cell off from the
+ * position the library uses. This is the offset to add when decoding (and
+ * to subtract when encoding), by piece and rotation.
+ */
+/* static */ class action_offsets {
+public:
+    struct offset {
+        i32 m_x, m_y;
+    };
+
+    static constexpr offset get(piece_type _piece, rotation_type _rotation)
+    { return s_table[static_cast<u8>(_piece) & 7][static_cast<u8>(_rotation) & 3]; }
+
+private:
+    // Rotations in the order of rotation_type: reverse, right, spawn, left
+    static constexpr std::array<std::array<offset, 4>, 8> s_table = {{
+        /* empty */ {{ { 0, 0 }, {  0, 0 }, { 0,  0 }, { 0,  0 } }},
+        /* I */     {{ { 1, 0 }, {  0, 0 }, { 0,  0 }, { 0, -1 } }},
+        /* L */     {{ { 0, 0 }, {  0, 0 }, { 0,  0 }, { 0,  0 } }},
+        /* O */     {{ { 1, 0 }, {  0, 0 }, { 0, -1 }, { 1, -1 } }},
+        /* Z */     {{ { 0, 0 }, {  0, 0 }, { 0, -1 }, { 1,  0 } }},
+        /* T */     {{ { 0, 0 }, {  0, 0 }, { 0,  0 }, { 0,  0 } }},
+        /* J */     {{ { 0, 0 }, {  0, 0 }, { 0,  0 }, { 0,  0 } }},
+        /* S */     {{ { 0, 0 }, { -1, 0 }, { 0, -1 }, { 0,  0 } }}
+    }};
+};
+
 class action_codec {
 public:
-    action_codec(u32 _width, u32 _height, u32 _garbage_height)
+    constexpr action_codec(u32 _width, u32 _height, u32 _garbage_height)
     : m_width(_width), m_height(_height), m_garbage_height(_garbage_height) {}
 
 private:
@@ -24,41 +57,17 @@ private:
         i32 _x = _value % m_width;
         i32 _y = m_height - (_value / 10) - 1;
 
-        if (_piece == piece_type::O) {
-            if (_rotation == rotation_type::spawn) return { _x, _y - 1 };
-            else if (_rotation == rotation_type::reverse) return { _x + 1, _y };
-            else if (_rotation == rotation_type::left) return { _x + 1, _y - 1 };
-        } else if (_piece == piece_type::I) {
-            if (_rotation == rotation_type::reverse) return { _x + 1, _y };
-            else if (_rotation == rotation_type::left) return { _x, _y - 1 };
-        } else if (_piece == piece_type::S) {
-            if (_rotation == rotation_type::spawn) return { _x, _y - 1 };
-            else if (_rotation == rotation_type::right) return { _x - 1, _y };
-        } else if (_piece == piece_type::Z) {
-            if (_rotation == rotation_type::spawn) return { _x, _y - 1 };
-            else if (_rotation == rotation_type::left) return { _x + 1, _y };
-        }
-
-        return { _x, _y };
+        action_offsets::offset _off = action_offsets::get(_piece, _rotation);
+        return { _x + _off.m_x, _y + _off.m_y };
     }
 
     constexpr u64 _M_encode_coordinate(
         i32 _x, i32 _y, piece_type _piece, rotation_type _rotation
     ) const {
         if (!defs::is_mino(_piece)) _x = 0, _y = 22;
-        else if (_piece == piece_type::O) {
-            if (_rotation == rotation_type::spawn) _y++;
-            else if (_rotation == rotation_type::reverse) _x--;
-            else if (_rotation == rotation_type::left) _x--, _y++;
-        } else if (_piece == piece_type::I) {
-            if (_rotation == rotation_type::reverse) _x--;
-            else if (_rotation == rotation_type::left) _y++;
-        } else if (_piece == piece_type::S) {
-            if (_rotation == rotation_type::spawn) _y++;
-            else if (_rotation == rotation_type::right) _x++;
-        } else if (_piece == piece_type::Z) {
-            if (_rotation == rotation_type::spawn) _y++;
-            else if (_rotation == rotation_type::left) _x--;
+        else {
+            action_offsets::offset _off = action_offsets::get(_piece, _rotation);
+            _x -= _off.m_x, _y -= _off.m_y;
         }
 
         return (m_height - _y - 1) * m_width + _x;
@@ -134,4 +143,79 @@ public:
     }
 };
 
+/*
+ * action_codec for a geometry known at compile time, so that every
+ * division is by a constant. An action value is piece + 8 * (rotation + 4
+ * * (coordinate + block_count * flags)); the first two are bit fields and
+ * only the coordinate needs real division. The batch decode splits that
+ * arithmetic into column loops over u32, which compilers vectorize.
+ */
+template <u32 Width, u32 Height, u32 GarbageHeight>
+class fixed_action_codec {
+public:
+    static constexpr u32 width = Width, height = Height;
+    static constexpr u32 block_count = Width * (Height + GarbageHeight);
+
+    // Largest value read from the three digits of a page
+    static constexpr u32 max_value = 64 * 64 * 64 - 1;
+
+    static constexpr action decode(u32 _value) {
+        u32 _coordinate = (_value >> 5) % block_count, _flags = (_value >> 5) / block_count;
+        return s_make(_value & 7, _value >> 3 & 3, _coordinate % Width, Height - 1 - _coordinate / Width, _flags);
+    }
+
+    // Encoding only multiplies, which the runtime codec already does with
+    // these constants once inlined
+    static constexpr i64 encode(const action& _act)
+    { return action_codec(Width, Height, GarbageHeight).encode(_act); }
+
+    // Decodes _count values into _out, as decode() does one at a time
+    static void decode(const u32* _values, std::size_t _count, action* _out) {
+        constexpr std::size_t _chunk = 64;
+
+        u32 _pieces[_chunk], _rotations[_chunk], _xs[_chunk], _ys[_chunk], _flags[_chunk];
+
+        for (std::size_t _base = 0; _base < _count; _base += _chunk) {
+            std::size_t _n = std::min(_chunk, _count - _base);
+            const u32* _in = _values + _base;
+
+            for (std::size_t _i = 0; _i < _n; _i++) {
+                u32 _v = _in[_i], _rest = _v >> 5, _coordinate = _rest % block_count;
+
+                _pieces[_i] = _v & 7;
+                _rotations[_i] = _v >> 3 & 3;
+                _xs[_i] = _coordinate % Width;
+                _ys[_i] = Height - 1 - _coordinate / Width;
+                _flags[_i] = _rest / block_count;
+            }
+
+            for (std::size_t _i = 0; _i < _n; _i++)
+                _out[_base + _i] = s_make(_pieces[_i], _rotations[_i], _xs[_i], _ys[_i], _flags[_i]);
+        }
+    }
+
+private:
+    static constexpr action s_make(u32 _piece, u32 _rotation, u32 _x, u32 _y, u32 _flags) {
+        piece_type _p = static_cast<piece_type>(_piece);
+        rotation_type _r = static_cast<rotation_type>(_rotation);
+        action_offsets::offset _off = action_offsets::get(_p, _r);
+
+        return action {
+            { _p, _r, _x + _off.m_x, _y + _off.m_y },
+            (_flags & 1) != 0, (_flags >> 1 & 1) != 0, (_flags >> 2 & 1) != 0, (_flags >> 3 & 1) != 0,
+            !(_flags >> 4 & 1)
+        };
+    }
+};
+
+using v110_action_codec = fixed_action_codec<FIELD_WIDTH, 21, GARBAGE_LINE>;
+using v115_action_codec = fixed_action_codec<FIELD_WIDTH, 23, GARBAGE_LINE>;
+
+// Decodes an action of a page whose field is _height rows tall, 23 for v115
+// and 21 for v110
+constexpr action decode_action(u32 _value, u32 _height) {
+    return _height == v115_action_codec::height ?
+        v115_action_codec::decode(_value) : v110_action_codec::decode(_value);
+}
+
 }
\ No newline at end of file
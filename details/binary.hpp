@@ -0,0 +1,562 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include <optional>
+#include <stdexcept>
+
+#include <details/intdef.hpp>
+#include <details/simd.hpp>
+
+#include <details/defs.hpp>
+#include <details/inner_field.hpp>
+#include <details/field.hpp>
+#include <details/action.hpp>
+
+namespace fumen::details {
+
+/*
+ * Binary page format, version 2. Integers are little-endian and read
+ * byte-wise, so a file can be used in place at any alignment.
+ *
+ *   header    64 bytes: "FMPB", u16 version, u16 header size, u32 fumen,
+ *             page, field and comment counts, u64 offsets of the four
+ *             sections below and u64 file size
+ *   fumens    u32[fumen count + 1], index of the first page of each fumen
+ *   pages     12 bytes each: u32 field, u32 comment, u16 operation, u8
+ *             flags, u8 reserved
+ *   fields    u32[field count + 1] offsets into the records that follow.
+ *             A record starts with a u32 mask of the stored rows (bit 0 is
+ *             the garbage line, bit y + 1 the line y). A full record then
+ *             has 5 bytes per stored row, two cells per byte with the lower
+ *             x in the low nibble; rows not stored are empty. A delta
+ *             record has bit 31 of the mask set, then the u32 index of a
+ *             full record, then the rows which differ from it.
+ *   comments  u32[comment count + 1] offsets into the bytes that follow
+ *
+ * Deltas refer only to full records, so any field is read from at most
+ * two records. Fields and comments are deduplicated over the whole file.
+ * An operation is stored as the v115 action of a page with the operation
+ * and no flags, piece + 8 * (rotation + 4 * coordinate), and 0 if there is
+ * none. The coordinate is the cell before the offsets of action_offsets,
+ * so every decoded operation fits, those the offsets move off the field
+ * included, and runs of operations are read with the batch decode of
+ * v115_action_codec.
+ */
+/* static */ class binary_format {
+public:
+    static constexpr char magic[4] = { 'F', 'M', 'P', 'B' };
+    static constexpr u16 version = 2;
+    static constexpr u32 header_size = 64, page_size = 12, row_size = FIELD_WIDTH / 2;
+    static constexpr u32 row_count = FIELD_HEIGHT + GARBAGE_LINE;
+    static constexpr u32 delta_bit = 1u << 31;
+
+    using packed_rows = std::array<std::array<char, row_size>, row_count>;
+
+    template <typename T>
+    static void put(std::string& _out, T _value) {
+        for (u32 _i = 0; _i < sizeof(T); _i++)
+            _out += static_cast<char>((static_cast<u64>(_value) >> (_i * 8)) & 0xFF);
+    }
+
+    template <typename T>
+    static T get(const char* _ptr) {
+        u64 _value = 0;
+        for (u32 _i = 0; _i < sizeof(T); _i++)
+            _value |= static_cast<u64>(static_cast<u8>(_ptr[_i])) << (_i * 8);
+        return static_cast<T>(_value);
+    }
+
+    // Values of stored operations are below this
+    static constexpr u32 operation_limit = 32 * v115_action_codec::block_count;
+
+    static u16 pack_operation(const std::optional<field_operation>& _op) {
+        if (!_op || _op->m_piece == piece_type::empty) return 0;
+
+        action_offsets::offset _off = action_offsets::get(_op->m_piece, _op->m_rotation);
+        i64 _x = static_cast<i64>(static_cast<i32>(_op->m_x)) - _off.m_x,
+            _y = static_cast<i64>(static_cast<i32>(_op->m_y)) - _off.m_y;
+
+        // Gray is not a piece an action can hold
+        if (_op->m_piece >= piece_type::gray ||
+            _x < 0 || _x >= static_cast<i64>(FIELD_WIDTH) ||
+            _y < -static_cast<i64>(GARBAGE_LINE) || _y >= static_cast<i64>(v115_action_codec::height))
+            throw std::invalid_argument("Operation out of range");
+
+        action _act;
+        _act.m_operation = inner_operation { _op->m_piece, _op->m_rotation, _op->m_x, _op->m_y };
+        _act.m_lock = true;
+
+        return static_cast<u16>(v115_action_codec::encode(_act));
+    }
+
+    // The operation of an action decoded from a stored value
+    static std::optional<field_operation> operation_of(const action& _act) {
+        const inner_operation& _op = _act.m_operation;
+        if (_op.m_piece == piece_type::empty) return std::nullopt;
+
+        return field_operation { _op.m_piece, _op.m_rotation, _op.m_x, _op.m_y };
+    }
+
+    static std::optional<field_operation> unpack_operation(u16 _value) {
+        if (_value >= operation_limit)
+            throw std::invalid_argument("Invalid binary fumen data");
+
+        return operation_of(v115_action_codec::decode(_value));
+    }
+
+    // Cells are 4 bits, so one that is not a piece would spill into the
+    // next cell and is rejected
+    template <typename Field>
+    static packed_rows pack_rows(const Field& _field) {
+        packed_rows _rows {};
+
+        for (u32 _r = 0; _r < row_count; _r++)
+            for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
+                piece_type _piece = _field.get_number_at(_x, static_cast<i32>(_r) - GARBAGE_LINE);
+                if (_piece > piece_type::gray)
+                    throw std::invalid_argument("Invalid piece in field");
+
+                _rows[_r][_x / 2] |= static_cast<char>(static_cast<u8>(_piece) << (_x % 2 * 4));
+            }
+
+        return _rows;
+    }
+
+    // Rows of _rows selected by _mask, after the mask and the optional base
+    static std::string make_record(const packed_rows& _rows, u32 _mask, std::optional<u32> _base) {
+        std::string _record;
+        _record.reserve(8 + row_size * simd::popcount(_mask));
+
+        put<u32>(_record, _base ? _mask | delta_bit : _mask);
+        if (_base) put<u32>(_record, *_base);
+
+        for (u32 _r = 0; _r < row_count; _r++)
+            if (_mask >> _r & 1u) _record.append(_rows[_r].data(), row_size);
+
+        return _record;
+    }
+
+    static u32 nonempty_mask(const packed_rows& _rows) {
+        static constexpr std::array<char, row_size> _empty {};
+
+        u32 _mask = 0;
+        for (u32 _r = 0; _r < row_count; _r++)
+            if (_rows[_r] != _empty) _mask |= 1u << _r;
+
+        return _mask;
+    }
+
+    static u32 diff_mask(const packed_rows& _a, const packed_rows& _b) {
+        u32 _mask = 0;
+        for (u32 _r = 0; _r < row_count; _r++)
+            if (_a[_r] != _b[_r]) _mask |= 1u << _r;
+
+        return _mask;
+    }
+};
+
+// A field inside a binary page file, read without unpacking
+class binary_field {
+public:
+    binary_field() = default;
+    // _base is a full record, _delta a delta record on it or nullptr
+    binary_field(const char* _base, const char* _delta) : m_base(_base), m_delta(_delta) {}
+
+private:
+    const char* m_base = nullptr;
+    const char* m_delta = nullptr;
+
+    static u32 s_mask(const char* _record)
+    { return binary_format::get<u32>(_record) & ~binary_format::delta_bit; }
+
+    // Row _r of _record, or nullptr if the record does not store it
+    static const char* s_row(const char* _record, u32 _r, u32 _header) {
+        u32 _mask = s_mask(_record);
+        if (!(_mask >> _r & 1u)) return nullptr;
+
+        return _record + _header + binary_format::row_size * simd::popcount(_mask & ((1u << _r) - 1));
+    }
+
+    static void s_apply(inner_field& _field, const char* _record, u32 _header) {
+        u32 _mask = s_mask(_record);
+
+        for (u32 _rank = 0; _mask; _mask &= _mask - 1, _rank++) {
+            i32 _y = static_cast<i32>(simd::ctz(_mask)) - GARBAGE_LINE;
+            const char* _row = _record + _header + _rank * binary_format::row_size;
+
+            for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+                _field.set_number_at(_x, _y, static_cast<piece_type>(
+                    static_cast<u8>(_row[_x / 2]) >> (_x % 2 * 4) & 0xF
+                ));
+        }
+    }
+
+public:
+    piece_type at(i32 _x, i32 _y) const {
+        if (_x < 0 || _x >= static_cast<i32>(FIELD_WIDTH) ||
+            _y < -static_cast<i32>(GARBAGE_LINE) || _y >= static_cast<i32>(FIELD_HEIGHT))
+            throw std::out_of_range("Cell out of field");
+
+        u32 _r = _y + GARBAGE_LINE;
+
+        const char* _row = m_delta ? s_row(m_delta, _r, 8) : nullptr;
+        if (!_row) _row = s_row(m_base, _r, 4);
+        if (!_row) return piece_type::empty;
+
+        return static_cast<piece_type>(static_cast<u8>(_row[_x / 2]) >> (_x % 2 * 4) & 0xF);
+    }
+
+    inner_field to_inner_field(const inner_field::allocator_type& _alloc = {}) const {
+        inner_field _field(_alloc);
+
+        s_apply(_field, m_base, 4);
+        if (m_delta) s_apply(_field, m_delta, 8);
+
+        return _field;
+    }
+
+    field to_field() const { return field(to_inner_field()); }
+
+    // Records are deduplicated, so equal fields of one file share records
+    bool same_record(const binary_field& _other) const
+    { return m_base == _other.m_base && m_delta == _other.m_delta; }
+};
+
+struct binary_page {
+    binary_field m_field;
+    std::string_view m_comment;
+    std::optional<field_operation> m_operation;
+    u8 m_flags = 0;
+};
+
+/*
+ * Builds a binary page file. Pages can be any type with the members of
+ * fumen_page (m_field, m_comment, m_operation and m_flags.all).
+ */
+class binary_writer {
+private:
+    std::vector<u32> m_fumens { 0 };
+    std::string m_pages;
+
+    // Full record the fields of the current fumen are stored against
+    std::optional<u32> m_key;
+    binary_format::packed_rows m_key_rows {};
+
+    std::vector<u32> m_field_offsets { 0 }, m_comment_offsets { 0 };
+    std::string m_fields, m_comments;
+    std::unordered_map<std::string, u32> m_field_ids, m_comment_ids;
+
+    static u32 s_intern(
+        std::unordered_map<std::string, u32>& _ids, std::vector<u32>& _offsets,
+        std::string& _data, std::string&& _value
+    ) {
+        auto [_it, _inserted] = _ids.try_emplace(std::move(_value), _offsets.size() - 1);
+
+        if (_inserted) {
+            if (_data.size() + _it->first.size() > UINT32_MAX)
+                throw std::length_error("Binary fumen section too large");
+
+            _data += _it->first;
+            _offsets.push_back(_data.size());
+        }
+
+        return _it->second;
+    }
+
+    // A delta on the current key if it is smaller than a full record;
+    // otherwise the field is stored in full and becomes the key
+    template <typename Field>
+    u32 m_add_field(const Field& _field) {
+        binary_format::packed_rows _rows = binary_format::pack_rows(_field);
+        u32 _full = binary_format::nonempty_mask(_rows);
+
+        if (m_key) {
+            u32 _diff = binary_format::diff_mask(m_key_rows, _rows);
+
+            if (_diff == 0) return *m_key;
+
+            if (4 + binary_format::row_size * simd::popcount(_diff) < binary_format::row_size * simd::popcount(_full))
+                return s_intern(
+                    m_field_ids, m_field_offsets, m_fields,
+                    binary_format::make_record(_rows, _diff, m_key)
+                );
+        }
+
+        m_key = s_intern(
+            m_field_ids, m_field_offsets, m_fields,
+            binary_format::make_record(_rows, _full, std::nullopt)
+        );
+        m_key_rows = _rows;
+
+        return *m_key;
+    }
+
+    template <typename Pages>
+    void m_add_pages(const Pages& _pages) {
+        for (const auto& _page : _pages) {
+            u32 _field = m_add_field(_page.m_field.inner());
+            u32 _comment = s_intern(
+                m_comment_ids, m_comment_offsets, m_comments,
+                std::string(std::string_view(_page.m_comment))
+            );
+
+            binary_format::put<u32>(m_pages, _field);
+            binary_format::put<u32>(m_pages, _comment);
+            binary_format::put<u16>(m_pages, binary_format::pack_operation(_page.m_operation));
+            binary_format::put<u8>(m_pages, _page.m_flags.all);
+            binary_format::put<u8>(m_pages, 0);
+        }
+    }
+
+public:
+    // Appends one fumen; if a page cannot be stored, none of it is
+    template <typename Pages>
+    void add(const Pages& _pages) {
+        m_key = std::nullopt;
+        std::size_t _start = m_pages.size();
+
+        try {
+            m_add_pages(_pages);
+        } catch (...) {
+            m_pages.resize(_start);
+            m_key = std::nullopt;
+            throw;
+        }
+
+        m_fumens.push_back(page_count());
+    }
+
+    u32 fumen_count() const { return m_fumens.size() - 1; }
+    u32 page_count() const { return m_pages.size() / binary_format::page_size; }
+
+    std::string data() const {
+        u64 _fumens_offset = binary_format::header_size,
+            _pages_offset = _fumens_offset + 4 * m_fumens.size(),
+            _fields_offset = _pages_offset + m_pages.size(),
+            _comments_offset = _fields_offset + 4 * m_field_offsets.size() + m_fields.size(),
+            _size = _comments_offset + 4 * m_comment_offsets.size() + m_comments.size();
+
+        std::string _out;
+        _out.reserve(_size);
+
+        _out.append(binary_format::magic, 4);
+        binary_format::put<u16>(_out, binary_format::version);
+        binary_format::put<u16>(_out, binary_format::header_size);
+        binary_format::put<u32>(_out, fumen_count());
+        binary_format::put<u32>(_out, page_count());
+        binary_format::put<u32>(_out, m_field_offsets.size() - 1);
+        binary_format::put<u32>(_out, m_comment_offsets.size() - 1);
+        for (u64 _offset : { _fumens_offset, _pages_offset, _fields_offset, _comments_offset, _size })
+            binary_format::put<u64>(_out, _offset);
+
+        for (u32 _first : m_fumens) binary_format::put<u32>(_out, _first);
+        _out += m_pages;
+        for (u32 _offset : m_field_offsets) binary_format::put<u32>(_out, _offset);
+        _out += m_fields;
+        for (u32 _offset : m_comment_offsets) binary_format::put<u32>(_out, _offset);
+        _out += m_comments;
+
+        return _out;
+    }
+};
+
+/*
+ * Zero-copy reader of a binary page file, e.g. over a mapped_file. The
+ * header is checked on construction; pages are resolved on access in
+ * constant time. The underlying bytes must outlive the view and the
+ * pages taken from it.
+ */
+class binary_view {
+public:
+    binary_view() = default;
+
+    explicit binary_view(std::string_view _data) : m_data(_data) {
+        if (_data.size() < binary_format::header_size ||
+            _data.compare(0, 4, binary_format::magic, 4) != 0)
+            throw std::invalid_argument("Invalid binary fumen data");
+
+        if (m_get<u16>(4) != binary_format::version)
+            throw std::logic_error("Unsupported binary fumen version.");
+
+        m_fumen_count = m_get<u32>(8);
+        m_page_count = m_get<u32>(12);
+        m_field_count = m_get<u32>(16);
+        m_comment_count = m_get<u32>(20);
+
+        m_fumens = m_get<u64>(24);
+        m_pages = m_get<u64>(32);
+        m_fields = m_get<u64>(40);
+        m_comments = m_get<u64>(48);
+
+        u64 _size = m_get<u64>(56);
+
+        bool _valid = _size <= _data.size()
+            && m_get<u16>(6) <= m_fumens
+            && m_fumens + 4 * (u64(m_fumen_count) + 1) <= m_pages
+            && m_pages + u64(binary_format::page_size) * m_page_count <= m_fields
+            && m_fields + 4 * (u64(m_field_count) + 1) <= m_comments
+            && m_comments + 4 * (u64(m_comment_count) + 1) <= _size;
+
+        if (!_valid)
+            throw std::invalid_argument("Invalid binary fumen data");
+
+        m_field_data = m_fields + 4 * (u64(m_field_count) + 1);
+        m_comment_data = m_comments + 4 * (u64(m_comment_count) + 1);
+
+        if (m_field_data + m_get<u32>(m_fields + 4 * u64(m_field_count)) > m_comments ||
+            m_comment_data + m_get<u32>(m_comments + 4 * u64(m_comment_count)) > _size)
+            throw std::invalid_argument("Invalid binary fumen data");
+
+        m_data = _data.substr(0, _size);
+    }
+
+private:
+    std::string_view m_data;
+    u32 m_fumen_count = 0, m_page_count = 0, m_field_count = 0, m_comment_count = 0;
+    u64 m_fumens = 0, m_pages = 0, m_fields = 0, m_comments = 0, m_field_data = 0, m_comment_data = 0;
+
+    template <typename T>
+    T m_get(u64 _offset) const { return binary_format::get<T>(m_data.data() + _offset); }
+
+    static void s_check(u32 _idx, u32 _count) {
+        if (_idx >= _count)
+            throw std::out_of_range("Index out of range in binary view");
+    }
+
+    // Begin and end of entry _idx of an offset table
+    std::pair<u64, u64> m_entry(u64 _table, u64 _data, u32 _idx, u64 _limit) const {
+        u64 _begin = _data + m_get<u32>(_table + 4 * u64(_idx)),
+            _end = _data + m_get<u32>(_table + 4 * u64(_idx) + 4);
+
+        if (_begin > _end || _end > _limit)
+            throw std::invalid_argument("Invalid binary fumen data");
+
+        return { _begin, _end };
+    }
+
+    // Offset of field record _idx, checked against its mask
+    u64 m_record(u32 _idx) const {
+        s_check(_idx, m_field_count);
+
+        auto [_begin, _end] = m_entry(m_fields, m_field_data, _idx, m_comments);
+        if (_end - _begin < 4)
+            throw std::invalid_argument("Invalid binary fumen data");
+
+        u32 _mask = m_get<u32>(_begin);
+        u64 _header = _mask & binary_format::delta_bit ? 8 : 4,
+            _rows = _mask & ~binary_format::delta_bit;
+
+        if (_rows >> binary_format::row_count ||
+            _end - _begin != _header + binary_format::row_size * simd::popcount(_rows))
+            throw std::invalid_argument("Invalid binary fumen data");
+
+        return _begin;
+    }
+
+    u64 m_page_record(u32 _idx) const { return m_pages + u64(binary_format::page_size) * _idx; }
+
+    // Page _idx without its operation
+    binary_page m_page(u32 _idx) const {
+        u64 _record = m_page_record(_idx);
+        return binary_page { field(m_get<u32>(_record)), comment(m_get<u32>(_record + 4)), std::nullopt, m_get<u8>(_record + 10) };
+    }
+
+    // Calls _fn(i, operation) for the pages _first + i before _last, the
+    // values of a run of pages gathered and decoded in one batch
+    template <typename Fn>
+    void m_operations(u32 _first, u32 _last, Fn&& _fn) const {
+        if (_first > _last || _last > m_page_count)
+            throw std::out_of_range("Index out of range in binary view");
+
+        constexpr u32 _chunk = 64;
+        u32 _values[_chunk];
+        action _acts[_chunk];
+
+        for (u32 _base = _first; _base < _last; _base += _chunk) {
+            u32 _n = std::min(_chunk, _last - _base);
+
+            for (u32 _i = 0; _i < _n; _i++) {
+                _values[_i] = m_get<u16>(m_page_record(_base + _i) + 8);
+                if (_values[_i] >= binary_format::operation_limit)
+                    throw std::invalid_argument("Invalid binary fumen data");
+            }
+
+            v115_action_codec::decode(_values, _n, _acts);
+
+            for (u32 _i = 0; _i < _n; _i++)
+                _fn(_base - _first + _i, binary_format::operation_of(_acts[_i]));
+        }
+    }
+
+public:
+    u32 fumen_count() const { return m_fumen_count; }
+    u32 page_count() const { return m_page_count; }
+    u32 field_count() const { return m_field_count; }
+    u32 comment_count() const { return m_comment_count; }
+
+    // Pages [first, second) of fumen _idx
+    std::pair<u32, u32> fumen(u32 _idx) const {
+        s_check(_idx, m_fumen_count);
+
+        u32 _first = m_get<u32>(m_fumens + 4 * u64(_idx)),
+            _last = m_get<u32>(m_fumens + 4 * u64(_idx) + 4);
+
+        if (_first > _last || _last > m_page_count)
+            throw std::invalid_argument("Invalid binary fumen data");
+
+        return { _first, _last };
+    }
+
+    binary_field field(u32 _idx) const {
+        u64 _base = m_record(_idx), _delta = 0;
+
+        if (m_get<u32>(_base) & binary_format::delta_bit) {
+            _delta = _base;
+            _base = m_record(m_get<u32>(_delta + 4));
+
+            if (m_get<u32>(_base) & binary_format::delta_bit)
+                throw std::invalid_argument("Invalid binary fumen data");
+        }
+
+        return binary_field(m_data.data() + _base, _delta ? m_data.data() + _delta : nullptr);
+    }
+
+    std::string_view comment(u32 _idx) const {
+        s_check(_idx, m_comment_count);
+
+        auto [_begin, _end] = m_entry(m_comments, m_comment_data, _idx, m_data.size());
+        return m_data.substr(_begin, _end - _begin);
+    }
+
+    binary_page page(u32 _idx) const {
+        s_check(_idx, m_page_count);
+
+        binary_page _page = m_page(_idx);
+        _page.m_operation = binary_format::unpack_operation(m_get<u16>(m_page_record(_idx) + 8));
+
+        return _page;
+    }
+
+    // Pages [_first, _last) into _out, their operations decoded together
+    void pages(u32 _first, u32 _last, binary_page* _out) const {
+        m_operations(_first, _last, [&] (u32 _i, std::optional<field_operation>&& _op) {
+            _out[_i] = m_page(_first + _i);
+            _out[_i].m_operation = std::move(_op);
+        });
+    }
+
+    // The operations of pages [_first, _last) into _out
+    void operations(u32 _first, u32 _last, std::optional<field_operation>* _out) const {
+        m_operations(_first, _last, [&] (u32 _i, std::optional<field_operation>&& _op) {
+            _out[_i] = std::move(_op);
+        });
+    }
+};
+
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <deque>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 
@@ -13,23 +14,27 @@ namespace fumen::details {
 
 class buffer {
 public:
+    typedef u8 value_type;
+    typedef std::pmr::polymorphic_allocator<value_type> allocator_type;
+    typedef std::pmr::deque<value_type>::iterator iterator;
+    typedef std::pmr::deque<value_type>::const_iterator const_iterator;
+    typedef std::pmr::deque<value_type>::reverse_iterator reverse_iterator;
+    typedef std::pmr::deque<value_type>::const_reverse_iterator const_reverse_iterator;
+    typedef std::pmr::deque<value_type>::size_type size_type;
+    typedef std::pmr::deque<value_type>::reference reference;
+    typedef std::pmr::deque<value_type>::const_reference const_reference;
+
     buffer() = default;
-    buffer(const std::string& _data) {
+    explicit buffer(const allocator_type& _alloc) : m_data(_alloc) {}
+    buffer(std::string_view _data, const allocator_type& _alloc = {}) : m_data(_alloc) {
         for (char _c : _data)
             m_data.push_back(s_single_decode(_c));
     }
 
-    typedef u8 value_type;
-    typedef std::deque<value_type>::iterator iterator;
-    typedef std::deque<value_type>::const_iterator const_iterator;
-    typedef std::deque<value_type>::reverse_iterator reverse_iterator;
-    typedef std::deque<value_type>::const_reverse_iterator const_reverse_iterator;
-    typedef std::deque<value_type>::size_type size_type;
-    typedef std::deque<value_type>::reference reference;
-    typedef std::deque<value_type>::const_reference const_reference;
-
 private:
-    std::deque<value_type> m_data;
+    std::pmr::deque<value_type> m_data;
+    // Set once take() or skip() has run past the end
+    bool m_overrun = false;
 
     static constexpr std::string_view s_table =
         "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -49,6 +54,9 @@ private:
 public:
     static constexpr size_type table_size = s_table.size();
 
+    // The value of one encoded character, 0 for a character not in the table
+    static constexpr value_type value_of(char _c) { return s_single_decode(_c); }
+
     /* Iterators */
     iterator               begin()         { return m_data.begin();   }
     iterator               end()           { return m_data.end();     }
@@ -66,12 +74,17 @@ public:
     /* Converter */
     std::string to_string() const {
         std::string _result;
-        _result.reserve(m_data.size());
+        to_string(_result);
+        return _result;
+    }
 
-        for (const value_type& _c : m_data)
-            _result.push_back(_S_single_encode(_c));
+    // Appends the encoded characters to _out
+    template <typename String>
+    void to_string(String& _out) const {
+        _out.reserve(_out.size() + m_data.size());
 
-        return _result;
+        for (const value_type& _c : m_data)
+            _out.push_back(_S_single_encode(_c));
     }
 
     /* Modifiers */
@@ -90,6 +103,36 @@ public:
         return _value;
     }
 
+    // poll() that reads zeros past the end instead of throwing, marking
+    // the buffer as overrun
+    i64 take(u32 _max) {
+        i64 _value = 0;
+
+        for (u32 _i = 0; _i < _max; _i++) {
+            if (m_data.empty()) {
+                m_overrun = true;
+                break;
+            }
+
+            value_type _d = m_data.front(); m_data.pop_front();
+
+            _value += _d * math::powi<i64>(s_table.size(), _i);
+        }
+
+        return _value;
+    }
+
+    // Drops the next _cnt values, or all of them and marks the buffer as
+    // overrun if there are fewer
+    void skip(size_type _cnt) {
+        if (_cnt > m_data.size()) {
+            m_overrun = true;
+            _cnt = m_data.size();
+        }
+
+        m_data.erase(m_data.begin(), m_data.begin() + _cnt);
+    }
+
     void push(i64 _value, u32 _cnt = 1) {
         for (u32 _i = 0; _i < _cnt; _i++) {
             m_data.push_back(_value % s_table.size());
@@ -105,6 +148,8 @@ public:
     /* Capacity */
     bool empty() const { return m_data.empty(); }
     size_type size() const { return m_data.size(); }
+    // Whether a read ran past the end
+    bool overrun() const { return m_overrun; }
 
     /* Accessor */
     reference at(size_type _idx) {
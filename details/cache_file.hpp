@@ -0,0 +1,244 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <utility>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#include <details/intdef.hpp>
+#include <details/mapped_file.hpp>
+#include <details/binary.hpp>
+#include <details/decoder.hpp>
+#include <details/normalize.hpp>
+
+namespace fumen::details {
+
+/*
+ * Decoded-page cache file, version 3, as written by decode_cache::save.
+ * Integers are little-endian.
+ *
+ *   header    56 bytes: "FMDC", u32 version, u64 slot count (a power of
+ *             two), u64 offsets of the three sections below, u64 file
+ *             size and u64 checksum of the rest of the header and the
+ *             sections
+ *   slots     24 bytes each: u64 high and low halves of the fingerprint
+ *             of the key, u32 fumen index + 1 (0 for an empty slot), u32
+ *             reserved. A key starts at slot (low & (count - 1)) and is
+ *             probed linearly.
+ *   refs      8 bytes per page: u32 field ref + 1 and u32 comment ref + 1,
+ *             0 for none
+ *   pages     a binary page file (see binary_format), one fumen per key
+ *
+ * Keys are the version and extracted data of a fumen, as decode_cache
+ * uses them, so the file is addressed by content. The checksum is
+ * verified when the file is opened, so a damaged file is rejected rather
+ * than served.
+ */
+class cache_file {
+public:
+    static constexpr char magic[4] = { 'F', 'M', 'D', 'C' };
+    static constexpr u32 version = 3;
+    static constexpr u64 header_size = 56, slot_size = 24, ref_size = 8;
+
+    static fingerprint key_of(std::string_view _key) {
+        fingerprint_hasher _hasher;
+        _hasher.add(_key.data(), _key.size());
+        return _hasher.finish();
+    }
+
+    // Checksum of a file, skipping the checksum field itself
+    static u64 checksum(std::string_view _file) {
+        fingerprint_hasher _hasher;
+        _hasher.add(_file.data(), header_size - 8);
+        _hasher.add(_file.data() + header_size, _file.size() - header_size);
+        return _hasher.finish().m_lo;
+    }
+
+    class writer {
+    private:
+        // A decoded page as binary_writer reads it
+        struct page_view {
+            struct field_view {
+                const inner_field& m_field;
+                const inner_field& inner() const { return m_field; }
+            } m_field;
+            std::string_view m_comment;
+            const std::optional<field_operation>& m_operation;
+            page::flags m_flags;
+        };
+
+        binary_writer m_pages;
+        std::vector<std::pair<fingerprint, u32>> m_keys;
+        std::string m_refs;
+
+        static u32 s_ref(const std::optional<u32>& _ref) { return _ref ? *_ref + 1 : 0; }
+
+    public:
+        // Adds the pages of _key; throws, adding nothing, if a page cannot
+        // be stored
+        void add(std::string_view _key, const pages& _pages) {
+            std::vector<page_view> _views;
+            _views.reserve(_pages.size());
+
+            std::string _refs;
+            _refs.reserve(ref_size * _pages.size());
+
+            for (const page& _page : _pages) {
+                _views.push_back({
+                    { _page.m_inner_field },
+                    _page.m_comment ? std::string_view(*_page.m_comment) : std::string_view(),
+                    _page.m_operation, _page.m_flags
+                });
+
+                binary_format::put<u32>(_refs, s_ref(_page.m_refs.m_field));
+                binary_format::put<u32>(_refs, s_ref(_page.m_refs.m_comment));
+            }
+
+            // Rolls itself back if it throws, so nothing is added yet
+            u32 _idx = m_pages.fumen_count();
+            m_pages.add(_views);
+
+            m_keys.emplace_back(key_of(_key), _idx);
+            m_refs += _refs;
+        }
+
+        u32 size() const { return m_pages.fumen_count(); }
+
+        std::string data() const {
+            u64 _slots = 16;
+            while (_slots < m_keys.size() * 2) _slots *= 2;
+
+            u64 _slots_offset = header_size,
+                _refs_offset = _slots_offset + _slots * slot_size,
+                _pages_offset = _refs_offset + m_refs.size();
+
+            std::string _table(_slots * slot_size, '\0');
+            for (const auto& [_fp, _idx] : m_keys) {
+                u64 _s = _fp.m_lo & (_slots - 1);
+                while (binary_format::get<u32>(_table.data() + _s * slot_size + 16))
+                    _s = (_s + 1) & (_slots - 1);
+
+                std::string _slot;
+                binary_format::put<u64>(_slot, _fp.m_hi);
+                binary_format::put<u64>(_slot, _fp.m_lo);
+                binary_format::put<u32>(_slot, _idx + 1);
+                _table.replace(_s * slot_size, 20, _slot);
+            }
+
+            std::string _pages = m_pages.data();
+
+            std::string _out;
+            _out.reserve(_pages_offset + _pages.size());
+
+            _out.append(magic, 4);
+            binary_format::put<u32>(_out, version);
+            binary_format::put<u64>(_out, _slots);
+            for (u64 _offset : { _slots_offset, _refs_offset, _pages_offset, _pages_offset + _pages.size() })
+                binary_format::put<u64>(_out, _offset);
+
+            binary_format::put<u64>(_out, 0);
+
+            _out += _table;
+            _out += m_refs;
+            _out += _pages;
+
+            std::string _sum;
+            binary_format::put<u64>(_sum, checksum(_out));
+            _out.replace(header_size - 8, 8, _sum);
+
+            return _out;
+        }
+    };
+
+    cache_file() = default;
+
+    // Maps and checks _path; throws if it is not a valid cache file
+    explicit cache_file(const std::string& _path) : m_file(_path) {
+        std::string_view _data = m_file.view();
+
+        if (_data.size() < header_size || _data.substr(0, 4) != std::string_view(magic, 4))
+            throw std::invalid_argument("Invalid cache file");
+
+        if (m_get<u32>(4) != version)
+            throw std::logic_error("Unsupported cache file version.");
+
+        m_slots = m_get<u64>(8);
+        m_slots_offset = m_get<u64>(16);
+        m_refs_offset = m_get<u64>(24);
+
+        u64 _pages_offset = m_get<u64>(32), _size = m_get<u64>(40);
+
+        bool _valid = _size == _data.size()
+            && m_slots && !(m_slots & (m_slots - 1))
+            && m_slots_offset >= header_size && m_slots_offset <= _size
+            && m_slots <= (_size - m_slots_offset) / slot_size
+            && m_refs_offset == m_slots_offset + m_slots * slot_size
+            && m_refs_offset <= _pages_offset && _pages_offset <= _size
+            && m_get<u64>(48) == checksum(_data);
+
+        if (!_valid)
+            throw std::invalid_argument("Invalid cache file");
+
+        m_view = binary_view(_data.substr(_pages_offset));
+
+        if (_pages_offset - m_refs_offset != ref_size * m_view.page_count())
+            throw std::invalid_argument("Invalid cache file");
+    }
+
+private:
+    mapped_file m_file;
+    binary_view m_view;
+    u64 m_slots = 0, m_slots_offset = 0, m_refs_offset = 0;
+
+    template <typename T>
+    T m_get(u64 _offset) const { return binary_format::get<T>(m_file.data() + _offset); }
+
+    static std::optional<u32> s_ref(u32 _value)
+    { return _value ? std::optional<u32>(_value - 1) : std::nullopt; }
+
+public:
+    // The pages stored under _key, rebuilt without decoding
+    std::optional<pages> find(std::string_view _key) const {
+        if (!m_slots) return std::nullopt;
+
+        fingerprint _fp = key_of(_key);
+
+        for (u64 _s = _fp.m_lo & (m_slots - 1), _n = 0; _n < m_slots; _s = (_s + 1) & (m_slots - 1), _n++) {
+            u64 _slot = m_slots_offset + _s * slot_size;
+
+            u32 _idx = m_get<u32>(_slot + 16);
+            if (!_idx) return std::nullopt;
+            if (m_get<u64>(_slot) != _fp.m_hi || m_get<u64>(_slot + 8) != _fp.m_lo) continue;
+
+            auto [_first, _last] = m_view.fumen(_idx - 1);
+
+            std::vector<binary_page> _bps(_last - _first);
+            m_view.pages(_first, _last, _bps.data());
+
+            pages _pages;
+            _pages.reserve(_last - _first);
+
+            for (u32 _i = _first; _i < _last; _i++) {
+                const binary_page& _bp = _bps[_i - _first];
+                u64 _refs = m_refs_offset + ref_size * _i;
+
+                page _page { _i - _first, _bp.m_field.to_inner_field(), _bp.m_operation,
+                    std::string(_bp.m_comment), { s_ref(m_get<u32>(_refs)), s_ref(m_get<u32>(_refs + 4)) }, {} };
+                _page.m_flags.all = _bp.m_flags;
+
+                _pages.push_back(std::move(_page));
+            }
+
+            return _pages;
+        }
+
+        return std::nullopt;
+    }
+
+    u32 size() const { return m_view.fumen_count(); }
+};
+
+}
\ No newline at end of file
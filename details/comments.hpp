@@ -1,10 +1,10 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <string_view>
 
 #include <details/intdef.hpp>
-#include <details/math.hpp>
 
 namespace fumen::details {
 
@@ -15,20 +15,50 @@ private:
 
     static constexpr u32 s_size = s_table.size() + 1;
 
+    // s_table padded to s_size, the last digit maps to DEL as in encode()
+    static constexpr std::array<char, s_size> s_decode_table = [] {
+        std::array<char, s_size> _table {};
+
+        for (u32 _i = 0; _i < s_table.size(); _i++)
+            _table[_i] = s_table[_i];
+        _table[s_size - 1] = '\x7f';
+
+        return _table;
+    }();
+
+    static constexpr std::array<i64, 4> s_weights = {
+        1, s_size, s_size * s_size, s_size * s_size * s_size
+    };
+
 public:
-    static std::string decode(i64 _value) {
-        std::string _str(4, ' ');
+    static constexpr u32 group_size = 4;
 
-        for (u32 _i = 0; _i < 4; _i++) {
-            _str[_i] = s_table[_value % s_size];
+    // Writes the 4 characters of a 5-digit group into _out
+    static constexpr void decode(i64 _value, char* _out) {
+        for (u32 _i = 0; _i < group_size; _i++) {
+            _out[_i] = s_decode_table[_value % s_size];
             _value /= s_size;
         }
+    }
 
+    static std::string decode(i64 _value) {
+        std::string _str(group_size, ' ');
+        decode(_value, _str.data());
         return _str;
     }
 
     static constexpr i64 encode(char _ch, u32 _cnt)
-    { return (_ch - 32u) * math::powi<u64>(s_size, _cnt); }
+    { return (_ch - 32u) * s_weights[_cnt]; }
+
+    // Packs up to 4 characters of _str into a 5-digit group
+    static constexpr i64 encode(std::string_view _str) {
+        i64 _value = 0;
+
+        for (u32 _i = 0; _i < _str.size() && _i < group_size; _i++)
+            _value += encode(_str[_i], _i);
+
+        return _value;
+    }
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <atomic>
+#include <thread>
+#include <random>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+
+#include <cstdio>
+#include <system_error>
+
+#include <details/intdef.hpp>
+#include <details/mapped_file.hpp>
+#include <details/binary.hpp>
+#include <details/decoder.hpp>
+
+namespace fumen::details {
+
+/*
+ * A newline-delimited fumen file, memory-mapped and indexed by line. Lines
+ * are handed out as string_views into the mapping, without the line break;
+ * blank lines are not indexed.
+ *
+ * The index is saved to "<path>.idx" and reused when the file has the same
+ * size and modification time, both taken from the mapping:
+ *
+ *   header    magic "FMIX", u32 version, u64 file size, i64 file mtime in
+ *             nanoseconds, u64 line count (32 bytes, little-endian)
+ *   offsets   u64[line count] start of each line
+ */
+class corpus {
+public:
+    static constexpr char magic[4] = { 'F', 'M', 'I', 'X' };
+    static constexpr u32 version = 1;
+    static constexpr u64 header_size = 32;
+
+    // Lines handed to one worker at a time by the parallel loops
+    static constexpr u64 chunk_size = 1024;
+
+    // Maps _path and loads or builds its index. The index is saved beside
+    // the file if _persist is set; failing to save it is not an error.
+    explicit corpus(const std::string& _path, bool _persist = true)
+    : m_file(_path) {
+        if (m_load(index_path(_path))) return;
+
+        m_build();
+        if (_persist) m_save(index_path(_path));
+    }
+
+    corpus(const corpus&) = delete;
+    corpus& operator=(const corpus&) = delete;
+
+    corpus(corpus&&) = default;
+    corpus& operator=(corpus&&) = default;
+
+private:
+    mapped_file m_file;
+
+    // The index, either mapped from the saved file or built in memory
+    mapped_file m_index_file;
+    std::string m_built;
+    u64 m_count = 0;
+
+    // Taken from whichever holds it on each use, so moves keep it valid
+    std::string_view m_index() const
+    { return m_built.empty() ? m_index_file.view() : std::string_view(m_built); }
+
+    bool m_load(const std::string& _path) {
+        try {
+            mapped_file _index(_path);
+            std::string_view _data = _index.view();
+
+            if (_data.size() < header_size || _data.substr(0, 4) != std::string_view(magic, 4) ||
+                binary_format::get<u32>(_data.data() + 4) != version ||
+                binary_format::get<u64>(_data.data() + 8) != m_file.size() ||
+                binary_format::get<i64>(_data.data() + 16) != m_file.mtime())
+                return false;
+
+            u64 _count = binary_format::get<u64>(_data.data() + 24);
+            if (_count > (_data.size() - header_size) / 8 || _data.size() != header_size + _count * 8)
+                return false;
+
+            // Offsets are trusted only as far as the mapping goes
+            for (u64 _i = 0; _i < _count; _i++)
+                if (binary_format::get<u64>(_data.data() + header_size + _i * 8) >= m_file.size())
+                    return false;
+
+            m_index_file = std::move(_index);
+            m_count = _count;
+
+            return true;
+        } catch (const std::system_error&) {
+            return false;
+        }
+    }
+
+    void m_build() {
+        std::string_view _data = m_file.view();
+
+        m_built.resize(header_size);
+        std::memcpy(m_built.data(), magic, 4);
+
+        u64 _count = 0;
+        for (u64 _pos = 0; _pos < _data.size(); ) {
+            const void* _nl = std::memchr(_data.data() + _pos, '\n', _data.size() - _pos);
+            u64 _end = _nl ? static_cast<const char*>(_nl) - _data.data() : _data.size();
+
+            if (!s_trim(_data.substr(_pos, _end - _pos)).empty()) {
+                binary_format::put<u64>(m_built, _pos);
+                _count++;
+            }
+
+            _pos = _end + 1;
+        }
+
+        std::string _header;
+        binary_format::put<u32>(_header, version);
+        binary_format::put<u64>(_header, m_file.size());
+        binary_format::put<i64>(_header, m_file.mtime());
+        binary_format::put<u64>(_header, _count);
+        m_built.replace(4, _header.size(), _header);
+
+        m_count = _count;
+    }
+
+    // Written to a temporary file first, so a reader never sees half of it
+    void m_save(const std::string& _path) const {
+        std::string _tmp = _path + ".tmp";
+
+        {
+            std::ofstream _out(_tmp, std::ios::binary | std::ios::trunc);
+            if (!_out.write(m_index().data(), m_index().size())) {
+                std::remove(_tmp.c_str());
+                return;
+            }
+        }
+
+        if (std::rename(_tmp.c_str(), _path.c_str()) != 0)
+            std::remove(_tmp.c_str());
+    }
+
+    static std::string_view s_trim(std::string_view _line) {
+        while (!_line.empty() && (_line.back() == '\r' || _line.back() == ' ' || _line.back() == '\t'))
+            _line.remove_suffix(1);
+
+        return _line;
+    }
+
+    static void s_check(u64 _idx, u64 _count) {
+        if (_idx >= _count)
+            throw std::out_of_range("Corpus line index out of range");
+    }
+
+public:
+    static std::string index_path(const std::string& _path) { return _path + ".idx"; }
+
+    u64 size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+    std::string_view operator[](u64 _idx) const {
+        std::string_view _data = m_file.view();
+        u64 _begin = binary_format::get<u64>(m_index().data() + header_size + _idx * 8);
+
+        std::string_view _rest = _data.substr(_begin);
+        return s_trim(_rest.substr(0, _rest.find('\n')));
+    }
+
+    std::string_view at(u64 _idx) const {
+        s_check(_idx, m_count);
+        return (*this)[_idx];
+    }
+
+    void advise(mapped_file::access _access) const { m_file.advise(_access); }
+
+    // Calls _fn(idx, line) for every line on _threads threads (0 for one per
+    // core). Lines are taken in chunks, so the calls are not in order. The
+    // first exception thrown by _fn stops the loop and is rethrown.
+    template <typename Fn>
+    void for_each(Fn&& _fn, u32 _threads = 0) const {
+        if (_threads == 0) _threads = std::max(1u, std::thread::hardware_concurrency());
+
+        u64 _chunks = (m_count + chunk_size - 1) / chunk_size;
+        _threads = static_cast<u32>(std::min<u64>(_threads, std::max<u64>(_chunks, 1)));
+
+        std::atomic<u64> _next { 0 };
+        std::atomic<bool> _failed { false };
+        std::exception_ptr _error;
+
+        auto _work = [&] {
+            try {
+                for (u64 _c; !_failed.load(std::memory_order_relaxed) && (_c = _next++) < _chunks; ) {
+                    u64 _last = std::min(m_count, (_c + 1) * chunk_size);
+
+                    for (u64 _i = _c * chunk_size; _i < _last; _i++)
+                        _fn(_i, (*this)[_i]);
+                }
+            } catch (...) {
+                if (!_failed.exchange(true)) _error = std::current_exception();
+            }
+        };
+
+        if (_threads == 1) _work();
+        else {
+            std::vector<std::thread> _pool;
+            _pool.reserve(_threads);
+
+            for (u32 _t = 0; _t < _threads; _t++) _pool.emplace_back(_work);
+            for (std::thread& _th : _pool) _th.join();
+        }
+
+        if (_error) std::rethrow_exception(_error);
+    }
+
+    // _count distinct line indices drawn uniformly, in ascending order
+    std::vector<u64> sample(u64 _count, u64 _seed) const {
+        _count = std::min(_count, m_count);
+
+        // Floyd's algorithm: _count draws, whatever the corpus size
+        std::mt19937_64 _rng(_seed);
+        std::unordered_set<u64> _picked;
+        _picked.reserve(_count);
+
+        for (u64 _j = m_count - _count; _j < m_count; _j++) {
+            u64 _r = std::uniform_int_distribution<u64>(0, _j)(_rng);
+            if (!_picked.insert(_r).second) _picked.insert(_j);
+        }
+
+        std::vector<u64> _indices(_picked.begin(), _picked.end());
+        std::sort(_indices.begin(), _indices.end());
+
+        return _indices;
+    }
+
+    // Decodes the lines for which _filter(line, version) is true, calling
+    // _fn(idx, pages&&) from the worker threads. The version comes from the
+    // header alone; lines without one are skipped before _filter. Returns
+    // the number of lines which failed to decode.
+    template <typename Filter, typename Fn>
+    u64 decode_if(Filter&& _filter, Fn&& _fn, u32 _threads = 0) const {
+        std::atomic<u64> _failures { 0 };
+
+        for_each([&] (u64 _idx, std::string_view _line) {
+            std::optional<u32> _version = decoder::version(_line);
+            if (!_version || !_filter(_line, *_version)) return;
+
+            pages _pages;
+            try {
+                decoder::decode(_line, [&] (page&& _page) { _pages.push_back(std::move(_page)); });
+            } catch (const std::exception&) {
+                _failures.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            _fn(_idx, std::move(_pages));
+        }, _threads);
+
+        return _failures.load();
+    }
+};
+
+}
\ No newline at end of file
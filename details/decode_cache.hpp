@@ -0,0 +1,324 @@
+#pragma once
+
+#include <map>
+#include <list>
+#include <array>
+#include <vector>
+#include <string>
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <string_view>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include <cstdio>
+#include <fstream>
+
+#include <details/intdef.hpp>
+#include <details/decoder.hpp>
+#include <details/cache_file.hpp>
+
+namespace fumen::details {
+
+/*
+ * A thread-safe LRU cache of decoded fumens. Entries are keyed by the
+ * version and the extracted data (see decoder::extract), so fumens that
+ * differ only in their prefix letter, '?' breaks, whitespace or text
+ * around the data share an entry. The pages are immutable and shared by
+ * every caller.
+ *
+ * With prefix reuse on, each entry also keeps the decoder state at page
+ * boundaries, at least _interval pages apart, and after its last page. A
+ * missed fumen is decoded from the latest of those points within its
+ * longest common prefix with any cached entry, so extending a cached
+ * fumen by a page decodes one page. That entry is found in a map of all
+ * keys in order: the key sharing the longest prefix with a string sorts
+ * next to it.
+ *
+ * Pages that repeat the previous field share one counter, written before
+ * the first of them, and extending such a run rewrites it. Points are
+ * therefore not taken inside runs, and an extension resumes from before
+ * its run (at most 64 pages back).
+ *
+ * save() writes the cached pages to a cache_file, and load() maps one so
+ * that its fumens are served, on their first miss, without decoding. The
+ * file holds no decoder state, so entries served from it have no points:
+ * a fumen extending one of them is decoded from its first page.
+ *
+ * Every decode is held to the _limits the cache was made with, so cached
+ * pages are within them too. Pages read from a file are checked against
+ * the page and comment limits, and decoded instead if over one; the work
+ * limit bounds decoding, which they skip.
+ */
+class decode_cache {
+public:
+    using pages_ptr = std::shared_ptr<const pages>;
+
+    struct statistics {
+        u64 m_hits, m_misses, m_resumed, m_reused_pages, m_file_hits;
+    };
+
+    explicit decode_cache(
+        std::size_t _capacity, bool _prefix = true, u32 _interval = 8, const decode_limits& _limits = {}
+    ) : m_shard_capacity(std::max<std::size_t>(1, _capacity / s_shards)),
+      m_prefix(_prefix), m_interval(std::max(1u, _interval)), m_limits(_limits) {}
+
+private:
+    static constexpr std::size_t s_shards = 16;
+
+    using point = decoder::resume_point<inner_field, std::string>;
+
+    struct entry {
+        // "110@" or "115@", then the extracted data
+        std::string m_key;
+        pages_ptr m_pages;
+        // Ordered by offset; shared with the entries resumed from them
+        std::vector<std::shared_ptr<const point>> m_points;
+    };
+
+    using entry_ptr = std::shared_ptr<const entry>;
+
+    struct shard {
+        std::mutex m_mutex;
+        std::list<entry_ptr> m_lru;
+        std::unordered_map<std::string_view, std::list<entry_ptr>::iterator> m_index;
+    };
+
+    std::array<shard, s_shards> m_shards;
+    std::size_t m_shard_capacity;
+
+    bool m_prefix;
+    u32 m_interval;
+    decode_limits m_limits;
+
+    // Every cached key, for prefix lookups. Taken after a shard lock, never
+    // before one.
+    std::shared_mutex m_order_mutex;
+    std::map<std::string_view, entry_ptr> m_order;
+
+    std::atomic<u64> m_hits { 0 }, m_misses { 0 }, m_resumed { 0 }, m_reused_pages { 0 }, m_file_hits { 0 };
+
+    std::optional<cache_file> m_file;
+
+    static constexpr std::size_t s_header = 4;
+
+    shard& m_shard(std::string_view _key)
+    { return m_shards[std::hash<std::string_view>()(_key) % s_shards]; }
+
+    static std::size_t s_common(std::string_view _a, std::string_view _b) {
+        std::size_t _n = std::min(_a.size(), _b.size());
+        return std::mismatch(_a.begin(), _a.begin() + _n, _b.begin()).first - _a.begin();
+    }
+
+    // The cached entry sharing the longest prefix with _key, and its length
+    std::pair<entry_ptr, std::size_t> m_longest_prefix(std::string_view _key) {
+        std::shared_lock _lock(m_order_mutex);
+
+        entry_ptr _best;
+        std::size_t _best_len = 0;
+
+        auto _it = m_order.lower_bound(_key);
+        auto _try = [&] (decltype(_it) _at) {
+            std::size_t _len = s_common(_key, _at->first);
+            if (_len > _best_len) _best = _at->second, _best_len = _len;
+        };
+
+        if (_it != m_order.end()) _try(_it);
+        if (_it != m_order.begin()) _try(std::prev(_it));
+
+        return { _best, _best_len };
+    }
+
+    bool m_within_limits(const pages& _pages) const {
+        if (_pages.size() > m_limits.m_max_pages) return false;
+
+        u64 _comment_bytes = 0;
+        for (const page& _page : _pages)
+            if (_page.m_comment) _comment_bytes += _page.m_comment->size();
+
+        return _comment_bytes <= m_limits.m_max_comment_bytes;
+    }
+
+    void m_insert(entry_ptr _entry) {
+        shard& _s = m_shard(_entry->m_key);
+        std::lock_guard _lock(_s.m_mutex);
+
+        // Decoded by another thread meanwhile
+        if (_s.m_index.count(_entry->m_key)) return;
+
+        _s.m_lru.push_front(_entry);
+        _s.m_index.emplace(_entry->m_key, _s.m_lru.begin());
+
+        entry_ptr _evicted;
+        if (_s.m_lru.size() > m_shard_capacity) {
+            _evicted = std::move(_s.m_lru.back());
+            _s.m_index.erase(_evicted->m_key);
+            _s.m_lru.pop_back();
+        }
+
+        if (m_prefix) {
+            std::unique_lock _order(m_order_mutex);
+
+            m_order.emplace(_entry->m_key, _entry);
+            if (_evicted) m_order.erase(_evicted->m_key);
+        }
+    }
+
+public:
+    // The pages of _data, decoded or from the cache. Throws as decoder::decode
+    // held to the limits of the cache.
+    pages_ptr decode(std::string_view _data) {
+        if (_data.size() > m_limits.m_max_input) throw std::length_error("Fumen input too long");
+
+        std::string _key = "115@";
+        u32 _version = decoder::extract(_data, _key);
+        if (_version == 110) _key[2] = '0';
+
+        {
+            shard& _s = m_shard(_key);
+            std::lock_guard _lock(_s.m_mutex);
+
+            auto _it = _s.m_index.find(_key);
+            if (_it != _s.m_index.end()) {
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                _s.m_lru.splice(_s.m_lru.begin(), _s.m_lru, _it->second);
+                return (*_it->second)->m_pages;
+            }
+        }
+
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+
+        auto _entry = std::make_shared<entry>();
+
+        // A damaged file is only a cache: its fumens are decoded instead
+        std::optional<pages> _stored;
+        if (m_file) {
+            try {
+                _stored = m_file->find(_key);
+            } catch (const std::exception&) {}
+
+            if (_stored && m_within_limits(*_stored)) {
+                m_file_hits.fetch_add(1, std::memory_order_relaxed);
+
+                _entry->m_key = std::move(_key);
+                _entry->m_pages = std::make_shared<const pages>(std::move(*_stored));
+
+                pages_ptr _result = _entry->m_pages;
+                m_insert(std::move(_entry));
+
+                return _result;
+            }
+        }
+
+        pages _pages;
+        point _state;
+        _state.m_limits = m_limits;
+
+        if (m_prefix) {
+            auto [_base, _common] = m_longest_prefix(_key);
+
+            if (_base && _common >= s_header) {
+                // The last point whose data is all within the common prefix
+                auto _after = std::upper_bound(_base->m_points.begin(), _base->m_points.end(), _common - s_header,
+                    [] (u64 _offset, const auto& _p) { return _offset < _p->m_offset; });
+
+                if (_after != _base->m_points.begin()) {
+                    _state = **std::prev(_after);
+                    _entry->m_points.assign(_base->m_points.begin(), _after);
+                    _pages.assign(_base->m_pages->begin(), _base->m_pages->begin() + _state.m_pidx);
+
+                    m_resumed.fetch_add(1, std::memory_order_relaxed);
+                    m_reused_pages.fetch_add(_state.m_pidx, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        decoder::resume(std::string_view(_key).substr(s_header), _version, _state,
+            [&] (page&& _page) { _pages.push_back(std::move(_page)); },
+            [&] (const point& _point, bool _last) {
+                if (!m_prefix) return;
+
+                u32 _since = _point.m_pidx - (_entry->m_points.empty() ? 0 : _entry->m_points.back()->m_pidx);
+                if (_last || (!_point.repeating() && _since >= m_interval))
+                    _entry->m_points.push_back(std::make_shared<const point>(_point));
+            });
+
+        // Without pages there is no boundary, but the start is a point too
+        if (m_prefix && _entry->m_points.empty()) _entry->m_points.push_back(std::make_shared<const point>(_state));
+
+        _entry->m_key = std::move(_key);
+        _entry->m_pages = std::make_shared<const pages>(std::move(_pages));
+
+        pages_ptr _result = _entry->m_pages;
+        m_insert(std::move(_entry));
+
+        return _result;
+    }
+
+    statistics stats() const {
+        return {
+            m_hits.load(std::memory_order_relaxed), m_misses.load(std::memory_order_relaxed),
+            m_resumed.load(std::memory_order_relaxed), m_reused_pages.load(std::memory_order_relaxed),
+            m_file_hits.load(std::memory_order_relaxed)
+        };
+    }
+
+    /*
+     * Writes the cached fumens to _path, most recently used first within
+     * each shard, through a temporary file. Fumens with cells the file
+     * format cannot store (above gray) are left out. Returns the number
+     * written.
+     */
+    u32 save(const std::string& _path) {
+        cache_file::writer _writer;
+
+        for (shard& _s : m_shards) {
+            std::vector<entry_ptr> _entries;
+            {
+                std::lock_guard _lock(_s.m_mutex);
+                _entries.assign(_s.m_lru.begin(), _s.m_lru.end());
+            }
+
+            for (const entry_ptr& _entry : _entries) {
+                try {
+                    _writer.add(_entry->m_key, *_entry->m_pages);
+                } catch (const std::invalid_argument&) {}
+            }
+        }
+
+        std::string _tmp = _path + ".tmp", _data = _writer.data();
+        {
+            std::ofstream _out(_tmp, std::ios::binary | std::ios::trunc);
+            if (!_out.write(_data.data(), _data.size())) {
+                std::remove(_tmp.c_str());
+                throw std::runtime_error("Cannot write " + _tmp);
+            }
+        }
+
+        if (std::rename(_tmp.c_str(), _path.c_str()) != 0) {
+            std::remove(_tmp.c_str());
+            throw std::runtime_error("Cannot rename " + _tmp);
+        }
+
+        return _writer.size();
+    }
+
+    // Maps a file written by save(). Not safe while other threads decode.
+    void load(const std::string& _path) { m_file.emplace(_path); }
+
+    std::size_t size() {
+        std::size_t _size = 0;
+        for (shard& _s : m_shards) {
+            std::lock_guard _lock(_s.m_mutex);
+            _size += _s.m_lru.size();
+        }
+        return _size;
+    }
+};
+
+}
\ No newline at end of file
@@ -3,8 +3,12 @@
 #include <vector>
 #include <string>
 
-#include <regex>
+#include <utility>
 #include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <memory_resource>
 
 #include <details/intdef.hpp>
 #include <details/strlib.hpp>
@@ -15,16 +19,20 @@
 #include <details/action.hpp>
 #include <details/comments.hpp>
 #include <details/quiz.hpp>
+#include <details/result.hpp>
 #include <details/inner_field.hpp>
+#include <details/persistent_field.hpp>
 #include <details/field.hpp>
+#include <details/instrument.hpp>
 
 namespace fumen::details {
 
-struct page {
+template <typename Field, typename String = std::string>
+struct basic_page {
     u32 m_idx;
-    inner_field m_inner_field;
+    Field m_inner_field;
     std::optional<field_operation> m_operation;
-    std::optional<std::string> m_comment;
+    std::optional<String> m_comment;
     struct {
         std::optional<u32> m_field, m_comment;
     } m_refs;
@@ -41,150 +49,377 @@ struct page {
     } m_flags;
 };
 
+using page = basic_page<inner_field>;
 using pages = std::vector<page>;
 
+// Pages whose fields share unchanged rows, see persistent_field
+using history_page = basic_page<persistent_field>;
+using history = std::vector<history_page>;
+
+// Pages whose fields and comments are allocated from a memory_resource
+using pmr_page = basic_page<pmr_inner_field, std::pmr::string>;
+using pmr_pages = std::pmr::vector<pmr_page>;
+
+/*
+ * Parts of the pages decoder::project produces, or-ed together. The
+ * operation, flags and refs of a page are always there; parts left out
+ * are not computed. Without the field, pages hold a no_field instead of
+ * one, and without comments they have none. quiz_bit is the one flag that
+ * needs a part: whether a comment is a quiz takes parsing all of it, so
+ * without decode_parts::comment the bit is always 0.
+ */
+struct decode_parts {
+    static constexpr u32 operations = 0;
+    // The field of each page, and the lock simulation it takes
+    static constexpr u32 field = 1;
+    // Comments, and the quiz progression that rewrites them and sets quiz_bit
+    static constexpr u32 comment = 2;
+    static constexpr u32 all = field | comment;
+    // Only the last page is produced
+    static constexpr u32 last_page = 4;
+};
+
+// The field of pages projected without decode_parts::field
+struct no_field {};
+
+template <u32 Parts, typename Field>
+using projected_field = std::conditional_t<(Parts & decode_parts::field) != 0, Field, no_field>;
+
+/*
+ * Bounds on one decode, for untrusted input. Each is checked as the
+ * decode goes, before the work it bounds is done, and going over one
+ * fails the decode: the try_ functions return input_too_long,
+ * too_many_pages, too_many_comment_bytes or work_limit_exceeded, and the
+ * throwing ones throw std::length_error. A page costs work units for the
+ * cells its field diff may write, its field and its lock, and for each
+ * comment character it decodes or carries over, so the work bounds the
+ * time a decode takes whatever the input.
+ */
+struct decode_limits {
+    // Characters of the fumen, header and separators included
+    u64 m_max_input = UINT64_MAX;
+    u64 m_max_pages = UINT64_MAX;
+    // Characters of the comments of all pages, carried-over ones included
+    u64 m_max_comment_bytes = UINT64_MAX;
+    u64 m_max_work = UINT64_MAX;
+};
+
+class push_decoder;
+class replay_stats;
+class static_decoder;
+
 /* static */ class decoder {
 private:
+    // Decodes through the same steps as s_decode, a character at a time
+    friend class push_decoder;
+    // Reads the decoder state after each page
+    friend class replay_stats;
+    // Reads the header as s_decode does, in constant evaluation
+    friend class static_decoder;
+
+    template <typename String>
     struct store_data {
+        explicit store_data(std::pmr::memory_resource* _resource)
+        : m_last_comment(s_make<String>(_resource)), m_escaped(_resource) {}
+
         i32 m_counter = -1;
         struct {
             i32 m_field = 0, m_comment = 0;
         } m_refs;
         std::optional<quiz> m_quiz = std::nullopt;
-        std::string m_last_comment = "";
+        String m_last_comment;
+        // Scratch space for escaped comments, reused between pages
+        std::pmr::string m_escaped;
     };
 
-    static std::pair<u32, std::string> s_extract(const std::string& _data) {
-        auto rmf = [] (char c) {
-            return !(c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '?');
-        };
+    static constexpr bool s_is_removed(char _c)
+    { return _c == ' ' || _c == '\t' || _c == '\n' || _c == '\r' || _c == '?'; }
 
-        std::string _dt = _data;
+    // Finds the first "[vmd](110|115)@" before any '&'. Returns the data
+    // after it and the version, or a version of 0 if there is none.
+    static constexpr std::pair<std::string_view, u32> s_header(std::string_view _data) {
+        _data = _data.substr(0, _data.find('&'));
 
-        size_t _idx = _dt.find('&');
-        if (_idx != std::string::npos)
-            _dt = _dt.substr(0, _idx);
+        for (std::size_t _i = 0; _i + 5 <= _data.size(); _i++) {
+            char _c = _data[_i];
+            if (_c != 'v' && _c != 'm' && _c != 'd') continue;
 
-        std::regex _ver_regx("([vmd])(110|115)@", std::regex::ECMAScript);
-        std::smatch _matches;
-        if (!std::regex_search(_dt, _matches, _ver_regx))
-            throw std::logic_error("Unsupported Fumen version.");
+            std::string_view _ver = _data.substr(_i + 1, 4);
+            if (_ver != "110@" && _ver != "115@") continue;
 
-        return {
-            std::stoi(_matches.str().substr(1, 3)),
-            strlib::strrmv(_matches.suffix().str(), rmf)
-        };
+            return { _data.substr(_i + 5), _ver[2] == '5' ? 115 : 110 };
+        }
+
+        return { {}, 0 };
     }
 
-    static std::pair<bool, inner_field> s_update_field(
+    // Appends the data after the header, without whitespace and '?', to
+    // _out. Returns the version, or 0 if there is no header.
+    template <typename String>
+    static u32 s_extract(std::string_view _data, String& _out) {
+        auto [_rest, _version] = s_header(_data);
+        if (!_version) return 0;
+
+        _out.reserve(_out.size() + _rest.size());
+        for (char _r : _rest)
+            if (!s_is_removed(_r)) _out += _r;
+
+        return _version;
+    }
+
+    // Applies one run of a field diff, _block_diff, from cell _idx on.
+    // _is_changed is cleared by the run that marks the field unchanged.
+    template <typename Field>
+    static void s_apply_run(
+        i64 _block_diff, const u32 _htop, const u32 _block_count,
+        u32& _idx, bool& _is_changed, Field& _field
+    ) {
+        i64 _diff = _block_diff / _block_count,
+            _counts = _block_diff % _block_count;
+
+        if (_diff == 8 && _counts == _block_count - 1)
+            _is_changed = false;
+
+        // Unchanged cells
+        if (_diff == 8) {
+            _idx += _counts + 1;
+            return;
+        }
+
+        // A malformed run may reach past the last cell
+        for (u32 _i = 0; _i < _counts + 1 && _idx < _block_count; _i++) {
+            i32 _x = _idx % FIELD_WIDTH,
+                _y = _htop - _idx / FIELD_WIDTH - 1;
+            _field.add_number(_x, _y, _diff - 8);
+            _idx++;
+        }
+    }
+
+    // Applies the next field diff to _field and returns whether it changed
+    template <typename Field>
+    static bool s_update_field(
         buffer& _buf,
         const u32 _htop, const u32 _block_count,
-        const inner_field& _prev
+        Field& _field
     ) {
-        bool _is_changed = true; inner_field _field = _prev;
+        bool _is_changed = true;
 
         u32 _idx = 0;
 
-        while (_idx < _block_count) {
-            i64 _block_diff = _buf.poll(2),
-                _diff = _block_diff / _block_count,
+        while (_idx < _block_count)
+            s_apply_run(_buf.take(2), _htop, _block_count, _idx, _is_changed, _field);
+
+        return _is_changed;
+    }
+
+    // Reads past the next field diff and returns whether it changed anything
+    static bool s_skip_field(buffer& _buf, const u32 _block_count) {
+        bool _is_changed = true;
+
+        for (u32 _idx = 0; _idx < _block_count; ) {
+            i64 _block_diff = _buf.take(2),
                 _counts = _block_diff % _block_count;
-            
-            if (_diff == 8 && _counts == _block_count - 1)
+
+            if (_block_diff / _block_count == 8 && _counts == _block_count - 1)
                 _is_changed = false;
-            
-            for (u32 _i = 0; _i < _counts + 1; _i++) {
-                i32 _x = _idx % FIELD_WIDTH,
-                    _y = _htop - _idx / FIELD_WIDTH - 1;
-                _field.add_number(_x, _y, _diff - 8);
-                _idx++;
-            }
+
+            _idx += _counts + 1;
         }
 
-        return { _is_changed, _field };
+        return _is_changed;
     }
 
-    static pages s_decode(const std::string& _data, u32 _htop) {
-        u32 _max_height = _htop + GARBAGE_LINE,
-            _block_count = FIELD_WIDTH * _max_height;
+    // Reads past a comment, without decoding its characters
+    static void s_skip_comment(buffer& _buf) {
+        i64 _comment_len = _buf.take(2);
+        // Each group of four characters takes five values
+        _buf.skip((_comment_len + 3) / 4 * 5);
+    }
 
-        buffer _buf(_data);
+    template <typename T>
+    static constexpr bool s_uses_resource =
+        std::uses_allocator_v<T, std::pmr::polymorphic_allocator<std::byte>>;
+
+    // A default T, allocated from _resource if T is allocator-aware
+    template <typename T>
+    static T s_make(std::pmr::memory_resource* _resource) {
+        if constexpr (s_uses_resource<T>)
+            return T(typename T::allocator_type(_resource));
+        else
+            return T();
+    }
 
-        u32 _pidx = 0;
-        inner_field _prev_field;
+    // A copy of _value, allocated from _resource if T is allocator-aware
+    template <typename T>
+    static T s_copy(const T& _value, std::pmr::memory_resource* _resource) {
+        if constexpr (s_uses_resource<T>)
+            return T(_value, typename T::allocator_type(_resource));
+        else
+            return _value;
+    }
 
-        store_data _st_data;
+public:
+    /*
+     * The decoder state between two pages: the characters of the extracted
+     * data read so far, the index and field of the next page, and the
+     * comment and quiz carried over, and the limits used. Decoding data
+     * that starts with the same characters can resume from it.
+     */
+    template <typename Field = inner_field, typename String = std::string>
+    struct resume_point {
+        explicit resume_point(std::pmr::memory_resource* _resource = std::pmr::get_default_resource())
+        : m_field(s_make<Field>(_resource)), m_st_data(_resource) {}
+
+        u64 m_offset = 0;
+        u32 m_pidx = 0;
+        Field m_field;
+        store_data<String> m_st_data;
+
+        // The limits the decode is held to, and what it has used of them
+        decode_limits m_limits;
+        u64 m_comment_bytes = 0, m_work = 0;
+
+        // Whether the next page repeats the field under a counter already
+        // read. Data that extends such a run rewrites its counter.
+        bool repeating() const { return m_st_data.m_counter > 0; }
+    };
 
-        pages _pages;
-        action_codec _act_codec(FIELD_WIDTH, _htop, GARBAGE_LINE);
-        comment_codec _comment_codec;
+private:
+    static bool s_charge(u64& _used, u64 _amount, u64 _max) {
+        if (_amount > _max - _used) return false;
+        _used += _amount;
+        return true;
+    }
 
-        while (!_buf.empty()) {
-            std::pair<bool, inner_field> _current;
+    // Checked before the values of a page are read. The work is charged
+    // for the most the page can take: a field diff over every cell, then
+    // copying and locking the field.
+    template <typename Field, typename String>
+    static decode_errc s_begin_page(resume_point<Field, String>& _state, u32 _block_count) {
+        if (_state.m_pidx >= _state.m_limits.m_max_pages)
+            return decode_errc::too_many_pages;
 
-            if (0 < _st_data.m_counter) {
-                _current = { false, _prev_field };
+        if (!s_charge(_state.m_work, _block_count + 2 * (PLAY_BLOCKS + FIELD_WIDTH), _state.m_limits.m_max_work))
+            return decode_errc::work_limit_exceeded;
 
-                _st_data.m_counter--;
-            } else {
-                _current = s_update_field(_buf, _htop, _block_count, _prev_field);
+        return decode_errc::ok;
+    }
 
-                if (!_current.first)
-                    _st_data.m_counter = _buf.poll(1);
-            }
+    // Checked before _len comment characters are decoded or copied
+    template <typename Field, typename String>
+    static decode_errc s_charge_comment(resume_point<Field, String>& _state, u64 _len) {
+        if (!s_charge(_state.m_comment_bytes, _len, _state.m_limits.m_max_comment_bytes))
+            return decode_errc::too_many_comment_bytes;
+
+        if (!s_charge(_state.m_work, _len, _state.m_limits.m_max_work))
+            return decode_errc::work_limit_exceeded;
 
-            action _act = _act_codec.decode(_buf.poll(3));
+        return decode_errc::ok;
+    }
+
+    /*
+     * The rest of a page whose values have all been read: _act, whether
+     * the field diff changed anything, and the _comment_len escaped
+     * characters of its comment in m_escaped. Carries the comment and quiz
+     * over, calls _on_page if _emit and locks the piece.
+     */
+    template <u32 Parts, typename Field, typename String, typename Fn>
+    static decode_errc s_page(
+        resume_point<Field, String>& _state, const action& _act, bool _is_changed, i64 _comment_len,
+        bool _emit, Fn& _on_page, std::pmr::memory_resource* _resource
+    ) {
+        constexpr bool _with_field = Parts & decode_parts::field,
+            _with_comment = Parts & decode_parts::comment;
 
-            std::pair<std::optional<std::string>, std::optional<i32>> _comment;
+        u32& _pidx = _state.m_pidx;
+        Field& _field = _state.m_field;
+        store_data<String>& _st_data = _state.m_st_data;
+
+        // A piece locked with blocks off the field would be written out of
+        // bounds, here or by whoever replays the page, so the page is
+        // rejected before it is built, whatever the parts
+        if (_act.m_lock && defs::is_mino(_act.m_operation.m_piece) && !field_util::fits(_act.m_operation))
+            return decode_errc::invalid_data;
+
+        // The comment of this page, and the page it refers to if it
+        // was not stored in this page
+        String _comment = s_make<String>(_resource);
+        std::optional<i32> _comment_ref;
+
+        if constexpr (_with_comment) {
             if (_act.m_comment) {
-                std::string _comment_string;
-                i64 _comment_len = _buf.poll(2);
-
-                for (i64 _i = 0; _i < (_comment_len + 3) / 4; _i++)
-                    _comment_string += _comment_codec.decode(_buf.poll(5));
-                
-                _comment_string.resize(_comment_len);
-                _comment_string = converter::unescape(_comment_string);
-                _st_data.m_last_comment = _comment_string;
-                _comment.first = _comment_string;
-                _st_data.m_refs.m_comment = _pidx;
-
-                if (quiz::is_quiz_comment(_comment_string)) {
-                    try {
-                        _st_data.m_quiz = quiz(_comment_string);
-                    } catch (const std::invalid_argument&) {
-                        _st_data.m_quiz = std::nullopt;
-                    }
-                } else
-                    _st_data.m_quiz = std::nullopt;
-            } else if (_pidx == 0)
-                _comment.first = "";
-            else {
-                if (_st_data.m_quiz.has_value())
-                    _comment.first = _st_data.m_quiz->format().to_string();
+                {
+                    instrument::stage_scope _probe(decode_stage::unescape);
+
+                    _st_data.m_escaped.resize(_comment_len);
+                    converter::unescape(_st_data.m_escaped, _comment);
+                    _st_data.m_last_comment = _comment;
+                }
+
+                instrument::stage_scope _probe(decode_stage::quiz);
+                if (quiz::is_quiz_comment(_comment))
+                    _st_data.m_quiz = quiz::parse(_comment, _resource);
                 else
-                    _comment.first = std::nullopt;
-                
-                _comment.second = _st_data.m_refs.m_comment;
+                    _st_data.m_quiz = std::nullopt;
+            } else if (_pidx != 0 && _emit) {
+                instrument::stage_scope _probe(decode_stage::quiz);
+
+                // A quiz comment only gets shorter as it is formatted
+                decode_errc _errc = s_charge_comment(_state, _st_data.m_last_comment.size());
+                if (_errc != decode_errc::ok) return _errc;
+
+                if (_st_data.m_quiz.has_value()) {
+                    std::optional<quiz> _formatted = _st_data.m_quiz->try_format();
+                    if (!_formatted) return decode_errc::invalid_quiz;
+
+                    _formatted->to_string(_comment);
+                } else
+                    _comment = _st_data.m_last_comment;
             }
+        }
 
-            bool _is_quiz = _st_data.m_quiz.has_value();
-            if (_is_quiz && _st_data.m_quiz->can_operate() && _act.m_lock) {
-                if (defs::is_mino(_act.m_operation.m_piece)) {
-                    try {
-                        quiz _next = _st_data.m_quiz->next_if_end();
-                        _st_data.m_quiz = _next.operate(
-                            _next.get_operation(_act.m_operation.m_piece)
-                        );
-                    } catch (const std::invalid_argument&) {
-                        _st_data.m_quiz = _st_data.m_quiz->format();
-                    }
-                }
+        // The page a comment was last stored in needs no comment decoded
+        if (_act.m_comment)
+            _st_data.m_refs.m_comment = _pidx;
+        else if (_pidx != 0)
+            _comment_ref = _st_data.m_refs.m_comment;
+
+        bool _is_quiz = _with_comment && _st_data.m_quiz.has_value();
+        if (_is_quiz && _st_data.m_quiz->can_operate() && _act.m_lock) {
+            instrument::stage_scope _probe(decode_stage::quiz);
+
+            // A piece the quiz cannot place formats it instead
+            if (defs::is_mino(_act.m_operation.m_piece)) {
+                std::optional<quiz> _next = _st_data.m_quiz->try_place(_act.m_operation.m_piece);
+                if (!_next) _next = _st_data.m_quiz->try_format();
+                if (!_next) return decode_errc::invalid_quiz;
+
+                _st_data.m_quiz = std::move(_next);
             }
-            
-            page _page;
-            _page.m_idx = _pidx;
-            _page.m_inner_field = _current.second;
+        }
+
+        std::optional<u32> _field_ref;
+        if (_is_changed || _pidx == 0)
+            _st_data.m_refs.m_field = _pidx;
+        else
+            _field_ref = _st_data.m_refs.m_field;
+
+        instrument::page();
+
+        if (_emit) {
+            // Built in place, so the members keep the allocator they were
+            // constructed with
+            basic_page<projected_field<Parts, Field>, String> _page {
+                _pidx,
+                [&] {
+                    if constexpr (_with_field) return s_copy(_field, _resource);
+                    else return no_field {};
+                }(),
+                std::nullopt,
+                _with_comment ? std::optional<String>(std::move(_comment)) : std::nullopt,
+                { _field_ref, _comment_ref },
+                {}
+            };
             if (_act.m_operation.m_piece != piece_type::empty) {
                 _page.m_operation = static_cast<field_operation>(
                     mino(
@@ -194,55 +429,299 @@ private:
                         _act.m_operation.m_y
                     )
                 );
-            } else
-                _page.m_operation = std::nullopt;
-            _page.m_comment = _comment.first.has_value() ?
-                *_comment.first : _st_data.m_last_comment;
-            _page.m_flags = {
-                .lock_bit = _act.m_lock,
-                .mirror_bit = _act.m_mirror,
-                .colorize_bit = _act.m_colorize,
-                .rise_bit = _act.m_rise,
-                .quiz_bit = _is_quiz
-            };
-            if (_comment.second.has_value())
-                _page.m_refs.m_comment = *_comment.second;
-            else
-                _page.m_refs.m_comment = std::nullopt;
-            if (_current.first || _pidx == 0) {
-                _st_data.m_refs.m_field = _pidx;
-                _page.m_refs.m_field = std::nullopt;
-            } else
-                _page.m_refs.m_field = _st_data.m_refs.m_field;
+            }
+            _page.m_flags.lock_bit = _act.m_lock;
+            _page.m_flags.mirror_bit = _act.m_mirror;
+            _page.m_flags.colorize_bit = _act.m_colorize;
+            _page.m_flags.rise_bit = _act.m_rise;
+            _page.m_flags.quiz_bit = _is_quiz;
+
+            _on_page(std::move(_page));
+        }
+
+        _pidx++;
+
+        if (_with_field && _act.m_lock) {
+            instrument::stage_scope _probe(decode_stage::lock);
+
+            if (defs::is_mino(_act.m_operation.m_piece))
+                _field.fill(_act.m_operation);
             
-            _pages.push_back(_page);
+            _field.clear_line();
 
-            _pidx++;
+            if (_act.m_rise)
+                _field.rise_garbage();
+            
+            if (_act.m_mirror)
+                _field.mirror();
+        }
+
+        return decode_errc::ok;
+    }
+
+    // Decodes _data from _state, which is updated as pages are decoded.
+    // _on_boundary(const resume_point&, bool last) is called after each page.
+    // Parts not in Parts are read past (see decode_parts). Returns the
+    // error the decode stopped at, its offset counted in _data. Data that
+    // ends inside a page is read as zeros, then fails when the page is.
+    template <typename Field, typename String, u32 Parts = decode_parts::all, typename Fn, typename Boundary>
+    static decode_error s_decode(
+        std::string_view _data, u32 _htop, resume_point<Field, String>& _state,
+        Fn&& _on_page, Boundary&& _on_boundary, std::pmr::memory_resource* _resource
+    ) {
+        constexpr bool _with_field = Parts & decode_parts::field,
+            _with_comment = Parts & decode_parts::comment,
+            _last_only = Parts & decode_parts::last_page;
+
+        u32 _max_height = _htop + GARBAGE_LINE,
+            _block_count = FIELD_WIDTH * _max_height;
+
+        buffer _buf = [&] {
+            instrument::stage_scope _probe(decode_stage::base64);
+            return buffer(_data.substr(_state.m_offset), buffer::allocator_type(_resource));
+        }();
+
+        // The field of the current page, updated in place
+        Field& _field = _state.m_field;
 
-            if (_act.m_lock) {
-                if (defs::is_mino(_act.m_operation.m_piece))
-                    _current.second.fill(_act.m_operation);
-                
-                _current.second.clear_line();
+        store_data<String>& _st_data = _state.m_st_data;
 
-                if (_act.m_rise)
-                    _current.second.rise_garbage();
-                
-                if (_act.m_mirror)
-                    _current.second.mirror();
+        comment_codec _comment_codec;
+
+        auto _error = [&] (decode_errc _errc) {
+            return decode_error { _errc, _buf.overrun() ? _data.size() : _data.size() - _buf.size() };
+        };
+
+        while (!_buf.empty()) {
+            decode_errc _errc = s_begin_page(_state, _block_count);
+            if (_errc != decode_errc::ok) return _error(_errc);
+
+            bool _is_changed = false;
+
+            if (0 < _st_data.m_counter) {
+                _st_data.m_counter--;
+            } else {
+                instrument::stage_scope _probe(decode_stage::field);
+                if constexpr (_with_field)
+                    _is_changed = s_update_field(_buf, _htop, _block_count, _field);
+                else
+                    _is_changed = s_skip_field(_buf, _block_count);
+
+                if (!_is_changed)
+                    _st_data.m_counter = _buf.take(1);
+            }
+
+            action _act;
+            {
+                instrument::stage_scope _probe(decode_stage::action);
+                u32 _value = static_cast<u32>(_buf.take(3));
+                _act = decode_action(_value, _htop);
+            }
+
+            if (_buf.overrun()) return _error(decode_errc::invalid_data);
+
+            i64 _comment_len = 0;
+
+            if (_act.m_comment) {
+                instrument::stage_scope _probe(decode_stage::comment);
+
+                if constexpr (_with_comment) {
+                    _comment_len = _buf.take(2);
+                    if (_buf.overrun()) return _error(decode_errc::invalid_data);
+
+                    _errc = s_charge_comment(_state, _comment_len);
+                    if (_errc != decode_errc::ok) return _error(_errc);
+
+                    i64 _group_count = (_comment_len + 3) / 4;
+
+                    _st_data.m_escaped.resize(_group_count * comment_codec::group_size);
+                    for (i64 _i = 0; _i < _group_count; _i++)
+                        _comment_codec.decode(
+                            _buf.take(5),
+                            _st_data.m_escaped.data() + _i * comment_codec::group_size
+                        );
+                } else
+                    s_skip_comment(_buf);
+
+                if (_buf.overrun()) return _error(decode_errc::invalid_data);
             }
 
-            _prev_field = _current.second;
+            // Intermediate pages are not built when only the last is wanted
+            _errc = s_page<Parts>(_state, _act, _is_changed, _comment_len, !_last_only || _buf.empty(), _on_page, _resource);
+            if (_errc != decode_errc::ok) return _error(_errc);
+
+            _state.m_offset = _data.size() - _buf.size();
+            _on_boundary(static_cast<const resume_point<Field, String>&>(_state), _buf.empty());
         }
 
-        return _pages;
+        return {};
     }
 
+    // The offset in _data, as given, of _offset characters into the data
+    // extracted from it
+    static u64 s_raw_offset(std::string_view _data, u64 _offset) {
+        auto [_rest, _version] = s_header(_data);
+        if (!_version) return 0;
+
+        u64 _pos = _rest.data() - _data.data();
+        for (char _c : _rest) {
+            if (_offset == 0) break;
+            if (!s_is_removed(_c)) _offset--;
+            _pos++;
+        }
+
+        return _pos;
+    }
+
+    static constexpr auto s_no_boundary = [] (const auto&, bool) {};
+
+    static constexpr u32 s_height(u32 _version) { return _version == 115 ? 23 : 21; }
+
 public:
+    // 110 or 115 from the header of _data, without decoding it
+    static std::optional<u32> version(std::string_view _data) {
+        u32 _version = s_header(_data).second;
+        return _version ? std::optional<u32>(_version) : std::nullopt;
+    }
+
     static pages decode(const std::string& _data) {
-        auto [__v, _dt] = s_extract(_data);
-        
-        return s_decode(_dt, __v == 115 ? 23 : 21);
+        pages _pages;
+
+        decode(_data, [&] (page&& _page) { _pages.push_back(std::move(_page)); });
+
+        return _pages;
+    }
+
+    static history decode_history(const std::string& _data) {
+        history _history;
+
+        decode<persistent_field>(_data, [&] (history_page&& _page) {
+            _history.push_back(std::move(_page));
+        });
+
+        return _history;
+    }
+
+    // Allocates the pages and everything the decode needs from _resource
+    static pmr_pages decode(std::string_view _data, std::pmr::memory_resource* _resource) {
+        pmr_pages _pages(_resource);
+
+        decode<pmr_inner_field, std::pmr::string>(_data, [&] (pmr_page&& _page) {
+            _pages.push_back(std::move(_page));
+        }, _resource);
+
+        return _pages;
+    }
+
+    // Calls _on_page(basic_page<Field, String>&&) for each page as soon as
+    // it is decoded. Allocator-aware fields and comments, and the decoder
+    // state, are allocated from _resource.
+    template <typename Field = inner_field, typename String = std::string, typename Fn>
+    static void decode(
+        std::string_view _data, Fn&& _on_page,
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) { project<decode_parts::all, Field, String>(_data, _on_page, {}, _resource); }
+
+    // decode() held to _limits, see decode_limits
+    template <typename Field = inner_field, typename String = std::string, typename Fn>
+    static void decode(
+        std::string_view _data, Fn&& _on_page, const decode_limits& _limits,
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) { project<decode_parts::all, Field, String>(_data, _on_page, _limits, _resource); }
+
+    /*
+     * decode() reporting a failure by its result instead of throwing, with
+     * the offset of the character of _data it was found at. Pages decoded
+     * before it have been passed to _on_page. Only _on_page and running out
+     * of memory can throw.
+     */
+    template <typename Field = inner_field, typename String = std::string, typename Fn>
+    static decode_error try_decode(
+        std::string_view _data, Fn&& _on_page, const decode_limits& _limits = {},
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) { return try_project<decode_parts::all, Field, String>(_data, _on_page, _limits, _resource); }
+
+    /*
+     * decode() producing only the parts of each page in Parts, e.g.
+     * decode_parts::operations or decode_parts::field | last_page. The
+     * stages of the other parts are skipped: without the field its diffs
+     * are read past run by run and nothing is locked, and without comments
+     * their characters are skipped unread and no quiz is followed. Pages
+     * are basic_page<projected_field<Parts, Field>, String>.
+     */
+    template <u32 Parts, typename Field = inner_field, typename String = std::string, typename Fn>
+    static void project(
+        std::string_view _data, Fn&& _on_page, const decode_limits& _limits = {},
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) {
+        decode_error _error = try_project<Parts, Field, String>(_data, _on_page, _limits, _resource);
+        if (_error) _error.raise();
+    }
+
+    // project() reporting a failure as try_decode() does
+    template <u32 Parts, typename Field = inner_field, typename String = std::string, typename Fn>
+    static decode_error try_project(
+        std::string_view _data, Fn&& _on_page, const decode_limits& _limits = {},
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) {
+        if (_data.size() > _limits.m_max_input) return { decode_errc::input_too_long, _limits.m_max_input };
+
+        instrument::call_scope _call(_data.size());
+
+        std::pmr::string _dt(_resource);
+        u32 _version;
+        {
+            instrument::stage_scope _probe(decode_stage::extract);
+            _version = s_extract(_data, _dt);
+        }
+
+        if (!_version) return { decode_errc::unsupported_version, 0 };
+
+        resume_point<Field, String> _state(_resource);
+        _state.m_limits = _limits;
+
+        decode_error _error = s_decode<Field, String, Parts>(
+            _dt, s_height(_version), _state, _on_page, s_no_boundary, _resource);
+        if (_error) _error.m_offset = s_raw_offset(_data, _error.m_offset);
+
+        return _error;
+    }
+
+    // Appends the data of _data after its header, without whitespace and
+    // '?', to _out and returns the version. This is the text the offsets of
+    // resume_point count in.
+    template <typename String>
+    static u32 extract(std::string_view _data, String& _out) {
+        u32 _version = s_extract(_data, _out);
+        if (!_version) throw std::logic_error("Unsupported Fumen version.");
+
+        return _version;
+    }
+
+    /*
+     * Continues decoding _extracted, data written by extract() for
+     * _version, from _state, a point reached on data with the same first
+     * _state.m_offset characters. _on_page is called for the remaining
+     * pages and _on_boundary(const resume_point&, bool last) after each of
+     * them, with _state as it is then. The decode is held to
+     * _state.m_limits, with _extracted as its input. It is one call for
+     * instrument, of the characters after _state.m_offset.
+     */
+    template <typename Field = inner_field, typename String = std::string, typename Fn, typename Boundary>
+    static void resume(
+        std::string_view _extracted, u32 _version, resume_point<Field, String>& _state,
+        Fn&& _on_page, Boundary&& _on_boundary,
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) {
+        if (_version != 110 && _version != 115) throw std::logic_error("Unsupported Fumen version.");
+        if (_state.m_offset > _extracted.size()) throw std::invalid_argument("Invalid fumen data");
+        if (_extracted.size() > _state.m_limits.m_max_input) throw std::length_error("Fumen input too long");
+
+        instrument::call_scope _call(_extracted.size() - _state.m_offset);
+
+        decode_error _error = s_decode<Field, String>(
+            _extracted, s_height(_version), _state, _on_page, _on_boundary, _resource);
+        if (_error) _error.raise();
     }
 };
 
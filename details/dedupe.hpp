@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#include <details/intdef.hpp>
+#include <details/normalize.hpp>
+
+namespace fumen::details {
+
+/*
+ * An exact set of fingerprints, safe to insert into from many threads.
+ * Fingerprints are spread over 64 shards by their high bits; each shard is
+ * an open-addressing table of 16-byte slots under its own lock, grown at
+ * half load. The all-zero fingerprint marks an empty slot and is kept
+ * aside.
+ */
+class fingerprint_set {
+public:
+    fingerprint_set() = default;
+    // Sized so that about _expected insertions need no rehash
+    explicit fingerprint_set(u64 _expected) {
+        u64 _per_shard = 16;
+        while (_per_shard < _expected / s_shards * 2) _per_shard *= 2;
+
+        for (shard& _s : m_shards) _s.m_slots.resize(_per_shard);
+    }
+
+private:
+    static constexpr u32 s_shards = 64;
+
+    struct shard {
+        std::mutex m_mutex;
+        std::vector<fingerprint> m_slots = std::vector<fingerprint>(16);
+        u64 m_size = 0;
+    };
+
+    std::array<shard, s_shards> m_shards;
+    std::atomic<bool> m_zero { false };
+
+    static bool s_empty(const fingerprint& _fp) { return _fp.m_hi == 0 && _fp.m_lo == 0; }
+
+    // Slot of _fp in _slots, or of the empty slot where it would go
+    static fingerprint& s_find(std::vector<fingerprint>& _slots, const fingerprint& _fp) {
+        u64 _mask = _slots.size() - 1;
+
+        for (u64 _i = _fp.m_lo & _mask; ; _i = (_i + 1) & _mask)
+            if (s_empty(_slots[_i]) || _slots[_i] == _fp) return _slots[_i];
+    }
+
+    static void s_grow(shard& _s) {
+        std::vector<fingerprint> _slots(_s.m_slots.size() * 2);
+
+        for (const fingerprint& _fp : _s.m_slots)
+            if (!s_empty(_fp)) s_find(_slots, _fp) = _fp;
+
+        _s.m_slots.swap(_slots);
+    }
+
+public:
+    // Returns true if _fp was not in the set
+    bool insert(const fingerprint& _fp) {
+        if (s_empty(_fp)) return !m_zero.exchange(true);
+
+        shard& _s = m_shards[_fp.m_hi >> 58];
+        std::lock_guard _lock(_s.m_mutex);
+
+        fingerprint& _slot = s_find(_s.m_slots, _fp);
+        if (!s_empty(_slot)) return false;
+
+        _slot = _fp;
+        if (++_s.m_size * 2 > _s.m_slots.size()) s_grow(_s);
+
+        return true;
+    }
+
+    bool contains(const fingerprint& _fp) {
+        if (s_empty(_fp)) return m_zero.load();
+
+        shard& _s = m_shards[_fp.m_hi >> 58];
+        std::lock_guard _lock(_s.m_mutex);
+
+        return !s_empty(s_find(_s.m_slots, _fp));
+    }
+
+    u64 size() {
+        u64 _size = m_zero.load();
+        for (shard& _s : m_shards) {
+            std::lock_guard _lock(_s.m_mutex);
+            _size += _s.m_size;
+        }
+        return _size;
+    }
+};
+
+/*
+ * A Bloom filter over fingerprints, safe to insert into from many threads.
+ * It answers "maybe seen" for some new fingerprints (at the rate chosen on
+ * construction) but never forgets one, in a fixed number of bits per
+ * expected item. Probes are derived from the two halves of the
+ * fingerprint, which are already independent hashes.
+ */
+class bloom_filter {
+public:
+    // _error is the false positive rate once _expected items are inserted
+    bloom_filter(u64 _expected, double _error = 0.001) {
+        double _bits = std::ceil(-static_cast<double>(std::max<u64>(_expected, 1)) * std::log(_error) /
+            (std::log(2.0) * std::log(2.0)));
+
+        m_words = std::max<u64>(1, static_cast<u64>(_bits + 63) / 64);
+        m_probes = std::clamp<u32>(static_cast<u32>(std::round(_bits / std::max<u64>(_expected, 1) * std::log(2.0))), 1, 32);
+        m_bits = std::make_unique<std::atomic<u64>[]>(m_words);
+    }
+
+private:
+    std::unique_ptr<std::atomic<u64>[]> m_bits;
+    u64 m_words;
+    u32 m_probes;
+
+public:
+    // Returns true if _fp was surely not inserted before
+    bool insert(const fingerprint& _fp) {
+        u64 _bit_count = m_words * 64, _h = _fp.m_lo, _step = _fp.m_hi | 1;
+        bool _new = false;
+
+        for (u32 _i = 0; _i < m_probes; _i++, _h += _step) {
+            u64 _bit = _h % _bit_count, _mask = 1ull << (_bit & 63);
+            _new |= !(m_bits[_bit >> 6].fetch_or(_mask, std::memory_order_relaxed) & _mask);
+        }
+
+        return _new;
+    }
+
+    bool contains(const fingerprint& _fp) const {
+        u64 _bit_count = m_words * 64, _h = _fp.m_lo, _step = _fp.m_hi | 1;
+
+        for (u32 _i = 0; _i < m_probes; _i++, _h += _step) {
+            u64 _bit = _h % _bit_count;
+            if (!(m_bits[_bit >> 6].load(std::memory_order_relaxed) >> (_bit & 63) & 1)) return false;
+        }
+
+        return true;
+    }
+
+    u64 bit_count() const { return m_words * 64; }
+    u32 probe_count() const { return m_probes; }
+};
+
+}
\ No newline at end of file
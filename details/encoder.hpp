@@ -2,10 +2,15 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 
 #include <optional>
+#include <memory_resource>
+
+#include <cstring>
 
 #include <details/intdef.hpp>
+#include <details/simd.hpp>
 #include <details/strlib.hpp>
 
 #include <details/defs.hpp>
@@ -14,6 +19,7 @@
 #include <details/action.hpp>
 #include <details/comments.hpp>
 #include <details/quiz.hpp>
+#include <details/result.hpp>
 #include <details/inner_field.hpp>
 #include <details/field.hpp>
 
@@ -39,66 +45,81 @@ struct encode_page {
 using encode_pages = std::vector<encode_page>;
 
 /* static */ class encoder {
-    static std::pair<bool, buffer> s_encode_field(
-        const inner_field& _prev, const inner_field& _current
+    // In encode, only support { field = 23, garbage = 1 }
+    static constexpr u32
+        s_field_top = 23,
+        s_block_count = FIELD_WIDTH * (s_field_top + 1),
+        s_field_count = FIELD_WIDTH * s_field_top;
+
+    static bool s_same_field(const pmr_inner_field& _prev, const pmr_inner_field& _current) {
+        return std::memcmp(_current.field().data(), _prev.field().data(), s_field_count) == 0
+            && std::memcmp(_current.garbage().data(), _prev.garbage().data(), FIELD_WIDTH) == 0;
+    }
+
+    // Appends the runs of cell diffs between two different fields to _buf
+    static void s_encode_field(
+        const pmr_inner_field& _prev, const pmr_inner_field& _current, buffer& _buf
     ) {
-        // In encode, only support { field = 23, garbage = 1 }
-        u32 _field_top = 23,
-            _max_height = _field_top + 1,
-            _block_count = FIELD_WIDTH * _max_height;
-        
-        buffer _buf;
-
-        auto _get_diff_fn = [&] (u32 _x, u32 _y) constexpr {
-            u32 _py = _field_top - _y - 1;
-
-            return
-                static_cast<i8>(_current.get_number_at(_x, _py)) -
-                static_cast<i8>(_prev.get_number_at(_x, _py)) + 8;
-        };
+        u32 _field_top = s_field_top,
+            _block_count = s_block_count,
+            _field_count = s_field_count;
 
         auto _record_block_counts_fn = [&] (i8 _diff, i64 _counter) {
             i64 _value = (i64)_diff * _block_count + _counter;
             _buf.push(_value, 2);
         };
 
-        bool _changed = true;
-        i8 _prev_diff = _get_diff_fn(0, 0);
-        i64 _counter = -1;
+        const u8
+            *_cfield = reinterpret_cast<const u8*>(_current.field().data()),
+            *_pfield = reinterpret_cast<const u8*>(_prev.field().data()),
+            *_cgarbage = reinterpret_cast<const u8*>(_current.garbage().data()),
+            *_pgarbage = reinterpret_cast<const u8*>(_prev.garbage().data());
 
-        for (u32 _y = 0; _y < _max_height; _y++) {
-            for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
-                i8 _diff = _get_diff_fn(_x, _y);
+        // Diffs in storage order (bottom row first, garbage last)
+        u8 _raw[PLAY_BLOCKS + FIELD_WIDTH];
+        simd::sub_bias(_raw, _cfield, _pfield, _field_count, 8);
+        simd::sub_bias(_raw + _field_count, _cgarbage, _pgarbage, FIELD_WIDTH, 8);
 
-                if (_diff != _prev_diff) {
-                    _record_block_counts_fn(_prev_diff, _counter);
-                    _counter = -1;
-                    _prev_diff = _diff;
-                }
+        // Diffs in encoding order (top row first), padded for 16-byte loads
+        u8 _diffs[PLAY_BLOCKS + FIELD_WIDTH + 16] = {};
+        for (u32 _y = 0; _y < _field_top; _y++)
+            std::memcpy(
+                _diffs + _y * FIELD_WIDTH,
+                _raw + (_field_top - _y - 1) * FIELD_WIDTH,
+                FIELD_WIDTH
+            );
+        std::memcpy(_diffs + _field_count, _raw + _field_count, FIELD_WIDTH);
+
+        u32 _start = 0;
+
+        for (u32 _i = 1; _i < _block_count; _i += 16) {
+            u32 _mask = simd::neq_mask16(_diffs + _i, _diffs + _i - 1);
+
+            if (_block_count - _i < 16)
+                _mask &= (1u << (_block_count - _i)) - 1;
+
+            while (_mask) {
+                u32 _end = _i + simd::ctz(_mask);
+
+                _record_block_counts_fn(_diffs[_start], _end - _start - 1);
+                _start = _end;
 
-                _counter++;
+                _mask &= _mask - 1;
             }
         }
 
-        _record_block_counts_fn(_prev_diff, _counter);
-
-        if (_prev_diff == 8 && _counter == _block_count - 1)
-            _changed = false;
-        
-        return { _changed, _buf };
+        _record_block_counts_fn(_diffs[_start], _block_count - _start - 1);
     }
 
     static void s_update_field(
         buffer& _buf, i64& _last_ridx,
-        const inner_field& _prev, const inner_field& _current
+        const pmr_inner_field& _prev, const pmr_inner_field& _current
     ) {
-        auto [_changed, __bufv] = s_encode_field(_prev, _current);
-
-        if (_changed) {
-            _buf += __bufv;
+        if (!s_same_field(_prev, _current)) {
+            s_encode_field(_prev, _current, _buf);
             _last_ridx = -1;
         } else if (_last_ridx < 0 || _buf[_last_ridx] == buffer::table_size - 1) {
-            _buf += __bufv;
+            _buf.push(8 * s_block_count + s_block_count - 1, 2);
             _buf.push(0);
             _last_ridx = _buf.size() - 1;
         } else if (_buf[_last_ridx] < buffer::table_size - 1) {
@@ -106,33 +127,104 @@ using encode_pages = std::vector<encode_page>;
         }
     }
 
+    // Pages may hold a field, std::optional<field> or an inner_field of
+    // any allocator, and a comment string or an optional one
+    template <typename Allocator>
+    static const basic_inner_field<Allocator>* s_page_field(const std::optional<basic_field<Allocator>>& _field)
+    { return _field ? &_field->inner() : nullptr; }
+
+    template <typename Allocator>
+    static const basic_inner_field<Allocator>* s_page_field(const basic_field<Allocator>& _field)
+    { return &_field.inner(); }
+
+    template <typename Allocator>
+    static const basic_inner_field<Allocator>* s_page_field(const basic_inner_field<Allocator>& _field)
+    { return &_field; }
+
+    template <typename String>
+    static std::optional<std::string_view> s_page_comment(const std::optional<String>& _comment)
+    { return _comment ? std::optional<std::string_view>(*_comment) : std::nullopt; }
+
+    template <typename String>
+    static std::optional<std::string_view> s_page_comment(const String& _comment)
+    { return std::string_view(_comment); }
+
 public:
-    static std::string encode(const encode_pages& _pages) {
-        i64 _last_ridx = -1;
-        buffer _buf;
-        inner_field _prev_field;
+    /*
+     * Encodes pages one at a time, so producers need not keep them. Pages
+     * can be any type with the members of encode_page. The working state is
+     * allocated from the resource given on construction.
+     */
+    class stream {
+    public:
+        explicit stream(std::pmr::memory_resource* _resource = std::pmr::get_default_resource())
+        : m_resource(_resource), m_buf(buffer::allocator_type(_resource)),
+          m_prev_field(pmr_inner_field::allocator_type(_resource)),
+          m_current_field(pmr_inner_field::allocator_type(_resource)),
+          m_prev_comment(std::in_place, _resource), m_estr(_resource) {}
+
+    private:
+        std::pmr::memory_resource* m_resource;
+
+        u32 m_idx = 0;
+        i64 m_last_ridx = -1;
+        buffer m_buf;
+        pmr_inner_field m_prev_field, m_current_field;
+
+        comment_codec m_comment_codec;
+
+        // Owned, since the pages it came from may be gone
+        std::optional<std::pmr::string> m_prev_comment;
+        std::optional<quiz> m_prev_quiz = std::nullopt;
+
+        // Escaped comment, reused between pages
+        std::pmr::string m_estr;
+
+        std::optional<std::string_view> m_prev() const
+        { return m_prev_comment ? std::optional<std::string_view>(*m_prev_comment) : std::nullopt; }
+
+        void m_set_prev(std::optional<std::string_view> _comment) {
+            if (!_comment) m_prev_comment.reset();
+            else if (m_prev_comment) m_prev_comment->assign(*_comment);
+            else m_prev_comment.emplace(*_comment, m_resource);
+        }
+
+    public:
+        // Throws std::invalid_argument for a page try_add() rejects
+        template <typename Page>
+        void add(const Page& _current_page) {
+            decode_errc _errc = try_add(_current_page);
+            if (_errc != decode_errc::ok) decode_error { _errc, m_idx }.raise();
+        }
+
+        // Adds _current_page, or returns why it cannot be and leaves the
+        // stream as it was
+        template <typename Page>
+        decode_errc try_add(const Page& _current_page) {
+            // The piece is locked into the field below, so one off the
+            // field is rejected before the stream changes
+            if (_current_page.m_flags.lock_bit && _current_page.m_operation) {
+                const auto& _op = *_current_page.m_operation;
+                if (defs::is_mino(_op.m_piece) &&
+                    !field_util::fits(inner_operation { _op.m_piece, _op.m_rotation, _op.m_x, _op.m_y }))
+                    return decode_errc::operation_out_of_field;
+            }
 
-        action_codec _act_codec(FIELD_WIDTH, 23, GARBAGE_LINE);
-        comment_codec _comment_codec;
+            u32 _idx = m_idx++;
 
-        std::optional<std::string> _prev_comment = "";
-        std::optional<quiz> _prev_quiz = std::nullopt;
+            if (const auto* _field = s_page_field(_current_page.m_field))
+                m_current_field.assign(*_field);
+            else
+                m_current_field = m_prev_field;
 
-        for (u32 _idx = 0; _idx < _pages.size(); _idx++) {
-            auto& _current_page = _pages[_idx];
-            std::optional<field> _field = _current_page.m_field;
+            s_update_field(m_buf, m_last_ridx, m_prev_field, m_current_field);
 
-            inner_field _current_field =
-                _field ? static_cast<inner_field>(*_field) : _prev_field;
-            
-            s_update_field(_buf, _last_ridx, _prev_field, _current_field);
+            std::optional<std::string_view> _current_comment = std::nullopt,
+                _page_comment = s_page_comment(_current_page.m_comment);
 
-            std::optional<std::string> _current_comment = std::nullopt;
+            if (_page_comment.has_value() && (_idx != 0 || !_page_comment->empty()))
+                _current_comment = _page_comment;
 
-            if (_current_page.m_comment.has_value() &&
-                (_idx != 0 || !_current_page.m_comment->empty()))
-                _current_comment = *_current_page.m_comment;
-            
             inner_operation _piece = _current_page.m_operation ?
                 inner_operation {
                     _current_page.m_operation->m_piece,
@@ -140,45 +232,41 @@ public:
                     _current_page.m_operation->m_x,
                     _current_page.m_operation->m_y
                 } : inner_operation{ piece_type::empty, rotation_type::reverse, 0, 22 };
-            
-            std::optional<std::string> _next_comment = std::nullopt;
+
+            std::optional<std::string_view> _next_comment = std::nullopt;
 
             if (_current_comment.has_value()) {
-                if (strlib::startswith(*_current_comment, "#Q=")) {
-                    if (!_prev_quiz.has_value() ||
-                        _prev_quiz->format().to_string() != *_current_comment) {
+                if (quiz::is_quiz_comment(*_current_comment)) {
+                    if (!m_prev_quiz.has_value() ||
+                        !m_prev_quiz->format().equals(*_current_comment)) {
                         _next_comment = _current_comment;
-                        _prev_comment = _next_comment;
-                        _prev_quiz = quiz(*_current_comment);
+                        m_set_prev(_next_comment);
+                        m_prev_quiz = quiz(*_current_comment, m_resource);
                     }
                 } else {
-                    if (_prev_quiz.has_value() &&
-                        _prev_quiz->format().to_string() == *_current_comment) {
-                            _prev_comment = _current_comment;
-                            _prev_quiz = std::nullopt;
+                    if (m_prev_quiz.has_value() &&
+                        m_prev_quiz->format().equals(*_current_comment)) {
+                            m_set_prev(_current_comment);
+                            m_prev_quiz = std::nullopt;
                     } else {
-                        _next_comment = _prev_comment != _current_comment ? 
-                            _current_comment : std::nullopt;
-                        _prev_comment = _prev_comment != _current_comment ?
-                            _next_comment : _prev_comment;
-                        _prev_quiz = std::nullopt;
+                        if (m_prev() != _current_comment) {
+                            _next_comment = _current_comment;
+                            m_set_prev(_next_comment);
+                        }
+                        m_prev_quiz = std::nullopt;
                     }
                 }
-            } else _prev_quiz = std::nullopt;
+            } else m_prev_quiz = std::nullopt;
 
-            if (_prev_quiz.has_value() &&
-                _prev_quiz->can_operate() &&
+            if (m_prev_quiz.has_value() &&
+                m_prev_quiz->can_operate() &&
                 _current_page.m_flags.lock_bit
             ) {
                 if (defs::is_mino(_piece.m_piece)) {
-                    try {
-                        quiz _next_quiz = _prev_quiz->next_if_end();
-                        _prev_quiz = _next_quiz.operate(_next_quiz.get_operation(_piece.m_piece));
-                    } catch (const std::exception& e) {
-                        // No operation if an error occurs
-                        _prev_quiz = _prev_quiz->format();
-                    }
-                } else _prev_quiz = _prev_quiz->format();
+                    // No operation if the piece cannot be placed
+                    std::optional<quiz> _next_quiz = m_prev_quiz->try_place(_piece.m_piece);
+                    m_prev_quiz = _next_quiz ? std::move(_next_quiz) : m_prev_quiz->format();
+                } else m_prev_quiz = m_prev_quiz->format();
             }
 
             encode_page::flags _current_flags;
@@ -195,59 +283,89 @@ public:
                 static_cast<bool>(_current_flags.lock_bit)
             };
 
-            i64 _act_num = _act_codec.encode(_act);
-            _buf.push(_act_num, 3);
+            i64 _act_num = v115_action_codec::encode(_act);
+            m_buf.push(_act_num, 3);
 
             if (_next_comment.has_value()) {
-                std::string _estr = converter::escape(*_next_comment);
-                u32 _comment_len = std::min<u32>(_estr.size(), 4095u);
+                m_estr.clear();
+                converter::escape(*_next_comment, m_estr);
+                u32 _comment_len = std::min<u32>(m_estr.size(), 4095u);
 
-                _buf.push(_comment_len, 2);
+                m_buf.push(_comment_len, 2);
 
-                for (u32 __i = 0; __i < _comment_len; __i += 4) {
-                    i64 __v = 0;
-                    for (u32 __cnt = 0; __cnt < 4; __cnt++) {
-                        if (__i + __cnt >= _comment_len) break;
+                std::string_view _estr_view(m_estr.data(), _comment_len);
+                for (u32 __i = 0; __i < _comment_len; __i += comment_codec::group_size)
+                    m_buf.push(m_comment_codec.encode(_estr_view.substr(__i, comment_codec::group_size)), 5);
+            } else if (!_page_comment.has_value())
+                m_prev_comment.reset();
 
-                        __v += _comment_codec.encode(_estr.at(__i + __cnt), __cnt);
-                    }
-
-                    _buf.push(__v, 5);
-                }
-            } else if (!_current_page.m_comment.has_value())
-                _prev_comment = std::nullopt;
-            
             if (_act.m_lock) {
                 if (defs::is_mino(_act.m_operation.m_piece))
-                    _current_field.fill(_act.m_operation);
-                
-                _current_field.clear_line();
+                    m_current_field.fill(_act.m_operation);
+
+                m_current_field.clear_line();
 
                 if (_act.m_rise)
-                    _current_field.rise_garbage();
-                
+                    m_current_field.rise_garbage();
+
                 if (_act.m_mirror)
-                    _current_field.mirror();
+                    m_current_field.mirror();
             }
 
-            _prev_field = _current_field;
+            m_prev_field = m_current_field;
+
+            return decode_errc::ok;
         }
 
-        std::string _data = _buf.to_string();
-        if (_data.size() < 42) return _data;
+        u32 size() const { return m_idx; }
+
+        // Appends the data of the pages added so far to _out
+        template <typename String>
+        void finish(String& _out) const {
+            std::pmr::string _data(m_resource);
+            m_buf.to_string(_data);
+
+            // A '?' after the first 42 characters and then every 47
+            _out.reserve(_out.size() + _data.size() + _data.size() / 47 + 1);
+            for (std::size_t _i = 0; _i < _data.size(); _i++) {
+                if (_i >= 42 && (_i - 42) % 47 == 0) _out += '?';
+                _out += _data[_i];
+            }
+        }
+    };
 
-        std::string _head = _data.substr(0, 42), _next;
-        for (u32 __i = 0; ; __i++) {
-            _next = _data.substr(42 + 47 * __i, 47);
+    static std::string encode(const encode_pages& _pages) {
+        std::string _data;
+        encode(_pages, _data);
+        return _data;
+    }
 
-            if (_next.empty()) break;
+    // Appends the encoded data of _pages to _out, see stream
+    template <typename Pages, typename String>
+    static void encode(
+        const Pages& _pages, String& _out,
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) {
+        decode_error _error = try_encode(_pages, _out, _resource);
+        if (_error) _error.raise();
+    }
 
-            _head += "?" + _next;
+    // encode() reporting a page that cannot be encoded by its code and
+    // index instead of throwing; _out is left as it was then
+    template <typename Pages, typename String>
+    static decode_error try_encode(
+        const Pages& _pages, String& _out,
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) {
+        stream _stream(_resource);
 
-            if (_next.size() < 47) break;
+        for (const auto& _page : _pages) {
+            decode_errc _errc = _stream.try_add(_page);
+            if (_errc != decode_errc::ok) return { _errc, _stream.size() };
         }
 
-        return _head;
+        _stream.finish(_out);
+        return {};
     }
 };
 
@@ -68,26 +68,48 @@ public:
     }
 };
 
-struct field {
-    field() = default;
-    field(const inner_field& _field) : m_field(_field) {}
-    field(const std::string& _field) {
+// Cells allocated with Allocator; field and pmr_field are the instances
+template <typename Allocator = std::allocator<piece_type>>
+struct basic_field {
+    using inner_field = basic_inner_field<Allocator>;
+    using play_field = typename inner_field::play_field;
+    using allocator_type = Allocator;
+
+    basic_field() = default;
+    basic_field(const inner_field& _field) : m_field(_field) {}
+    basic_field(inner_field&& _field) : m_field(std::move(_field)) {}
+    explicit basic_field(const allocator_type& _alloc) : m_field(_alloc) {}
+    basic_field(const std::string& _field) {
         m_field = inner_field(
             play_field::parse(_field),
             play_field(FIELD_WIDTH)
         );
     }
-    field(const std::string& _field, const std::string& _garbage) {
+    basic_field(const std::string& _field, const std::string& _garbage) {
         m_field = inner_field(
             play_field::parse(_field),
             play_field::parse(_garbage, FIELD_WIDTH)
         );
     }
 
+    basic_field(const basic_field&) = default;
+    basic_field(basic_field&&) = default;
+    basic_field(const basic_field& _other, const allocator_type& _alloc)
+    : m_field(_other.m_field, _alloc) {}
+    basic_field(basic_field&& _other, const allocator_type& _alloc)
+    : m_field(std::move(_other.m_field), _alloc) {}
+
+    basic_field& operator=(const basic_field&) = default;
+    basic_field& operator=(basic_field&&) = default;
+
 private:
     inner_field m_field;
 
 public:
+    const inner_field& inner() const { return m_field; }
+
+    allocator_type get_allocator() const { return m_field.get_allocator(); }
+
     bool can_fill() const { return true; }
     bool can_fill(field_operation _op) const
     { return can_fill(mino(_op)); }
@@ -168,4 +190,7 @@ public:
     }
 };
 
+using field = basic_field<>;
+using pmr_field = basic_field<std::pmr::polymorphic_allocator<piece_type>>;
+
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <vector>
+#include <memory_resource>
 
 #include <algorithm>
 #include <stdexcept>
@@ -61,39 +62,70 @@ public:
         throw std::invalid_argument("Invalid piece");
     }
 
-    static constexpr container_type rotate_right(const container_type& _pieces) {
-        container_type _result;
-        for (u32 _i = 0; _i < 4; ++_i) {
-            _result[_i] = { _pieces[_i].second, -_pieces[_i].first };
+    // Whether every block of _op is on the field
+    static constexpr bool fits(const inner_operation& _op) {
+        for (const auto& [_bx, _by] : get_blocks(_op.m_piece, _op.m_rotation)) {
+            i32 _x = _bx + static_cast<i32>(_op.m_x), _y = _by + static_cast<i32>(_op.m_y);
+            if (_x < 0 || _x >= static_cast<i32>(FIELD_WIDTH) || _y < 0 || _y >= static_cast<i32>(FIELD_HEIGHT))
+                return false;
         }
-        return _result;
-    }
-    
-    static constexpr container_type rotate_left(const container_type& _pieces) {
-        container_type _result;
-        for (u32 _i = 0; _i < 4; ++_i) {
-            _result[_i] = { -_pieces[_i].second, _pieces[_i].first };
-        }
-        return _result;
-    }
 
-    static constexpr container_type rotate_reverse(const container_type& _pieces) {
-        container_type _result;
-        for (u32 _i = 0; _i < 4; ++_i) {
-            _result[_i] = { -_pieces[_i].first, -_pieces[_i].second };
-        }
-        return _result;
+        return true;
     }
+
+    static constexpr container_type rotate_right(const container_type& _pieces)
+    { return s_transform(_pieces, [] (const pos_type& _p) { return pos_type { _p.second, -_p.first }; }); }
+
+    static constexpr container_type rotate_left(const container_type& _pieces)
+    { return s_transform(_pieces, [] (const pos_type& _p) { return pos_type { -_p.second, _p.first }; }); }
+
+    static constexpr container_type rotate_reverse(const container_type& _pieces)
+    { return s_transform(_pieces, [] (const pos_type& _p) { return pos_type { -_p.first, -_p.second }; }); }
+
+private:
+    // Built in one expression, since std::pair is not assignable in
+    // constant expressions before C++20
+    template <typename Fn>
+    static constexpr container_type s_transform(const container_type& _pieces, Fn _fn)
+    { return { { _fn(_pieces[0]), _fn(_pieces[1]), _fn(_pieces[2]), _fn(_pieces[3]) } }; }
 };
 
-struct play_field {
-    play_field(const std::vector<piece_type>& _pieces, u32 _size = PLAY_BLOCKS)
-    : m_pieces(_pieces), m_size(_size) {}
-    play_field(u32 _size = PLAY_BLOCKS)
-    : play_field(std::vector<piece_type>(_size, piece_type::empty), _size) {}
+/*
+ * Cells are stored in a std::vector with the given allocator. The pmr_
+ * aliases below use a polymorphic_allocator, so a field can live in any
+ * memory_resource; as with the pmr containers, copies made without an
+ * allocator use the default resource and assignments keep the resource
+ * of the target.
+ */
+template <typename Allocator = std::allocator<piece_type>>
+struct basic_play_field {
+    using storage_type = std::vector<piece_type, Allocator>;
+    using allocator_type = Allocator;
+
+    basic_play_field(const std::vector<piece_type>& _pieces, u32 _size = PLAY_BLOCKS, const allocator_type& _alloc = {})
+    : m_pieces(_pieces.begin(), _pieces.end(), _alloc), m_size(_size) {}
+    basic_play_field(u32 _size = PLAY_BLOCKS, const allocator_type& _alloc = {})
+    : m_pieces(_size, piece_type::empty, _alloc), m_size(_size) {}
+
+    basic_play_field(const basic_play_field&) = default;
+    basic_play_field(basic_play_field&&) = default;
+    basic_play_field(const basic_play_field& _other, const allocator_type& _alloc)
+    : m_pieces(_other.m_pieces, _alloc), m_size(_other.m_size) {}
+    basic_play_field(basic_play_field&& _other, const allocator_type& _alloc)
+    : m_pieces(std::move(_other.m_pieces), _alloc), m_size(_other.m_size) {}
+
+    basic_play_field& operator=(const basic_play_field&) = default;
+    basic_play_field& operator=(basic_play_field&&) = default;
+
+    // Copies the cells of a field with another allocator, keeping ours
+    template <typename Other>
+    void assign(const basic_play_field<Other>& _other) {
+        m_pieces.assign(_other.get_pieces().begin(), _other.get_pieces().end());
+        m_size = _other.size();
+    }
 
 private:
-    std::vector<piece_type> m_pieces;
+    storage_type m_pieces;
     u32 m_size = 0;
 
 public:
@@ -130,43 +162,29 @@ public:
         }
     }
 
+    // Compacts the rows which are not full downwards, in place
     void clear_line() {
-        std::vector<piece_type> _field = m_pieces;
-        u32 _top = m_pieces.size() / FIELD_WIDTH - 1;
-
-        for (i32 _y = _top; _y >= 0; _y--) {
-            std::vector<piece_type> _line(
-                _field.begin() + (_y * FIELD_WIDTH),
-                _field.begin() + ((_y + 1) * FIELD_WIDTH)
-            );
-
-            if (std::all_of(_line.begin(), _line.end(), [](piece_type _piece) { return _piece != piece_type::empty; })) {
-                std::vector<piece_type> _bottom(
-                    _field.begin(), _field.begin() + (_y * FIELD_WIDTH)
-                );
+        u32 _height = m_pieces.size() / FIELD_WIDTH, _top = 0;
 
-                _bottom.insert(
-                    _bottom.end(),
-                    _field.begin() + ((_y + 1) * FIELD_WIDTH),
-                    _field.end()
-                );
+        for (u32 _y = 0; _y < _height; _y++) {
+            auto _line = m_pieces.begin() + _y * FIELD_WIDTH;
 
-                _bottom.insert(_bottom.end(), FIELD_WIDTH, piece_type::empty);
+            if (std::all_of(_line, _line + FIELD_WIDTH, [](piece_type _piece) { return _piece != piece_type::empty; }))
+                continue;
 
-                _field = std::move(_bottom);
-            }
+            if (_top != _y)
+                std::copy(_line, _line + FIELD_WIDTH, m_pieces.begin() + _top * FIELD_WIDTH);
+            _top++;
         }
 
-        m_pieces = std::move(_field);
+        std::fill(m_pieces.begin() + _top * FIELD_WIDTH, m_pieces.end(), piece_type::empty);
     }
 
-    void up(const play_field& _up_field) {
-        std::vector<piece_type> _piece = _up_field.m_pieces;
-        _piece.insert(_piece.end(), m_pieces.begin(), m_pieces.end());
+    void up(const basic_play_field& _up_field) {
+        u32 _shift = std::min<u32>(_up_field.m_pieces.size(), m_size);
 
-        _piece.resize(m_size);
-
-        m_pieces = std::move(_piece);
+        std::copy_backward(m_pieces.begin(), m_pieces.end() - _shift, m_pieces.end());
+        std::copy(_up_field.m_pieces.begin(), _up_field.m_pieces.begin() + _shift, m_pieces.begin());
     }
 
     void mirror() {
@@ -202,31 +220,27 @@ public:
     }
 
     void up_shift() {
-        std::vector<piece_type> _blocks(FIELD_WIDTH, piece_type::empty);
-        _blocks.insert(_blocks.end(), m_pieces.begin(), m_pieces.end() - FIELD_WIDTH);
-
-        m_pieces = std::move(_blocks);
+        std::copy_backward(m_pieces.begin(), m_pieces.end() - FIELD_WIDTH, m_pieces.end());
+        std::fill(m_pieces.begin(), m_pieces.begin() + FIELD_WIDTH, piece_type::empty);
     }
 
     void down_shift() {
-        std::vector<piece_type> _blocks(m_pieces.begin() + FIELD_WIDTH, m_pieces.end());
-        _blocks.insert(_blocks.begin(), FIELD_WIDTH, piece_type::empty);
-
-        m_pieces = std::move(_blocks);
+        std::copy(m_pieces.begin() + FIELD_WIDTH, m_pieces.end(), m_pieces.begin());
+        std::fill(m_pieces.end() - FIELD_WIDTH, m_pieces.end(), piece_type::empty);
     }
 
     void clear() { m_pieces.assign(m_size, piece_type::empty); }
 
-    const std::vector<piece_type>& get_pieces() const { return m_pieces; }
+    const storage_type& get_pieces() const { return m_pieces; }
     u32 size() const { return m_size; }
 
-    static play_field parse(const std::string& _lines, u32 _len = 0) {
+    static basic_play_field parse(const std::string& _lines, u32 _len = 0) {
         u32 _size = _len == 0 ? _lines.size() : _len;
 
         if (_size % FIELD_WIDTH != 0)
             throw std::invalid_argument("Invalid field length");
         
-        play_field _field = _len == 0 ? play_field{} : play_field(_size);
+        basic_play_field _field = _len == 0 ? basic_play_field{} : basic_play_field(_size);
 
         for (u32 _i = 0; _i < _size; _i++) {
             _field.set(
@@ -240,13 +254,40 @@ public:
     }
 };
 
-struct inner_field {
-    inner_field(
-        const play_field& _field = play_field(PLAY_BLOCKS),
-        const play_field& _garbage = play_field(FIELD_WIDTH)
-    ) : m_field(_field), m_garbage(_garbage) {}
+template <typename Allocator = std::allocator<piece_type>>
+struct basic_inner_field {
+    using play_field = basic_play_field<Allocator>;
+    using allocator_type = Allocator;
+
+    basic_inner_field() : m_field(PLAY_BLOCKS), m_garbage(FIELD_WIDTH) {}
+    basic_inner_field(const play_field& _field, const play_field& _garbage = play_field(FIELD_WIDTH))
+    : m_field(_field), m_garbage(_garbage) {}
+
+    // An empty field allocated from _alloc
+    explicit basic_inner_field(const allocator_type& _alloc)
+    : m_field(PLAY_BLOCKS, _alloc), m_garbage(FIELD_WIDTH, _alloc) {}
+
+    basic_inner_field(const basic_inner_field&) = default;
+    basic_inner_field(basic_inner_field&&) = default;
+    basic_inner_field(const basic_inner_field& _other, const allocator_type& _alloc)
+    : m_field(_other.m_field, _alloc), m_garbage(_other.m_garbage, _alloc) {}
+    basic_inner_field(basic_inner_field&& _other, const allocator_type& _alloc)
+    : m_field(std::move(_other.m_field), _alloc), m_garbage(std::move(_other.m_garbage), _alloc) {}
+
+    basic_inner_field& operator=(const basic_inner_field&) = default;
+    basic_inner_field& operator=(basic_inner_field&&) = default;
+
+    // Copies the cells of a field with another allocator, keeping ours
+    template <typename Other>
+    void assign(const basic_inner_field<Other>& _other) {
+        m_field.assign(_other.m_field);
+        m_garbage.assign(_other.m_garbage);
+    }
 
 private:
+    template <typename Other>
+    friend struct basic_inner_field;
+
     play_field m_field, m_garbage;
 
 public:
@@ -345,8 +386,16 @@ public:
             m_garbage.get(_idx % FIELD_WIDTH, -(_idx / FIELD_WIDTH + 1));
     }
 
-    const std::vector<piece_type>& field() const { return m_field.get_pieces(); }
-    const std::vector<piece_type>& garbage() const { return m_garbage.get_pieces(); }
+    const typename play_field::storage_type& field() const { return m_field.get_pieces(); }
+    const typename play_field::storage_type& garbage() const { return m_garbage.get_pieces(); }
+
+    allocator_type get_allocator() const { return field().get_allocator(); }
 };
 
+using play_field = basic_play_field<>;
+using inner_field = basic_inner_field<>;
+
+using pmr_play_field = basic_play_field<std::pmr::polymorphic_allocator<piece_type>>;
+using pmr_inner_field = basic_inner_field<std::pmr::polymorphic_allocator<piece_type>>;
+
 }
\ No newline at end of file
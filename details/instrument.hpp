@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <details/intdef.hpp>
+
+/*
+ * Hot path instrumentation of the decoder. Define FUMEN_INSTRUMENT before
+ * including fumen.hpp to enable it; otherwise every probe is an empty
+ * object and the decoder compiles exactly as without it.
+ */
+
+namespace fumen::details {
+
+// comment is the base64 of a comment's groups, unescape its text
+enum class decode_stage : u8 {
+    extract, base64, field, action, comment, unescape, quiz, lock
+};
+
+inline constexpr u32 decode_stage_count = 8;
+
+inline const char* to_string(decode_stage _stage) {
+    switch (_stage) {
+        case decode_stage::extract:  return "extract";
+        case decode_stage::base64:   return "base64";
+        case decode_stage::field:    return "field";
+        case decode_stage::action:   return "action";
+        case decode_stage::comment:  return "comment";
+        case decode_stage::unescape: return "unescape";
+        case decode_stage::quiz:     return "quiz";
+        case decode_stage::lock:     return "lock";
+    }
+
+    return "unknown";
+}
+
+struct stage_stats {
+    u64 m_calls = 0, m_cycles = 0, m_allocs = 0;
+
+    stage_stats& operator+=(const stage_stats& _other) {
+        m_calls += _other.m_calls;
+        m_cycles += _other.m_cycles;
+        m_allocs += _other.m_allocs;
+        return *this;
+    }
+};
+
+// Counters of one decode call, or of many once aggregated with +=
+struct decode_stats {
+    u64 m_calls = 0, m_pages = 0, m_bytes = 0;
+    stage_stats m_total;
+    std::array<stage_stats, decode_stage_count> m_stages {};
+
+    stage_stats& operator[](decode_stage _stage)
+    { return m_stages[static_cast<u8>(_stage)]; }
+
+    const stage_stats& operator[](decode_stage _stage) const
+    { return m_stages[static_cast<u8>(_stage)]; }
+
+    decode_stats& operator+=(const decode_stats& _other) {
+        m_calls += _other.m_calls;
+        m_pages += _other.m_pages;
+        m_bytes += _other.m_bytes;
+        m_total += _other.m_total;
+
+        for (u32 _i = 0; _i < decode_stage_count; _i++)
+            m_stages[_i] += _other.m_stages[_i];
+
+        return *this;
+    }
+};
+
+/* static */ class instrument {
+public:
+#ifdef FUMEN_INSTRUMENT
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Returns the number of allocations made so far by the calling thread
+    using alloc_counter = u64 (*)();
+
+private:
+    static inline std::atomic<alloc_counter> s_alloc_counter { nullptr };
+    static inline thread_local decode_stats s_last;
+    static inline thread_local u32 s_depth = 0;
+
+    static u64 s_allocs() {
+        alloc_counter _counter = s_alloc_counter.load(std::memory_order_relaxed);
+        return _counter ? _counter() : 0;
+    }
+
+public:
+    // Timestamp counter on x86, nanoseconds elsewhere
+    static u64 cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+#endif
+    }
+
+    // The library cannot see allocations itself; m_allocs stay 0 without this
+    static void set_alloc_counter(alloc_counter _counter)
+    { s_alloc_counter.store(_counter, std::memory_order_relaxed); }
+
+    // Stats of the last decode on the calling thread
+    static const decode_stats& last() { return s_last; }
+
+#ifdef FUMEN_INSTRUMENT
+    // Measures one decode call; nested decodes add to the outermost one
+    class call_scope {
+    private:
+        u64 m_cycles, m_allocs;
+
+    public:
+        explicit call_scope(u64 _bytes) {
+            if (s_depth++ == 0) s_last = decode_stats();
+
+            s_last.m_calls++;
+            s_last.m_bytes += _bytes;
+
+            m_cycles = cycles();
+            m_allocs = s_allocs();
+        }
+
+        ~call_scope() {
+            s_last.m_total.m_calls++;
+            s_last.m_total.m_cycles += cycles() - m_cycles;
+            s_last.m_total.m_allocs += s_allocs() - m_allocs;
+            s_depth--;
+        }
+
+        call_scope(const call_scope&) = delete;
+        call_scope& operator=(const call_scope&) = delete;
+    };
+
+    class stage_scope {
+    private:
+        stage_stats& m_stats;
+        u64 m_cycles, m_allocs;
+
+    public:
+        explicit stage_scope(decode_stage _stage)
+        : m_stats(s_last[_stage]), m_cycles(cycles()), m_allocs(s_allocs()) {}
+
+        ~stage_scope() {
+            m_stats.m_calls++;
+            m_stats.m_cycles += cycles() - m_cycles;
+            m_stats.m_allocs += s_allocs() - m_allocs;
+        }
+
+        stage_scope(const stage_scope&) = delete;
+        stage_scope& operator=(const stage_scope&) = delete;
+    };
+
+    static void page() { s_last.m_pages++; }
+#else
+    class call_scope {
+    public:
+        constexpr explicit call_scope(u64) {}
+    };
+
+    class stage_scope {
+    public:
+        constexpr explicit stage_scope(decode_stage) {}
+    };
+
+    static constexpr void page() {}
+#endif
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <mutex>
+#include <shared_mutex>
+
+#include <details/intdef.hpp>
+
+#include <details/inner_field.hpp>
+#include <details/field.hpp>
+
+namespace fumen::details {
+
+/*
+ * Deduplicates comments and fields of decoded pages. Interned values are
+ * immutable, so pages only store a string_view (valid while the pool is
+ * alive) or a shared_ptr to the field. A pool can be shared by concurrent
+ * decodes; lookups take a shared lock and only new values take the
+ * exclusive one.
+ */
+class intern_pool {
+public:
+    intern_pool() = default;
+    intern_pool(const intern_pool&) = delete;
+    intern_pool& operator=(const intern_pool&) = delete;
+
+private:
+    struct field_entry {
+        std::string m_key;
+        std::shared_ptr<const field> m_field;
+    };
+
+    mutable std::shared_mutex m_mutex;
+
+    // std::deque keeps elements in place, so views into them stay valid
+    std::deque<std::string> m_comments;
+    std::unordered_map<std::string_view, u32> m_comment_ids;
+
+    std::deque<field_entry> m_fields;
+    std::unordered_map<std::string_view, u32> m_field_ids;
+
+    template <typename Map, typename Insert>
+    static u32 s_find_or_insert(
+        std::shared_mutex& _mutex, Map& _ids, std::string_view _key, Insert _insert_fn
+    ) {
+        {
+            std::shared_lock<std::shared_mutex> _lock(_mutex);
+
+            auto _it = _ids.find(_key);
+            if (_it != _ids.end()) return _it->second;
+        }
+
+        std::unique_lock<std::shared_mutex> _lock(_mutex);
+
+        auto _it = _ids.find(_key);
+        if (_it != _ids.end()) return _it->second;
+
+        return _insert_fn();
+    }
+
+public:
+    // Packs the cells of _field as the lookup key for fields
+    static std::string field_key(const inner_field& _field) {
+        const play_field::storage_type
+            &_pieces = _field.field(),
+            &_garbage = _field.garbage();
+
+        std::string _key(_pieces.size() + _garbage.size(), '\0');
+        std::copy(_pieces.begin(), _pieces.end(), reinterpret_cast<piece_type*>(_key.data()));
+        std::copy(
+            _garbage.begin(), _garbage.end(),
+            reinterpret_cast<piece_type*>(_key.data()) + _pieces.size()
+        );
+
+        return _key;
+    }
+
+    std::string_view intern(std::string_view _str) {
+        u32 _id = s_find_or_insert(m_mutex, m_comment_ids, _str, [&] {
+            u32 _new_id = m_comments.size();
+
+            m_comments.emplace_back(_str);
+            m_comment_ids.emplace(m_comments.back(), _new_id);
+
+            return _new_id;
+        });
+
+        std::shared_lock<std::shared_mutex> _lock(m_mutex);
+        return m_comments[_id];
+    }
+
+    std::shared_ptr<const field> intern(const inner_field& _field) {
+        std::string _key = field_key(_field);
+
+        u32 _id = s_find_or_insert(m_mutex, m_field_ids, _key, [&] {
+            u32 _new_id = m_fields.size();
+
+            m_fields.push_back({ std::move(_key), std::make_shared<const field>(_field) });
+            m_field_ids.emplace(m_fields.back().m_key, _new_id);
+
+            return _new_id;
+        });
+
+        std::shared_lock<std::shared_mutex> _lock(m_mutex);
+        return m_fields[_id].m_field;
+    }
+
+    std::size_t comment_count() const {
+        std::shared_lock<std::shared_mutex> _lock(m_mutex);
+        return m_comments.size();
+    }
+
+    std::size_t field_count() const {
+        std::shared_lock<std::shared_mutex> _lock(m_mutex);
+        return m_fields.size();
+    }
+};
+
+}
\ No newline at end of file
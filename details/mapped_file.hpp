@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <details/intdef.hpp>
+
+namespace fumen::details {
+
+/*
+ * A read-only memory mapping of a whole file (POSIX). The mapping stays
+ * valid while the object is alive, so views into it can be handed out
+ * without copying. An empty file maps to an empty view.
+ */
+class mapped_file {
+public:
+    mapped_file() = default;
+
+    explicit mapped_file(const std::string& _path) {
+        int _fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (_fd < 0) s_throw("open " + _path);
+
+        struct stat _st {};
+        if (::fstat(_fd, &_st) != 0) {
+            ::close(_fd);
+            s_throw("stat " + _path);
+        }
+
+        m_size = static_cast<std::size_t>(_st.st_size);
+        m_mtime = static_cast<i64>(_st.st_mtim.tv_sec) * 1000000000 + _st.st_mtim.tv_nsec;
+
+        if (m_size != 0) {
+            void* _addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (_addr == MAP_FAILED) {
+                ::close(_fd);
+                s_throw("mmap " + _path);
+            }
+
+            m_data = static_cast<const char*>(_addr);
+        }
+
+        ::close(_fd);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& _other) noexcept
+    : m_data(std::exchange(_other.m_data, nullptr)), m_size(std::exchange(_other.m_size, 0)),
+      m_mtime(std::exchange(_other.m_mtime, 0)) {}
+
+    mapped_file& operator=(mapped_file&& _other) noexcept {
+        if (this != &_other) {
+            m_unmap();
+            m_data = std::exchange(_other.m_data, nullptr);
+            m_size = std::exchange(_other.m_size, 0);
+            m_mtime = std::exchange(_other.m_mtime, 0);
+        }
+        return *this;
+    }
+
+    ~mapped_file() { m_unmap(); }
+
+private:
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+    i64 m_mtime = 0;
+
+    [[noreturn]] static void s_throw(const std::string& _what)
+    { throw std::system_error(errno, std::generic_category(), _what); }
+
+    void m_unmap() {
+        if (m_data) ::munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+        m_mtime = 0;
+    }
+
+public:
+    enum class access { normal, sequential, random };
+
+    // Hints the expected access pattern to the kernel
+    void advise(access _access) const {
+        if (!m_data) return;
+
+        int _advice = _access == access::sequential ? MADV_SEQUENTIAL :
+            _access == access::random ? MADV_RANDOM : MADV_NORMAL;
+        ::madvise(const_cast<char*>(m_data), m_size, _advice);
+    }
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+    // Modification time in nanoseconds, from the descriptor that was mapped
+    i64 mtime() const { return m_mtime; }
+    bool empty() const { return m_size == 0; }
+
+    std::string_view view() const { return { m_data, m_size }; }
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <string>
+
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <memory_resource>
+
+#include <details/intdef.hpp>
+#include <details/inner_field.hpp>
+#include <details/field.hpp>
+#include <details/decoder.hpp>
+#include <details/encoder.hpp>
+
+namespace fumen::details {
+
+// 128-bit hash of the decoded content of a fumen
+struct fingerprint {
+    u64 m_hi = 0, m_lo = 0;
+
+    bool operator==(const fingerprint& _other) const
+    { return m_hi == _other.m_hi && m_lo == _other.m_lo; }
+
+    bool operator!=(const fingerprint& _other) const { return !(*this == _other); }
+
+    std::string to_string() const {
+        static constexpr char s_hex[] = "0123456789abcdef";
+
+        std::string _str(32, '0');
+        for (u32 _i = 0; _i < 16; _i++) {
+            _str[15 - _i] = s_hex[m_hi >> (_i * 4) & 0xF];
+            _str[31 - _i] = s_hex[m_lo >> (_i * 4) & 0xF];
+        }
+
+        return _str;
+    }
+};
+
+struct fingerprint_hash {
+    std::size_t operator()(const fingerprint& _fp) const
+    { return static_cast<std::size_t>(_fp.m_lo ^ _fp.m_hi * 0x9E3779B97F4A7C15ull); }
+};
+
+/*
+ * Two 64-bit multiply-rotate lanes over 8-byte words, mixed at the end.
+ * Not cryptographic; collisions are negligible at corpus scale.
+ */
+class fingerprint_hasher {
+private:
+    static constexpr u64
+        s_p1 = 0x9E3779B185EBCA87ull, s_p2 = 0xC2B2AE3D27D4EB4Full,
+        s_p3 = 0x165667B19E3779F9ull, s_p4 = 0x85EBCA77C2B2AE63ull;
+
+    u64 m_a = 0x243F6A8885A308D3ull, m_b = 0x13198A2E03707344ull, m_words = 0;
+
+    static constexpr u64 s_rotl(u64 _x, u32 _r) { return _x << _r | _x >> (64 - _r); }
+
+    static constexpr u64 s_mix(u64 _x) {
+        _x ^= _x >> 33; _x *= 0xFF51AFD7ED558CCDull;
+        _x ^= _x >> 33; _x *= 0xC4CEB9FE1A85EC53ull;
+        return _x ^ _x >> 33;
+    }
+
+public:
+    void add(u64 _word) {
+        m_a = s_rotl(m_a ^ _word * s_p1, 31) * s_p2;
+        m_b = s_rotl(m_b + _word * s_p3, 27) * s_p4 + m_a;
+        m_words++;
+    }
+
+    // Bytes, with their length so that adjacent strings cannot run together
+    void add(const void* _data, std::size_t _size) {
+        const char* _bytes = static_cast<const char*>(_data);
+
+        add(_size);
+        for (; _size >= 8; _bytes += 8, _size -= 8) {
+            u64 _word;
+            std::memcpy(&_word, _bytes, 8);
+            add(_word);
+        }
+
+        if (_size) {
+            u64 _word = 0;
+            std::memcpy(&_word, _bytes, _size);
+            add(_word);
+        }
+    }
+
+    // The field, operation, public flags and comment of a decoded page
+    template <typename Page>
+    void add_page(const Page& _page) {
+        const auto& _field = _page.m_inner_field;
+        add(_field.field().data(), _field.field().size());
+        add(_field.garbage().data(), _field.garbage().size());
+
+        u64 _op = 0;
+        if (const std::optional<field_operation>& _o = _page.m_operation)
+            _op = 1ull << 40 | u64(_o->m_y) << 24 | u64(_o->m_x) << 16 |
+                u64(_o->m_rotation) << 8 | u64(_o->m_piece);
+        add(_op << 8 | (_page.m_flags.all & 0x0F));
+
+        std::string_view _comment = _page.m_comment ? std::string_view(*_page.m_comment) : std::string_view();
+        add(_comment.data(), _comment.size());
+    }
+
+    fingerprint finish() const {
+        u64 _a = s_mix(m_a ^ m_words), _b = s_mix(m_b + _a);
+        return { _b, s_mix(_a ^ _b) };
+    }
+};
+
+/*
+ * Canonical form of fumen data. Different editors write the same content
+ * in different ways ('?' breaks, m/d prefixes, v110, repeated comments,
+ * split repeat counters); the canonical form is what the encoder writes
+ * for the decoded pages. Pages are streamed from the decoder into the
+ * encoder one at a time and never converted to fumen_page.
+ */
+/* static */ class normalizer {
+private:
+    // A decoded page as the encoder reads it
+    struct page_view {
+        const pmr_inner_field& m_field;
+        const std::optional<field_operation>& m_operation;
+        const std::optional<std::pmr::string>& m_comment;
+        pmr_page::flags m_flags;
+    };
+
+public:
+    // Appends "v115@" and the canonical data of _data to _out. Returns the
+    // fingerprint of the content, which is equal for equal canonical forms.
+    template <typename String>
+    static fingerprint normalize(
+        std::string_view _data, String& _out,
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) {
+        fingerprint_hasher _hasher;
+        encoder::stream _stream(_resource);
+
+        decoder::decode<pmr_inner_field, std::pmr::string>(_data, [&] (pmr_page&& _page) {
+            _hasher.add_page(_page);
+            _stream.add(page_view { _page.m_inner_field, _page.m_operation, _page.m_comment, _page.m_flags });
+        }, _resource);
+
+        _out += "v115@";
+        _stream.finish(_out);
+
+        return _hasher.finish();
+    }
+
+    // The fingerprint alone, without encoding
+    static fingerprint fingerprint_of(
+        std::string_view _data,
+        std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) {
+        fingerprint_hasher _hasher;
+
+        decoder::decode<pmr_inner_field, std::pmr::string>(_data, [&] (pmr_page&& _page) {
+            _hasher.add_page(_page);
+        }, _resource);
+
+        return _hasher.finish();
+    }
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <string>
+
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+#include <details/intdef.hpp>
+#include <details/defs.hpp>
+#include <details/inner_field.hpp>
+#include <details/field.hpp>
+#include <details/decoder.hpp>
+
+namespace fumen::details {
+
+/*
+ * Pages of many fumens stored by column, for scans that read one attribute
+ * of every page. Each page has an entry in four arrays:
+ *
+ *   operations   u32: piece, rotation << 4, x << 8 and y << 16, x and y as
+ *                signed bytes (0 for no operation)
+ *   flags        u8, as basic_page::flags::all
+ *   comments     u32 index into a table of distinct comments
+ *   fields       u32 index into an arena of fields of field_size cells,
+ *                the playfield then the garbage row
+ *
+ * A page whose field equals the one of the page before it shares its
+ * arena entry, so replays store one field per placement at most. Pages
+ * are appended a fumen at a time, either straight from the decoder or
+ * from decoded pages.
+ */
+class page_store {
+public:
+    static constexpr u32 field_size = PLAY_BLOCKS + FIELD_WIDTH;
+
+    static u32 pack_operation(const std::optional<field_operation>& _op) {
+        if (!_op || _op->m_piece == piece_type::empty) return 0;
+
+        i32 _x = static_cast<i32>(_op->m_x), _y = static_cast<i32>(_op->m_y);
+        if (_x < INT8_MIN || _x > INT8_MAX || _y < INT8_MIN || _y > INT8_MAX)
+            throw std::invalid_argument("Operation out of range");
+
+        return static_cast<u8>(_op->m_piece) | static_cast<u8>(_op->m_rotation) << 4
+            | static_cast<u32>(static_cast<u8>(_x)) << 8 | static_cast<u32>(static_cast<u8>(_y)) << 16;
+    }
+
+    static std::optional<field_operation> unpack_operation(u32 _value) {
+        piece_type _piece = static_cast<piece_type>(_value & 0xF);
+        if (_piece == piece_type::empty) return std::nullopt;
+
+        return field_operation {
+            _piece, static_cast<rotation_type>(_value >> 4 & 3),
+            static_cast<u32>(static_cast<i8>(_value >> 8 & 0xFF)),
+            static_cast<u32>(static_cast<i8>(_value >> 16 & 0xFF))
+        };
+    }
+
+private:
+    // First page of each fumen, and the page count last
+    std::vector<u64> m_fumens { 0 };
+
+    std::vector<u32> m_operations;
+    std::vector<u8> m_flags;
+    std::vector<u32> m_comment_ids;
+    std::vector<u32> m_field_ids;
+
+    std::vector<piece_type> m_cells;
+
+    // std::deque keeps elements in place, so views into them stay valid
+    std::deque<std::string> m_comments;
+    std::unordered_map<std::string_view, u32> m_comment_index;
+
+    // m_inner_field of decoder pages, preferred over m_field of fumen_page
+    template <typename Page>
+    static auto s_field(const Page& _page, int) -> decltype((_page.m_inner_field)) { return _page.m_inner_field; }
+
+    template <typename Page>
+    static auto s_field(const Page& _page, long) -> decltype((_page.m_field.inner())) { return _page.m_field.inner(); }
+
+    template <typename String>
+    static std::string_view s_comment(const std::optional<String>& _comment)
+    { return _comment ? std::string_view(*_comment) : std::string_view(); }
+
+    template <typename String>
+    static std::string_view s_comment(const String& _comment) { return std::string_view(_comment); }
+
+    u32 m_intern(std::string_view _comment) {
+        auto _it = m_comment_index.find(_comment);
+        if (_it != m_comment_index.end()) return _it->second;
+
+        u32 _id = static_cast<u32>(m_comments.size());
+        m_comment_index.emplace(m_comments.emplace_back(_comment), _id);
+
+        return _id;
+    }
+
+    // Arena index of _field, shared with the previous page of the fumen
+    // if that has the same field
+    template <typename Allocator>
+    u32 m_field_id(const basic_inner_field<Allocator>& _field) {
+        const auto &_cells = _field.field(), &_garbage = _field.garbage();
+
+        if (m_field_ids.size() > m_fumens.back()) {
+            const piece_type* _prev = m_cells.data() + static_cast<u64>(m_field_ids.back()) * field_size;
+
+            if (std::equal(_cells.begin(), _cells.end(), _prev) &&
+                std::equal(_garbage.begin(), _garbage.end(), _prev + PLAY_BLOCKS))
+                return m_field_ids.back();
+        }
+
+        if (m_cells.size() / field_size >= UINT32_MAX)
+            throw std::length_error("Page store full");
+
+        u32 _id = static_cast<u32>(m_cells.size() / field_size);
+        m_cells.insert(m_cells.end(), _cells.begin(), _cells.end());
+        m_cells.insert(m_cells.end(), _garbage.begin(), _garbage.end());
+
+        return _id;
+    }
+
+    template <typename Allocator>
+    void m_push(u32 _op, u8 _flags, std::string_view _comment, const basic_inner_field<Allocator>& _field) {
+        m_field_ids.push_back(m_field_id(_field));
+        m_operations.push_back(_op);
+        m_flags.push_back(_flags);
+        m_comment_ids.push_back(m_intern(_comment));
+    }
+
+    // Drops the pages of a fumen that failed halfway, and the comments it
+    // interned after the first _comments
+    void m_rollback(u32 _comments) {
+        u64 _first = m_fumens.back();
+
+        while (m_comments.size() > _comments) {
+            m_comment_index.erase(m_comments.back());
+            m_comments.pop_back();
+        }
+
+        m_operations.resize(_first);
+        m_flags.resize(_first);
+        m_comment_ids.resize(_first);
+
+        u64 _cells = m_cells.size();
+        while (m_field_ids.size() > _first) {
+            _cells = std::min<u64>(_cells, static_cast<u64>(m_field_ids.back()) * field_size);
+            m_field_ids.pop_back();
+        }
+        m_cells.resize(_cells);
+    }
+
+public:
+    /*
+     * Decodes _data straight into the store and returns the index of the
+     * fumen. Throws as decoder::decode, adding no pages.
+     */
+    u32 decode(std::string_view _data) {
+        u32 _comments = comment_count();
+
+        try {
+            decoder::decode(_data, [&] (page&& _page) {
+                m_push(pack_operation(_page.m_operation), _page.m_flags.all,
+                    s_comment(_page.m_comment), _page.m_inner_field);
+            });
+        } catch (...) {
+            m_rollback(_comments);
+            throw;
+        }
+
+        m_fumens.push_back(m_operations.size());
+        return fumen_count() - 1;
+    }
+
+    /*
+     * Appends decoded pages as one fumen and returns its index. Pages can be
+     * any type with m_field (or m_inner_field), m_comment, m_operation and
+     * m_flags.all. Throws invalid_argument, adding no pages, if an operation
+     * is too far off the field to be stored.
+     */
+    template <typename Pages>
+    u32 add(const Pages& _pages) {
+        u32 _comments = comment_count();
+
+        try {
+            for (const auto& _page : _pages)
+                m_push(pack_operation(_page.m_operation), _page.m_flags.all, s_comment(_page.m_comment), s_field(_page, 0));
+        } catch (...) {
+            m_rollback(_comments);
+            throw;
+        }
+
+        m_fumens.push_back(m_operations.size());
+        return fumen_count() - 1;
+    }
+
+    /* Columns, one entry per page */
+
+    const std::vector<u32>& operations() const { return m_operations; }
+    const std::vector<u8>& flags() const { return m_flags; }
+    const std::vector<u32>& comment_ids() const { return m_comment_ids; }
+    const std::vector<u32>& field_ids() const { return m_field_ids; }
+
+    /* Tables */
+
+    std::string_view comment(u32 _id) const { return m_comments.at(_id); }
+    u32 comment_count() const { return static_cast<u32>(m_comments.size()); }
+
+    // field_size cells of field _id, the garbage row last
+    const piece_type* cells(u32 _id) const {
+        if (static_cast<u64>(_id) * field_size >= m_cells.size())
+            throw std::out_of_range("Field index out of range");
+
+        return m_cells.data() + static_cast<u64>(_id) * field_size;
+    }
+
+    u32 field_count() const { return static_cast<u32>(m_cells.size() / field_size); }
+
+    /* Pages */
+
+    u32 fumen_count() const { return static_cast<u32>(m_fumens.size() - 1); }
+    u64 page_count() const { return m_operations.size(); }
+
+    // Global indices [first, last) of the pages of fumen _idx
+    std::pair<u64, u64> fumen(u32 _idx) const {
+        if (_idx >= fumen_count()) throw std::out_of_range("Fumen index out of range");
+        return { m_fumens[_idx], m_fumens[_idx + 1] };
+    }
+
+    inner_field field(u64 _page) const {
+        const piece_type* _cells = cells(m_field_ids.at(_page));
+
+        inner_field _field;
+        for (u32 _i = 0; _i < PLAY_BLOCKS; _i++) _field.set_number_field_at(_i, _cells[_i]);
+        for (u32 _i = 0; _i < FIELD_WIDTH; _i++) _field.set_number_garbage_at(_i, _cells[PLAY_BLOCKS + _i]);
+
+        return _field;
+    }
+
+    std::optional<field_operation> operation(u64 _page) const { return unpack_operation(m_operations.at(_page)); }
+
+    std::string_view comment_of(u64 _page) const { return m_comments[m_comment_ids.at(_page)]; }
+
+    void reserve(u64 _pages) {
+        m_operations.reserve(_pages);
+        m_flags.reserve(_pages);
+        m_comment_ids.reserve(_pages);
+        m_field_ids.reserve(_pages);
+    }
+};
+
+}
\ No newline at end of file
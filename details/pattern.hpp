@@ -0,0 +1,257 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+
+#include <details/intdef.hpp>
+#include <details/defs.hpp>
+#include <details/inner_field.hpp>
+#include <details/field.hpp>
+
+namespace fumen::details {
+
+/*
+ * A board shape to search for, as rows of cells that must be filled, must
+ * be empty, or may be anything. Only occupancy is compared, not the
+ * piece colors. A floating pattern matches at any height; an anchored one
+ * only with its lowest row on the floor.
+ */
+struct board_pattern {
+    using row_mask = u16;
+
+    struct row {
+        row_mask m_filled = 0, m_empty = 0;
+
+        bool matches(row_mask _mask) const
+        { return (_mask & m_filled) == m_filled && !(_mask & m_empty); }
+    };
+
+    // Lowest row first
+    std::vector<row> m_rows;
+    bool m_anchored = false;
+
+    /*
+     * Rows from top to bottom as in field::to_string, separated by '\n' or
+     * '|'. '_' is an empty cell; '.', '?' and '*' are wildcards; the piece
+     * letters and 'X' are filled cells. Rows shorter than the field width
+     * are padded with wildcards.
+     */
+    static board_pattern parse(std::string_view _text, bool _anchored = false) {
+        board_pattern _pattern;
+        _pattern.m_anchored = _anchored;
+
+        for (std::string_view _rest = _text; ; ) {
+            std::size_t _end = _rest.find_first_of("\n|");
+            std::string_view _line = _rest.substr(0, _end);
+            if (!_line.empty() && _line.back() == '\r') _line.remove_suffix(1);
+
+            if (_line.size() > FIELD_WIDTH)
+                throw std::invalid_argument("Pattern row longer than the field");
+
+            row _row;
+            for (u32 _x = 0; _x < _line.size(); _x++) {
+                char _c = _line[_x];
+
+                if (_c == '_') _row.m_empty |= 1u << _x;
+                else if (_c == '.' || _c == '?' || _c == '*') continue;
+                else if (std::string_view("ILOZTJSX").find(_c) != std::string_view::npos) _row.m_filled |= 1u << _x;
+                else throw std::invalid_argument("Invalid pattern cell");
+            }
+
+            if (!_line.empty()) _pattern.m_rows.push_back(_row);
+
+            if (_end == std::string_view::npos) break;
+            _rest.remove_prefix(_end + 1);
+        }
+
+        if (_pattern.m_rows.size() > FIELD_HEIGHT)
+            throw std::invalid_argument("Pattern taller than the field");
+
+        std::reverse(_pattern.m_rows.begin(), _pattern.m_rows.end());
+        return _pattern;
+    }
+
+    // The occupied rows of _field, every cell fixed, up to its highest block
+    template <typename Allocator>
+    static board_pattern exact(const basic_inner_field<Allocator>& _field, bool _anchored = true) {
+        board_pattern _pattern;
+        _pattern.m_anchored = _anchored;
+
+        std::array<row_mask, FIELD_HEIGHT> _masks = row_masks(_field);
+        u32 _top = FIELD_HEIGHT;
+        while (_top > 0 && !_masks[_top - 1]) _top--;
+
+        for (u32 _y = 0; _y < _top; _y++)
+            _pattern.m_rows.push_back({ _masks[_y], static_cast<row_mask>(~_masks[_y] & full_row) });
+
+        return _pattern;
+    }
+
+    static constexpr row_mask full_row = (1u << FIELD_WIDTH) - 1;
+
+    // Occupancy of each row of the playfield, bit x for column x
+    template <typename Allocator>
+    static std::array<row_mask, FIELD_HEIGHT> row_masks(const basic_inner_field<Allocator>& _field) {
+        std::array<row_mask, FIELD_HEIGHT> _masks {};
+        const auto& _cells = _field.field();
+
+        for (u32 _y = 0; _y < FIELD_HEIGHT; _y++)
+            for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+                if (_cells[_x + _y * FIELD_WIDTH] != piece_type::empty)
+                    _masks[_y] |= 1u << _x;
+
+        return _masks;
+    }
+
+    // Lowest row of _masks at which the pattern matches, or -1
+    i32 match(const row_mask* _masks) const {
+        u32 _height = static_cast<u32>(m_rows.size());
+        if (_height > FIELD_HEIGHT) return -1;
+
+        for (u32 _base = 0, _last = m_anchored ? 0 : FIELD_HEIGHT - _height; _base <= _last; _base++) {
+            u32 _r = 0;
+            while (_r < _height && m_rows[_r].matches(_masks[_base + _r])) _r++;
+            if (_r == _height) return static_cast<i32>(_base);
+        }
+
+        return -1;
+    }
+};
+
+/*
+ * An inverted index from row occupancy to the pages having a row with that
+ * occupancy. A query looks up the pattern row with the fewest candidate
+ * pages (summed over all masks it accepts, wildcards included), then
+ * verifies each candidate against the stored row masks of its page.
+ * Empty rows are not indexed, since nearly every page has one; patterns
+ * with no filled cell fall back to checking every page.
+ *
+ * Pages are added in any order and can be added between queries. Queries
+ * are const and may run concurrently, but not alongside add().
+ */
+class pattern_index {
+public:
+    using row_mask = board_pattern::row_mask;
+
+    struct hit {
+        u64 m_fumen;
+        u32 m_page;
+        // Playfield row on which the lowest pattern row matched
+        u32 m_row;
+    };
+
+private:
+    static constexpr u32 s_masks = 1u << FIELD_WIDTH;
+
+    struct page_ref {
+        u64 m_fumen;
+        u32 m_page;
+    };
+
+    std::vector<page_ref> m_pages;
+    // FIELD_HEIGHT row masks per page, in page order
+    std::vector<row_mask> m_rows;
+    // Ordinals of the pages having a row equal to the mask, increasing
+    std::array<std::vector<u32>, s_masks> m_postings;
+
+    // Candidate pages of _row: the postings of every mask it accepts
+    u64 m_cost(const board_pattern::row& _row) const {
+        if (!_row.m_filled) return m_pages.size();
+
+        u64 _cost = 0;
+        for (u32 _m = 1; _m < s_masks; _m++)
+            if (_row.matches(static_cast<row_mask>(_m))) _cost += m_postings[_m].size();
+
+        return _cost;
+    }
+
+public:
+    // Indexes one page; returns its ordinal
+    template <typename Allocator>
+    u32 add(u64 _fumen, u32 _page, const basic_inner_field<Allocator>& _field) {
+        if (m_pages.size() >= UINT32_MAX)
+            throw std::length_error("Pattern index full");
+
+        u32 _ordinal = static_cast<u32>(m_pages.size());
+        m_pages.push_back({ _fumen, _page });
+
+        std::array<row_mask, FIELD_HEIGHT> _masks = board_pattern::row_masks(_field);
+        m_rows.insert(m_rows.end(), _masks.begin(), _masks.end());
+
+        for (row_mask _mask : _masks) {
+            std::vector<u32>& _list = m_postings[_mask];
+            if (_mask && (_list.empty() || _list.back() != _ordinal)) _list.push_back(_ordinal);
+        }
+
+        return _ordinal;
+    }
+
+    template <typename Allocator>
+    u32 add(u64 _fumen, u32 _page, const basic_field<Allocator>& _field) { return add(_fumen, _page, _field.inner()); }
+
+    // Indexes every page of a decoded fumen
+    template <typename Pages>
+    void add_pages(u64 _fumen, const Pages& _pages) {
+        u32 _i = 0;
+        for (const auto& _page : _pages) add(_fumen, _i++, _page.m_inner_field);
+    }
+
+    /*
+     * Pages matching _pattern, ordered by fumen and page, at most _limit of
+     * them. A pattern with no rows matches every page.
+     */
+    std::vector<hit> query(const board_pattern& _pattern, std::size_t _limit = SIZE_MAX) const {
+        std::vector<hit> _hits;
+        if (_pattern.m_rows.size() > FIELD_HEIGHT) return _hits;
+
+        const board_pattern::row* _best = nullptr;
+        u64 _best_cost = m_pages.size();
+        for (const board_pattern::row& _row : _pattern.m_rows) {
+            u64 _cost = m_cost(_row);
+            if (_cost < _best_cost) _best = &_row, _best_cost = _cost;
+        }
+
+        auto _verify = [&] (u32 _ordinal) {
+            i32 _base = _pattern.match(m_rows.data() + static_cast<u64>(_ordinal) * FIELD_HEIGHT);
+            if (_base >= 0)
+                _hits.push_back({ m_pages[_ordinal].m_fumen, m_pages[_ordinal].m_page, static_cast<u32>(_base) });
+        };
+
+        if (!_best) {
+            for (u32 _i = 0; _i < m_pages.size(); _i++) _verify(_i);
+        } else {
+            std::vector<u32> _candidates;
+            _candidates.reserve(_best_cost);
+
+            for (u32 _m = 1; _m < s_masks; _m++)
+                if (_best->matches(static_cast<row_mask>(_m)))
+                    _candidates.insert(_candidates.end(), m_postings[_m].begin(), m_postings[_m].end());
+
+            std::sort(_candidates.begin(), _candidates.end());
+            _candidates.erase(std::unique(_candidates.begin(), _candidates.end()), _candidates.end());
+
+            for (u32 _i : _candidates) _verify(_i);
+        }
+
+        std::sort(_hits.begin(), _hits.end(), [] (const hit& _a, const hit& _b) {
+            return _a.m_fumen != _b.m_fumen ? _a.m_fumen < _b.m_fumen : _a.m_page < _b.m_page;
+        });
+        if (_hits.size() > _limit) _hits.resize(_limit);
+
+        return _hits;
+    }
+
+    u64 page_count() const { return m_pages.size(); }
+
+    void reserve(u64 _pages) {
+        m_pages.reserve(_pages);
+        m_rows.reserve(_pages * FIELD_HEIGHT);
+    }
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <utility>
+
+#include <algorithm>
+
+#include <details/intdef.hpp>
+
+#include <details/defs.hpp>
+#include <details/inner_field.hpp>
+
+namespace fumen::details {
+
+/*
+ * A field with the same interface as inner_field for the operations the
+ * decoder runs, stored as refcounted immutable rows behind a refcounted
+ * row table. Copies share everything; the first write to a shared table
+ * or row clones only that table or row (copy-on-write). Empty rows are
+ * null and never allocated, and line clears / garbage rises only move row
+ * pointers, so a history of fields costs memory in proportion to the rows
+ * that actually changed between pages.
+ */
+class persistent_field {
+public:
+    static constexpr u32 row_count = FIELD_HEIGHT + GARBAGE_LINE;
+
+private:
+    struct row {
+        std::atomic<u32> m_refs { 1 };
+        std::array<piece_type, FIELD_WIDTH> m_cells {};
+    };
+
+    // m_rows[0] is the garbage line, m_rows[y + 1] is the field line y
+    struct node {
+        std::atomic<u32> m_refs { 1 };
+        std::array<row*, row_count> m_rows {};
+    };
+
+    node* m_node = nullptr;
+
+    template <typename T>
+    static T* s_retain(T* _ptr) {
+        if (_ptr) _ptr->m_refs.fetch_add(1, std::memory_order_relaxed);
+        return _ptr;
+    }
+
+    static void s_release(row* _row) {
+        if (_row && _row->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete _row;
+    }
+
+    static void s_release(node* _node) {
+        if (_node && _node->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            for (row* _row : _node->m_rows) s_release(_row);
+            delete _node;
+        }
+    }
+
+    static bool s_is_empty(const row* _row) {
+        return !_row || std::all_of(_row->m_cells.begin(), _row->m_cells.end(),
+            [] (piece_type _p) { return _p == piece_type::empty; });
+    }
+
+    static bool s_is_filled(const row* _row) {
+        return _row && std::all_of(_row->m_cells.begin(), _row->m_cells.end(),
+            [] (piece_type _p) { return _p != piece_type::empty; });
+    }
+
+    node* m_mutable_node() {
+        if (!m_node)
+            m_node = new node;
+        else if (m_node->m_refs.load(std::memory_order_acquire) != 1) {
+            node* _copy = new node;
+
+            for (u32 _i = 0; _i < row_count; _i++)
+                _copy->m_rows[_i] = s_retain(m_node->m_rows[_i]);
+
+            s_release(m_node);
+            m_node = _copy;
+        }
+
+        return m_node;
+    }
+
+    row* m_mutable_row(u32 _ridx) {
+        row*& _row = m_mutable_node()->m_rows[_ridx];
+
+        if (!_row)
+            _row = new row;
+        else if (_row->m_refs.load(std::memory_order_acquire) != 1) {
+            row* _copy = new row;
+            _copy->m_cells = _row->m_cells;
+
+            s_release(_row);
+            _row = _copy;
+        }
+
+        return _row;
+    }
+
+    const row* m_row(u32 _ridx) const
+    { return m_node ? m_node->m_rows[_ridx] : nullptr; }
+
+    void m_set(u32 _ridx, u32 _x, piece_type _piece) {
+        const row* _current = m_row(_ridx);
+        if ((_current ? _current->m_cells[_x] : piece_type::empty) == _piece)
+            return;
+
+        row* _row = m_mutable_row(_ridx);
+        _row->m_cells[_x] = _piece;
+
+        if (_piece == piece_type::empty && s_is_empty(_row)) {
+            s_release(_row);
+            m_node->m_rows[_ridx] = nullptr;
+        }
+    }
+
+public:
+    persistent_field() = default;
+
+    persistent_field(const persistent_field& _other)
+    : m_node(s_retain(_other.m_node)) {}
+
+    persistent_field(persistent_field&& _other) noexcept
+    : m_node(std::exchange(_other.m_node, nullptr)) {}
+
+    explicit persistent_field(const inner_field& _field) {
+        for (i32 _y = -1; _y < (i32)FIELD_HEIGHT; _y++)
+            for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+                set_number_at(_x, _y, _field.get_number_at(_x, _y));
+    }
+
+    ~persistent_field() { s_release(m_node); }
+
+    persistent_field& operator=(const persistent_field& _other) {
+        node* _node = s_retain(_other.m_node);
+        s_release(m_node);
+        m_node = _node;
+        return *this;
+    }
+
+    persistent_field& operator=(persistent_field&& _other) noexcept {
+        if (this != &_other) {
+            s_release(m_node);
+            m_node = std::exchange(_other.m_node, nullptr);
+        }
+        return *this;
+    }
+
+    piece_type get_number_at(i32 _x, i32 _y) const {
+        const row* _row = m_row(_y + GARBAGE_LINE);
+        return _row ? _row->m_cells[_x] : piece_type::empty;
+    }
+
+    void set_number_at(i32 _x, i32 _y, piece_type _piece)
+    { m_set(_y + GARBAGE_LINE, _x, _piece); }
+
+    void add_number(i32 _x, i32 _y, i8 _value) {
+        if (_value == 0) return;
+
+        set_number_at(_x, _y, static_cast<piece_type>(
+            static_cast<i8>(get_number_at(_x, _y)) + _value
+        ));
+    }
+
+    void fill(inner_operation _op) {
+        container_type _blocks = field_util::get_blocks(_op.m_piece, _op.m_rotation);
+
+        for (const auto& [_bx, _by] : _blocks)
+            set_number_at(_bx + _op.m_x, _by + _op.m_y, _op.m_piece);
+    }
+
+    void fill_all(const container_type& _cont, piece_type _piece) {
+        for (const auto& [_x, _y] : _cont)
+            set_number_at(_x, _y, _piece);
+    }
+
+    void clear_line() {
+        if (!m_node) return;
+
+        bool _any = false;
+        for (u32 _ridx = GARBAGE_LINE; _ridx < row_count; _ridx++)
+            _any = _any || s_is_filled(m_node->m_rows[_ridx]);
+
+        if (!_any) return;
+
+        node* _node = m_mutable_node();
+        u32 _top = GARBAGE_LINE;
+
+        for (u32 _ridx = GARBAGE_LINE; _ridx < row_count; _ridx++) {
+            row* _row = _node->m_rows[_ridx];
+
+            if (s_is_filled(_row)) s_release(_row);
+            else _node->m_rows[_top++] = _row;
+        }
+
+        std::fill(_node->m_rows.begin() + _top, _node->m_rows.end(), nullptr);
+    }
+
+    void rise_garbage() {
+        if (!m_node) return;
+
+        node* _node = m_mutable_node();
+
+        s_release(_node->m_rows[row_count - 1]);
+        std::copy_backward(
+            _node->m_rows.begin(), _node->m_rows.end() - 1, _node->m_rows.end()
+        );
+        _node->m_rows[0] = nullptr;
+    }
+
+    void mirror() {
+        if (!m_node) return;
+
+        for (u32 _ridx = GARBAGE_LINE; _ridx < row_count; _ridx++) {
+            const row* _row = m_row(_ridx);
+            if (!_row || std::equal(
+                _row->m_cells.begin(), _row->m_cells.end(), _row->m_cells.rbegin()
+            )) continue;
+
+            row* _mrow = m_mutable_row(_ridx);
+            std::reverse(_mrow->m_cells.begin(), _mrow->m_cells.end());
+        }
+    }
+
+    // Whether both fields share the same row table
+    bool shares(const persistent_field& _other) const
+    { return m_node == _other.m_node; }
+
+    // Whether line _y (-1 for garbage) of both fields is the same row,
+    // or empty in both
+    bool shares_row(const persistent_field& _other, i32 _y) const
+    { return m_row(_y + GARBAGE_LINE) == _other.m_row(_y + GARBAGE_LINE); }
+
+    explicit operator inner_field() const {
+        inner_field _field;
+
+        for (i32 _y = -1; _y < (i32)FIELD_HEIGHT; _y++) {
+            if (!m_row(_y + GARBAGE_LINE)) continue;
+
+            for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+                _field.set_number_at(_x, _y, get_number_at(_x, _y));
+        }
+
+        return _field;
+    }
+};
+
+}
\ No newline at end of file
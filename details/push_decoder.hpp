@@ -0,0 +1,260 @@
+#pragma once
+
+#include <string>
+
+#include <string_view>
+
+#include <details/intdef.hpp>
+#include <details/defs.hpp>
+#include <details/buffer.hpp>
+#include <details/action.hpp>
+#include <details/comments.hpp>
+#include <details/result.hpp>
+#include <details/decoder.hpp>
+
+namespace fumen::details {
+
+/*
+ * Decodes a fumen that arrives in pieces. feed() takes the next characters
+ * of the fumen, header included, and calls _on_page(page&&) for each page
+ * as soon as its last character is in; finish() then checks that the data
+ * did not stop inside a page. The pages are those decoder::decode gives.
+ *
+ * Nothing is buffered but the state of the current page: the digits of a
+ * value read so far, the cell its field diff has reached, and its comment
+ * as far as it has been decoded. The header may be split across chunks.
+ *
+ * The decode is held to the decode_limits given, the input limit counting
+ * every character fed. try_feed() and try_finish() report failures as
+ * decoder::try_decode does, offsets counting every character fed. After a
+ * failure the decoder must be reset() before it is fed again.
+ *
+ * Each feed is one call for instrument: last() holds the stats of the
+ * last chunk fed, as finishing decodes nothing.
+ */
+class push_decoder {
+private:
+    enum class phase : u8 {
+        header, page, field, counter, action, comment_length, comment
+    };
+
+    using point = decoder::resume_point<inner_field, std::string>;
+
+    static constexpr std::size_t s_header_size = 5;
+
+    // Characters fed, for the input limit
+    u64 m_fed = 0;
+
+    phase m_phase = phase::header;
+    // Set at the first '&' after the header, which ends the data
+    bool m_closed = false;
+
+    // The last characters seen while looking for the header
+    std::string m_head;
+
+    u32 m_version = 0, m_htop = 0, m_block_count = 0;
+
+    // The value being read: its digits so far, and how many it has
+    i64 m_value = 0;
+    u32 m_digits = 0, m_width = 0;
+
+    point m_state;
+
+    // The current page: the next cell of its field diff, its action and
+    // comment groups
+    u32 m_idx = 0;
+    bool m_is_changed = false;
+    action m_act;
+    i64 m_comment_len = 0, m_group = 0, m_groups = 0;
+
+    comment_codec m_comment_codec;
+
+    void m_expect(phase _phase, u32 _width) {
+        m_phase = _phase;
+        m_width = _width;
+    }
+
+    void m_find_header(char _c) {
+        m_head += _c;
+        if (m_head.size() > s_header_size) m_head.erase(0, 1);
+        if (m_head.size() < s_header_size) return;
+
+        char _p = m_head[0];
+        std::string_view _ver = std::string_view(m_head).substr(1);
+        if ((_p != 'v' && _p != 'm' && _p != 'd') || (_ver != "110@" && _ver != "115@")) return;
+
+        m_version = _ver[2] == '5' ? 115 : 110;
+        m_htop = decoder::s_height(m_version);
+        m_block_count = FIELD_WIDTH * (m_htop + GARBAGE_LINE);
+
+        m_head.clear();
+        m_phase = phase::page;
+    }
+
+    // Pages under a counter repeat the field, and start at the action
+    decode_errc m_start_page() {
+        decode_errc _errc = decoder::s_begin_page(m_state, m_block_count);
+        if (_errc != decode_errc::ok) return _errc;
+
+        if (0 < m_state.m_st_data.m_counter) {
+            m_state.m_st_data.m_counter--;
+            m_is_changed = false;
+            m_expect(phase::action, 3);
+        } else {
+            m_idx = 0;
+            m_is_changed = true;
+            m_expect(phase::field, 2);
+        }
+
+        return decode_errc::ok;
+    }
+
+    template <typename Fn>
+    decode_errc m_end_page(Fn& _on_page) {
+        decode_errc _errc = decoder::s_page<decode_parts::all>(m_state, m_act, m_is_changed, m_comment_len, true,
+            _on_page, std::pmr::get_default_resource());
+
+        m_comment_len = 0;
+        m_phase = phase::page;
+
+        return _errc;
+    }
+
+    template <typename Fn>
+    decode_errc m_digit(u8 _d, Fn& _on_page) {
+        if (m_phase == phase::page) {
+            decode_errc _errc = m_start_page();
+            if (_errc != decode_errc::ok) return _errc;
+        }
+
+        m_state.m_offset++;
+
+        m_value += static_cast<i64>(_d) << (6 * m_digits);
+        if (++m_digits < m_width) return decode_errc::ok;
+
+        i64 _value = m_value;
+        m_value = 0;
+        m_digits = 0;
+
+        switch (m_phase) {
+            case phase::field:
+                decoder::s_apply_run(_value, m_htop, m_block_count, m_idx, m_is_changed, m_state.m_field);
+                if (m_idx < m_block_count) return decode_errc::ok;
+
+                if (m_is_changed) m_expect(phase::action, 3);
+                else m_expect(phase::counter, 1);
+                return decode_errc::ok;
+
+            case phase::counter:
+                m_state.m_st_data.m_counter = static_cast<i32>(_value);
+                m_expect(phase::action, 3);
+                return decode_errc::ok;
+
+            case phase::action:
+                m_act = decode_action(static_cast<u32>(_value), m_htop);
+
+                if (!m_act.m_comment) return m_end_page(_on_page);
+
+                m_expect(phase::comment_length, 2);
+                return decode_errc::ok;
+
+            case phase::comment_length: {
+                decode_errc _errc = decoder::s_charge_comment(m_state, _value);
+                if (_errc != decode_errc::ok) return _errc;
+
+                m_comment_len = _value;
+                m_group = 0;
+                m_groups = (m_comment_len + 3) / 4;
+                m_state.m_st_data.m_escaped.resize(m_groups * comment_codec::group_size);
+
+                if (m_groups == 0) return m_end_page(_on_page);
+
+                m_expect(phase::comment, 5);
+                return decode_errc::ok;
+            }
+
+            case phase::comment:
+                m_comment_codec.decode(_value,
+                    m_state.m_st_data.m_escaped.data() + m_group * comment_codec::group_size);
+
+                if (++m_group == m_groups) return m_end_page(_on_page);
+                return decode_errc::ok;
+
+            default:
+                return decode_errc::ok;
+        }
+    }
+
+public:
+    explicit push_decoder(const decode_limits& _limits = {}) { m_state.m_limits = _limits; }
+
+    // Decodes the characters of _chunk, calling _on_page for each page
+    // completed by them
+    template <typename Fn>
+    void feed(std::string_view _chunk, Fn&& _on_page) {
+        decode_error _error = try_feed(_chunk, _on_page);
+        if (_error) _error.raise();
+    }
+
+    template <typename Fn>
+    decode_error try_feed(std::string_view _chunk, Fn&& _on_page) {
+        if (m_closed) return {};
+
+        if (_chunk.size() > m_state.m_limits.m_max_input - m_fed)
+            return { decode_errc::input_too_long, m_state.m_limits.m_max_input };
+
+        instrument::call_scope _call(_chunk.size());
+
+        u64 _at = m_fed;
+        m_fed += _chunk.size();
+
+        for (char _c : _chunk) {
+            if (m_closed) return {};
+
+            if (_c == '&') {
+                if (m_phase == phase::header) return { decode_errc::unsupported_version, _at };
+
+                m_closed = true;
+                return {};
+            }
+
+            if (m_phase == phase::header) m_find_header(_c);
+            else if (!decoder::s_is_removed(_c)) {
+                decode_errc _errc = m_digit(buffer::value_of(_c), _on_page);
+                if (_errc != decode_errc::ok) return { _errc, _at };
+            }
+
+            _at++;
+        }
+
+        return {};
+    }
+
+    // Ends the data; throws as decoder::decode if it is not a whole fumen
+    void finish() const {
+        decode_error _error = try_finish();
+        if (_error) _error.raise();
+    }
+
+    decode_error try_finish() const {
+        if (m_phase == phase::header) return { decode_errc::unsupported_version, 0 };
+        if (m_phase != phase::page) return { decode_errc::invalid_data, m_fed };
+        return {};
+    }
+
+    // Forgets everything fed, to decode another fumen under the same limits
+    void reset() { *this = push_decoder(m_state.m_limits); }
+
+    // 110 or 115 once the header is in, 0 before
+    u32 version() const { return m_version; }
+
+    u32 page_count() const { return m_state.m_pidx; }
+
+    // Data characters read after the header
+    u64 offset() const { return m_state.m_offset; }
+
+    // Whether the characters fed so far stop inside a page
+    bool in_page() const { return m_phase != phase::header && m_phase != phase::page; }
+};
+
+}
\ No newline at end of file
@@ -1,12 +1,14 @@
 #pragma once
 
-#include <format>
-
 #include <vector>
 #include <string>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <memory_resource>
 
 #include <algorithm>
-#include <regex>
+#include <stdexcept>
 
 #include <details/intdef.hpp>
 #include <details/strlib.hpp>
@@ -19,104 +21,211 @@ enum class quiz_operation {
     direct, swap, stock
 };
 
+class static_decoder;
+
 class quiz {
+    // Parses quizzes with the helpers below, in constant evaluation
+    friend class static_decoder;
+
 public:
     quiz() = default;
-    quiz(const std::string& _data) : m_data(s_verify(_data)) {}
+    quiz(const std::string& _data) {
+        if (!s_parse(_data, *this, std::pmr::get_default_resource()))
+            throw std::invalid_argument("Invalid quiz format");
+    }
+    // Keeps the parsed text in _resource
+    quiz(std::string_view _data, std::pmr::memory_resource* _resource) : m_raw(_resource) {
+        if (!s_parse(_data, *this, _resource))
+            throw std::invalid_argument("Invalid quiz format");
+    }
 
 private:
-    std::string m_data;
+    /*
+     * "#Q=[H](C)NNN;..." is stored as the hold and current piece names
+     * ('\0' if empty) and the text after "(C)", which is shared between
+     * states and consumed by moving m_pos. m_sep is the index of the bag
+     * separator (first ';') in that text. Comments which are not a quiz
+     * are kept verbatim in m_raw. Both live in the memory_resource given
+     * on construction, which states derived from this one reuse.
+     */
+    char m_hold_name = '\0', m_current_name = '\0';
+    std::shared_ptr<const std::pmr::string> m_least_data;
+    u32 m_pos = 0, m_sep = 0;
+    std::pmr::string m_raw;
+
+    static constexpr bool s_is_piece_name(char _c) {
+        switch (_c) {
+            case 'T': case 'I': case 'O': case 'S': case 'Z': case 'J': case 'L':
+            case 't': case 'i': case 'o': case 's': case 'z': case 'j': case 'l':
+                return true;
+        }
 
-    static std::string s_verify(const std::string& _data) {
-        std::string _str = strlib::strrmv(_data, [] (char c) {
-            return !(c == ' ' || c == '\t' || c == '\n' || c == '\r');
-        });
+        return false;
+    }
+
+    static constexpr bool s_is_space(char _c)
+    { return _c == ' ' || _c == '\t' || _c == '\n' || _c == '\r'; }
+
+    // Text kept as it is rather than parsed as a quiz
+    static constexpr bool s_is_plain(std::string_view _data)
+    { return _data == "#Q=[]()" || !is_quiz_comment(_data); }
+
+    // The "#Q=[H](C)" a quiz without whitespace starts with: the hold and
+    // current piece names ('\0' if empty) and its length, 0 if malformed
+    struct head {
+        char m_hold = '\0', m_current = '\0';
+        std::size_t m_size = 0;
+    };
+
+    static constexpr head s_parse_head(std::string_view _str) {
+        // ^#Q=\[[TIOSZJL]?]\([TIOSZJL]?\)[TIOSZJL]*;?.*$
+        head _head;
+        std::size_t _idx = 3;
+
+        auto _expect_fn = [&] (char _c) {
+            if (_idx >= _str.size() || _str[_idx] != _c) return false;
+            _idx++;
+            return true;
+        };
+
+        auto _piece_fn = [&] () {
+            if (_idx >= _str.size() || !s_is_piece_name(_str[_idx]))
+                return '\0';
+            return _str[_idx++];
+        };
+
+        if (!_expect_fn('[')) return _head;
+        _head.m_hold = _piece_fn();
+        if (!_expect_fn(']') || !_expect_fn('(')) return _head;
+        _head.m_current = _piece_fn();
+        if (!_expect_fn(')')) return _head;
+
+        _head.m_size = _idx;
+        return _head;
+    }
+
+    // Returns false if _data starts as a quiz but is not one
+    static bool s_parse(std::string_view _data, quiz& _quiz, std::pmr::memory_resource* _resource) {
+        if (s_is_plain(_data)) {
+            _quiz.m_raw = _data;
+            return true;
+        }
 
-        if (_str.empty() || _data == "#Q=[]()" || !strlib::startswith(_data, "#Q="))
-            return _data;
-        
-        std::regex _quiz_regex(
-            R"(^#Q=\[[TIOSZJL]?]\([TIOSZJL]?\)[TIOSZJL]*;?.*$)",
-            std::regex_constants::ECMAScript | std::regex_constants::icase
+        std::pmr::string _str(_resource);
+        _str.reserve(_data.size());
+        for (char _c : _data)
+            if (!s_is_space(_c)) _str += _c;
+
+        head _head = s_parse_head(_str);
+        if (_head.m_size == 0) return false;
+
+        _quiz.m_hold_name = _head.m_hold;
+        _quiz.m_current_name = _head.m_current;
+
+        _str.erase(0, _head.m_size);
+        _quiz.m_least_data = std::allocate_shared<std::pmr::string>(
+            std::pmr::polymorphic_allocator<std::pmr::string>(_resource), std::move(_str)
+        );
+        _quiz.m_pos = 0;
+        _quiz.m_sep = std::min<std::size_t>(
+            _quiz.m_least_data->find(';'), _quiz.m_least_data->size()
         );
 
-        if (!std::regex_match(_str, _quiz_regex))
-            throw std::invalid_argument("Invalid quiz format");
-        
-        return _str;
+        return true;
     }
 
-#if __cplusplus >= 202002L
-    constexpr
-#endif
-    char m_next() const {
-        std::size_t _idx = m_data.find(')') + 1;
-        if (_idx >= m_data.size() || m_data[_idx] == ';')
-            return '\0';
-        return m_data[_idx];
+    bool m_is_quiz() const { return m_least_data != nullptr; }
+
+    std::pmr::memory_resource* m_resource() const {
+        return m_is_quiz() ?
+            m_least_data->get_allocator().resource() : m_raw.get_allocator().resource();
     }
 
-    std::string m_least() const
-    { return m_data.substr(m_data.find(')') + 1); }
+    // Empty for text that is not a quiz, so the accessors below are safe on it
+    std::string_view m_least_view() const
+    { return m_is_quiz() ? std::string_view(*m_least_data) : std::string_view(); }
+
+    u32 m_least_size() const { return m_is_quiz() ? m_least_data->size() : 0; }
+
+    char m_least_at(u32 _idx) const
+    { return _idx < m_least_size() ? (*m_least_data)[_idx] : '\0'; }
+
+    char m_next() const {
+        char _name = m_least_at(m_pos);
+        return _name == ';' ? '\0' : _name;
+    }
 
-#if __cplusplus >= 202002L
-    constexpr
-#endif
-    char m_current() const {
-        char _name = m_data[m_data.find('(') + 1];
-        return _name == ')' ? '\0' : _name;
+    // Position of the text following the next piece
+    u32 m_after_next2() const {
+        if (m_least_at(m_pos) == ';') return m_pos;
+        return std::min(m_pos + 1, m_least_size());
     }
 
-#if __cplusplus >= 202002L
-    constexpr
-#endif
-    char m_hold() const {
-        char _name = m_data[m_data.find('[') + 1];
-        return _name == ']' ? '\0' : _name;
+    // Whether this is "#Q=[]();..." and the active bag is used up
+    bool m_is_end() const {
+        return m_is_quiz() && m_hold_name == '\0' && m_current_name == '\0'
+            && m_least_at(m_pos) == ';';
     }
 
-    std::string m_least_after_next2() const {
-        std::size_t _idx = m_data.find(')');
+    std::optional<quiz> m_advance(char _hold, char _current, u32 _pos) const {
+        if ((_hold != '\0' && !s_is_piece_name(_hold)) ||
+            (_current != '\0' && !s_is_piece_name(_current)))
+            return std::nullopt;
 
-        return m_data.substr(_idx + (m_data[_idx + 1] == ';' ? 1 : 2));
+        quiz _quiz = *this;
+        _quiz.m_hold_name = _hold;
+        _quiz.m_current_name = _current;
+        _quiz.m_pos = _pos;
+
+        return _quiz;
     }
 
-    std::string m_least_in_active_bag() const {
-        std::size_t _sepidx = m_data.find(';');
-        std::string _str = 0 <= _sepidx ? m_data.substr(0, _sepidx) : m_data;
-        std::size_t _idx = _str.find(')');
+    static std::string s_compose(char _hold, const std::string& _other) {
+        std::string _str = "#Q=[";
+        if (_hold != '\0') _str += _hold;
+        _str += "](";
+        if (!_other.empty()) _str += _other[0];
+        _str += ")";
+        if (_other.size() > 1) _str.append(_other, 1);
 
-        return _str.substr(_idx + (_str[_idx + 1] == ';' ? 1 : 2));
+        return _str;
     }
 
 public:
-    static quiz create(const std::string& _first, const std::string& _second) {
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-        return quiz(std::format("#Q=[{}]({}){}", _first, _second[0], _second.substr(1)));
-#else
-        return quiz(std::string("#Q=[") + _first + "](" + _second[0] + ")" + _second.substr(1));
-#endif
-    }
+    static quiz create(const std::string& _first, const std::string& _second)
+    { return quiz(s_compose(_first.empty() ? '\0' : _first[0], _second)); }
 
-    static quiz create(const std::string& _first) {
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-        return quiz(std::format("#Q=[]({}){}", _first[0], _first.substr(1)));
-#else
-        return quiz(std::string("#Q=[](") + _first[0] + ")" + _first.substr(1));
-#endif
-    }
+    static quiz create(const std::string& _first)
+    { return quiz(s_compose('\0', _first)); }
 
-    static bool is_quiz_comment(const std::string& _str)
-    { return strlib::startswith(_str, "#Q="); }
+    static constexpr bool is_quiz_comment(std::string_view _str)
+    { return _str.substr(0, 3) == "#Q="; }
 
-    quiz_operation get_operation(piece_type _piece) const {
+    /*
+     * The functions below that can fail have a try_ form, returning
+     * nothing instead of throwing, for the decoder and the encoder, which
+     * fall back to another state when a step fails.
+     */
+
+    // The quiz of _data, or nothing if it starts as a quiz but is not one
+    static std::optional<quiz> parse(
+        std::string_view _data, std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+    ) {
+        quiz _quiz;
+        _quiz.m_raw = std::pmr::string(_resource);
+
+        if (!s_parse(_data, _quiz, _resource)) return std::nullopt;
+        return _quiz;
+    }
+
+    std::optional<quiz_operation> try_get_operation(piece_type _piece) const {
         char
             _uname = defs::to_char(_piece),
-            _cname = m_current();
-        
+            _cname = m_current_name;
+
         if (_uname == _cname) return quiz_operation::direct;
 
-        char _hold = m_hold();
+        char _hold = m_hold_name;
         if (_hold == _uname) return quiz_operation::swap;
 
         if (_hold == '\0') {
@@ -125,58 +234,76 @@ public:
             if (_cname == '\0' && _uname == m_next()) return quiz_operation::direct;
         }
 
+        return std::nullopt;
+    }
+
+    quiz_operation get_operation(piece_type _piece) const {
+        if (auto _op = try_get_operation(_piece)) return *_op;
         throw std::invalid_argument("Invalid hold piece");
     }
 
-    quiz direct() const {
-        if (m_current() == '\0') {
-            std::string _least = m_least_after_next2();
-
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-            return quiz(std::format("#Q=[{}]({}){}", m_hold(), _least[0], _least.substr(1)));
-#else
-            return quiz(std::string("#Q=[") + m_hold() + "](" + _least[0] + ")" + _least.substr(1));
-#endif
+    std::optional<quiz> try_direct() const {
+        if (!m_is_quiz()) return std::nullopt;
+
+        if (m_current_name == '\0') {
+            u32 _pos = m_after_next2();
+
+            if (_pos >= m_least_size()) return std::nullopt;
+
+            return m_advance(m_hold_name, m_least_at(_pos), _pos + 1);
         }
 
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-        return quiz(std::format("#Q=[{}]({}){}", m_hold(), m_next(), m_least_after_next2()));
-#else
-        return quiz(std::string("#Q=[") + m_hold() + "](" + m_next() + ")" + m_least_after_next2());
-#endif
+        return m_advance(m_hold_name, m_next(), m_after_next2());
+    }
+
+    std::optional<quiz> try_swap() const {
+        if (!m_is_quiz() || m_hold_name == '\0') return std::nullopt;
+
+        return m_advance(m_current_name, m_next(), m_after_next2());
+    }
+
+    std::optional<quiz> try_stock() const {
+        if (!m_is_quiz() || m_hold_name != '\0' || m_next() == '\0') return std::nullopt;
+
+        u32 _pos = m_after_next2();
+
+        return m_advance(
+            m_current_name,
+            m_least_at(_pos),
+            std::min(_pos + 1, m_least_size())
+        );
+    }
+
+    quiz direct() const {
+        if (auto _quiz = try_direct()) return std::move(*_quiz);
+        throw std::invalid_argument("Invalid quiz format");
     }
 
     quiz swap() const {
-        if (m_hold() == '\0')
+        if (!m_is_quiz() || m_hold_name == '\0')
             throw std::runtime_error("Cannot swap with no hold piece");
-        
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-        return quiz(std::format("#Q=[{}]({}){}", m_current(), m_next(), m_least_after_next2()));
-#else
-        return quiz(std::string("#Q=[") + m_current() + "](" + m_next() + ")" + m_least_after_next2());
-#endif
+
+        if (auto _quiz = try_swap()) return std::move(*_quiz);
+        throw std::invalid_argument("Invalid quiz format");
     }
 
     quiz stock() const {
-        if (m_hold() != '\0' || m_next() == '\0')
+        if (!m_is_quiz() || m_hold_name != '\0' || m_next() == '\0')
             throw std::runtime_error("Cannot stock");
-        
-        std::string _least = m_least_after_next2();
-        std::string _head = _least.empty() ? std::string() : _least.substr(0, 1);
-
-        if (_least.size() > 1) {
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-            return quiz(std::format("#Q=[{}]({}){}", m_hold(), _head, _least.substr(1)));
-#else
-            return quiz(std::string("#Q=[") + m_hold() + "](" + _head + ")" + _least.substr(1));
-#endif
-        } else {
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-            return quiz(std::format("#Q=[{}]({})", m_hold(), _head));
-#else
-            return quiz(std::string("#Q=[") + m_hold() + "](" + _head + ")");
-#endif
+
+        if (auto _quiz = try_stock()) return std::move(*_quiz);
+        throw std::invalid_argument("Invalid quiz format");
+    }
+
+    std::optional<quiz> try_operate(quiz_operation _op) const {
+        switch (_op) {
+            case quiz_operation::direct: return try_direct();
+            case quiz_operation::swap:   return try_swap();
+            case quiz_operation::stock:  return try_stock();
+            default: break;
         }
+
+        return std::nullopt;
     }
 
     quiz operate(quiz_operation _op) const {
@@ -190,88 +317,155 @@ public:
         throw std::invalid_argument("Invalid operation type");
     }
 
-    quiz format() const {
-        quiz _quiz = next_if_end();
+    // next_if_end() then operate() with the operation that places _piece,
+    // as a quiz advances when a piece is locked
+    std::optional<quiz> try_place(piece_type _piece) const {
+        std::optional<quiz> _next = try_next_if_end();
+        if (!_next || !_next->m_is_quiz()) return std::nullopt;
+
+        std::optional<quiz_operation> _op = _next->try_get_operation(_piece);
+        if (!_op) return std::nullopt;
+
+        return _next->try_operate(*_op);
+    }
+
+    std::optional<quiz> try_format() const {
+        std::optional<quiz> _next = try_next_if_end();
+        if (!_next) return std::nullopt;
+
+        const quiz& _quiz = *_next;
+
+        // A finished quiz keeps its text, as tetris-fumen's format() does
+        if (_quiz.equals("#Q=[]()")) return *this;
+
+        if (!_quiz.m_is_quiz()) return _quiz;
 
-        if (_quiz.m_data == "#Q=[]()")
-            return quiz("");
-        
         char
-            _current = m_current(),
-            _hold = m_hold();
-        
-        if (_current == '\0' && _hold == '\0') {
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-            return quiz(std::format("#Q=[]({}){}", _hold, _quiz.m_least()));
-#else
-            return quiz(std::string("#Q=[](") + _hold + ")" + _quiz.m_least());
-#endif
-        }
-        
-        if (_current == '\0') {
-            std::string _least = _quiz.m_least();
-            if (_least.empty()) return quiz("");
-
-            char _head = _least[0];
-            if (_head == ';') return quiz(_least.substr(1));
-
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-            return quiz(std::format("#Q=[]({}){}", _head, _least.substr(1)));
-#else
-            return quiz(std::string("#Q=[](") + _head + ")" + _least.substr(1));
-#endif
-        }
+            _current = _quiz.m_current_name,
+            _hold = _quiz.m_hold_name;
 
-        return _quiz;
+        if (_current != '\0') return _quiz;
+
+        if (_hold != '\0')
+            return _quiz.m_advance('\0', _hold, _quiz.m_pos);
+
+        char _head = _quiz.m_least_at(_quiz.m_pos);
+        if (_head == '\0') return quiz(std::string_view(), m_resource());
+
+        if (_head == ';')
+            return parse(_quiz.m_least_view().substr(_quiz.m_pos + 1), m_resource());
+
+        return _quiz.m_advance('\0', _head, _quiz.m_pos + 1);
+    }
+
+    quiz format() const {
+        if (auto _quiz = try_format()) return std::move(*_quiz);
+        throw std::invalid_argument("Invalid quiz format");
     }
 
     piece_type get_hold() const {
         if (!can_operate()) return piece_type::empty;
 
-        char _hold = m_hold();
-
-        if (_hold == '\0' || _hold == ';')
+        if (m_hold_name == '\0')
             return piece_type::empty;
-        
-        return defs::to_piece(_hold);
+
+        return defs::to_piece(m_hold_name);
     }
 
+    /*
+     * The current piece, the next piece and the rest of the active bag,
+     * leaving out empty slots. _max truncates the list or pads it with
+     * empty to that length; 0 returns all of it.
+     */
     std::vector<piece_type> get_nexts(i64 _max = 0) const {
         if (!can_operate()) return std::vector<piece_type>(_max, piece_type::empty);
 
-        std::string _name =
-            (std::string(m_current(), 1) + m_next() + m_least_in_active_bag())
-                .substr(0, _max);
-        
-        if (_max != 0 && (i64)_name.size() < _max)
-            _name += std::string(_max - _name.size(), ' ');
-        
+        std::string _name;
+        if (m_current_name != '\0') _name += m_current_name;
+        if (m_next() != '\0') _name += m_next();
+
+        // Pieces remaining in the active bag
+        u32 _begin = std::min(m_pos + 1, m_sep);
+        _name.append(m_least_view().substr(_begin, m_sep - _begin));
+
+        if (_max != 0) _name.resize(_max, ' ');
+
         std::vector<piece_type> _pieces(_name.size());
         std::transform(_name.begin(), _name.end(), _pieces.begin(), [] (char _c) {
-            if (_c == '\0' || _c == ' ' || _c == ';') return piece_type::empty;
+            if (_c == ' ' || _c == ';') return piece_type::empty;
             else return defs::to_piece(_c);
         });
 
         return _pieces;
     }
 
-    std::string to_string() const { return m_data; }
+    std::string to_string() const {
+        std::string _str;
+        to_string(_str);
+        return _str;
+    }
+
+    // Appends the comment of this state to _out
+    template <typename String>
+    void to_string(String& _out) const {
+        if (!m_is_quiz()) {
+            _out.append(m_raw.data(), m_raw.size());
+            return;
+        }
+
+        _out.reserve(_out.size() + 7 + m_least_size() - m_pos + 2);
+
+        _out += "#Q=[";
+        if (m_hold_name != '\0') _out += m_hold_name;
+        _out += "](";
+        if (m_current_name != '\0') _out += m_current_name;
+        _out += ")";
+        _out.append(m_least_data->data() + m_pos, m_least_size() - m_pos);
+    }
+
+    // Same as `to_string() == _str` without building the string
+    bool equals(std::string_view _str) const {
+        if (!m_is_quiz()) return m_raw == _str;
+
+        char _head[9] = "#Q=[";
+        u32 _len = 4;
+        if (m_hold_name != '\0') _head[_len++] = m_hold_name;
+        _head[_len++] = ']';
+        _head[_len++] = '(';
+        if (m_current_name != '\0') _head[_len++] = m_current_name;
+        _head[_len++] = ')';
+
+        u32 _least_len = m_least_size() - m_pos;
+
+        return _str.size() == _len + _least_len
+            && _str.compare(0, _len, _head, _len) == 0
+            && _str.compare(_len, _least_len, m_least_view(), m_pos, _least_len) == 0;
+    }
 
     bool can_operate() const {
-        std::string _quiz = m_data;
+        if (!m_is_quiz()) return false;
+
+        if (m_is_end()) {
+            u32 _begin = m_pos + 1;
 
-        if (strlib::startswith(_quiz, "#Q=[]();"))
-            _quiz = m_data.substr(8);
-        
-        return strlib::startswith(_quiz, "#Q=") && _quiz != "#Q=[]()";
+            return m_least_data->compare(_begin, 3, "#Q=") == 0
+                && m_least_data->compare(_begin, std::string::npos, "#Q=[]()") != 0;
+        }
+
+        return m_hold_name != '\0' || m_current_name != '\0' || m_pos < m_least_size();
     }
 
-    quiz next_if_end() const {
-        if (strlib::startswith(m_data, "#Q=[]();"))
-            return quiz(m_data.substr(8));
-        
+    std::optional<quiz> try_next_if_end() const {
+        if (m_is_end())
+            return parse(m_least_view().substr(m_pos + 1), m_resource());
+
         return *this;
     }
+
+    quiz next_if_end() const {
+        if (auto _quiz = try_next_if_end()) return std::move(*_quiz);
+        throw std::invalid_argument("Invalid quiz format");
+    }
 };
 
 }
\ No newline at end of file
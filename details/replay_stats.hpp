@@ -0,0 +1,492 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+
+#include <details/intdef.hpp>
+#include <details/defs.hpp>
+#include <details/simd.hpp>
+#include <details/inner_field.hpp>
+#include <details/result.hpp>
+#include <details/decoder.hpp>
+
+namespace fumen::details {
+
+// What the lock of a page did, or-ed together
+struct replay_events {
+    static constexpr u8 lock = 1;
+    // Three of the four corners around a locked T are filled, the walls
+    // and the floor counting as filled
+    static constexpr u8 tspin = 2;
+    // A T-spin with only one of the two corners the T points at filled
+    static constexpr u8 mini = 4;
+};
+
+// The shape of the top of a field
+struct replay_surface {
+    // One above the highest filled cell of each column, 0 if it is empty
+    std::array<u8, FIELD_WIDTH> m_heights {};
+    // Empty cells under the highest filled cell of their column
+    u8 m_holes = 0;
+    // Sum of the height differences of neighbouring columns
+    u8 m_bumpiness = 0;
+    // Deepest column lower than both of its neighbours, the walls being
+    // higher than any column
+    u8 m_well_depth = 0;
+};
+
+/*
+ * A field with the same interface as inner_field for the operations the
+ * decoder runs, which also keeps the occupancy of each row as a bitmask,
+ * bit x for column x. The lock simulation updates the masks as it goes:
+ * fill() tests the corners of a T before placing it, clear_line() finds
+ * full rows by comparing masks, and rise_garbage() and mirror() move
+ * them. What the last lock did is kept until the next one.
+ *
+ * Cells are kept too, since field diffs add to the piece in a cell, and
+ * both are in fixed arrays so that copies allocate nothing.
+ */
+class replay_field {
+public:
+    static constexpr u16 full_row = (1u << FIELD_WIDTH) - 1;
+
+private:
+    std::array<piece_type, PLAY_BLOCKS> m_cells {};
+    std::array<piece_type, FIELD_WIDTH> m_garbage {};
+
+    // Filled and gray cells of each row, and of the garbage row
+    std::array<u16, FIELD_HEIGHT> m_rows {}, m_gray {};
+    u16 m_garbage_row = 0, m_garbage_gray = 0;
+
+    // Bumped by every change, so that unchanged fields are not measured
+    // again
+    u32 m_changes = 0;
+
+    u32 m_locks = 0;
+    u8 m_spin = 0;
+    struct {
+        u8 m_events = 0, m_lines = 0, m_garbage_lines = 0;
+    } m_last;
+
+    void m_set(u32 _idx, piece_type _piece) {
+        u16 _bit = static_cast<u16>(1u << (_idx % FIELD_WIDTH));
+        u32 _y = _idx / FIELD_WIDTH;
+
+        m_cells[_idx] = _piece;
+        m_rows[_y] = _piece != piece_type::empty ? m_rows[_y] | _bit : m_rows[_y] & ~_bit;
+        m_gray[_y] = _piece == piece_type::gray ? m_gray[_y] | _bit : m_gray[_y] & ~_bit;
+    }
+
+    // Whether (_x, _y) is filled or off the field, the top excepted
+    bool m_blocked(i32 _x, i32 _y) const {
+        if (_x < 0 || _x >= static_cast<i32>(FIELD_WIDTH) || _y < 0) return true;
+        if (_y >= static_cast<i32>(FIELD_HEIGHT)) return false;
+
+        return m_rows[_y] >> _x & 1;
+    }
+
+    // replay_events of a T locked at _op, by the corner rule
+    u8 m_spin_of(const inner_operation& _op) const {
+        i32 _x = static_cast<i32>(_op.m_x), _y = static_cast<i32>(_op.m_y);
+
+        bool
+            _ul = m_blocked(_x - 1, _y + 1), _ur = m_blocked(_x + 1, _y + 1),
+            _dl = m_blocked(_x - 1, _y - 1), _dr = m_blocked(_x + 1, _y - 1);
+
+        if (_ul + _ur + _dl + _dr < 3) return 0;
+
+        // The two corners on the side the T points at
+        bool _front = false;
+        switch (_op.m_rotation) {
+            case rotation_type::spawn:   _front = _ul && _ur; break;
+            case rotation_type::right:   _front = _ur && _dr; break;
+            case rotation_type::reverse: _front = _dl && _dr; break;
+            case rotation_type::left:    _front = _ul && _dl; break;
+        }
+
+        return _front ? replay_events::tspin : replay_events::tspin | replay_events::mini;
+    }
+
+    static u16 s_reverse(u16 _row) {
+        u16 _result = 0;
+        for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+            if (_row >> _x & 1) _result |= 1u << (FIELD_WIDTH - 1 - _x);
+
+        return _result;
+    }
+
+public:
+    /* The operations of the decoder, as inner_field */
+
+    void add_number(i32 _x, i32 _y, i8 _value) {
+        m_changes++;
+
+        if (_y >= 0) {
+            u32 _idx = _x + _y * FIELD_WIDTH;
+            m_set(_idx, static_cast<piece_type>(static_cast<i8>(m_cells[_idx]) + _value));
+            return;
+        }
+
+        piece_type& _cell = m_garbage[_x];
+        _cell = static_cast<piece_type>(static_cast<i8>(_cell) + _value);
+
+        u16 _bit = static_cast<u16>(1u << _x);
+        m_garbage_row = _cell != piece_type::empty ? m_garbage_row | _bit : m_garbage_row & ~_bit;
+        m_garbage_gray = _cell == piece_type::gray ? m_garbage_gray | _bit : m_garbage_gray & ~_bit;
+    }
+
+    // Every block of _op must be on the field
+    void fill(inner_operation _op) {
+        m_changes++;
+
+        if (_op.m_piece == piece_type::T) m_spin = m_spin_of(_op);
+
+        for (const auto& [_bx, _by] : field_util::get_blocks(_op.m_piece, _op.m_rotation))
+            m_set((_bx + _op.m_x) + (_by + _op.m_y) * FIELD_WIDTH, _op.m_piece);
+    }
+
+    // Ends a lock: clears the full rows, counting those holding gray cells
+    // as garbage
+    void clear_line() {
+        m_last = { static_cast<u8>(replay_events::lock | m_spin), 0, 0 };
+        m_spin = 0;
+        m_locks++;
+
+        u32 _top = 0;
+        for (u32 _y = 0; _y < FIELD_HEIGHT; _y++) {
+            if (m_rows[_y] == full_row) {
+                m_last.m_lines++;
+                if (m_gray[_y]) m_last.m_garbage_lines++;
+                continue;
+            }
+
+            if (_top != _y) {
+                std::copy_n(m_cells.begin() + _y * FIELD_WIDTH, FIELD_WIDTH, m_cells.begin() + _top * FIELD_WIDTH);
+                m_rows[_top] = m_rows[_y];
+                m_gray[_top] = m_gray[_y];
+            }
+            _top++;
+        }
+
+        if (_top == FIELD_HEIGHT) return;
+
+        m_changes++;
+        std::fill(m_cells.begin() + _top * FIELD_WIDTH, m_cells.end(), piece_type::empty);
+        std::fill(m_rows.begin() + _top, m_rows.end(), 0);
+        std::fill(m_gray.begin() + _top, m_gray.end(), 0);
+    }
+
+    void rise_garbage() {
+        m_changes++;
+
+        std::copy_backward(m_cells.begin(), m_cells.end() - FIELD_WIDTH, m_cells.end());
+        std::copy(m_garbage.begin(), m_garbage.end(), m_cells.begin());
+        std::copy_backward(m_rows.begin(), m_rows.end() - 1, m_rows.end());
+        std::copy_backward(m_gray.begin(), m_gray.end() - 1, m_gray.end());
+
+        m_rows[0] = m_garbage_row;
+        m_gray[0] = m_garbage_gray;
+
+        m_garbage.fill(piece_type::empty);
+        m_garbage_row = m_garbage_gray = 0;
+    }
+
+    void mirror() {
+        m_changes++;
+
+        for (u32 _y = 0; _y < FIELD_HEIGHT; _y++) {
+            std::reverse(m_cells.begin() + _y * FIELD_WIDTH, m_cells.begin() + (_y + 1) * FIELD_WIDTH);
+            m_rows[_y] = s_reverse(m_rows[_y]);
+            m_gray[_y] = s_reverse(m_gray[_y]);
+        }
+    }
+
+    /* Accessors */
+
+    piece_type get_number_at(i32 _x, i32 _y) const
+    { return _y >= 0 ? m_cells[_x + _y * FIELD_WIDTH] : m_garbage[_x]; }
+
+    // Occupancy of row _y, -1 for the garbage row
+    u16 row(i32 _y) const { return _y >= 0 ? m_rows[_y] : m_garbage_row; }
+
+    u32 changes() const { return m_changes; }
+
+    // Locks so far, and what the last of them did
+    u32 locks() const { return m_locks; }
+    u8 last_events() const { return m_last.m_events; }
+    u8 last_lines() const { return m_last.m_lines; }
+    u8 last_garbage_lines() const { return m_last.m_garbage_lines; }
+
+    /*
+     * Measured on the row masks from the top row down: a column's height
+     * is set by the first row it is filled in, and the columns filled in
+     * rows above that are empty in a row have a hole there.
+     */
+    replay_surface surface() const {
+        replay_surface _surface;
+
+        u16 _above = 0;
+        u32 _holes = 0;
+
+        u32 _top = FIELD_HEIGHT;
+        while (_top > 0 && m_rows[_top - 1] == 0) _top--;
+
+        for (u32 _y = _top; _y-- > 0; ) {
+            u16 _row = m_rows[_y];
+
+            for (u16 _fresh = _row & ~_above; _fresh; _fresh &= _fresh - 1)
+                _surface.m_heights[simd::ctz(_fresh)] = static_cast<u8>(_y + 1);
+
+            _holes += simd::popcount(_above & ~_row & full_row);
+            _above |= _row;
+        }
+
+        _surface.m_holes = static_cast<u8>(_holes);
+
+        const auto& _h = _surface.m_heights;
+        u32 _bumpiness = 0, _well = 0;
+
+        for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
+            if (_x + 1 < FIELD_WIDTH) _bumpiness += _h[_x] > _h[_x + 1] ? _h[_x] - _h[_x + 1] : _h[_x + 1] - _h[_x];
+
+            u32
+                _left = _x == 0 ? FIELD_HEIGHT : _h[_x - 1],
+                _right = _x + 1 == FIELD_WIDTH ? FIELD_HEIGHT : _h[_x + 1],
+                _rim = std::min(_left, _right);
+
+            if (_rim > _h[_x]) _well = std::max<u32>(_well, _rim - _h[_x]);
+        }
+
+        _surface.m_bumpiness = static_cast<u8>(_bumpiness);
+        _surface.m_well_depth = static_cast<u8>(_well);
+
+        return _surface;
+    }
+};
+
+/*
+ * Per-page statistics of many replays, by column. Each page has an entry
+ * in each of these arrays, for the field as its lock leaves it:
+ *
+ *   events           u8, replay_events of its lock (0 if it has none)
+ *   lines            u8, rows its lock cleared
+ *   garbage_lines    u8, of those, rows holding gray cells
+ *   holes, bumpiness, well_depth
+ *                    u8, as replay_surface
+ *   heights          u8[FIELD_WIDTH], as replay_surface
+ *
+ * Fumens are decoded with replay_field as the field and only the field
+ * part (see decode_parts), so comments are skipped unread and no page is
+ * built; the statistics are read from the decoder state after each page.
+ * A field is measured again only if it changed since the page before.
+ */
+class replay_stats {
+public:
+    struct totals {
+        u64 m_fumens = 0, m_pages = 0, m_locks = 0;
+        u64 m_lines = 0, m_garbage_lines = 0;
+        // Full T-spins and minis, and the rows they cleared
+        u64 m_tspins = 0, m_minis = 0, m_tspin_lines = 0;
+        // Summed over pages, for averages
+        u64 m_holes = 0, m_bumpiness = 0;
+        u8 m_max_height = 0, m_max_well_depth = 0;
+    };
+
+private:
+    using point = decoder::resume_point<replay_field, std::string>;
+
+    // First page of each fumen, and the page count last
+    std::vector<u64> m_fumens { 0 };
+    // Where each fumen came from: its corpus line, or its index
+    std::vector<u64> m_sources;
+
+    std::vector<u8> m_events, m_lines, m_garbage_lines;
+    std::vector<u8> m_holes, m_bumpiness, m_well_depth;
+    std::vector<u8> m_heights;
+
+    void m_push(const replay_field& _field, u32& _locks, u32& _changes, replay_surface& _surface) {
+        bool _locked = _field.locks() != _locks;
+        _locks = _field.locks();
+
+        m_events.push_back(_locked ? _field.last_events() : 0);
+        m_lines.push_back(_locked ? _field.last_lines() : 0);
+        m_garbage_lines.push_back(_locked ? _field.last_garbage_lines() : 0);
+
+        if (_field.changes() != _changes) {
+            _surface = _field.surface();
+            _changes = _field.changes();
+        }
+
+        m_holes.push_back(_surface.m_holes);
+        m_bumpiness.push_back(_surface.m_bumpiness);
+        m_well_depth.push_back(_surface.m_well_depth);
+        m_heights.insert(m_heights.end(), _surface.m_heights.begin(), _surface.m_heights.end());
+    }
+
+    void m_rollback() {
+        u64 _first = m_fumens.back();
+
+        for (auto* _column : { &m_events, &m_lines, &m_garbage_lines, &m_holes, &m_bumpiness, &m_well_depth })
+            _column->resize(_first);
+        m_heights.resize(_first * FIELD_WIDTH);
+    }
+
+public:
+    /*
+     * Appends the pages of _data as one fumen from _source. Returns the
+     * error decoder::try_decode would, adding no pages if there is one.
+     */
+    decode_error try_decode(std::string_view _data, u64 _source, const decode_limits& _limits = {}) {
+        if (_data.size() > _limits.m_max_input) return { decode_errc::input_too_long, _limits.m_max_input };
+
+        instrument::call_scope _call(_data.size());
+
+        std::string _dt;
+        u32 _version;
+        {
+            instrument::stage_scope _probe(decode_stage::extract);
+            _version = decoder::s_extract(_data, _dt);
+        }
+        if (!_version) return { decode_errc::unsupported_version, 0 };
+
+        point _state;
+        _state.m_limits = _limits;
+
+        u32 _locks = 0, _changes = 0;
+        replay_surface _surface;
+
+        decode_error _error = decoder::s_decode<replay_field, std::string, decode_parts::field | decode_parts::last_page>(
+            _dt, decoder::s_height(_version), _state, [] (auto&&) {},
+            [&] (const point& _point, bool) { m_push(_point.m_field, _locks, _changes, _surface); },
+            std::pmr::get_default_resource());
+
+        if (_error) {
+            m_rollback();
+            _error.m_offset = decoder::s_raw_offset(_data, _error.m_offset);
+            return _error;
+        }
+
+        m_fumens.push_back(m_events.size());
+        m_sources.push_back(_source);
+
+        return {};
+    }
+
+    // Appends the pages of _data and returns the index of the fumen.
+    // Throws as decoder::decode, adding no pages.
+    u32 decode(std::string_view _data, const decode_limits& _limits = {}) {
+        decode_error _error = try_decode(_data, fumen_count(), _limits);
+        if (_error) _error.raise();
+
+        return fumen_count() - 1;
+    }
+
+    /*
+     * Appends every line of _corpus on _threads threads (0 for one per
+     * core), in line order, and returns the number of lines which failed.
+     * Each chunk of lines is decoded into its own table by the thread that
+     * takes it, and the tables are appended in order at the end. Corpus is
+     * fumen::corpus, from <fumen_corpus.hpp>.
+     */
+    template <typename Corpus>
+    u64 analyze(const Corpus& _corpus, u32 _threads = 0, const decode_limits& _limits = {}) {
+        constexpr u64 _chunk = Corpus::chunk_size;
+        std::vector<replay_stats> _parts((_corpus.size() + _chunk - 1) / _chunk);
+        std::atomic<u64> _failures { 0 };
+
+        _corpus.for_each([&] (u64 _idx, std::string_view _line) {
+            if (_parts[_idx / _chunk].try_decode(_line, _idx, _limits))
+                _failures.fetch_add(1, std::memory_order_relaxed);
+        }, _threads);
+
+        for (replay_stats& _part : _parts) append(_part);
+
+        return _failures.load();
+    }
+
+    // Appends the fumens of _other
+    void append(const replay_stats& _other) {
+        u64 _base = m_fumens.back();
+        for (u64 _i = 1; _i < _other.m_fumens.size(); _i++) m_fumens.push_back(_base + _other.m_fumens[_i]);
+        m_sources.insert(m_sources.end(), _other.m_sources.begin(), _other.m_sources.end());
+
+        m_events.insert(m_events.end(), _other.m_events.begin(), _other.m_events.end());
+        m_lines.insert(m_lines.end(), _other.m_lines.begin(), _other.m_lines.end());
+        m_garbage_lines.insert(m_garbage_lines.end(), _other.m_garbage_lines.begin(), _other.m_garbage_lines.end());
+        m_holes.insert(m_holes.end(), _other.m_holes.begin(), _other.m_holes.end());
+        m_bumpiness.insert(m_bumpiness.end(), _other.m_bumpiness.begin(), _other.m_bumpiness.end());
+        m_well_depth.insert(m_well_depth.end(), _other.m_well_depth.begin(), _other.m_well_depth.end());
+        m_heights.insert(m_heights.end(), _other.m_heights.begin(), _other.m_heights.end());
+    }
+
+    /* Columns, one entry per page (FIELD_WIDTH for heights) */
+
+    const std::vector<u8>& events() const { return m_events; }
+    const std::vector<u8>& lines() const { return m_lines; }
+    const std::vector<u8>& garbage_lines() const { return m_garbage_lines; }
+    const std::vector<u8>& holes() const { return m_holes; }
+    const std::vector<u8>& bumpiness() const { return m_bumpiness; }
+    const std::vector<u8>& well_depth() const { return m_well_depth; }
+    const std::vector<u8>& heights() const { return m_heights; }
+
+    // FIELD_WIDTH column heights of page _page
+    const u8* heights(u64 _page) const {
+        if (_page >= page_count()) throw std::out_of_range("Page index out of range");
+        return m_heights.data() + _page * FIELD_WIDTH;
+    }
+
+    /* Fumens */
+
+    u32 fumen_count() const { return static_cast<u32>(m_fumens.size() - 1); }
+    u64 page_count() const { return m_events.size(); }
+
+    // Global indices [first, last) of the pages of fumen _idx
+    std::pair<u64, u64> fumen(u32 _idx) const {
+        if (_idx >= fumen_count()) throw std::out_of_range("Fumen index out of range");
+        return { m_fumens[_idx], m_fumens[_idx + 1] };
+    }
+
+    u64 source(u32 _idx) const { return m_sources.at(_idx); }
+
+    // Sums of the columns over every page
+    totals total() const {
+        totals _totals;
+        _totals.m_fumens = fumen_count();
+        _totals.m_pages = page_count();
+
+        for (u64 _i = 0; _i < page_count(); _i++) {
+            u8 _events = m_events[_i];
+
+            _totals.m_locks += _events & replay_events::lock;
+            _totals.m_lines += m_lines[_i];
+            _totals.m_garbage_lines += m_garbage_lines[_i];
+
+            if (_events & replay_events::tspin) {
+                (_events & replay_events::mini ? _totals.m_minis : _totals.m_tspins)++;
+                _totals.m_tspin_lines += m_lines[_i];
+            }
+
+            _totals.m_holes += m_holes[_i];
+            _totals.m_bumpiness += m_bumpiness[_i];
+            _totals.m_max_well_depth = std::max(_totals.m_max_well_depth, m_well_depth[_i]);
+        }
+
+        for (u8 _height : m_heights) _totals.m_max_height = std::max(_totals.m_max_height, _height);
+
+        return _totals;
+    }
+
+    void reserve(u64 _pages) {
+        for (auto* _column : { &m_events, &m_lines, &m_garbage_lines, &m_holes, &m_bumpiness, &m_well_depth })
+            _column->reserve(_pages);
+        m_heights.reserve(_pages * FIELD_WIDTH);
+    }
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <utility>
+#include <variant>
+#include <stdexcept>
+
+#include <details/intdef.hpp>
+
+namespace fumen::details {
+
+enum class decode_errc : u8 {
+    ok, unsupported_version, invalid_data, invalid_quiz,
+    input_too_long, too_many_pages, too_many_comment_bytes, work_limit_exceeded,
+    operation_out_of_field
+};
+
+inline const char* to_string(decode_errc _code) {
+    switch (_code) {
+        case decode_errc::ok:                     return "ok";
+        case decode_errc::unsupported_version:    return "Unsupported Fumen version.";
+        case decode_errc::invalid_data:           return "Invalid fumen data";
+        case decode_errc::invalid_quiz:           return "Invalid quiz format";
+        case decode_errc::input_too_long:         return "Fumen input too long";
+        case decode_errc::too_many_pages:         return "Too many pages";
+        case decode_errc::too_many_comment_bytes: return "Too many comment bytes";
+        case decode_errc::work_limit_exceeded:    return "Decode work limit exceeded";
+        case decode_errc::operation_out_of_field: return "Operation out of field";
+    }
+
+    return "unknown";
+}
+
+/*
+ * Why a decode failed, and where: m_offset counts characters of the input
+ * as given, up to the point where the error was found (its end if it
+ * stopped inside a page). For an encode, m_offset is the index of the page
+ * that could not be encoded.
+ */
+struct decode_error {
+    decode_errc m_code = decode_errc::ok;
+    u64 m_offset = 0;
+
+    explicit operator bool() const { return m_code != decode_errc::ok; }
+
+    const char* message() const { return to_string(m_code); }
+
+    // Throws what the throwing API throws for this error
+    [[noreturn]] void raise() const {
+        switch (m_code) {
+            case decode_errc::unsupported_version:
+                throw std::logic_error(message());
+            case decode_errc::input_too_long:
+            case decode_errc::too_many_pages:
+            case decode_errc::too_many_comment_bytes:
+            case decode_errc::work_limit_exceeded:
+                throw std::length_error(message());
+            default:
+                throw std::invalid_argument(message());
+        }
+    }
+};
+
+// A T, or the decode_error that kept it from being made (decoded or encoded)
+template <typename T>
+class result {
+public:
+    result(T _value) : m_data(std::in_place_index<0>, std::move(_value)) {}
+    result(decode_error _error) : m_data(std::in_place_index<1>, _error) {}
+
+private:
+    std::variant<T, decode_error> m_data;
+
+public:
+    bool has_value() const { return m_data.index() == 0; }
+    explicit operator bool() const { return has_value(); }
+
+    // The value; raises the error if there is none
+    T& value() & {
+        if (!has_value()) error().raise();
+        return *std::get_if<0>(&m_data);
+    }
+
+    const T& value() const & {
+        if (!has_value()) error().raise();
+        return *std::get_if<0>(&m_data);
+    }
+
+    T&& value() && { return std::move(value()); }
+
+    T& operator*() & { return *std::get_if<0>(&m_data); }
+    const T& operator*() const & { return *std::get_if<0>(&m_data); }
+
+    T* operator->() { return std::get_if<0>(&m_data); }
+    const T* operator->() const { return std::get_if<0>(&m_data); }
+
+    // The error, ok if there is a value
+    decode_error error() const {
+        const decode_error* _error = std::get_if<1>(&m_data);
+        return _error ? *_error : decode_error();
+    }
+};
+
+}
\ No newline at end of file
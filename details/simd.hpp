@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+
+#include <details/intdef.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FUMEN_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define FUMEN_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace fumen::details::simd {
+
+inline u32 ctz(u32 _value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(_value);
+#else
+    u32 _cnt = 0;
+    while (!(_value & 1u)) { _value >>= 1; _cnt++; }
+    return _cnt;
+#endif
+}
+
+inline u32 popcount(u32 _value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(_value);
+#else
+    u32 _cnt = 0;
+    for (; _value; _value &= _value - 1) _cnt++;
+    return _cnt;
+#endif
+}
+
+inline u32 popcount64(u64 _value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<u32>(__builtin_popcountll(_value));
+#else
+    u32 _cnt = 0;
+    for (; _value; _value &= _value - 1) _cnt++;
+    return _cnt;
+#endif
+}
+
+// Number of differing bits of two 256-bit strings. With AVX2 the bytes of
+// the xor are counted by nibble lookups and summed with one SAD. Otherwise
+// it is four __builtin_popcountll, a single instruction only with -mpopcnt
+// (see FUMEN_AVX2 in CMakeLists.txt) and a bit-twiddling call without it.
+inline u32 hamming256(const u64* _a, const u64* _b) {
+#ifdef FUMEN_SIMD_AVX2
+    __m256i _x = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_a)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_b))
+    );
+
+    const __m256i _lut = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+    ), _low = _mm256_set1_epi8(0x0F);
+
+    __m256i _counts = _mm256_add_epi8(
+        _mm256_shuffle_epi8(_lut, _mm256_and_si256(_x, _low)),
+        _mm256_shuffle_epi8(_lut, _mm256_and_si256(_mm256_srli_epi16(_x, 4), _low))
+    );
+    __m256i _sums = _mm256_sad_epu8(_counts, _mm256_setzero_si256());
+
+    return static_cast<u32>(
+        _mm256_extract_epi64(_sums, 0) + _mm256_extract_epi64(_sums, 1) +
+        _mm256_extract_epi64(_sums, 2) + _mm256_extract_epi64(_sums, 3)
+    );
+#else
+    return popcount64(_a[0] ^ _b[0]) + popcount64(_a[1] ^ _b[1]) +
+        popcount64(_a[2] ^ _b[2]) + popcount64(_a[3] ^ _b[3]);
+#endif
+}
+
+// Bit i of the result is set if _a[i] != _b[i], for 16 bytes.
+inline u32 neq_mask16(const u8* _a, const u8* _b) {
+#ifdef FUMEN_SIMD_SSE2
+    __m128i _va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_a)),
+            _vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_b));
+
+    return ~static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_va, _vb))) & 0xFFFFu;
+#else
+    u32 _mask = 0;
+    for (u32 _i = 0; _i < 16; _i++)
+        _mask |= static_cast<u32>(_a[_i] != _b[_i]) << _i;
+    return _mask;
+#endif
+}
+
+// Bit i of the result is set if _p[i] == _ch, for 16 bytes.
+inline u32 eq_mask16(const char* _p, char _ch) {
+#ifdef FUMEN_SIMD_SSE2
+    __m128i _v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p));
+
+    return static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_v, _mm_set1_epi8(_ch))));
+#else
+    u32 _mask = 0;
+    for (u32 _i = 0; _i < 16; _i++)
+        _mask |= static_cast<u32>(_p[_i] == _ch) << _i;
+    return _mask;
+#endif
+}
+
+// Bit i of the result is set if _lo[k] <= _p[i] <= _hi[k] for some k,
+// for 16 bytes. Bounds must be ASCII; bytes >= 0x80 never match.
+template <std::size_t N>
+inline u32 in_ranges_mask16(const char* _p, const char (&_lo)[N], const char (&_hi)[N]) {
+#ifdef FUMEN_SIMD_SSE2
+    __m128i _v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p)),
+            _result = _mm_setzero_si128();
+
+    for (std::size_t _k = 0; _k < N; _k++)
+        _result = _mm_or_si128(_result, _mm_and_si128(
+            _mm_cmpgt_epi8(_v, _mm_set1_epi8(static_cast<char>(_lo[_k] - 1))),
+            _mm_cmplt_epi8(_v, _mm_set1_epi8(static_cast<char>(_hi[_k] + 1)))
+        ));
+
+    return static_cast<u32>(_mm_movemask_epi8(_result));
+#else
+    u32 _mask = 0;
+    for (u32 _i = 0; _i < 16; _i++) {
+        u8 _c = static_cast<u8>(_p[_i]);
+
+        for (std::size_t _k = 0; _k < N; _k++)
+            if (static_cast<u8>(_lo[_k]) <= _c && _c <= static_cast<u8>(_hi[_k]))
+                { _mask |= 1u << _i; break; }
+    }
+    return _mask;
+#endif
+}
+
+// _dst[i] = _a[i] - _b[i] + _bias (mod 256)
+inline void sub_bias(u8* _dst, const u8* _a, const u8* _b, std::size_t _size, u8 _bias) {
+    std::size_t _i = 0;
+
+#ifdef FUMEN_SIMD_SSE2
+    __m128i _vbias = _mm_set1_epi8(static_cast<char>(_bias));
+
+    for (; _i + 16 <= _size; _i += 16) {
+        __m128i _va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_a + _i)),
+                _vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_b + _i));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(_dst + _i),
+            _mm_add_epi8(_mm_sub_epi8(_va, _vb), _vbias)
+        );
+    }
+#endif
+
+    for (; _i < _size; _i++)
+        _dst[_i] = static_cast<u8>(_a[_i] - _b[_i] + _bias);
+}
+
+}
\ No newline at end of file
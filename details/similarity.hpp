@@ -0,0 +1,290 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include <details/intdef.hpp>
+#include <details/simd.hpp>
+#include <details/inner_field.hpp>
+#include <details/field.hpp>
+
+namespace fumen::details {
+
+// Occupancy of the 230 playfield cells and 10 garbage cells, one bit each
+struct board_bits {
+    static constexpr u32 garbage_offset = PLAY_BLOCKS;
+
+    alignas(32) std::array<u64, 4> m_words {};
+
+    template <typename Allocator>
+    static board_bits from(const basic_inner_field<Allocator>& _field) {
+        board_bits _bits;
+
+        const auto& _cells = _field.field();
+        for (u32 _i = 0; _i < PLAY_BLOCKS; _i++)
+            if (_cells[_i] != piece_type::empty) _bits.set(_i);
+
+        const auto& _garbage = _field.garbage();
+        for (u32 _i = 0; _i < FIELD_WIDTH; _i++)
+            if (_garbage[_i] != piece_type::empty) _bits.set(garbage_offset + _i);
+
+        return _bits;
+    }
+
+    void set(u32 _bit) { m_words[_bit >> 6] |= 1ull << (_bit & 63); }
+    bool test(u32 _bit) const { return m_words[_bit >> 6] >> (_bit & 63) & 1; }
+
+    // Number of cells filled in one board and empty in the other
+    u32 distance(const board_bits& _other) const
+    { return simd::hamming256(m_words.data(), _other.m_words.data()); }
+
+    bool operator==(const board_bits& _other) const { return m_words == _other.m_words; }
+    bool operator!=(const board_bits& _other) const { return m_words != _other.m_words; }
+};
+
+/*
+ * Boards within a Hamming distance of a query board, ranked by distance.
+ *
+ * Small indexes are scanned with hamming256. Larger ones also keep a
+ * multi-index hash: the 256 bits are cut into 16 keys of 16 bits, each
+ * key taking every 16th bit so that it samples the whole board rather
+ * than a few rows (the upper rows are empty on most boards). A board
+ * within distance k of the query agrees with it to within k / 16 bits on
+ * at least one key, so only the boards listed under those neighbouring
+ * keys need to be checked. When those lists add up to more than an
+ * eighth of the index, the scan is cheaper and is used instead.
+ *
+ * Each key's table is flat: the boards sorted by key value, and 65537
+ * offsets into them. Tables are rebuilt by add() once the boards added
+ * since the last build are an eighth of the index; queries scan those.
+ *
+ * Boards can be added between queries. Queries are const and may run
+ * concurrently, but not alongside add().
+ */
+class similarity_index {
+public:
+    struct hit {
+        u64 m_fumen;
+        u32 m_page;
+        u32 m_distance;
+    };
+
+    // Below this many boards, queries always scan
+    static constexpr u64 scan_limit = 4096;
+
+private:
+    static constexpr u32 s_keys = 16;
+
+    struct board_ref {
+        u64 m_fumen;
+        u32 m_page;
+    };
+
+    using key_set = std::array<u16, s_keys>;
+
+    std::vector<board_bits> m_boards;
+    std::vector<board_ref> m_refs;
+    std::vector<key_set> m_keys;
+
+    // Boards with key _v under key _k are m_postings[_k][m_offsets[_k][_v]]
+    // up to m_offsets[_k][_v + 1], for the first m_indexed boards
+    std::array<std::vector<u32>, s_keys> m_offsets, m_postings;
+    u32 m_indexed = 0;
+
+    // Bits _k, _k + 16, ... of _bits
+    static u16 s_key(const board_bits& _bits, u32 _k) {
+        u16 _key = 0;
+        for (u32 _i = 0; _i < 16; _i++)
+            _key |= static_cast<u16>(_bits.test(_k + _i * s_keys) << _i);
+        return _key;
+    }
+
+    // Calls _fn for every 16-bit value within _radius bits of _key
+    template <typename Fn>
+    static void s_neighbours(u16 _key, u32 _radius, u32 _from, Fn&& _fn) {
+        _fn(_key);
+        if (_radius == 0) return;
+
+        for (u32 _b = _from; _b < 16; _b++)
+            s_neighbours(static_cast<u16>(_key ^ 1u << _b), _radius - 1, _b + 1, _fn);
+    }
+
+    void m_scan(const board_bits& _query, u32 _radius, u32 _from, std::vector<hit>& _hits) const {
+        for (u32 _i = _from; _i < m_boards.size(); _i++) {
+            u32 _d = _query.distance(m_boards[_i]);
+            if (_d <= _radius) _hits.push_back({ m_refs[_i].m_fumen, m_refs[_i].m_page, _d });
+        }
+    }
+
+    // Counting sort of every board by each key
+    void m_build() {
+        u32 _count = static_cast<u32>(m_boards.size());
+
+        for (u32 _k = 0; _k < s_keys; _k++) {
+            std::vector<u32>& _offsets = m_offsets[_k];
+            _offsets.assign(1u << 16 | 1u, 0);
+
+            for (u32 _i = 0; _i < _count; _i++) _offsets[m_keys[_i][_k] + 1u]++;
+            for (u32 _v = 0; _v < 1u << 16; _v++) _offsets[_v + 1] += _offsets[_v];
+
+            std::vector<u32> _cursor(_offsets.begin(), _offsets.end() - 1);
+            m_postings[_k].resize(_count);
+            for (u32 _i = 0; _i < _count; _i++) m_postings[_k][_cursor[m_keys[_i][_k]]++] = _i;
+        }
+
+        m_indexed = _count;
+    }
+
+public:
+    // Indexes one board; returns its ordinal
+    u32 add(u64 _fumen, u32 _page, const board_bits& _bits) {
+        if (m_boards.size() >= UINT32_MAX)
+            throw std::length_error("Similarity index full");
+
+        u32 _ordinal = static_cast<u32>(m_boards.size());
+        m_boards.push_back(_bits);
+        m_refs.push_back({ _fumen, _page });
+
+        key_set _keys;
+        for (u32 _k = 0; _k < s_keys; _k++) _keys[_k] = s_key(_bits, _k);
+        m_keys.push_back(_keys);
+
+        if (m_boards.size() >= scan_limit && m_boards.size() - m_indexed > m_indexed / 8)
+            m_build();
+
+        return _ordinal;
+    }
+
+    template <typename Allocator>
+    u32 add(u64 _fumen, u32 _page, const basic_inner_field<Allocator>& _field)
+    { return add(_fumen, _page, board_bits::from(_field)); }
+
+    template <typename Allocator>
+    u32 add(u64 _fumen, u32 _page, const basic_field<Allocator>& _field)
+    { return add(_fumen, _page, board_bits::from(_field.inner())); }
+
+    // Indexes every page of a decoded fumen
+    template <typename Pages>
+    void add_pages(u64 _fumen, const Pages& _pages) {
+        u32 _i = 0;
+        for (const auto& _page : _pages) add(_fumen, _i++, _page.m_inner_field);
+    }
+
+    /*
+     * Boards at most _radius cells away from _query, nearest first (ties by
+     * fumen and page), at most _limit of them.
+     */
+    std::vector<hit> query(const board_bits& _query, u32 _radius, std::size_t _limit = SIZE_MAX) const {
+        std::vector<hit> _hits;
+        u32 _key_radius = _radius / s_keys;
+
+        bool _scan = m_boards.size() < scan_limit || _key_radius > 2;
+
+        key_set _keys;
+        if (!_scan) {
+            // Boards added since the last build are scanned in any case
+            u64 _cost = m_boards.size() - m_indexed;
+            for (u32 _k = 0; _k < s_keys && !_scan; _k++) {
+                _keys[_k] = s_key(_query, _k);
+
+                s_neighbours(_keys[_k], _key_radius, 0, [&] (u16 _key) {
+                    _cost += m_offsets[_k][_key + 1u] - m_offsets[_k][_key];
+                });
+
+                _scan = _cost > m_boards.size() / 8;
+            }
+        }
+
+        if (_scan) m_scan(_query, _radius, 0, _hits);
+        else {
+            // Boards listed under several keys are checked once
+            std::vector<u64> _seen(m_indexed / 64 + 1);
+
+            for (u32 _k = 0; _k < s_keys; _k++)
+                s_neighbours(_keys[_k], _key_radius, 0, [&] (u16 _key) {
+                    const u32* _posting = m_postings[_k].data();
+
+                    for (u32 _p = m_offsets[_k][_key]; _p < m_offsets[_k][_key + 1u]; _p++) {
+                        u32 _i = _posting[_p];
+
+                        u64& _word = _seen[_i >> 6];
+                        if (_word >> (_i & 63) & 1) continue;
+                        _word |= 1ull << (_i & 63);
+
+                        u32 _d = _query.distance(m_boards[_i]);
+                        if (_d <= _radius) _hits.push_back({ m_refs[_i].m_fumen, m_refs[_i].m_page, _d });
+                    }
+                });
+
+            m_scan(_query, _radius, m_indexed, _hits);
+        }
+
+        auto _less = [] (const hit& _a, const hit& _b) {
+            if (_a.m_distance != _b.m_distance) return _a.m_distance < _b.m_distance;
+            return _a.m_fumen != _b.m_fumen ? _a.m_fumen < _b.m_fumen : _a.m_page < _b.m_page;
+        };
+
+        if (_hits.size() > _limit) {
+            std::partial_sort(_hits.begin(), _hits.begin() + _limit, _hits.end(), _less);
+            _hits.resize(_limit);
+        } else std::sort(_hits.begin(), _hits.end(), _less);
+
+        return _hits;
+    }
+
+    /*
+     * query() for each of _queries, spread over _threads threads (0 for one
+     * per core). The first exception thrown stops the batch and is
+     * rethrown.
+     */
+    std::vector<std::vector<hit>> query_batch(
+        const std::vector<board_bits>& _queries, u32 _radius,
+        std::size_t _limit = SIZE_MAX, u32 _threads = 0
+    ) const {
+        std::vector<std::vector<hit>> _results(_queries.size());
+
+        if (_threads == 0) _threads = std::max(1u, std::thread::hardware_concurrency());
+        _threads = static_cast<u32>(std::min<std::size_t>(_threads, _queries.size()));
+
+        std::atomic<std::size_t> _next { 0 };
+        std::atomic<bool> _failed { false };
+        std::exception_ptr _error;
+
+        auto _work = [&] {
+            try {
+                for (std::size_t _i; !_failed.load(std::memory_order_relaxed) && (_i = _next++) < _queries.size(); )
+                    _results[_i] = query(_queries[_i], _radius, _limit);
+            } catch (...) {
+                if (!_failed.exchange(true)) _error = std::current_exception();
+            }
+        };
+
+        if (_threads <= 1) _work();
+        else {
+            std::vector<std::thread> _pool;
+            _pool.reserve(_threads);
+
+            for (u32 _t = 0; _t < _threads; _t++) _pool.emplace_back(_work);
+            for (std::thread& _th : _pool) _th.join();
+        }
+
+        if (_error) std::rethrow_exception(_error);
+        return _results;
+    }
+
+    u64 size() const { return m_boards.size(); }
+
+    void reserve(u64 _boards) {
+        m_boards.reserve(_boards);
+        m_refs.reserve(_boards);
+        m_keys.reserve(_boards);
+    }
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,638 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#include <details/intdef.hpp>
+
+#include <details/defs.hpp>
+#include <details/utils.hpp>
+#include <details/quiz.hpp>
+#include <details/buffer.hpp>
+#include <details/action.hpp>
+#include <details/comments.hpp>
+#include <details/inner_field.hpp>
+#include <details/field.hpp>
+#include <details/decoder.hpp>
+
+namespace fumen::details {
+
+// A decoded page with its field inline, as static_decoder builds it
+struct static_page {
+    static constexpr u32 none = UINT32_MAX;
+
+    u32 m_idx = 0;
+    std::array<piece_type, PLAY_BLOCKS> m_field {};
+    std::array<piece_type, FIELD_WIDTH> m_garbage {};
+    // m_piece is empty if the page has no operation
+    field_operation m_operation { piece_type::empty, rotation_type::reverse, 0, 0 };
+    // The comment is m_comment_size characters of the fumen text at
+    // m_comment_offset
+    u32 m_comment_offset = 0, m_comment_size = 0;
+    // Pages the field and comment were taken from, or none
+    u32 m_field_ref = none, m_comment_ref = none;
+    // As basic_page::flags::all
+    u8 m_flags = 0;
+
+    constexpr bool has_operation() const { return m_operation.m_piece != piece_type::empty; }
+
+    constexpr bool lock() const { return m_flags & 1; }
+    constexpr bool mirror() const { return m_flags >> 1 & 1; }
+    constexpr bool colorize() const { return m_flags >> 2 & 1; }
+    constexpr bool rise() const { return m_flags >> 3 & 1; }
+    constexpr bool quiz() const { return m_flags >> 4 & 1; }
+
+    constexpr piece_type at(u32 _x, u32 _y) const { return m_field[_x + _y * FIELD_WIDTH]; }
+};
+
+/*
+ * The pages of a fumen decoded by static_decoder, with every comment in
+ * one character array. Pages and Chars are the sizes static_decoder::measure
+ * gives for it.
+ */
+template <u32 Pages, u32 Chars>
+struct static_fumen {
+    std::array<static_page, Pages> m_pages {};
+    std::array<char, Chars> m_text {};
+
+    static constexpr u32 size() { return Pages; }
+
+    constexpr const static_page& operator[](u32 _idx) const { return m_pages[_idx]; }
+
+    constexpr std::string_view comment(u32 _idx) const
+    { return std::string_view(m_text.data(), Chars).substr(m_pages[_idx].m_comment_offset, m_pages[_idx].m_comment_size); }
+
+    // The pages as decoder::decode gives them, built without decoding
+    pages to_pages() const {
+        pages _pages;
+        _pages.reserve(Pages);
+
+        for (u32 _i = 0; _i < Pages; _i++) {
+            const static_page& _sp = m_pages[_i];
+
+            auto _ref = [] (u32 _value) { return _value == static_page::none ? std::nullopt : std::optional<u32>(_value); };
+
+            page _page {
+                _sp.m_idx,
+                inner_field(
+                    play_field(std::vector<piece_type>(_sp.m_field.begin(), _sp.m_field.end()), PLAY_BLOCKS),
+                    play_field(std::vector<piece_type>(_sp.m_garbage.begin(), _sp.m_garbage.end()), FIELD_WIDTH)
+                ),
+                std::nullopt,
+                std::string(comment(_i)),
+                { _ref(_sp.m_field_ref), _ref(_sp.m_comment_ref) },
+                {}
+            };
+            if (_sp.has_operation()) _page.m_operation = _sp.m_operation;
+            _page.m_flags.all = _sp.m_flags;
+
+            _pages.push_back(std::move(_page));
+        }
+
+        return _pages;
+    }
+};
+
+/*
+ * A decoder that runs in constant evaluation, for fumens embedded in the
+ * program. It follows decoder::s_decode step for step, quizzes included,
+ * but reads the data in place and keeps its state in fixed-size arrays,
+ * so it needs no allocation. A fumen is decoded twice: measure() counts
+ * its pages and comment characters, which size the static_fumen that
+ * decode() fills.
+ *
+ *     constexpr std::string_view s_data = "v115@vhAAgH";
+ *     constexpr auto s_size = static_decoder::measure(s_data);
+ *     constexpr auto s_pages = static_decoder::decode<s_size.m_pages, s_size.m_chars>(s_data);
+ *
+ * Malformed data throws as decoder::decode does, which in a constant
+ * expression fails the build.
+ */
+/* static */ class static_decoder {
+public:
+    struct size_type {
+        u32 m_pages = 0, m_chars = 0;
+    };
+
+private:
+    // Longer than any comment, whose length is two base64 digits
+    static constexpr u32 s_capacity = 4096;
+
+    using text_type = std::array<char, s_capacity>;
+
+    // The data after the header, read in place as buffer reads it
+    struct reader {
+        std::string_view m_data;
+        std::size_t m_pos = 0;
+
+        constexpr void skip() { while (m_pos < m_data.size() && decoder::s_is_removed(m_data[m_pos])) m_pos++; }
+
+        constexpr bool empty() const { return m_pos >= m_data.size(); }
+
+        constexpr i64 poll(u32 _max) {
+            i64 _value = 0, _weight = 1;
+
+            for (u32 _i = 0; _i < _max; _i++, _weight *= 64) {
+                if (empty()) throw std::invalid_argument("Invalid fumen data");
+
+                _value += buffer::value_of(m_data[m_pos++]) * _weight;
+                skip();
+            }
+
+            return _value;
+        }
+    };
+
+    /* Text */
+
+    struct text {
+        text_type m_data {};
+        u32 m_size = 0;
+
+        constexpr void push(char _c) {
+            if (m_size >= s_capacity) throw std::invalid_argument("Invalid fumen data");
+            m_data[m_size++] = _c;
+        }
+
+        // As std::string appends, for converter
+        constexpr text& operator+=(char _c) { push(_c); return *this; }
+
+        constexpr void append(const char* _str, std::size_t _size)
+        { for (std::size_t _i = 0; _i < _size; _i++) push(_str[_i]); }
+
+        constexpr std::string_view view() const { return std::string_view(m_data.data(), m_size); }
+    };
+
+    // converter::unescape, without its vectorized scans
+    static constexpr void s_unescape(std::string_view _str, text& _out) {
+        u32 _high = 0;
+
+        for (std::size_t _i = 0; _i < _str.size(); ) {
+            i32 _unit = converter::s_parse_escape(_str, _i);
+
+            if (_unit < 0) {
+                if (_high != 0) {
+                    converter::s_push_utf8(0xFFFD, _out);
+                    _high = 0;
+                }
+
+                _out.push(_str[_i++]);
+            } else
+                converter::s_push_utf16(_unit, _high, _out);
+        }
+
+        if (_high != 0) converter::s_push_utf8(0xFFFD, _out);
+    }
+
+    /* Quiz */
+
+    /*
+     * quiz, by value. Where quiz throws invalid_argument, which the decoder
+     * catches, these return false and leave the state as it was.
+     */
+    struct quiz_state {
+        bool m_is_quiz = false;
+        char m_hold = '\0', m_current = '\0';
+        u32 m_pos = 0, m_sep = 0;
+        // The text after "(C)" without whitespace, or the whole comment
+        // if it is not a quiz
+        text m_text;
+
+        // quiz(_data)
+        static constexpr bool s_parse(std::string_view _data, quiz_state& _out) {
+            quiz_state _quiz;
+
+            if (quiz::s_is_plain(_data)) {
+                _out = s_raw(_data);
+                return true;
+            }
+
+            text _str;
+            for (char _c : _data)
+                if (!quiz::s_is_space(_c)) _str.push(_c);
+
+            quiz::head _head = quiz::s_parse_head(_str.view());
+            if (_head.m_size == 0) return false;
+
+            _quiz.m_is_quiz = true;
+            _quiz.m_hold = _head.m_hold;
+            _quiz.m_current = _head.m_current;
+            for (char _c : _str.view().substr(_head.m_size)) _quiz.m_text.push(_c);
+
+            std::size_t _sep = _quiz.m_text.view().find(';');
+            _quiz.m_sep = static_cast<u32>(_sep < _quiz.m_text.m_size ? _sep : _quiz.m_text.m_size);
+
+            _out = _quiz;
+            return true;
+        }
+
+        static constexpr quiz_state s_raw(std::string_view _data) {
+            quiz_state _quiz;
+            for (char _c : _data) _quiz.m_text.push(_c);
+            return _quiz;
+        }
+
+        constexpr std::string_view m_view() const { return m_text.view(); }
+
+        constexpr char m_at(u32 _idx) const { return _idx < m_text.m_size ? m_text.m_data[_idx] : '\0'; }
+
+        constexpr char m_next() const {
+            char _name = m_at(m_pos);
+            return _name == ';' ? '\0' : _name;
+        }
+
+        constexpr u32 m_after_next2() const {
+            if (m_at(m_pos) == ';') return m_pos;
+            return m_pos + 1 < m_text.m_size ? m_pos + 1 : m_text.m_size;
+        }
+
+        constexpr bool m_is_end() const
+        { return m_is_quiz && m_hold == '\0' && m_current == '\0' && m_at(m_pos) == ';'; }
+
+        constexpr bool m_advance(char _hold, char _current, u32 _pos, quiz_state& _out) const {
+            if ((_hold != '\0' && !quiz::s_is_piece_name(_hold)) ||
+                (_current != '\0' && !quiz::s_is_piece_name(_current)))
+                return false;
+
+            _out = *this;
+            _out.m_hold = _hold;
+            _out.m_current = _current;
+            _out.m_pos = _pos;
+
+            return true;
+        }
+
+        constexpr bool next_if_end(quiz_state& _out) const {
+            if (m_is_end()) return s_parse(m_view().substr(m_pos + 1), _out);
+
+            _out = *this;
+            return true;
+        }
+
+        constexpr bool can_operate() const {
+            if (!m_is_quiz) return false;
+
+            if (m_is_end()) {
+                std::string_view _rest = m_view().substr(m_pos + 1);
+                return _rest.substr(0, 3) == "#Q=" && _rest != "#Q=[]()";
+            }
+
+            return m_hold != '\0' || m_current != '\0' || m_pos < m_text.m_size;
+        }
+
+        // Applies the placement of _piece
+        constexpr bool operate(piece_type _piece, quiz_state& _out) const {
+            char _uname = defs::to_char(_piece), _cname = m_current;
+
+            if (_uname == _cname) return m_direct(_out);
+            if (m_hold == _uname) return m_advance(m_current, m_next(), m_after_next2(), _out);
+
+            if (m_hold == '\0') {
+                if (_uname == m_next()) {
+                    u32 _pos = m_after_next2();
+                    return m_advance(m_current, m_at(_pos), _pos + 1 < m_text.m_size ? _pos + 1 : m_text.m_size, _out);
+                }
+            } else if (_cname == '\0' && _uname == m_next()) return m_direct(_out);
+
+            return false;
+        }
+
+        constexpr bool m_direct(quiz_state& _out) const {
+            if (!m_is_quiz) return false;
+
+            if (m_current == '\0') {
+                u32 _pos = m_after_next2();
+                if (_pos >= m_text.m_size) return false;
+
+                return m_advance(m_hold, m_at(_pos), _pos + 1, _out);
+            }
+
+            return m_advance(m_hold, m_next(), m_after_next2(), _out);
+        }
+
+        // quiz::format, which throws when the text after a finished bag
+        // is a malformed quiz
+        constexpr quiz_state format() const {
+            quiz_state _quiz;
+            if (!next_if_end(_quiz)) throw std::invalid_argument("Invalid quiz format");
+
+            // A finished quiz keeps its text
+            bool _finished = _quiz.m_is_quiz
+                ? _quiz.m_hold == '\0' && _quiz.m_current == '\0' && _quiz.m_pos == _quiz.m_text.m_size
+                : _quiz.m_view() == "#Q=[]()";
+            if (_finished) return *this;
+
+            if (!_quiz.m_is_quiz) return _quiz;
+
+            if (_quiz.m_current != '\0') return _quiz;
+
+            quiz_state _out;
+            bool _valid = true;
+
+            if (_quiz.m_hold != '\0') _valid = _quiz.m_advance('\0', _quiz.m_hold, _quiz.m_pos, _out);
+            else {
+                char _head = _quiz.m_at(_quiz.m_pos);
+                if (_head == '\0') return s_raw({});
+
+                if (_head == ';') _valid = s_parse(_quiz.m_view().substr(_quiz.m_pos + 1), _out);
+                else _valid = _quiz.m_advance('\0', _head, _quiz.m_pos + 1, _out);
+            }
+
+            if (!_valid) throw std::invalid_argument("Invalid quiz format");
+            return _out;
+        }
+
+        template <typename Out>
+        constexpr void to_string(Out& _out) const {
+            if (!m_is_quiz) {
+                for (char _c : m_view()) _out.push(_c);
+                return;
+            }
+
+            for (char _c : std::string_view("#Q=[")) _out.push(_c);
+            if (m_hold != '\0') _out.push(m_hold);
+            _out.push(']');
+            _out.push('(');
+            if (m_current != '\0') _out.push(m_current);
+            _out.push(')');
+            for (char _c : m_view().substr(m_pos)) _out.push(_c);
+        }
+    };
+
+    /* Field */
+
+    struct board {
+        std::array<piece_type, PLAY_BLOCKS> m_field {};
+        std::array<piece_type, FIELD_WIDTH> m_garbage {};
+
+        constexpr void add_number(i32 _x, i32 _y, i32 _value) {
+            piece_type& _cell = _y >= 0 ? m_field[_x + _y * FIELD_WIDTH] : m_garbage[_x];
+            _cell = static_cast<piece_type>(static_cast<u8>(static_cast<u8>(_cell) + _value));
+        }
+
+        constexpr void fill(const inner_operation& _op) {
+            container_type _blocks = field_util::get_blocks(_op.m_piece, _op.m_rotation);
+
+            for (const auto& _block : _blocks) {
+                i32 _x = _block.first + static_cast<i32>(_op.m_x), _y = _block.second + static_cast<i32>(_op.m_y);
+                if (_x < 0 || _x >= (i32)FIELD_WIDTH || _y < 0 || _y >= (i32)FIELD_HEIGHT)
+                    throw std::invalid_argument("Invalid fumen data");
+
+                m_field[_x + _y * FIELD_WIDTH] = _op.m_piece;
+            }
+        }
+
+        constexpr void clear_line() {
+            u32 _top = 0;
+
+            for (u32 _y = 0; _y < FIELD_HEIGHT; _y++) {
+                bool _full = true;
+                for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+                    _full = _full && m_field[_x + _y * FIELD_WIDTH] != piece_type::empty;
+
+                if (_full) continue;
+
+                if (_top != _y)
+                    for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+                        m_field[_x + _top * FIELD_WIDTH] = m_field[_x + _y * FIELD_WIDTH];
+                _top++;
+            }
+
+            for (u32 _i = _top * FIELD_WIDTH; _i < PLAY_BLOCKS; _i++) m_field[_i] = piece_type::empty;
+        }
+
+        constexpr void rise_garbage() {
+            for (u32 _i = PLAY_BLOCKS; _i-- > FIELD_WIDTH; ) m_field[_i] = m_field[_i - FIELD_WIDTH];
+            for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
+                m_field[_x] = m_garbage[_x];
+                m_garbage[_x] = piece_type::empty;
+            }
+        }
+
+        constexpr void mirror() {
+            for (u32 _y = 0; _y < FIELD_HEIGHT; _y++)
+                for (u32 _l = 0, _r = FIELD_WIDTH - 1; _l < _r; _l++, _r--) {
+                    piece_type _t = m_field[_l + _y * FIELD_WIDTH];
+                    m_field[_l + _y * FIELD_WIDTH] = m_field[_r + _y * FIELD_WIDTH];
+                    m_field[_r + _y * FIELD_WIDTH] = _t;
+                }
+        }
+    };
+
+    static constexpr bool s_update_field(reader& _buf, u32 _htop, u32 _block_count, board& _field) {
+        bool _is_changed = true;
+
+        u32 _idx = 0;
+
+        while (_idx < _block_count) {
+            i64 _block_diff = _buf.poll(2),
+                _diff = _block_diff / _block_count,
+                _counts = _block_diff % _block_count;
+
+            if (_diff == 8 && _counts == _block_count - 1)
+                _is_changed = false;
+
+            if (_diff == 8) {
+                _idx += _counts + 1;
+                continue;
+            }
+
+            for (u32 _i = 0; _i < _counts + 1 && _idx < _block_count; _i++) {
+                i32 _x = _idx % FIELD_WIDTH,
+                    _y = _htop - _idx / FIELD_WIDTH - 1;
+                _field.add_number(_x, _y, _diff - 8);
+                _idx++;
+            }
+        }
+
+        return _is_changed;
+    }
+
+    /* Output */
+
+    // Counts what decode() will write
+    struct counter {
+        size_type m_size;
+
+        constexpr void push(char) { m_size.m_chars++; }
+        constexpr u32 text_size() const { return m_size.m_chars; }
+        constexpr void add(const static_page&) { m_size.m_pages++; }
+    };
+
+    template <u32 Pages, u32 Chars>
+    struct writer {
+        static_fumen<Pages, Chars>& m_fumen;
+        u32 m_pages = 0, m_chars = 0;
+
+        constexpr void push(char _c) {
+            if (m_chars >= Chars) throw std::length_error("Static fumen too small");
+            m_fumen.m_text[m_chars++] = _c;
+        }
+
+        constexpr u32 text_size() const { return m_chars; }
+
+        constexpr void add(const static_page& _page) {
+            if (m_pages >= Pages) throw std::length_error("Static fumen too small");
+            m_fumen.m_pages[m_pages++] = _page;
+        }
+    };
+
+    template <typename Out>
+    static constexpr void s_decode(std::string_view _data, Out& _out) {
+        auto [_rest, _version] = decoder::s_header(_data);
+        if (!_version) throw std::logic_error("Unsupported Fumen version.");
+
+        reader _buf { _rest };
+        _buf.skip();
+
+        u32 _htop = decoder::s_height(_version),
+            _block_count = FIELD_WIDTH * (_htop + GARBAGE_LINE);
+
+        board _field;
+        i32 _counter = -1;
+        u32 _field_ref = 0, _comment_ref = 0;
+        u32 _last_offset = 0, _last_size = 0;
+
+        bool _has_quiz = false;
+        quiz_state _quiz;
+
+        text _escaped, _comment;
+
+        for (u32 _pidx = 0; !_buf.empty(); _pidx++) {
+            bool _is_changed = false;
+
+            if (0 < _counter) _counter--;
+            else {
+                _is_changed = s_update_field(_buf, _htop, _block_count, _field);
+
+                if (!_is_changed) _counter = static_cast<i32>(_buf.poll(1));
+            }
+
+            u32 _value = static_cast<u32>(_buf.poll(3));
+            action _act = decode_action(_value, _htop);
+
+            static_page _page;
+            _page.m_comment_offset = _out.text_size();
+
+            if (_act.m_comment) {
+                i64 _comment_len = _buf.poll(2),
+                    _group_count = (_comment_len + 3) / 4;
+
+                _escaped.m_size = static_cast<u32>(_group_count * comment_codec::group_size);
+                for (i64 _i = 0; _i < _group_count; _i++)
+                    comment_codec::decode(_buf.poll(5), _escaped.m_data.data() + _i * comment_codec::group_size);
+                _escaped.m_size = static_cast<u32>(_comment_len);
+
+                _comment.m_size = 0;
+                s_unescape(_escaped.view(), _comment);
+
+                for (char _c : _comment.view()) _out.push(_c);
+                _page.m_comment_size = _comment.m_size;
+
+                _last_offset = _page.m_comment_offset;
+                _last_size = _comment.m_size;
+                _comment_ref = _pidx;
+
+                _has_quiz = quiz::is_quiz_comment(_comment.view()) && quiz_state::s_parse(_comment.view(), _quiz);
+            } else if (_pidx != 0) {
+                if (_has_quiz) {
+                    _quiz.format().to_string(_out);
+                    _page.m_comment_size = _out.text_size() - _page.m_comment_offset;
+                } else {
+                    _page.m_comment_offset = _last_offset;
+                    _page.m_comment_size = _last_size;
+                }
+
+                _page.m_comment_ref = _comment_ref;
+            }
+
+            bool _is_quiz = _has_quiz;
+            if (_is_quiz && _quiz.can_operate() && _act.m_lock && defs::is_mino(_act.m_operation.m_piece)) {
+                quiz_state _next, _operated;
+
+                if (_quiz.next_if_end(_next) && _next.operate(_act.m_operation.m_piece, _operated))
+                    _quiz = _operated;
+                else
+                    _quiz = _quiz.format();
+            }
+
+            if (_is_changed || _pidx == 0) _field_ref = _pidx;
+            else _page.m_field_ref = _field_ref;
+
+            _page.m_idx = _pidx;
+            _page.m_field = _field.m_field;
+            _page.m_garbage = _field.m_garbage;
+
+            if (_act.m_operation.m_piece != piece_type::empty)
+                _page.m_operation = {
+                    _act.m_operation.m_piece, _act.m_operation.m_rotation,
+                    _act.m_operation.m_x, _act.m_operation.m_y
+                };
+
+            _page.m_flags = static_cast<u8>(_act.m_lock | _act.m_mirror << 1 | _act.m_colorize << 2
+                | _act.m_rise << 3 | _is_quiz << 4);
+
+            _out.add(_page);
+
+            if (_act.m_lock) {
+                if (defs::is_mino(_act.m_operation.m_piece)) _field.fill(_act.m_operation);
+
+                _field.clear_line();
+
+                if (_act.m_rise) _field.rise_garbage();
+                if (_act.m_mirror) _field.mirror();
+            }
+        }
+    }
+
+public:
+    // The page count and comment characters of _data
+    static constexpr size_type measure(std::string_view _data) {
+        counter _counter;
+        s_decode(_data, _counter);
+        return _counter.m_size;
+    }
+
+    // Throws length_error if the sizes are smaller than measure() gives
+    template <u32 Pages, u32 Chars>
+    static constexpr static_fumen<Pages, Chars> decode(std::string_view _data) {
+        static_fumen<Pages, Chars> _fumen;
+        writer<Pages, Chars> _writer { _fumen };
+
+        s_decode(_data, _writer);
+
+        if (_writer.m_pages != Pages || _writer.m_chars != Chars)
+            throw std::length_error("Static fumen size mismatch");
+
+        return _fumen;
+    }
+};
+
+
+// The characters of a string literal as a constant, for operator""_fumen
+#if __cpp_nontype_template_args >= 201911L
+template <std::size_t N>
+struct static_text {
+    char m_data[N] {};
+
+    constexpr static_text(const char (&_str)[N]) {
+        for (std::size_t _i = 0; _i < N; _i++) m_data[_i] = _str[_i];
+    }
+
+    constexpr std::string_view view() const { return std::string_view(m_data, N - 1); }
+};
+#else
+template <char... Chars>
+struct static_text {
+    static constexpr char m_data[] = { Chars..., '\0' };
+
+    static constexpr std::string_view view() { return std::string_view(m_data, sizeof...(Chars)); }
+};
+#endif
+
+}
\ No newline at end of file
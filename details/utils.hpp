@@ -1,204 +1,292 @@
 #pragma once
 
-#include <format>
-
-#include <vector>
+#include <array>
 #include <string>
-
-#include <locale>
+#include <string_view>
 
 #include <details/intdef.hpp>
+#include <details/simd.hpp>
 
 namespace fumen::details {
 
+/*
+ * escape/unescape follow the JavaScript functions of the same name, which
+ * work on UTF-16 code units. Strings on the C++ side are UTF-8, so both
+ * directions convert on the fly without an intermediate std::u16string.
+ * Results are appended to a caller-provided string (std::string or any
+ * string with the same append interface, e.g. std::pmr::string), which
+ * can be reused between calls to avoid allocations.
+ */
+class static_decoder;
+
 /* static */ class converter {
-    static std::u16string utf8_to_utf16(const std::string& _str) {
-        std::u16string _result;
-        for (size_t _i = 0; _i < _str.size(); _i++) {
-            unsigned char _current = _str[_i];
-            u32 _temp = 0;
-
-            u32 _counter = 0;
-            // If '0xxxxxxx' (ASCII character)
-            if (_current < 0x80)
-            { _temp = _current; _counter = 0; }
-            // If '110xxxxx 10xxxxxx' (2-byte character)
-            else if (0xC2 <= _current && _current <= 0xDF)
-            { _temp = _current & 0x1F; _counter = 1; }
-            // If '1110xxxx 10xxxxxx 10xxxxxx' (3-byte character)
-            else if (0xE0 <= _current && _current <= 0xEF)
-            { _temp = _current & 0x0F; _counter = 2; }
-            // If '11110xxx 10xxxxxx 10xxxxxx 10xxxxxx' (4-byte character)
-            else if (0xF0 <= _current && _current <= 0xF4)
-            { _temp = _current & 0x07; _counter = 3; }
-            // Invalid UTF-8 byte
-            else { _temp = 0xFFFD; _counter = 0; }
-
-            for (u32 _j = 0; _j < _counter; _j++) {
-                if (++_i >= _str.size()) { _temp = 0xFFFD; break; }
-                
-                _current = _str[_i];
-
-                // detect overlong
-                if (_j == 0) {
-                    if (_counter == 2 && _current < 0xA0)
-                    { _temp = 0xFFFD; break; }
-                    else if (_counter == 3 && _current < 0x90)
-                    { _temp = 0xFFFD; break; }
-                }
+    // Unescapes comments with the helpers below, in constant evaluation
+    friend class static_decoder;
 
-                if (_current < 0x80 || 0xBF < _current)
-                    { _temp = 0xFFFD; break; }
+    static constexpr std::string_view s_hex_digits = "0123456789ABCDEF";
 
-                _temp <<= 6;
-                _temp |= _current & 0x3F;
-            }
+    // Characters kept as they are by escape(): A-Z a-z 0-9 @*_+-./
+    static constexpr char s_safe_lo[] = { '*', '-', '@', '_', 'a' };
+    static constexpr char s_safe_hi[] = { '+', '9', 'Z', '_', 'z' };
 
-            if (0xD800 <= _temp && _temp <= 0xDFFF)
-                _temp = 0xFFFD; // Invalid Unicode code point
+    static constexpr std::array<bool, 256> s_safe_table = [] {
+        std::array<bool, 256> _table {};
 
-            if (_temp < 0x10000)
-                _result += (char16_t)_temp;
-            else {
-                _temp -= 0x10000;
-                _result += (char16_t)(0xD800 | (_temp >> 10));
-                _result += (char16_t)(0xDC00 | (_temp & 0x3FF));
-            }
+        for (u32 _k = 0; _k < sizeof(s_safe_lo); _k++)
+            for (u32 _c = (u8)s_safe_lo[_k]; _c <= (u8)s_safe_hi[_k]; _c++)
+                _table[_c] = true;
+
+        return _table;
+    }();
+
+    // Value of a hex digit, or -1
+    static constexpr std::array<i8, 256> s_hex_table = [] {
+        std::array<i8, 256> _table {};
+
+        for (u32 _c = 0; _c < 256; _c++) _table[_c] = -1;
+        for (u32 _i = 0; _i < 10; _i++) _table['0' + _i] = _i;
+        for (u32 _i = 0; _i < 6; _i++)
+            _table['A' + _i] = _table['a' + _i] = 10 + _i;
+
+        return _table;
+    }();
+
+    // Length of the leading run which escape() copies as it is
+    static std::size_t s_safe_prefix(const char* _str, std::size_t _size) {
+        std::size_t _i = 0;
+
+        for (; _i + 16 <= _size; _i += 16) {
+            u32 _mask = simd::in_ranges_mask16(_str + _i, s_safe_lo, s_safe_hi);
+
+            if (_mask != 0xFFFFu) return _i + simd::ctz(~_mask);
         }
 
-        return _result;
+        for (; _i < _size && s_safe_table[(u8)_str[_i]]; _i++);
+
+        return _i;
     }
 
-    static std::string utf16_to_utf8(const std::u16string& _str) {
-        std::string _result;
+    // Length of the leading run without '%'
+    static std::size_t s_plain_prefix(const char* _str, std::size_t _size) {
+        std::size_t _i = 0;
 
-        for (size_t _i = 0; _i < _str.size(); _i++) {
-            char16_t _current = _str[_i];
-
-            if (_current < 0x80) {
-                _result += _current;
-            } else if (_current < 0x800) {
-                _result += (char)((_current >> 6) | 0xC0);
-                _result += (char)((_current & 0x3F) | 0x80);
-            } else if (0xD800 <= _current && _current <= 0xDFFF) {
-                if (_i + 1 < _str.size()) {
-                    char16_t _next = _str[_i + 1];
-                    if (0xDC00 <= _next && _next <= 0xDFFF) {
-
-                        uint32_t _cp = 0x10000 + (((_current - 0xD800) << 10) | (_next - 0xDC00));
-                        _result += (char)((_cp >> 18) | 0xF0);
-                        _result += (char)(((_cp >> 12) & 0x3F) | 0x80);
-                        _result += (char)(((_cp >> 6) & 0x3F) | 0x80);
-                        _result += (char)((_cp & 0x3F) | 0x80);
-                        _i += 2;
-
-                        continue;
-                    }
-                }
+        for (; _i + 16 <= _size; _i += 16) {
+            u32 _mask = simd::eq_mask16(_str + _i, '%');
 
-                _result += (char)0xEF;
-                _result += (char)0xBF;
-                _result += (char)0xBD;
-                _i++;
-                continue;
-            }  else if (0xDC00 <= _current && _current <= 0xDFFF) {
-                _result += (char)0xEF;
-                _result += (char)0xBF;
-                _result += (char)0xBD;
-                _i++;
-                continue;
-            } else {
-                _result += (char)((_current >> 12) | 0xE0);
-                _result += (char)(((_current >> 6) & 0x3F) | 0x80);
-                _result += (char)((_current & 0x3F) | 0x80);
+            if (_mask) return _i + simd::ctz(_mask);
+        }
+
+        for (; _i < _size && _str[_i] != '%'; _i++);
+
+        return _i;
+    }
+
+    template <typename String>
+    static void s_push_unit(u32 _unit, String& _out) {
+        if (_unit <= 0xFF) {
+            char _esc[3] = { '%', s_hex_digits[_unit >> 4], s_hex_digits[_unit & 0xF] };
+            _out.append(_esc, 3);
+        } else {
+            char _esc[6] = {
+                '%', 'u',
+                s_hex_digits[(_unit >> 12) & 0xF], s_hex_digits[(_unit >> 8) & 0xF],
+                s_hex_digits[(_unit >> 4) & 0xF], s_hex_digits[_unit & 0xF]
+            };
+            _out.append(_esc, 6);
+        }
+    }
+
+    // Decodes one UTF-8 sequence starting at _i and moves _i past it.
+    // An invalid sequence gives U+FFFD and consumes only its valid prefix,
+    // as TextDecoder does: an encoded surrogate is three of them.
+    static u32 s_next_code_point(std::string_view _str, std::size_t& _i) {
+        unsigned char _current = _str[_i++];
+        u32 _temp = 0;
+
+        u32 _counter = 0;
+        // If '0xxxxxxx' (ASCII character)
+        if (_current < 0x80)
+        { _temp = _current; _counter = 0; }
+        // If '110xxxxx 10xxxxxx' (2-byte character)
+        else if (0xC2 <= _current && _current <= 0xDF)
+        { _temp = _current & 0x1F; _counter = 1; }
+        // If '1110xxxx 10xxxxxx 10xxxxxx' (3-byte character)
+        else if (0xE0 <= _current && _current <= 0xEF)
+        { _temp = _current & 0x0F; _counter = 2; }
+        // If '11110xxx 10xxxxxx 10xxxxxx 10xxxxxx' (4-byte character)
+        else if (0xF0 <= _current && _current <= 0xF4)
+        { _temp = _current & 0x07; _counter = 3; }
+        // Invalid UTF-8 byte
+        else return 0xFFFD;
+
+        for (u32 _j = 0; _j < _counter; _j++) {
+            if (_i >= _str.size()) return 0xFFFD;
+
+            _current = _str[_i];
+
+            if (_current < 0x80 || 0xBF < _current) return 0xFFFD;
+
+            // detect overlong, surrogates and out of range
+            if (_j == 0) {
+                if (_counter == 2 && _temp == 0 && _current < 0xA0) return 0xFFFD;
+                if (_counter == 2 && _temp == 0xD && _current >= 0xA0) return 0xFFFD;
+                if (_counter == 3 && _temp == 0 && _current < 0x90) return 0xFFFD;
+                if (_counter == 3 && _temp == 4 && _current >= 0x90) return 0xFFFD;
             }
+
+            _temp <<= 6;
+            _temp |= _current & 0x3F;
+            _i++;
         }
 
-        return _result;
+        return _temp;
     }
 
-public:
-    static std::string escape(const std::string& _str) {
-        std::u16string _escstr = utf8_to_utf16(_str);
-        std::string _result;
+    template <typename String>
+    static constexpr void s_push_utf8(u32 _cp, String& _out) {
+        if (_cp < 0x80) {
+            _out += (char)_cp;
+        } else if (_cp < 0x800) {
+            char _seq[2] = { (char)((_cp >> 6) | 0xC0), (char)((_cp & 0x3F) | 0x80) };
+            _out.append(_seq, 2);
+        } else if (_cp < 0x10000) {
+            char _seq[3] = {
+                (char)((_cp >> 12) | 0xE0),
+                (char)(((_cp >> 6) & 0x3F) | 0x80),
+                (char)((_cp & 0x3F) | 0x80)
+            };
+            _out.append(_seq, 3);
+        } else {
+            char _seq[4] = {
+                (char)((_cp >> 18) | 0xF0),
+                (char)(((_cp >> 12) & 0x3F) | 0x80),
+                (char)(((_cp >> 6) & 0x3F) | 0x80),
+                (char)((_cp & 0x3F) | 0x80)
+            };
+            _out.append(_seq, 4);
+        }
+    }
 
-        for (char16_t  _c : _escstr) {
-            if (
-                std::isalnum(_c) ||
-                ((std::u16string)u"@*_+-./").find(_c)
-                    != std::string::npos
-            ) _result += (char)_c;
-            else {
-                if (_c <= 0xff) {
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-                    _result += "%" + std::format("{:02X}", (u16)_c);
-#else
-                    std::string _hexstr(2, '0');
-                    std::sprintf(_hexstr.data(), "%02X", (u16)_c);
-                    _result += "%" + _hexstr;
-#endif
-                }
-                else {
-#if __cplusplus >= 202002L || defined(__cpp_lib_format)
-                    _result += "%u" + std::format("{:04X}", (u16)_c);
-#else
-                    std::string _hexstr(4, '0');
-                    std::sprintf(_hexstr.data(), "%04X", (u16)_c);
-                    _result += "%u" + _hexstr;
-#endif
-                }
+    // Appends a UTF-16 code unit, pairing surrogates through _high
+    template <typename String>
+    static constexpr void s_push_utf16(u32 _unit, u32& _high, String& _out) {
+        if (_high != 0) {
+            if (0xDC00 <= _unit && _unit <= 0xDFFF) {
+                s_push_utf8(0x10000 + (((_high - 0xD800) << 10) | (_unit - 0xDC00)), _out);
+                _high = 0;
+                return;
             }
+
+            s_push_utf8(0xFFFD, _out);
+            _high = 0;
         }
 
-        return _result;
+        if (0xD800 <= _unit && _unit <= 0xDBFF) _high = _unit;
+        else if (0xDC00 <= _unit && _unit <= 0xDFFF) s_push_utf8(0xFFFD, _out);
+        else s_push_utf8(_unit, _out);
     }
 
-    static std::string unescape(const std::string& _str) {
-        std::u16string _result;
+    // Parses _cnt hex digits at _str[_i], or returns -1
+    static constexpr i32 s_parse_hex(std::string_view _str, std::size_t _i, u32 _cnt) {
+        if (_str.size() < _i + _cnt) return -1;
+
+        i32 _value = 0;
+        for (u32 _j = 0; _j < _cnt; _j++) {
+            i8 _digit = s_hex_table[(u8)_str[_i + _j]];
+            if (_digit < 0) return -1;
+
+            _value = (_value << 4) | _digit;
+        }
+
+        return _value;
+    }
+
+    // The code unit of the escape at _str[_i], moving _i past it, or -1
+    // if there is none there
+    static constexpr i32 s_parse_escape(std::string_view _str, std::size_t& _i) {
+        if (_str[_i] != '%') return -1;
+
+        i32 _unit = -1;
+
+        if (_i + 1 < _str.size() && _str[_i + 1] == 'u') {
+            _unit = s_parse_hex(_str, _i + 2, 4);
+            if (_unit >= 0) _i += 6;
+        }
+
+        if (_unit < 0) {
+            _unit = s_parse_hex(_str, _i + 1, 2);
+            if (_unit >= 0) _i += 3;
+        }
+
+        return _unit;
+    }
 
-        for (
-            std::string::const_iterator _iter = _str.begin();
-            _iter != _str.end();
-            _iter++
-        ) {
-            char _c = *_iter;
-            
-            if (_c == '%') {
-                _iter++;
+public:
+    template <typename String>
+    static void escape(std::string_view _str, String& _out) {
+        _out.reserve(_out.size() + _str.size());
 
-                if (_iter == _str.end()) break;
+        for (std::size_t _i = 0; _i < _str.size(); ) {
+            std::size_t _run = s_safe_prefix(_str.data() + _i, _str.size() - _i);
+            _out.append(_str.data() + _i, _run);
+            _i += _run;
 
-                if (*_iter == 'u') {
-                    std::string _hex; _iter++;
+            if (_i >= _str.size()) break;
 
-                    if (_iter == _str.end()) break;
+            u32 _cp = s_next_code_point(_str, _i);
 
-                    for (u32 _i = 0; _i < 4; _i++) {
-                        _hex += *_iter++;
-                        if (_iter == _str.end()) break;
-                    }
+            if (_cp < 0x10000)
+                s_push_unit(_cp, _out);
+            else {
+                _cp -= 0x10000;
+                s_push_unit(0xD800 | (_cp >> 10), _out);
+                s_push_unit(0xDC00 | (_cp & 0x3FF), _out);
+            }
+        }
+    }
 
-                    if (_hex.size() < 4) continue;
+    static std::string escape(const std::string& _str) {
+        std::string _result;
+        escape(std::string_view(_str), _result);
+        return _result;
+    }
 
-                    _result += (char16_t)std::stoul(_hex, nullptr, 16);
-                } else {
-                    std::string _hex;
+    // Bytes which are not part of an escape are copied as they are
+    template <typename String>
+    static void unescape(std::string_view _str, String& _out) {
+        _out.reserve(_out.size() + _str.size());
 
-                    for (u32 _i = 0; _i < 2; _i++) {
-                        if (_iter == _str.end()) break;
-                        _hex += *_iter++;
-                    }
+        u32 _high = 0;
 
-                    _iter--;
+        for (std::size_t _i = 0; _i < _str.size(); ) {
+            if (_high == 0) {
+                std::size_t _run = s_plain_prefix(_str.data() + _i, _str.size() - _i);
+                _out.append(_str.data() + _i, _run);
+                _i += _run;
 
-                    if (_hex.size() < 2) continue;
+                if (_i >= _str.size()) break;
+            }
+
+            i32 _unit = s_parse_escape(_str, _i);
 
-                    _result += (char16_t)std::stoul(_hex, nullptr, 16);
+            if (_unit < 0) {
+                if (_high != 0) {
+                    s_push_utf8(0xFFFD, _out);
+                    _high = 0;
                 }
-            } else _result += (char16_t)_c;
+
+                _out += _str[_i++];
+            } else
+                s_push_utf16(_unit, _high, _out);
         }
 
-        return utf16_to_utf8(_result);
+        if (_high != 0) s_push_utf8(0xFFFD, _out);
+    }
+
+    static std::string unescape(const std::string& _str) {
+        std::string _result;
+        unescape(std::string_view(_str), _result);
+        return _result;
     }
 };
 
@@ -2,12 +2,25 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 
+#include <memory>
 #include <optional>
+#include <string_view>
+#include <memory_resource>
 
 #include <details/intdef.hpp>
 #include <details/encoder.hpp>
+#include <details/result.hpp>
 #include <details/decoder.hpp>
+#include <details/intern.hpp>
+#include <details/instrument.hpp>
+#include <details/normalize.hpp>
+#include <details/dedupe.hpp>
+#include <details/pattern.hpp>
+#include <details/page_store.hpp>
+#include <details/push_decoder.hpp>
+#include <details/replay_stats.hpp>
 
 namespace fumen {
 
@@ -15,10 +28,35 @@ using field = fumen::details::field;
 using piece_type = fumen::details::piece_type;
 using rotation = fumen::details::rotation_type;
 using operation = fumen::details::field_operation;
+using intern_pool = fumen::details::intern_pool;
+using persistent_field = fumen::details::persistent_field;
+using instrument = fumen::details::instrument;
+using decode_stage = fumen::details::decode_stage;
+using decode_stats = fumen::details::decode_stats;
+using fingerprint = fumen::details::fingerprint;
+using fingerprint_hash = fumen::details::fingerprint_hash;
+using fingerprint_set = fumen::details::fingerprint_set;
+using bloom_filter = fumen::details::bloom_filter;
+using board_pattern = fumen::details::board_pattern;
+using pattern_index = fumen::details::pattern_index;
+using page_store = fumen::details::page_store;
+using decode_parts = fumen::details::decode_parts;
+using decode_limits = fumen::details::decode_limits;
+using decode_errc = fumen::details::decode_errc;
+using decode_error = fumen::details::decode_error;
+using push_decoder = fumen::details::push_decoder;
+using replay_events = fumen::details::replay_events;
+using replay_surface = fumen::details::replay_surface;
+using replay_field = fumen::details::replay_field;
+using replay_stats = fumen::details::replay_stats;
 
-struct fumen_page {
-    field m_field;
-    std::string m_comment;
+template <typename T>
+using result = fumen::details::result<T>;
+
+template <typename String, typename Field = field>
+struct basic_fumen_page {
+    Field m_field;
+    String m_comment;
     std::optional<operation> m_operation;
     union flags {
         struct {
@@ -32,8 +70,25 @@ struct fumen_page {
     } m_flags;
 };
 
+using fumen_page = basic_fumen_page<std::string>;
 using fumen_pages = std::vector<fumen_page>;
 
+// A page whose field and comment are owned by an intern_pool
+struct fumen_interned_page {
+    std::shared_ptr<const field> m_field;
+    std::string_view m_comment;
+    std::optional<operation> m_operation;
+    fumen_page::flags m_flags;
+
+    fumen_page to_page() const
+    { return fumen_page { *m_field, std::string(m_comment), m_operation, m_flags }; }
+};
+
+using fumen_interned_pages = std::vector<fumen_interned_page>;
+
+using fumen_history_page = fumen::details::history_page;
+using fumen_history = fumen::details::history;
+
 inline static char piece_to_char(piece_type _p)
 { return fumen::details::defs::to_char(_p); }
 
@@ -46,40 +101,120 @@ inline static bool is_valid_piece(char _p)
 inline static bool is_valid_piece(piece_type _p)
 { return static_cast<u8>(_p) <= 8u; }
 
-inline static std::string encode(const fumen_pages& _pgs) {
-    fumen::details::encode_pages _epgs;
-    _epgs.reserve(_pgs.size());
+// The fumen of _pgs, or the index of the first page that cannot be
+// encoded, without throwing
+inline static result<std::string> try_encode(const fumen_pages& _pgs) {
+    std::string _str = "v115@";
 
-    for (const auto& _pg : _pgs) {
-        fumen::details::encode_page _epg;
+    decode_error _error = fumen::details::encoder::try_encode(_pgs, _str);
+    if (_error) return _error;
+    return _str;
+}
 
-        _epg.m_field = _pg.m_field;
-        _epg.m_comment = _pg.m_comment;
-        if (_pg.m_operation)
-            _epg.m_operation = fumen::details::field_operation {
-                _pg.m_operation->m_piece,
-                _pg.m_operation->m_rotation,
-                _pg.m_operation->m_x,
-                _pg.m_operation->m_y
-            };
-        _epg.m_flags.all = _pg.m_flags.all;
+inline static std::string encode(const fumen_pages& _pgs)
+{ return try_encode(_pgs).value(); }
 
-        _epgs.push_back(std::move(_epg));
-    }
+inline static fumen_page to_page(const fumen::details::page& _pg) {
+    fumen_page _fpg;
 
-    return "v115@" + fumen::details::encoder::encode(_epgs);
+    _fpg.m_field = _pg.m_inner_field;
+    _fpg.m_comment = _pg.m_comment.value_or("");
+    if (_pg.m_operation)
+        _fpg.m_operation = {
+            _pg.m_operation->m_piece,
+            _pg.m_operation->m_rotation,
+            _pg.m_operation->m_x,
+            _pg.m_operation->m_y
+        };
+    _fpg.m_flags.all = _pg.m_flags.all;
+
+    return _fpg;
 }
 
+inline static fumen_pages to_pages(const fumen::details::pages& _pgs) {
+    fumen_pages _fpgs; _fpgs.reserve(_pgs.size());
+
+    for (const fumen::details::page& _pg : _pgs)
+        _fpgs.push_back(to_page(_pg));
+
+    return _fpgs;
+}
+
+inline static fumen_pages decode(const std::string& _str)
+{ return to_pages(fumen::details::decoder::decode(_str)); }
+
+// Decodes untrusted input, throwing std::length_error as soon as it goes
+// over one of _limits
+inline static fumen_pages decode(const std::string& _str, const decode_limits& _limits) {
+    fumen_pages _fpgs;
+
+    fumen::details::decoder::decode(_str, [&] (fumen::details::page&& _pg) {
+        _fpgs.push_back(to_page(_pg));
+    }, _limits);
+
+    return _fpgs;
+}
+
+// Decodes only the parts in Parts (see decode_parts), e.g.
+// decode<decode_parts::operations>(str); the other parts are left empty
+template <u32 Parts>
 inline static fumen_pages decode(const std::string& _str) {
-    fumen::details::pages _pgs = fumen::details::decoder::decode(_str);
+    fumen_pages _fpgs;
 
-    fumen_pages _fpgs; _fpgs.reserve(_pgs.size());
+    fumen::details::decoder::project<Parts>(_str, [&] (auto&& _pg) {
+        fumen_page& _fpg = _fpgs.emplace_back();
 
-    for (const fumen::details::page& _pg : _pgs) {
+        if constexpr ((Parts & decode_parts::field) != 0) _fpg.m_field = field(std::move(_pg.m_inner_field));
+        if (_pg.m_comment) _fpg.m_comment = std::move(*_pg.m_comment);
+        _fpg.m_operation = _pg.m_operation;
+        _fpg.m_flags.all = _pg.m_flags.all;
+    });
+
+    return _fpgs;
+}
+
+// The pages of fumen _idx of a page_store
+inline static fumen_pages to_pages(const page_store& _store, u32 _idx) {
+    auto [_first, _last] = _store.fumen(_idx);
+
+    fumen_pages _fpgs; _fpgs.reserve(_last - _first);
+
+    for (u64 _i = _first; _i < _last; _i++) {
         fumen_page _fpg;
 
-        _fpg.m_field = _pg.m_inner_field;
-        _fpg.m_comment = _pg.m_comment.value_or("");
+        _fpg.m_field = _store.field(_i);
+        _fpg.m_comment = _store.comment_of(_i);
+        _fpg.m_operation = _store.operation(_i);
+        _fpg.m_flags.all = _store.flags()[_i];
+
+        _fpgs.push_back(std::move(_fpg));
+    }
+
+    return _fpgs;
+}
+
+inline static fumen_interned_pages decode(const std::string& _str, intern_pool& _pool) {
+    fumen_interned_pages _fpgs;
+
+    fumen::details::decoder::decode(_str, [&] (fumen::details::page&& _pg) {
+        fumen_interned_page _fpg;
+
+        // Consecutive pages often share the field or the comment, which is
+        // cheaper to compare here than to key and look up in the pool.
+        const auto &_cells = _pg.m_inner_field.field(), &_garbage = _pg.m_inner_field.garbage();
+        if (!_fpgs.empty() &&
+            std::equal(_cells.begin(), _cells.end(), _fpgs.back().m_field->inner().field().begin()) &&
+            std::equal(_garbage.begin(), _garbage.end(), _fpgs.back().m_field->inner().garbage().begin()))
+            _fpg.m_field = _fpgs.back().m_field;
+        else
+            _fpg.m_field = _pool.intern(_pg.m_inner_field);
+
+        const std::string& _comment = *_pg.m_comment;
+        if (!_fpgs.empty() && _fpgs.back().m_comment == _comment)
+            _fpg.m_comment = _fpgs.back().m_comment;
+        else
+            _fpg.m_comment = _pool.intern(_comment);
+
         if (_pg.m_operation)
             _fpg.m_operation = {
                 _pg.m_operation->m_piece,
@@ -90,27 +225,111 @@ inline static fumen_pages decode(const std::string& _str) {
         _fpg.m_flags.all = _pg.m_flags.all;
 
         _fpgs.push_back(std::move(_fpg));
-    }
+    });
 
     return _fpgs;
 }
 
-inline static bool is_valid(const std::string& _str) {
-    try {
-        fumen::decode(_str);
-        return true;
-    } catch (...) {
-        return false;
-    }
+// The canonical v115 form of a fumen, as encode(decode(_str)) writes it
+inline static std::string normalize(std::string_view _str, fingerprint* _fp = nullptr) {
+    std::byte _stack[1 << 14];
+    std::pmr::monotonic_buffer_resource _arena(_stack, sizeof(_stack));
+
+    std::string _out;
+    fingerprint _result = fumen::details::normalizer::normalize(_str, _out, &_arena);
+    if (_fp) *_fp = _result;
+
+    return _out;
+}
+
+// Hash of the decoded content, equal for fumens with the same normalize()
+inline static fingerprint fingerprint_of(std::string_view _str) {
+    std::byte _stack[1 << 14];
+    std::pmr::monotonic_buffer_resource _arena(_stack, sizeof(_stack));
+
+    return fumen::details::normalizer::fingerprint_of(_str, &_arena);
 }
 
+// Decodes with fields sharing unchanged rows between pages, for long replays
+inline static fumen_history decode_history(const std::string& _str)
+{ return fumen::details::decoder::decode_history(_str); }
+
+// The pages of _str, or why and where it failed, without throwing
+inline static result<fumen_pages> try_decode(std::string_view _str, const decode_limits& _limits = {}) {
+    fumen_pages _fpgs;
+
+    decode_error _error = fumen::details::decoder::try_decode(_str, [&] (fumen::details::page&& _pg) {
+        _fpgs.push_back(to_page(_pg));
+    }, _limits);
+
+    if (_error) return _error;
+    return _fpgs;
+}
+
+inline static bool is_valid(const std::string& _str)
+{ return !fumen::details::decoder::try_decode(_str, [] (fumen::details::page&&) {}); }
+
 inline static bool try_decode(const std::string& _input, fumen_pages& _output) {
-    try {
-        _output = fumen::decode(_input);
-        return true;
-    } catch (...) {
-        return false;
-    }
+    result<fumen_pages> _result = try_decode(std::string_view(_input));
+    if (!_result) return false;
+
+    _output = std::move(*_result);
+    return true;
+}
+
+namespace pmr {
+
+/*
+ * The same API with pages, fields and comments allocated from a
+ * std::pmr::memory_resource, e.g. a per-thread monotonic_buffer_resource
+ * released in one shot after a batch. The resource must outlive the
+ * returned objects.
+ */
+using field = fumen::details::pmr_field;
+using fumen_page = basic_fumen_page<std::pmr::string, field>;
+using fumen_pages = std::pmr::vector<fumen_page>;
+
+inline static fumen_pages decode(
+    std::string_view _str,
+    std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+) {
+    fumen_pages _fpgs(_resource);
+
+    fumen::details::decoder::decode<fumen::details::pmr_inner_field, std::pmr::string>(
+        _str, [&] (fumen::details::pmr_page&& _pg) {
+            // Moved, so both keep the allocator of _resource
+            fumen_page _fpg {
+                field(std::move(_pg.m_inner_field)),
+                std::move(*_pg.m_comment),
+                std::nullopt,
+                {}
+            };
+
+            if (_pg.m_operation)
+                _fpg.m_operation = {
+                    _pg.m_operation->m_piece,
+                    _pg.m_operation->m_rotation,
+                    _pg.m_operation->m_x,
+                    _pg.m_operation->m_y
+                };
+            _fpg.m_flags.all = _pg.m_flags.all;
+
+            _fpgs.push_back(std::move(_fpg));
+        }, _resource
+    );
+
+    return _fpgs;
+}
+
+inline static std::pmr::string encode(
+    const fumen_pages& _pgs,
+    std::pmr::memory_resource* _resource = std::pmr::get_default_resource()
+) {
+    std::pmr::string _str("v115@", _resource);
+    fumen::details::encoder::encode(_pgs, _str, _resource);
+    return _str;
+}
+
 }
 
 }
\ No newline at end of file
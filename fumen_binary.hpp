@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * Binary page files and memory-mapped files (POSIX mmap), on top of
+ * fumen.hpp.
+ */
+
+#include <fumen.hpp>
+
+#include <details/mapped_file.hpp>
+#include <details/binary.hpp>
+
+namespace fumen {
+
+using mapped_file = fumen::details::mapped_file;
+using binary_writer = fumen::details::binary_writer;
+using binary_view = fumen::details::binary_view;
+using binary_page = fumen::details::binary_page;
+using binary_field = fumen::details::binary_field;
+
+inline static fumen_page to_page(const binary_page& _pg) {
+    fumen_page _fpg;
+
+    _fpg.m_field = _pg.m_field.to_field();
+    _fpg.m_comment = _pg.m_comment;
+    _fpg.m_operation = _pg.m_operation;
+    _fpg.m_flags.all = _pg.m_flags;
+
+    return _fpg;
+}
+
+// Pages of fumen _idx of a binary page file
+inline static fumen_pages decode(const binary_view& _view, u32 _idx) {
+    auto [_first, _last] = _view.fumen(_idx);
+
+    std::vector<binary_page> _pgs(_last - _first);
+    _view.pages(_first, _last, _pgs.data());
+
+    fumen_pages _fpgs; _fpgs.reserve(_pgs.size());
+    for (const binary_page& _pg : _pgs)
+        _fpgs.push_back(to_page(_pg));
+
+    return _fpgs;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+/*
+ * The shared decode cache and the cache files it saves and loads, on
+ * top of fumen_binary.hpp.
+ */
+
+#include <fumen_binary.hpp>
+
+#include <details/cache_file.hpp>
+#include <details/decode_cache.hpp>
+
+namespace fumen {
+
+using decode_cache = fumen::details::decode_cache;
+using cache_file = fumen::details::cache_file;
+
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * Memory-mapped corpus files, decoded on several threads; programs
+ * including this header link with the platform thread library
+ * (Threads::Threads in CMake).
+ */
+
+#include <mutex>
+
+#include <fumen_binary.hpp>
+
+#include <details/corpus.hpp>
+
+namespace fumen {
+
+using corpus = fumen::details::corpus;
+
+// Decodes the lines of _corpus for which _filter(line, version) is true and
+// calls _fn(idx, fumen_pages&&) from the worker threads, see corpus::decode_if
+template <typename Filter, typename Fn>
+inline static u64 decode_if(const corpus& _corpus, Filter&& _filter, Fn&& _fn, u32 _threads = 0) {
+    return _corpus.decode_if(_filter, [&] (u64 _idx, fumen::details::pages&& _pgs) {
+        _fn(_idx, to_pages(_pgs));
+    }, _threads);
+}
+
+// Adds the pages of every line of _corpus to _index, under the line number.
+// Returns the number of lines that failed to decode.
+inline static u64 index_patterns(const corpus& _corpus, pattern_index& _index, u32 _threads = 0) {
+    std::mutex _mutex;
+
+    return _corpus.decode_if([] (std::string_view, u32) { return true; },
+        [&] (u64 _idx, fumen::details::pages&& _pgs) {
+            std::lock_guard _lock(_mutex);
+            _index.add_pages(_idx, _pgs);
+        }, _threads);
+}
+
+}
\ No newline at end of file
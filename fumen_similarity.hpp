@@ -0,0 +1,18 @@
+#pragma once
+
+/*
+ * Nearest-board search; query_batch runs on several threads, so programs
+ * including this header link with the platform thread library
+ * (Threads::Threads in CMake).
+ */
+
+#include <fumen.hpp>
+
+#include <details/similarity.hpp>
+
+namespace fumen {
+
+using board_bits = fumen::details::board_bits;
+using similarity_index = fumen::details::similarity_index;
+
+}
\ No newline at end of file
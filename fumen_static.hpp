@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * Decoding during compilation: static_decoder and the _fumen literal.
+ */
+
+#include <fumen.hpp>
+
+#include <details/static_decoder.hpp>
+
+namespace fumen {
+
+using static_decoder = fumen::details::static_decoder;
+using static_page = fumen::details::static_page;
+
+template <u32 Pages, u32 Chars>
+using static_fumen = fumen::details::static_fumen<Pages, Chars>;
+
+// Pages decoded at compile time, see literals::operator""_fumen
+template <u32 Pages, u32 Chars>
+inline static fumen_pages to_pages(const static_fumen<Pages, Chars>& _fumen)
+{ return to_pages(_fumen.to_pages()); }
+
+/*
+ * "v115@..."_fumen decodes a fumen during compilation into a static_fumen,
+ * so a malformed one fails the build and nothing is decoded at run time:
+ *
+ *     using namespace fumen::literals;
+ *     constexpr auto tki = "v115@..."_fumen;
+ *
+ * Before C++20 this relies on string literal operator templates, a GNU
+ * extension supported by GCC and Clang; elsewhere use static_decoder.
+ */
+namespace literals {
+
+#if __cpp_nontype_template_args >= 201911L
+template <fumen::details::static_text Text>
+constexpr auto operator""_fumen() {
+    constexpr static_decoder::size_type _size = static_decoder::measure(Text.view());
+    constexpr auto _fumen = static_decoder::decode<_size.m_pages, _size.m_chars>(Text.view());
+    return _fumen;
+}
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#ifdef __clang__
+#pragma clang diagnostic ignored "-Wgnu-string-literal-operator-template"
+#endif
+template <typename Char, Char... Chars>
+constexpr auto operator""_fumen() {
+    using text = fumen::details::static_text<Chars...>;
+
+    constexpr static_decoder::size_type _size = static_decoder::measure(text::view());
+    constexpr auto _fumen = static_decoder::decode<_size.m_pages, _size.m_chars>(text::view());
+    return _fumen;
+}
+#pragma GCC diagnostic pop
+#endif
+
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// The offsets as fumen defines them, one piece and rotation at a time
+static action_offsets::offset s_offset(piece_type _piece, rotation_type _rotation) {
+    switch (_piece) {
+    case piece_type::O:
+        if (_rotation == rotation_type::spawn) return { 0, -1 };
+        if (_rotation == rotation_type::reverse) return { 1, 0 };
+        if (_rotation == rotation_type::left) return { 1, -1 };
+        break;
+    case piece_type::I:
+        if (_rotation == rotation_type::reverse) return { 1, 0 };
+        if (_rotation == rotation_type::left) return { 0, -1 };
+        break;
+    case piece_type::S:
+        if (_rotation == rotation_type::spawn) return { 0, -1 };
+        if (_rotation == rotation_type::right) return { -1, 0 };
+        break;
+    case piece_type::Z:
+        if (_rotation == rotation_type::spawn) return { 0, -1 };
+        if (_rotation == rotation_type::left) return { 1, 0 };
+        break;
+    default:
+        break;
+    }
+    return { 0, 0 };
+}
+
+static bool s_same_action(const action& _a, const action& _b) {
+    return _a.m_operation.m_piece == _b.m_operation.m_piece
+        && _a.m_operation.m_rotation == _b.m_operation.m_rotation
+        && _a.m_operation.m_x == _b.m_operation.m_x
+        && _a.m_operation.m_y == _b.m_operation.m_y
+        && _a.m_rise == _b.m_rise && _a.m_mirror == _b.m_mirror && _a.m_colorize == _b.m_colorize
+        && _a.m_comment == _b.m_comment && _a.m_lock == _b.m_lock;
+}
+
+// Every value three digits can hold, through Codec and the runtime codec
+template <typename Codec>
+static void s_check_codec() {
+    const action_codec _runtime(FIELD_WIDTH, Codec::height, GARBAGE_LINE);
+    u32 _failures = 0;
+
+    for (u32 _value = 0; _value <= Codec::max_value; _value++) {
+        action _fixed = Codec::decode(_value), _expected = _runtime.decode(_value);
+        bool _ok = s_same_action(_fixed, _expected)
+            && s_same_action(decode_action(_value, Codec::height), _expected)
+            && Codec::encode(_fixed) == _runtime.encode(_expected);
+
+        // Values with a piece and no flags past the lock bit encode back
+        // to themselves
+        if (defs::is_mino(_expected.m_operation.m_piece) && _value < 32 * 32 * Codec::block_count)
+            _ok = _ok && Codec::encode(_fixed) == _value;
+
+        if (!_ok && _failures++ < 8) std::cerr << "  height " << Codec::height << ", value " << _value << "\n";
+    }
+
+    FUMEN_CHECK(_failures == 0);
+
+    // The batch decode against the scalar one, in batches of every size
+    // up to a few chunks so the tail of each is covered
+    std::vector<u32> _values(Codec::max_value + 1);
+    for (u32 _value = 0; _value <= Codec::max_value; _value++) _values[_value] = _value;
+
+    std::vector<action> _batch(_values.size());
+    u32 _batch_failures = 0;
+
+    for (std::size_t _base = 0, _size = 1; _base < _values.size(); _base += _size, _size = _size % 200 + 1) {
+        std::size_t _n = std::min(_size, _values.size() - _base);
+        Codec::decode(_values.data() + _base, _n, _batch.data() + _base);
+    }
+
+    for (u32 _value = 0; _value <= Codec::max_value; _value++)
+        if (!s_same_action(_batch[_value], Codec::decode(_value)) && _batch_failures++ < 8)
+            std::cerr << "  height " << Codec::height << ", batch value " << _value << "\n";
+
+    FUMEN_CHECK(_batch_failures == 0);
+}
+
+int main() {
+    for (u8 _p = 0; _p <= static_cast<u8>(piece_type::gray); _p++) {
+        for (u8 _r = 0; _r < 4; _r++) {
+            piece_type _piece = static_cast<piece_type>(_p);
+            rotation_type _rotation = static_cast<rotation_type>(_r);
+
+            action_offsets::offset _got = action_offsets::get(_piece, _rotation);
+            action_offsets::offset _expected = s_offset(_piece, _rotation);
+
+            if (!FUMEN_CHECK(_got.m_x == _expected.m_x && _got.m_y == _expected.m_y))
+                std::cerr << "  piece " << +_p << ", rotation " << +_r << "\n";
+        }
+    }
+
+    s_check_codec<v110_action_codec>();
+    s_check_codec<v115_action_codec>();
+
+    return fumen::tests::result();
+}
@@ -0,0 +1,200 @@
+#include <string>
+#include <vector>
+#include <typeinfo>
+#include <stdexcept>
+
+#include <fumen_binary.hpp>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// Offset of field record _idx in _data
+static u64 s_record(const std::string& _data, u32 _idx) {
+    u64 _fields = binary_format::get<u64>(_data.data() + 40);
+    u32 _count = binary_format::get<u32>(_data.data() + 16);
+
+    return _fields + 4 * (u64(_count) + 1) + binary_format::get<u32>(_data.data() + _fields + 4 * u64(_idx));
+}
+
+// Whether field record _idx of _data is a delta
+static bool s_is_delta(const std::string& _data, u32 _idx) {
+    return binary_format::get<u32>(_data.data() + s_record(_data, _idx)) & binary_format::delta_bit;
+}
+
+// Index of the field record of page _idx
+static u32 s_field_of(const std::string& _data, u32 _idx) {
+    u64 _pages = binary_format::get<u64>(_data.data() + 32);
+    return binary_format::get<u32>(_data.data() + _pages + u64(binary_format::page_size) * _idx);
+}
+
+static bool s_same_cells(const binary_field& _binary, const inner_field& _field) {
+    bool _ok = true;
+    inner_field _unpacked = _binary.to_inner_field();
+
+    _ok &= _unpacked.field() == _field.field() && _unpacked.garbage() == _field.garbage();
+
+    for (i32 _y = -1; _y < (i32)FIELD_HEIGHT; _y++)
+        for (i32 _x = 0; _x < (i32)FIELD_WIDTH; _x++)
+            _ok &= _binary.at(_x, _y) == _unpacked.get_number_at(_x, _y);
+
+    return _ok;
+}
+
+// The type of what _fn throws, or of void if it does not
+template <typename Fn>
+static const std::type_info& s_thrown(Fn&& _fn) {
+    try {
+        _fn();
+    } catch (const std::exception& _e) {
+        return typeid(_e);
+    }
+    return typeid(void);
+}
+
+int main() {
+    /*
+     * Four rows, then the same with one row changed, which is stored as a
+     * delta on the first, then a single row, for which a delta on the
+     * first would be larger than the row itself.
+     */
+    const std::string _rows = "IIIIIIIII_" "LLLLLLLLL_" "JJJJJJJJJ_" "OOOOOOOOO_";
+    const fumen::fumen_pages _hand = {
+        fumen::tests::page(_rows).comment("a"),
+        fumen::tests::page("IIIIIIIII_" "LLLLLLLLL_" "JJJJ_JJJJ_" "OOOOOOOOO_").comment("b"),
+        fumen::tests::page("IIIIIIIII_" "LLLLLLLLL_" "JJJJ_JJJJ_" "OOOOOOOOO_").comment("b"),
+        fumen::tests::page("TTT_______").comment("a"),
+        fumen::tests::page(_rows).comment("a"),
+    };
+
+    binary_writer _writer;
+    _writer.add(_hand);
+    for (const char* _data : fumen::tests::samples) _writer.add(fumen::decode(_data));
+    _writer.add(_hand);
+
+    const std::string _data = _writer.data();
+    binary_view _view(_data);
+
+    FUMEN_CHECK(_view.fumen_count() == std::size(fumen::tests::samples) + 2);
+    FUMEN_CHECK(_view.page_count() == _writer.page_count());
+
+    // Every page reads back as it was added, the cells by at() and unpacked
+    for (u32 _f = 0; _f < _view.fumen_count(); _f++) {
+        fumen::fumen_pages _pages = _f == 0 || _f == _view.fumen_count() - 1
+            ? _hand : fumen::decode(fumen::tests::samples[_f - 1]);
+
+        auto [_first, _last] = _view.fumen(_f);
+        if (!FUMEN_CHECK(_last - _first == _pages.size())) continue;
+
+        for (u32 _i = _first; _i < _last; _i++) {
+            binary_page _page = _view.page(_i);
+            const fumen::fumen_page& _expected = _pages[_i - _first];
+
+            FUMEN_CHECK(s_same_cells(_page.m_field, _expected.m_field.inner()));
+            FUMEN_CHECK(_page.m_comment == _expected.m_comment);
+            FUMEN_CHECK(fumen::tests::same_operation(_page.m_operation, _expected.m_operation));
+            FUMEN_CHECK(_page.m_flags == _expected.m_flags.all);
+
+            // Equal fields of one fumen are one record, different fields not
+            if (_i > _first) {
+                const fumen::fumen_page& _prev = _pages[_i - _first - 1];
+                bool _equal = _prev.m_field.inner().field() == _expected.m_field.inner().field()
+                    && _prev.m_field.inner().garbage() == _expected.m_field.inner().garbage();
+
+                FUMEN_CHECK(_view.page(_i - 1).m_field.same_record(_page.m_field) == _equal);
+            }
+        }
+    }
+
+    // The second four rows are a delta, the single row is full again
+    FUMEN_CHECK(!s_is_delta(_data, s_field_of(_data, 0)));
+    FUMEN_CHECK(s_is_delta(_data, s_field_of(_data, 1)));
+    FUMEN_CHECK(!s_is_delta(_data, s_field_of(_data, 3)));
+
+    // The same fumen added again is stored as the same records, comments
+    // are deduplicated over the file
+    const u32 _again = _view.fumen(_view.fumen_count() - 1).first;
+    for (u32 _i = 0; _i < _hand.size(); _i++) {
+        FUMEN_CHECK(_view.page(_i).m_field.same_record(_view.page(_again + _i).m_field));
+        FUMEN_CHECK(_view.page(_i).m_comment.data() == _view.page(_again + _i).m_comment.data());
+    }
+    FUMEN_CHECK(_view.page(0).m_field.same_record(_view.page(4).m_field));
+
+    // Files that are cut short, not of this format or version, or with a
+    // delta on a delta are rejected
+    FUMEN_CHECK(s_thrown([&] { binary_view { _data.substr(0, _data.size() - 1) }; }) == typeid(std::invalid_argument));
+    FUMEN_CHECK(s_thrown([&] { binary_view { _data.substr(0, binary_format::header_size - 1) }; }) == typeid(std::invalid_argument));
+    FUMEN_CHECK(s_thrown([&] { binary_view { std::string_view() }; }) == typeid(std::invalid_argument));
+
+    std::string _bad_magic = _data;
+    _bad_magic[0] = 'X';
+    FUMEN_CHECK(s_thrown([&] { binary_view { _bad_magic }; }) == typeid(std::invalid_argument));
+
+    std::string _bad_version = _data;
+    _bad_version[4] = binary_format::version + 1;
+    FUMEN_CHECK(s_thrown([&] { binary_view { _bad_version }; }) == typeid(std::logic_error));
+
+    u32 _delta = s_field_of(_data, 1);
+    std::string _chained = _data;
+    for (u32 _i = 0; _i < 4; _i++) _chained[s_record(_data, _delta) + 4 + _i] = static_cast<char>(_delta >> (_i * 8));
+
+    binary_view _chained_view(_chained);
+    FUMEN_CHECK(s_thrown([&] { _chained_view.page(1); }) == typeid(std::invalid_argument));
+    FUMEN_CHECK(s_thrown([&] { _chained_view.page(0); }) == typeid(void));
+
+    // Every operation an action can hold is stored as it was decoded, the
+    // ones the offsets move off the field included
+    for (u32 _value = 0; _value <= v115_action_codec::max_value; _value++) {
+        action _act = decode_action(_value, _value % 2 ? v115_action_codec::height : v110_action_codec::height);
+        if (_act.m_operation.m_piece == piece_type::empty) continue;
+
+        const inner_operation& _op = _act.m_operation;
+        std::optional<field_operation> _packed = binary_format::unpack_operation(
+            binary_format::pack_operation(field_operation { _op.m_piece, _op.m_rotation, _op.m_x, _op.m_y }));
+
+        if (!FUMEN_CHECK(fumen::tests::same_operation(_packed, field_operation { _op.m_piece, _op.m_rotation, _op.m_x, _op.m_y })))
+            break;
+    }
+
+    // Unlocked pages with such operations, through a fumen and a file:
+    // an I at x = 10, an S at x = -1 and an O at y = -2
+    fumen::fumen_pages _edges = { fumen::tests::page(""), fumen::tests::page(""), fumen::tests::page("") };
+    _edges[0].m_operation = field_operation { piece_type::I, rotation_type::reverse, 10, 5 };
+    _edges[1].m_operation = field_operation { piece_type::S, rotation_type::right, static_cast<u32>(-1), 5 };
+    _edges[2].m_operation = field_operation { piece_type::O, rotation_type::left, 4, static_cast<u32>(-2) };
+
+    fumen::fumen_pages _decoded = fumen::decode(fumen::encode(_edges));
+    binary_writer _edge_writer;
+    _edge_writer.add(_decoded);
+
+    const std::string _edge_data = _edge_writer.data();
+    fumen::fumen_pages _read = fumen::decode(binary_view(_edge_data), 0);
+
+    if (FUMEN_CHECK(_decoded.size() == _edges.size() && _read.size() == _edges.size()))
+        for (std::size_t _i = 0; _i < _edges.size(); _i++) {
+            FUMEN_CHECK(fumen::tests::same_operation(_decoded[_i].m_operation, _edges[_i].m_operation));
+            FUMEN_CHECK(fumen::tests::same_operation(_read[_i].m_operation, _edges[_i].m_operation));
+        }
+
+    // The operation column, decoded in batches, against pages one at a time
+    std::vector<std::optional<field_operation>> _ops(_view.page_count());
+    _view.operations(0, _view.page_count(), _ops.data());
+
+    u32 _mismatches = 0;
+    for (u32 _i = 0; _i < _view.page_count(); _i++)
+        _mismatches += !fumen::tests::same_operation(_ops[_i], _view.page(_i).m_operation);
+
+    FUMEN_CHECK(_mismatches == 0);
+    FUMEN_CHECK(_view.page_count() > 64);
+
+    if (_view.page_count() > 1) {
+        std::optional<field_operation> _last;
+        _view.operations(_view.page_count() - 1, _view.page_count(), &_last);
+        FUMEN_CHECK(fumen::tests::same_operation(_last, _ops.back()));
+    }
+
+    FUMEN_CHECK(s_thrown([&] { _view.operations(1, 0, _ops.data()); }) == typeid(std::out_of_range));
+    FUMEN_CHECK(s_thrown([&] { _view.operations(0, _view.page_count() + 1, _ops.data()); }) == typeid(std::out_of_range));
+
+    return fumen::tests::result();
+}
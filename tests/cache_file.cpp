@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <fumen_cache.hpp>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// A fumen that decodes to cells above gray, which a cache file cannot store
+static const char* const s_unstorable = "v115@vWEplQDAURfBAScQAA8NBf/ATvA";
+
+static std::string s_read(const std::string& _path) {
+    std::ifstream _in(_path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(_in), {});
+}
+
+static void s_write(const std::string& _path, const std::string& _data) {
+    std::ofstream(_path, std::ios::binary | std::ios::trunc).write(_data.data(), _data.size());
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return 2;
+    std::string _path = argv[1];
+
+    {
+        decode_cache _cache(64);
+        for (const char* _fumen : fumen::tests::samples) _cache.decode(_fumen);
+        _cache.decode(s_unstorable);
+
+        // Every sample is kept, and the unstorable fumen is left out
+        u32 _saved = _cache.save(_path);
+        FUMEN_CHECK(_saved == std::size(fumen::tests::samples));
+    }
+
+    {
+        decode_cache _cache(64);
+        _cache.load(_path);
+
+        for (const char* _fumen : fumen::tests::samples) {
+            pages _fresh = decoder::decode(std::string(_fumen));
+            FUMEN_CHECK(fumen::tests::same_pages(*_cache.decode(_fumen), _fresh));
+        }
+
+        FUMEN_CHECK(_cache.stats().m_file_hits == std::size(fumen::tests::samples));
+    }
+
+    // A changed byte anywhere, the header included, is rejected
+    std::string _data = s_read(_path);
+    for (std::size_t _offset : { std::size_t(12), std::size_t(40), cache_file::header_size + 3, _data.size() - 1 }) {
+        std::string _damaged = _data;
+        _damaged[_offset] ^= 0x10;
+        s_write(_path, _damaged);
+
+        bool _rejected = false;
+        try {
+            cache_file _file(_path);
+        } catch (const std::exception&) {
+            _rejected = true;
+        }
+        FUMEN_CHECK(_rejected);
+    }
+
+    std::remove(_path.c_str());
+    return fumen::tests::result();
+}
\ No newline at end of file
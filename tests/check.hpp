@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <optional>
+#include <string_view>
+#include <iostream>
+
+#include <fumen.hpp>
+
+/*
+ * The tests are plain executables run by ctest. A failed check prints its
+ * expression and location and the run goes on, so one run reports every
+ * failure; the process then exits with 1.
+ */
+#define FUMEN_CHECK(_cond) fumen::tests::check((_cond), #_cond, __FILE__, __LINE__)
+
+namespace fumen::tests {
+
+inline int failures = 0;
+
+inline bool check(bool _ok, const char* _expr, const char* _file, int _line) {
+    if (!_ok) {
+        std::cerr << _file << ":" << _line << ": check failed: " << _expr << "\n";
+        failures++;
+    }
+    return _ok;
+}
+
+inline int result() { return failures ? 1 : 0; }
+
+// Fumens covering quizzes, comments, repeat counters and v110
+inline const char* const samples[] = {
+    // Quiz on every page
+    "v115@vhGSxQaAFLDmClcJSAVDEHBEooRBMoAVBq+CMCaNBA?AmmBVvB7bBJYBcpB3aB",
+    // Quiz on some pages, plain comments on others
+    "v115@HfwwAewh9eglMeg0ueQpBeQpLewhTeQpCecCBvhJAA?AtMBAglykYUAFLDmClcJSAVDEHBEooRBJoAVBmrIAgWMAfo?w2Bl8d3BlyL0CAgWUAFLDmClcJSAVDEHBEooRBJoAVBaTuA?AAgWUAFLDmClcJSAVDEHBEooRBJoAVBAgWAA",
+    // Comments, and unchanged fields under repeat counters
+    "v115@vhLRwgqIIKtAbCJsvZDAQlqBAGHXAAlsIMGPFAooMD?EPBAAAsHPAA95mAgl2af",
+    "v115@vhKEkIbiInaBNhIrYBAgHzlBAAAqtPUAke88Aw0jJE?uXpTASom2AwngHB7sXAA/wA",
+    "v115@RfwwFfAtBeAtAeA8AeAtQ4CeA8CeA8wwQ4KewwGeQp?JeglDewwA8EeglEeAtMeA8EeHGEvhBl3AWhQPAPJtJEFMVA?BBoo2AURdBA",
+    // Field diffs without comments
+    "v115@Vgg0AewwAeglAeAtBeQpAeAtFeQ4FeQpIeA8AeA8Be?QpDewhAeA8JeQpAewhBeAtIeQ4GewwglBeglDe8CBvhDcqI?DmH6TIC8n",
+    "v115@vhCAgHAgHvHe",
+    // v110: a comment, a repeat counter and an unlocked last page
+    "v110@neI3qbVRPHA2qm2AA8lCA7eBDaBxXB7eAO0c",
+};
+
+// The pages of _data, decoded with decoder::decode
+inline fumen::details::pages decode(std::string_view _data) {
+    fumen::details::pages _pages;
+    fumen::details::decoder::decode(_data, [&] (fumen::details::page&& _pg) { _pages.push_back(std::move(_pg)); });
+    return _pages;
+}
+
+// _data fed to a push_decoder _chunk characters at a time, its pages
+// appended to _pages; the error of the feed or finish
+inline fumen::details::decode_error feed(std::string_view _data, std::size_t _chunk, fumen::details::pages& _pages,
+    const fumen::details::decode_limits& _limits = {}) {
+    fumen::details::push_decoder _decoder(_limits);
+
+    for (std::size_t _i = 0; _i < _data.size(); _i += _chunk) {
+        fumen::details::decode_error _error = _decoder.try_feed(_data.substr(_i, _chunk), [&] (fumen::details::page&& _pg) {
+            _pages.push_back(std::move(_pg));
+        });
+        if (_error) return _error;
+    }
+
+    return _decoder.try_finish();
+}
+
+// A deterministic stream of numbers for generated boards and inputs
+inline u32 next(u64& _state) {
+    _state = _state * 6364136223846793005ull + 1442695040888963407ull;
+    return static_cast<u32>(_state >> 33);
+}
+
+/*
+ * A page to build test input from, set up in one expression:
+ * page("___X______" "XXX___XXXX").comment("a").lock(piece_type::T, rotation_type::spawn, 4, 0)
+ * An empty field string leaves the field empty, an empty garbage string
+ * leaves the garbage line empty.
+ */
+struct page : fumen::fumen_page {
+    page() = default;
+    explicit page(const std::string& _field, const std::string& _garbage = "") {
+        m_field = _garbage.empty() ? fumen::field(_field) : fumen::field(_field, _garbage);
+    }
+
+    page& comment(const std::string& _comment) { m_comment = _comment; return *this; }
+
+    // Locks _piece at (_x, _y), the lock bit set as an operation needs
+    page& lock(fumen::details::piece_type _piece, fumen::details::rotation_type _rotation, u32 _x, u32 _y) {
+        m_operation = fumen::details::field_operation { _piece, _rotation, _x, _y };
+        m_flags.lock_bit = 1;
+        return *this;
+    }
+};
+
+inline bool same_operation(const std::optional<fumen::details::field_operation>& _a,
+    const std::optional<fumen::details::field_operation>& _b) {
+    if (!_a || !_b) return !_a && !_b;
+
+    return _a->m_piece == _b->m_piece && _a->m_rotation == _b->m_rotation
+        && _a->m_x == _b->m_x && _a->m_y == _b->m_y;
+}
+
+template <typename Page>
+bool same_page(const Page& _a, const Page& _b) {
+    return _a.m_idx == _b.m_idx
+        && _a.m_inner_field.field() == _b.m_inner_field.field()
+        && _a.m_inner_field.garbage() == _b.m_inner_field.garbage()
+        && same_operation(_a.m_operation, _b.m_operation)
+        && _a.m_comment == _b.m_comment
+        && _a.m_refs.m_field == _b.m_refs.m_field
+        && _a.m_refs.m_comment == _b.m_refs.m_comment
+        && _a.m_flags.all == _b.m_flags.all;
+}
+
+template <typename Pages>
+bool same_pages(const Pages& _a, const Pages& _b) {
+    if (_a.size() != _b.size()) return false;
+
+    for (std::size_t _i = 0; _i < _a.size(); _i++)
+        if (!same_page(_a[_i], _b[_i])) return false;
+
+    return true;
+}
+
+}
\ No newline at end of file
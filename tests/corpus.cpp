@@ -0,0 +1,209 @@
+#include <set>
+#include <mutex>
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <fumen_corpus.hpp>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+static std::string s_read(const std::string& _path) {
+    std::ifstream _in(_path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(_in), {});
+}
+
+static void s_write(const std::string& _path, const std::string& _data) {
+    std::ofstream(_path, std::ios::binary | std::ios::trunc).write(_data.data(), _data.size());
+}
+
+// Sets the modification time of _path to _seconds after the epoch
+static void s_touch(const std::string& _path, i64 _seconds) {
+    struct timespec _times[2] = { { _seconds, 0 }, { _seconds, 0 } };
+    ::utimensat(AT_FDCWD, _path.c_str(), _times, 0);
+}
+
+// An index of _path as corpus saves it, with _offsets as its lines
+static std::string s_index(const std::string& _path, const std::vector<u64>& _offsets) {
+    mapped_file _file(_path);
+
+    std::string _index(corpus::magic, 4);
+    binary_format::put<u32>(_index, corpus::version);
+    binary_format::put<u64>(_index, _file.size());
+    binary_format::put<i64>(_index, _file.mtime());
+    binary_format::put<u64>(_index, _offsets.size());
+    for (u64 _offset : _offsets) binary_format::put<u64>(_index, _offset);
+
+    return _index;
+}
+
+static bool s_lines(const corpus& _corpus, const std::vector<std::string>& _lines) {
+    if (_corpus.size() != _lines.size()) return false;
+
+    for (u64 _i = 0; _i < _lines.size(); _i++)
+        if (_corpus[_i] != _lines[_i] || _corpus.at(_i) != _lines[_i]) return false;
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return 2;
+    const std::string _path = argv[1], _index = corpus::index_path(_path);
+    std::remove(_index.c_str());
+
+    // Blank, whitespace-only and CRLF lines, and no newline at the end
+    s_write(_path,
+        "v115@vhCAgHAgHvHe\r\n"
+        "\n"
+        "   \t \r\n"
+        "v115@vhAR!BehTaMeVrB  \n"
+        "\r\n"
+        "not a fumen\n"
+        "v110@neI3qbVRPHA2qm2AA8lCA7eBDaBxXB7eAO0c\n"
+        "v114@vhARwBehTaMeVrB\n"
+        "v115@vhKEkIbiInaBNhIrYBAgHzlBAAAqtPUAke88Aw0jJE?uXpTASom2AwngHB7sXAA/wA");
+
+    const std::vector<std::string> _lines = {
+        "v115@vhCAgHAgHvHe",
+        "v115@vhAR!BehTaMeVrB",
+        "not a fumen",
+        "v110@neI3qbVRPHA2qm2AA8lCA7eBDaBxXB7eAO0c",
+        "v114@vhARwBehTaMeVrB",
+        "v115@vhKEkIbiInaBNhIrYBAgHzlBAAAqtPUAke88Aw0jJE?uXpTASom2AwngHB7sXAA/wA",
+    };
+
+    // Built, then saved beside the file, only when asked to
+    {
+        corpus _corpus(_path, false);
+        FUMEN_CHECK(s_lines(_corpus, _lines));
+        FUMEN_CHECK(s_read(_index).empty());
+    }
+
+    std::string _built;
+    {
+        corpus _corpus(_path);
+        FUMEN_CHECK(s_lines(_corpus, _lines));
+        bool _thrown = false;
+        try { _corpus.at(_lines.size()); } catch (const std::out_of_range&) { _thrown = true; }
+        FUMEN_CHECK(_thrown);
+
+        _built = s_read(_index);
+        FUMEN_CHECK(_built.size() == corpus::header_size + 8 * _lines.size());
+
+        // A moved corpus still reads its index
+        corpus _moved = std::move(_corpus);
+        FUMEN_CHECK(s_lines(_moved, _lines));
+    }
+
+    // Reopened, the saved index is used as it is: one that lists the first
+    // line only gives one line
+    s_write(_index, s_index(_path, { 0 }));
+    {
+        corpus _corpus(_path);
+        FUMEN_CHECK(_corpus.size() == 1 && _corpus[0] == _lines[0]);
+
+        corpus _moved = std::move(_corpus);
+        FUMEN_CHECK(_moved.size() == 1 && _moved[0] == _lines[0]);
+    }
+
+    // Damaged or stale indexes are rebuilt, and saved again
+    std::string _bad_magic = _built, _bad_version = _built, _bad_offset = s_index(_path, { 0, 1u << 20 });
+    _bad_magic[0] = 'X';
+    _bad_version[4]++;
+
+    for (const std::string& _damaged : { _bad_magic, _bad_version, _bad_offset, _built.substr(0, _built.size() - 1),
+        _built.substr(0, corpus::header_size - 1), std::string() }) {
+        s_write(_index, _damaged);
+
+        corpus _corpus(_path);
+        FUMEN_CHECK(s_lines(_corpus, _lines));
+        FUMEN_CHECK(s_read(_index) == _built);
+    }
+
+    // The same size with another line break and modification time, then
+    // another size
+    std::string _data = s_read(_path);
+    std::vector<std::string> _changed = _lines;
+    _data[_data.find("not a") + 3] = '\n';
+    _changed[2] = "not";
+    _changed.insert(_changed.begin() + 3, "a fumen");
+
+    s_write(_path, _data);
+    s_touch(_path, 1000000000);
+    {
+        corpus _corpus(_path);
+        FUMEN_CHECK(s_lines(_corpus, _changed));
+    }
+
+    _data += "\nv115@vhCAgHAgHvHe\n\n";
+    _changed.push_back("v115@vhCAgHAgHvHe");
+    s_write(_path, _data);
+    {
+        corpus _corpus(_path);
+        FUMEN_CHECK(s_lines(_corpus, _changed));
+    }
+
+    corpus _corpus(_path);
+
+    // Samples are distinct indices in range, ascending; asking for more than
+    // there are gives all of them
+    for (u64 _count : { 0, 1, 3, 7, 100 }) {
+        for (u64 _seed : { 1, 2, 3 }) {
+            std::vector<u64> _sample = _corpus.sample(_count, _seed);
+            FUMEN_CHECK(_sample.size() == std::min<u64>(_count, _corpus.size()));
+
+            for (std::size_t _i = 0; _i < _sample.size(); _i++) {
+                FUMEN_CHECK(_sample[_i] < _corpus.size());
+                if (_i > 0) FUMEN_CHECK(_sample[_i - 1] < _sample[_i]);
+            }
+        }
+    }
+    FUMEN_CHECK(_corpus.sample(3, 7) == _corpus.sample(3, 7));
+
+    // Lines without a header are skipped, others filtered by version, and
+    // those which fail to decode counted
+    std::mutex _mutex;
+    std::set<u64> _decoded;
+    auto _collect = [&] (u64 _idx, pages&& _pages) {
+        std::lock_guard _lock(_mutex);
+        FUMEN_CHECK(!_pages.empty());
+        _decoded.insert(_idx);
+    };
+
+    u64 _failures = _corpus.decode_if([] (std::string_view, u32) { return true; }, _collect, 4);
+    FUMEN_CHECK(_failures == 1);
+    FUMEN_CHECK(_decoded == std::set<u64>({ 0, 4, 6, 7 }));
+
+    _decoded.clear();
+    _failures = _corpus.decode_if([] (std::string_view, u32 _version) { return _version == 110; }, _collect);
+    FUMEN_CHECK(_failures == 0);
+    FUMEN_CHECK(_decoded == std::set<u64>({ 4 }));
+
+    // More threads than chunks: every line is seen once
+    std::vector<u32> _seen(_corpus.size());
+    _corpus.for_each([&] (u64 _idx, std::string_view _line) {
+        FUMEN_CHECK(_line == _changed[_idx]);
+        _seen[_idx]++;
+    }, 16);
+    FUMEN_CHECK(std::all_of(_seen.begin(), _seen.end(), [] (u32 _n) { return _n == 1; }));
+
+    // An exception thrown for one line comes out of the loop
+    bool _rethrown = false;
+    try {
+        _corpus.for_each([] (u64 _idx, std::string_view) { if (_idx == 2) throw std::runtime_error("line 2"); }, 16);
+    } catch (const std::runtime_error&) {
+        _rethrown = true;
+    }
+    FUMEN_CHECK(_rethrown);
+
+    std::remove(_path.c_str());
+    std::remove(_index.c_str());
+    return fumen::tests::result();
+}
@@ -0,0 +1,94 @@
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdexcept>
+
+#include <fumen_cache.hpp>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// A fumen of _blocks * 64 empty pages, each block under one repeat counter
+static std::string s_repeated(u32 _blocks) {
+    std::string _fumen = "v115@";
+    for (u32 _b = 0; _b < _blocks; _b++) {
+        _fumen += "vh/";
+        for (u32 _i = 0; _i < 64; _i++) _fumen += "AgH";
+    }
+    return _fumen;
+}
+
+// The fumens made of _data cut at each page boundary, shortest first
+static std::vector<std::string> s_prefixes(const std::string& _data) {
+    std::string _extracted;
+    u32 _version = decoder::extract(_data, _extracted);
+
+    std::string _header = _version == 115 ? "v115@" : "v110@";
+    std::vector<std::string> _prefixes;
+
+    decoder::resume_point<> _state;
+    decoder::resume(_extracted, _version, _state, [] (page&&) {},
+        [&] (const decoder::resume_point<>& _point, bool) {
+            _prefixes.push_back(_header + _extracted.substr(0, _point.m_offset));
+        });
+
+    return _prefixes;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return 2;
+    std::string _path = argv[1];
+
+    decode_limits _limits;
+    _limits.m_max_pages = 1000;
+
+    // Cached or not, a fumen over the limits is rejected every time
+    decode_cache _cache(64, true, 8, _limits);
+    for (int _i = 0; _i < 2; _i++) {
+        bool _rejected = false;
+        try {
+            _cache.decode(s_repeated(20));
+        } catch (const std::length_error&) {
+            _rejected = true;
+        }
+        FUMEN_CHECK(_rejected);
+    }
+
+    FUMEN_CHECK(_cache.decode(s_repeated(10))->size() == 64 * 10);
+
+    // Each fumen resumes from the one before, a page shorter, and must
+    // decode as it does alone
+    decode_cache _resumed(64, true, 1);
+    for (const char* _data : fumen::tests::samples)
+        for (const std::string& _prefix : s_prefixes(_data))
+            FUMEN_CHECK(fumen::tests::same_pages(*_resumed.decode(_prefix), fumen::tests::decode(_prefix)));
+
+    FUMEN_CHECK(_resumed.stats().m_resumed > 0);
+
+    // After a warm start the shortest prefixes come from the file, and
+    // the fumens extending them are decoded from their first page
+    decode_cache _saved(64);
+    for (const char* _data : fumen::tests::samples) _saved.decode(s_prefixes(_data).front());
+    _saved.save(_path);
+
+    decode_cache _warm(64);
+    _warm.load(_path);
+
+    for (const char* _data : fumen::tests::samples) {
+        std::vector<std::string> _prefixes = s_prefixes(_data);
+
+        for (std::size_t _i = 0; _i < _prefixes.size(); _i++) {
+            u64 _resumed = _warm.stats().m_resumed;
+            FUMEN_CHECK(fumen::tests::same_pages(*_warm.decode(_prefixes[_i]), fumen::tests::decode(_prefixes[_i])));
+
+            if (_i == 1) FUMEN_CHECK(_warm.stats().m_resumed == _resumed);
+        }
+    }
+
+    FUMEN_CHECK(_warm.stats().m_file_hits == std::size(fumen::tests::samples));
+
+    std::remove(_path.c_str());
+
+    return fumen::tests::result();
+}
\ No newline at end of file
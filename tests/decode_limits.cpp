@@ -0,0 +1,98 @@
+#include <string>
+#include <string_view>
+#include <stdexcept>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// What decoding _data takes of each limit of decode_limits
+static decode_limits s_needs(std::string_view _data) {
+    std::string _extracted;
+    u32 _version = decoder::extract(_data, _extracted);
+
+    // The comment bytes and work the decoder counted by the last page
+    decoder::resume_point<> _state;
+    decoder::resume(_extracted, _version, _state, [] (page&&) {}, [] (const auto&, bool) {});
+
+    pages _pages = fumen::tests::decode(_data);
+
+    decode_limits _needs;
+    _needs.m_max_input = _data.size();
+    _needs.m_max_pages = _pages.size();
+    _needs.m_max_comment_bytes = _state.m_comment_bytes;
+    _needs.m_max_work = _state.m_work;
+
+    // Stored comments are charged as escaped in the data, so only the
+    // ones carried over to pages without a comment are known here
+    u64 _carried = 0;
+    for (const page& _page : _pages)
+        if (_page.m_refs.m_comment) _carried += _pages[*_page.m_refs.m_comment].m_comment->size();
+    FUMEN_CHECK(_state.m_comment_bytes >= _carried);
+
+    // Each page is charged for a diff over every cell, then copying and
+    // locking its field, and the work for each comment byte
+    u32 _height = _version == 115 ? 23 : 21;
+    u64 _page_work = FIELD_WIDTH * (_height + GARBAGE_LINE) + 2 * (PLAY_BLOCKS + FIELD_WIDTH);
+    FUMEN_CHECK(_state.m_work == _pages.size() * _page_work + _state.m_comment_bytes);
+
+    return _needs;
+}
+
+// Decodes _data under _limits through decode, project and push_decoder,
+// checks that all three stop with _code, and returns whether they do
+static bool s_check(std::string_view _data, const decode_limits& _limits, decode_errc _code) {
+    bool _ok = true;
+
+    decode_error _decoded = decoder::try_decode(_data, [] (page&&) {}, _limits);
+    _ok &= FUMEN_CHECK(_decoded.m_code == _code);
+
+    decode_error _projected = decoder::try_project<decode_parts::all>(_data, [] (auto&&) {}, _limits);
+    _ok &= FUMEN_CHECK(_projected.m_code == _code && _projected.m_offset == _decoded.m_offset);
+
+    for (std::size_t _chunk : { std::size_t(1), std::size_t(7), SIZE_MAX }) {
+        pages _pages;
+        _ok &= FUMEN_CHECK(fumen::tests::feed(_data, _chunk, _pages, _limits).m_code == _code);
+    }
+
+    // The throwing decode throws std::length_error for all of them
+    bool _thrown = false;
+    try {
+        decoder::decode(_data, [] (page&&) {}, _limits);
+    } catch (const std::length_error&) {
+        _thrown = true;
+    }
+    _ok &= FUMEN_CHECK(_thrown == (_code != decode_errc::ok));
+
+    return _ok;
+}
+
+int main() {
+    for (std::string_view _data : fumen::tests::samples) {
+        decode_limits _needs = s_needs(_data);
+        bool _ok = true;
+
+        // Each limit exactly at what _data takes, then one below it
+        auto _boundary = [&] (u64 decode_limits::* _limit, decode_errc _code) {
+            decode_limits _limits;
+            _limits.*_limit = _needs.*_limit;
+            _ok &= s_check(_data, _limits, decode_errc::ok);
+
+            if (_needs.*_limit == 0) return;
+            _limits.*_limit = _needs.*_limit - 1;
+            _ok &= s_check(_data, _limits, _code);
+        };
+
+        _boundary(&decode_limits::m_max_input, decode_errc::input_too_long);
+        _boundary(&decode_limits::m_max_pages, decode_errc::too_many_pages);
+        _boundary(&decode_limits::m_max_comment_bytes, decode_errc::too_many_comment_bytes);
+        _boundary(&decode_limits::m_max_work, decode_errc::work_limit_exceeded);
+
+        // All of them at once
+        _ok &= s_check(_data, _needs, decode_errc::ok);
+
+        if (!_ok) std::cerr << "  for " << _data << "\n";
+    }
+
+    return fumen::tests::result();
+}
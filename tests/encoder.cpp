@@ -0,0 +1,114 @@
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// An unlocked page showing _field, with _garbage as its garbage row
+static std::string s_rows(const std::string& _row, u32 _count) {
+    std::string _rows;
+    for (u32 _i = 0; _i < _count; _i++) _rows += _row;
+    return _rows;
+}
+
+struct encode_case {
+    fumen::fumen_pages m_pages;
+    const char* m_expected;
+};
+
+int main() {
+    // Decoded and encoded again, a v115 fumen is given back as it was,
+    // and any fumen once it has been encoded
+    for (const char* _data : fumen::tests::samples) {
+        std::string _encoded = fumen::encode(fumen::decode(_data));
+        if (*decoder::version(_data) == 115) FUMEN_CHECK(_encoded == _data);
+
+        FUMEN_CHECK(fumen::encode(fumen::decode(_encoded)) == _encoded);
+    }
+
+    const std::string _empty = "__________";
+
+    /*
+     * Hand-built fields against the strings of the scalar run-length
+     * encoder they replaced. Cells are diffed top row first, garbage
+     * last, and the scan compares 16 cells at a time from cell 1, so
+     * changes at cells 16, 17, 32 and 33 (x = 6 and 7 of y = 21, x = 2
+     * and 3 of y = 20) sit on the edges of its loads.
+     */
+    const encode_case _cases[] = {
+        // Full rows
+        { { fumen::tests::page("XXXXXXXXXX") }, "v115@bhJ8JeAAe" },
+        { { fumen::tests::page("IIIIIIIIII" "LLLLLLLLLL"), fumen::tests::page("") }, "v115@Rh5hplJeAAeRhZapWJeAAe" },
+        { { fumen::tests::page(s_rows("XXXXXXXXXX", 23)) }, "v115@l/JeAAe" },
+        { { fumen::tests::page(s_rows("XXXXXXXXXX", 23), "XXXXXXXXXX"), fumen::tests::page("") }, "v115@v/AAevDAAe" },
+        // Changes to the garbage row alone, and with the field
+        { { fumen::tests::page("", "XXXXXXXXX_"), fumen::tests::page("", "_XXXXXXXXX"), fumen::tests::page("T_________", "_XXXXXXXXX") },
+          "v115@lhI8AeAAelhAAHeA8AAebhwwSeAAe" },
+        // Runs ending and starting on the edges of the 16-cell loads
+        { { fumen::tests::page(_empty + "______T___" "__LL______" + s_rows(_empty, 20)) }, "v115@PewwEehlXhAAe" },
+        { { fumen::tests::page(_empty + "_____TT___" "_JJJ______" + s_rows(_empty, 20)) }, "v115@OexwDei0XhAAe" },
+        { { fumen::tests::page(_empty + "______T___" "___L______" + s_rows(_empty, 20)) }, "v115@PewwFeglXhAAe" },
+        // A run over several loads
+        { { fumen::tests::page(_empty + "_____III__" "_JJJ______" + s_rows("OOOOOOOOOO", 4) + "OO________" + s_rows(_empty, 15)) },
+          "v115@OeyhCei0Fe5pngAAe" },
+        // The first and the last cell, in the part of the last load past
+        // the end
+        { { fumen::tests::page("X_________" + s_rows(_empty, 21) + "_________X", "_________X") }, "v115@A8jhA8IeA8AAe" },
+        // A change at every other cell
+        { { fumen::tests::page("_I_I_I_I_I" "L_L_L_L_L_" "_S_S_S_S_S" "Z_Z_Z_Z_Z_") },
+          "v115@+gwhAewhAewhAewhAewhglAeglAeglAeglAeglBeQ4?AeQ4AeQ4AeQ4AeQ4AtAeAtAeAtAeAtAeAtKeAAe" },
+    };
+
+    for (const encode_case& _case : _cases) {
+        std::string _encoded = fumen::encode(_case.m_pages);
+        if (!FUMEN_CHECK(_encoded == _case.m_expected)) std::cerr << "  gave " << _encoded << "\n";
+
+        // And the fields decode back
+        fumen::fumen_pages _decoded = fumen::decode(_encoded);
+        if (!FUMEN_CHECK(_decoded.size() == _case.m_pages.size())) continue;
+
+        for (std::size_t _i = 0; _i < _decoded.size(); _i++) {
+            const inner_field &_a = _decoded[_i].m_field.inner(), &_b = _case.m_pages[_i].m_field.inner();
+            FUMEN_CHECK(_a.field() == _b.field() && _a.garbage() == _b.garbage());
+        }
+
+        fumen::result<std::string> _result = fumen::try_encode(_case.m_pages);
+        FUMEN_CHECK(_result.has_value() && *_result == _encoded);
+    }
+
+    // A piece locked off the field is reported with the index of its page,
+    // or thrown as std::invalid_argument; an unlocked one is kept
+    fumen::fumen_pages _pages = { fumen::tests::page("T_________"), fumen::tests::page(""), fumen::tests::page("") };
+    _pages[1].m_operation = field_operation { piece_type::I, rotation_type::spawn, 9, 0 };
+    _pages[2].m_operation = field_operation { piece_type::T, rotation_type::spawn, 4, 1 };
+    _pages[2].m_flags.lock_bit = true;
+
+    FUMEN_CHECK(fumen::try_encode(_pages).has_value());
+
+    _pages[1].m_flags.lock_bit = true;
+    fumen::result<std::string> _result = fumen::try_encode(_pages);
+    FUMEN_CHECK(!_result.has_value());
+    FUMEN_CHECK(_result.error().m_code == decode_errc::operation_out_of_field && _result.error().m_offset == 1);
+
+    bool _thrown = false;
+    try {
+        fumen::encode(_pages);
+    } catch (const std::invalid_argument&) {
+        _thrown = true;
+    }
+    FUMEN_CHECK(_thrown);
+
+    // The stream is left as it was before the page
+    encoder::stream _stream;
+    FUMEN_CHECK(_stream.try_add(_pages[0]) == decode_errc::ok);
+    FUMEN_CHECK(_stream.try_add(_pages[1]) == decode_errc::operation_out_of_field);
+    FUMEN_CHECK(_stream.size() == 1);
+
+    std::string _first = "v115@";
+    _stream.finish(_first);
+    FUMEN_CHECK(_first == fumen::encode({ _pages[0] }));
+
+    return fumen::tests::result();
+}
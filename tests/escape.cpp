@@ -0,0 +1,98 @@
+#include <string>
+#include <string_view>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// Input and output strings against what JavaScript's escape() and
+// unescape() give, UTF-8 on the C++ side
+struct escape_case {
+    std::string_view m_in, m_out;
+};
+
+// The tests below are split at 16 bytes, the width of the prefix scans
+static const escape_case s_escapes[] = {
+    // Runs of safe characters, every one of them
+    { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789@*_+-./",
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789@*_+-./" },
+    { "AAAAAAAAAAAAAAA BBBB", "AAAAAAAAAAAAAAA%20BBBB" },
+    { "AAAAAAAAAAAAAAAA BBBB", "AAAAAAAAAAAAAAAA%20BBBB" },
+    { "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA~B", "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA%7EB" },
+    { "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA#", "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA%23" },
+    // 2-, 3- and 4-byte code points, the last as a surrogate pair
+    { "\xC3\xA9", "%E9" },
+    { "\xE3\x81\x82", "%u3042" },
+    { "\xE2\x82\xAC", "%u20AC" },
+    { "\xF0\x9F\x98\x80", "%uD83D%uDE00" },
+    { "a \xC3\xA9 \xE3\x81\x82 \xF0\x9F\x98\x80 z", "a%20%E9%20%u3042%20%uD83D%uDE00%20z" },
+    { "AAAAAAAAAAAAAAAA\xC3\xA9", "AAAAAAAAAAAAAAAA%E9" },
+    // Invalid UTF-8: one U+FFFD for each byte that cannot start or go on
+    // with a sequence, as TextDecoder gives
+    { "\xFF", "%uFFFD" },
+    { "\xC3", "%uFFFD" },
+    { "\xE3\x81", "%uFFFD" },
+    { "\xE3\x81" "A", "%uFFFDA" },
+    { "\xF0\x9F\x98", "%uFFFD" },
+    { "\x80", "%uFFFD" },
+    { "\xC3\xA9\xFF" "A", "%E9%uFFFDA" },
+    // Overlong, surrogate and out-of-range sequences
+    { "\xC0\xAF", "%uFFFD%uFFFD" },
+    { "\xE0\x80\x80", "%uFFFD%uFFFD%uFFFD" },
+    { "\xED\xA0\x80", "%uFFFD%uFFFD%uFFFD" },
+    { "\xF0\x80\x80\x80", "%uFFFD%uFFFD%uFFFD%uFFFD" },
+    { "\xF4\x90\x80\x80", "%uFFFD%uFFFD%uFFFD%uFFFD" },
+};
+
+static const escape_case s_unescapes[] = {
+    { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef" },
+    { "AAAAAAAAAAAAAAA%41", "AAAAAAAAAAAAAAAA" },
+    { "AAAAAAAAAAAAAAAA%41", "AAAAAAAAAAAAAAAAA" },
+    { "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA%u3042", "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\xE3\x81\x82" },
+    { "%E9", "\xC3\xA9" },
+    { "%e9", "\xC3\xA9" },
+    { "a%u00E9b", "a\xC3\xA9" "b" },
+    { "%u3042", "\xE3\x81\x82" },
+    { "%u20ac", "\xE2\x82\xAC" },
+    // Surrogates: a pair is one code point, a lone one U+FFFD
+    { "%uD83D%uDE00", "\xF0\x9F\x98\x80" },
+    { "%uD83D", "\xEF\xBF\xBD" },
+    { "%uD83Dx", "\xEF\xBF\xBDx" },
+    { "%uDE00", "\xEF\xBF\xBD" },
+    { "%uD83D%uD83D%uDE00", "\xEF\xBF\xBD\xF0\x9F\x98\x80" },
+    { "%uD83D%41", "\xEF\xBF\xBD" "A" },
+    { "%uD83D%", "\xEF\xBF\xBD%" },
+    // Malformed escapes are kept as they are
+    { "%", "%" },
+    { "%Z", "%Z" },
+    { "%4", "%4" },
+    { "%u12", "%u12" },
+    { "%uZZZZ", "%uZZZZ" },
+    { "%u12G4", "%u12G4" },
+    { "100%", "100%" },
+    { "%%41", "%A" },
+};
+
+int main() {
+    for (const escape_case& _case : s_escapes) {
+        std::string _out;
+        converter::escape(_case.m_in, _out);
+
+        if (!FUMEN_CHECK(_out == _case.m_out)) std::cerr << "  escape gave " << _out << "\n";
+    }
+
+    for (const escape_case& _case : s_unescapes) {
+        std::string _out;
+        converter::unescape(_case.m_in, _out);
+
+        if (!FUMEN_CHECK(_out == _case.m_out)) std::cerr << "  for " << _case.m_in << "\n";
+    }
+
+    // Output is appended, so a string can be reused between calls
+    std::string _out = "x";
+    converter::unescape("%E9", _out);
+    converter::escape("\xC3\xA9", _out);
+    FUMEN_CHECK(_out == "x\xC3\xA9%E9");
+
+    return fumen::tests::result();
+}
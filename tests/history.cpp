@@ -0,0 +1,86 @@
+#include <string>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+static bool s_same_cells(const inner_field& _a, const inner_field& _b, i32 _y) {
+    for (i32 _x = 0; _x < (i32)FIELD_WIDTH; _x++)
+        if (_a.get_number_at(_x, _y) != _b.get_number_at(_x, _y)) return false;
+    return true;
+}
+
+// Whether locking _page moves rows of its field: a line clear, a garbage
+// rise or a mirror
+static bool s_moves_rows(const page& _page) {
+    if (!_page.m_flags.lock_bit) return false;
+    if (_page.m_flags.rise_bit || _page.m_flags.mirror_bit) return true;
+
+    inner_field _field = _page.m_inner_field;
+    if (_page.m_operation) {
+        const field_operation& _op = *_page.m_operation;
+        _field.fill(inner_operation { _op.m_piece, _op.m_rotation, _op.m_x, _op.m_y });
+    }
+
+    for (i32 _y = 0; _y < (i32)FIELD_HEIGHT; _y++) {
+        bool _full = true;
+        for (i32 _x = 0; _x < (i32)FIELD_WIDTH; _x++)
+            _full = _full && _field.get_number_at(_x, _y) != piece_type::empty;
+        if (_full) return true;
+    }
+    return false;
+}
+
+int main() {
+    for (const char* _data : fumen::tests::samples) {
+        history _history = decoder::decode_history(_data);
+        pages _pages = fumen::tests::decode(_data);
+        if (!FUMEN_CHECK(_history.size() == _pages.size())) continue;
+
+        bool _ok = true;
+        u32 _shared = 0;
+
+        for (std::size_t _i = 0; _i < _pages.size(); _i++) {
+            const history_page& _hpage = _history[_i];
+            const page& _page = _pages[_i];
+
+            // Each page is the same page decode gives, field included
+            inner_field _field(_hpage.m_inner_field);
+            _ok &= FUMEN_CHECK(_field.field() == _page.m_inner_field.field()
+                && _field.garbage() == _page.m_inner_field.garbage());
+
+            _ok &= FUMEN_CHECK(_hpage.m_idx == _page.m_idx
+                && fumen::tests::same_operation(_hpage.m_operation, _page.m_operation)
+                && _hpage.m_comment == _page.m_comment
+                && _hpage.m_refs.m_field == _page.m_refs.m_field
+                && _hpage.m_refs.m_comment == _page.m_refs.m_comment
+                && _hpage.m_flags.all == _page.m_flags.all);
+
+            if (_i == 0) continue;
+            const page& _prev = _pages[_i - 1];
+            const persistent_field& _prev_field = _history[_i - 1].m_inner_field;
+
+            // A field carried over from an unlocked page is the same table
+            if (_page.m_refs.m_field && !_prev.m_flags.lock_bit)
+                _ok &= FUMEN_CHECK(_hpage.m_inner_field.shares(_prev_field));
+
+            // Unless the lock between them moved rows, the rows left as
+            // they were are the rows of the page before
+            if (s_moves_rows(_prev)) continue;
+
+            for (i32 _y = -1; _y < (i32)FIELD_HEIGHT; _y++) {
+                if (!s_same_cells(_page.m_inner_field, _prev.m_inner_field, _y)) continue;
+
+                _ok &= FUMEN_CHECK(_hpage.m_inner_field.shares_row(_prev_field, _y));
+                _shared++;
+            }
+        }
+
+        // Every sample has rows kept between its pages
+        _ok &= FUMEN_CHECK(_pages.size() < 2 || _shared > 0);
+
+        if (!_ok) std::cerr << "  for " << _data << "\n";
+    }
+
+    return fumen::tests::result();
+}
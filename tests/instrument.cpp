@@ -0,0 +1,90 @@
+#include <new>
+#include <string>
+#include <cstdlib>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// Built with FUMEN_INSTRUMENT, see CMakeLists.txt
+static_assert(instrument::enabled);
+
+static thread_local u64 s_allocs = 0;
+static u64 s_counter_calls = 0;
+
+void* operator new(std::size_t _size) {
+    s_allocs++;
+    if (void* _ptr = std::malloc(_size ? _size : 1)) return _ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t _size) { return operator new(_size); }
+void operator delete(void* _ptr) noexcept { std::free(_ptr); }
+void operator delete[](void* _ptr) noexcept { std::free(_ptr); }
+void operator delete(void* _ptr, std::size_t) noexcept { std::free(_ptr); }
+void operator delete[](void* _ptr, std::size_t) noexcept { std::free(_ptr); }
+
+static u64 s_calls(decode_stage _stage) { return instrument::last()[_stage].m_calls; }
+
+int main() {
+    instrument::set_alloc_counter([] () -> u64 { s_counter_calls++; return s_allocs; });
+
+    // Each decode starts its stats over, whatever ran before it
+    for (std::string _data : fumen::tests::samples) {
+        pages _pages = fumen::tests::decode(_data);
+
+        u64 _locks = 0;
+        for (const page& _page : _pages) _locks += _page.m_flags.lock_bit;
+
+        const decode_stats& _stats = instrument::last();
+        FUMEN_CHECK(_stats.m_calls == 1 && _stats.m_total.m_calls == 1);
+        FUMEN_CHECK(_stats.m_pages == _pages.size());
+        FUMEN_CHECK(_stats.m_bytes == _data.size());
+
+        FUMEN_CHECK(s_calls(decode_stage::extract) == 1 && s_calls(decode_stage::base64) == 1);
+        FUMEN_CHECK(s_calls(decode_stage::action) == _pages.size());
+        FUMEN_CHECK(s_calls(decode_stage::lock) == _locks);
+        FUMEN_CHECK(s_calls(decode_stage::comment) == s_calls(decode_stage::unescape));
+
+        // The pages are allocated, and counted through the counter
+        FUMEN_CHECK(_stats.m_total.m_allocs >= _pages.size());
+    }
+    FUMEN_CHECK(s_counter_calls > 0);
+
+    // 11 pages, 9 of them locked, and 6 comments, each read once
+    const std::string _commented = fumen::tests::samples[1];
+    fumen::tests::decode(_commented);
+
+    FUMEN_CHECK(instrument::last().m_pages == 11);
+    FUMEN_CHECK(s_calls(decode_stage::action) == 11);
+    FUMEN_CHECK(s_calls(decode_stage::lock) == 9);
+    FUMEN_CHECK(s_calls(decode_stage::comment) == 6);
+    FUMEN_CHECK(s_calls(decode_stage::unescape) == 6);
+
+    // Resuming is a call of its own
+    std::string _extracted;
+    u32 _version = decoder::extract(_commented, _extracted);
+
+    decoder::resume_point<> _state;
+    decoder::resume(_extracted, _version, _state, [] (page&&) {}, [] (const auto&, bool) {});
+
+    FUMEN_CHECK(instrument::last().m_calls == 1);
+    FUMEN_CHECK(instrument::last().m_bytes == _extracted.size());
+    FUMEN_CHECK(instrument::last().m_pages == 11);
+    FUMEN_CHECK(s_calls(decode_stage::comment) == 6 && s_calls(decode_stage::unescape) == 6);
+
+    // So is each chunk fed to a push_decoder
+    push_decoder _decoder;
+    std::size_t _half = _commented.size() / 2;
+    u32 _fed = 0;
+
+    _decoder.feed(std::string_view(_commented).substr(0, _half), [&] (page&&) { _fed++; });
+    u32 _first = _fed;
+    FUMEN_CHECK(instrument::last().m_calls == 1 && instrument::last().m_bytes == _half);
+
+    _decoder.feed(std::string_view(_commented).substr(_half), [&] (page&&) { _fed++; });
+    _decoder.finish();
+    FUMEN_CHECK(instrument::last().m_calls == 1 && instrument::last().m_bytes == _commented.size() - _half);
+    FUMEN_CHECK(instrument::last().m_pages == _fed - _first && _fed == 11);
+
+    return fumen::tests::result();
+}
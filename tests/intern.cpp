@@ -0,0 +1,112 @@
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+static bool s_same_field(const fumen::field& _a, const fumen::field& _b) {
+    return _a.inner().field() == _b.inner().field() && _a.inner().garbage() == _b.inner().garbage();
+}
+
+// Interns the pages of every sample into _pool, from the _first-th on
+static std::vector<fumen::fumen_interned_pages> s_decode_all(intern_pool& _pool, std::size_t _first = 0) {
+    const std::size_t _count = std::size(fumen::tests::samples);
+    std::vector<fumen::fumen_interned_pages> _all(_count);
+
+    for (std::size_t _i = 0; _i < _count; _i++) {
+        std::size_t _at = (_first + _i) % _count;
+        _all[_at] = fumen::decode(fumen::tests::samples[_at], _pool);
+    }
+
+    return _all;
+}
+
+// Whether _a and _b hold the same interned values, not only equal ones
+static bool s_same_interned(const std::vector<fumen::fumen_interned_pages>& _a,
+    const std::vector<fumen::fumen_interned_pages>& _b) {
+    for (std::size_t _i = 0; _i < _a.size(); _i++)
+        for (std::size_t _j = 0; _j < _a[_i].size(); _j++)
+            if (_a[_i][_j].m_field != _b[_i][_j].m_field || _a[_i][_j].m_comment.data() != _b[_i][_j].m_comment.data())
+                return false;
+    return true;
+}
+
+int main() {
+    intern_pool _pool;
+    std::vector<fumen::fumen_interned_pages> _interned = s_decode_all(_pool);
+
+    std::set<std::string> _comments, _fields;
+
+    for (std::size_t _i = 0; _i < _interned.size(); _i++) {
+        fumen::fumen_pages _pages = fumen::decode(fumen::tests::samples[_i]);
+        if (!FUMEN_CHECK(_interned[_i].size() == _pages.size())) continue;
+
+        // The same pages decode gives
+        for (std::size_t _j = 0; _j < _pages.size(); _j++) {
+            const fumen::fumen_interned_page& _ipage = _interned[_i][_j];
+            const fumen::fumen_page& _page = _pages[_j];
+
+            FUMEN_CHECK(_ipage.m_comment == _page.m_comment);
+            FUMEN_CHECK(s_same_field(*_ipage.m_field, _page.m_field));
+            FUMEN_CHECK(fumen::tests::same_operation(_ipage.m_operation, _page.m_operation));
+            FUMEN_CHECK(_ipage.m_flags.all == _page.m_flags.all);
+
+            _comments.insert(_page.m_comment);
+            _fields.insert(intern_pool::field_key(_page.m_field.inner()));
+        }
+    }
+
+    // Each distinct value is held once, and equal values are the same one
+    FUMEN_CHECK(_pool.comment_count() == _comments.size());
+    FUMEN_CHECK(_pool.field_count() == _fields.size());
+
+    for (const auto& _pages : _interned) {
+        for (const auto& _a : _pages) {
+            for (const auto& _b : _pages) {
+                if (_a.m_comment == _b.m_comment) FUMEN_CHECK(_a.m_comment.data() == _b.m_comment.data());
+                if (s_same_field(*_a.m_field, *_b.m_field)) FUMEN_CHECK(_a.m_field == _b.m_field);
+            }
+        }
+    }
+
+    // Decoding again adds nothing and gives back the same values
+    FUMEN_CHECK(s_same_interned(s_decode_all(_pool, 3), _interned));
+    FUMEN_CHECK(_pool.comment_count() == _comments.size());
+    FUMEN_CHECK(_pool.field_count() == _fields.size());
+
+    for (const std::string& _comment : _comments)
+        FUMEN_CHECK(_pool.intern(_comment).data() == _pool.intern(std::string(_comment)).data());
+
+    // Threads decoding into a fresh pool, each from another sample and
+    // interning comments of their own, end up with one of each value
+    const u32 _threads = 8, _count = 2000;
+    intern_pool _shared;
+    std::vector<std::vector<fumen::fumen_interned_pages>> _results(_threads);
+    std::vector<std::vector<std::string_view>> _views(_threads);
+
+    std::vector<std::thread> _workers;
+    for (u32 _t = 0; _t < _threads; _t++) {
+        _workers.emplace_back([&, _t] {
+            for (u32 _i = 0; _i < _count; _i++) {
+                _views[_t].push_back(_shared.intern("comment " + std::to_string((_i * (_t + 1)) % _count)));
+                if (_i % 500 == 0) _results[_t] = s_decode_all(_shared, _t + _i);
+            }
+        });
+    }
+    for (std::thread& _worker : _workers) _worker.join();
+
+    FUMEN_CHECK(_shared.comment_count() == _comments.size() + _count);
+    FUMEN_CHECK(_shared.field_count() == _fields.size());
+
+    for (u32 _t = 0; _t < _threads; _t++) {
+        FUMEN_CHECK(s_same_interned(_results[_t], _results[0]));
+
+        for (u32 _i = 0; _i < _count; _i++)
+            FUMEN_CHECK(_views[_t][_i].data() == _shared.intern("comment " + std::to_string((_i * (_t + 1)) % _count)).data());
+    }
+
+    return fumen::tests::result();
+}
@@ -0,0 +1,101 @@
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// _data with a space and a newline after each _every characters of its
+// data and '?' breaks at other places, then behind a URL
+static std::string s_respelled(const std::string& _data, std::size_t _every) {
+    std::string _out = "https://fumen.zui.jp/?" + _data.substr(0, 5);
+
+    std::size_t _count = 0;
+    for (std::size_t _i = 5; _i < _data.size(); _i++) {
+        if (_data[_i] == '?') continue;
+
+        _out += _data[_i];
+        if (++_count % _every == 0) _out += " \n";
+        if (_count % (_every + 3) == 0) _out += '?';
+    }
+
+    return _out;
+}
+
+int main() {
+    std::vector<fumen::fingerprint> _fingerprints;
+
+    for (const char* _data : fumen::tests::samples) {
+        fumen::fingerprint _fp;
+        std::string _normal = fumen::normalize(_data, &_fp);
+
+        // The canonical form is what the encoder writes for the pages,
+        // and is its own canonical form
+        FUMEN_CHECK(_normal == fumen::encode(fumen::decode(_data)));
+        FUMEN_CHECK(fumen::normalize(_normal) == _normal);
+
+        FUMEN_CHECK(fumen::fingerprint_of(_data) == _fp);
+        FUMEN_CHECK(fumen::fingerprint_of(_normal) == _fp);
+
+        // The same content spelled with other prefixes, whitespace and
+        // breaks has the same fingerprint and canonical form
+        std::string _mirrored = _data;
+        _mirrored[0] = 'm';
+
+        for (const std::string& _other : { s_respelled(_data, 1), s_respelled(_data, 5), s_respelled(_data, 40), _mirrored }) {
+            fumen::fingerprint _other_fp;
+            FUMEN_CHECK(fumen::normalize(_other, &_other_fp) == _normal);
+            FUMEN_CHECK(_other_fp == _fp);
+        }
+
+        _fingerprints.push_back(_fp);
+    }
+
+    // Different fumens, different fingerprints
+    for (std::size_t _i = 0; _i < _fingerprints.size(); _i++)
+        for (std::size_t _j = _i + 1; _j < _fingerprints.size(); _j++)
+            FUMEN_CHECK(_fingerprints[_i] != _fingerprints[_j]);
+
+    // A second insert of a fingerprint is a duplicate, the all-zero one
+    // included
+    fumen::fingerprint_set _set;
+    fumen::bloom_filter _bloom(_fingerprints.size());
+    _fingerprints.push_back(fumen::fingerprint {});
+
+    for (const fumen::fingerprint& _fp : _fingerprints) {
+        FUMEN_CHECK(!_set.contains(_fp));
+        FUMEN_CHECK(_set.insert(_fp));
+        FUMEN_CHECK(!_set.insert(_fp));
+        FUMEN_CHECK(_set.contains(_fp));
+
+        _bloom.insert(_fp);
+        FUMEN_CHECK(!_bloom.insert(_fp));
+        FUMEN_CHECK(_bloom.contains(_fp));
+    }
+    FUMEN_CHECK(_set.size() == _fingerprints.size());
+
+    // From many threads, each fingerprint is new to exactly one insert,
+    // through the shards growing many times over
+    const u32 _threads = 8, _count = 20000;
+    fumen::fingerprint_set _shared;
+    std::atomic<u32> _new { 0 };
+
+    std::vector<std::thread> _workers;
+    for (u32 _t = 0; _t < _threads; _t++) {
+        _workers.emplace_back([&, _t] {
+            u64 _state = _t % 2;
+            for (u32 _i = 0; _i < _count; _i++) {
+                fumen::fingerprint _fp { fumen::tests::next(_state) * 0x9E3779B97F4A7C15ull, _i + 1ull };
+                _new += _shared.insert(_fp);
+            }
+        });
+    }
+    for (std::thread& _worker : _workers) _worker.join();
+
+    FUMEN_CHECK(_new == 2 * _count);
+    FUMEN_CHECK(_shared.size() == 2 * _count);
+
+    return fumen::tests::result();
+}
@@ -0,0 +1,86 @@
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// The pages of fumen _idx of _store against _expected
+static bool s_same(const page_store& _store, u32 _idx, const pages& _expected) {
+    auto [_first, _last] = _store.fumen(_idx);
+    if (_last - _first != _expected.size()) return false;
+
+    for (u64 _i = _first; _i < _last; _i++) {
+        const page& _page = _expected[_i - _first];
+        inner_field _field = _store.field(_i);
+
+        if (_field.field() != _page.m_inner_field.field() || _field.garbage() != _page.m_inner_field.garbage()
+            || !fumen::tests::same_operation(_store.operation(_i), _page.m_operation)
+            || _store.comment_of(_i) != _page.m_comment.value_or("")
+            || _store.flags()[_i] != _page.m_flags.all)
+            return false;
+
+        // A page with the field of the one before shares its copy
+        if (_i > _first) {
+            const inner_field& _prev = _expected[_i - _first - 1].m_inner_field;
+            bool _same = _prev.field() == _page.m_inner_field.field() && _prev.garbage() == _page.m_inner_field.garbage();
+
+            if (_same != (_store.field_ids()[_i] == _store.field_ids()[_i - 1])) return false;
+        }
+    }
+
+    return true;
+}
+
+int main() {
+    page_store _store;
+    std::vector<pages> _expected;
+
+    // Decoded straight into the store, and added from decoded pages
+    for (const char* _data : fumen::tests::samples) {
+        _expected.push_back(fumen::tests::decode(_data));
+
+        FUMEN_CHECK(_store.decode(_data) == _expected.size() * 2 - 2);
+        FUMEN_CHECK(_store.add(_expected.back()) == _expected.size() * 2 - 1);
+    }
+
+    FUMEN_CHECK(_store.field_count() < _store.page_count());
+
+    // A fumen that fails halfway leaves the store as it was
+    u64 _pages = _store.page_count();
+    u32 _fumens = _store.fumen_count(), _comments = _store.comment_count(), _fields = _store.field_count();
+
+    bool _thrown = false;
+    try {
+        std::string _cut = fumen::tests::samples[2];
+        _store.decode(_cut.substr(0, _cut.size() - 1));
+    } catch (const std::exception&) {
+        _thrown = true;
+    }
+    FUMEN_CHECK(_thrown);
+
+    pages _unstorable = _expected[0];
+    _unstorable.back().m_comment = "not in the store";
+    _unstorable.back().m_operation = field_operation { piece_type::T, rotation_type::spawn, 1000, 0 };
+
+    _thrown = false;
+    try {
+        _store.add(_unstorable);
+    } catch (const std::invalid_argument&) {
+        _thrown = true;
+    }
+    FUMEN_CHECK(_thrown);
+
+    FUMEN_CHECK(_store.page_count() == _pages);
+    FUMEN_CHECK(_store.fumen_count() == _fumens);
+    FUMEN_CHECK(_store.comment_count() == _comments);
+    FUMEN_CHECK(_store.field_count() == _fields);
+
+    for (u32 _i = 0; _i < _expected.size(); _i++) {
+        FUMEN_CHECK(s_same(_store, 2 * _i, _expected[_i]));
+        FUMEN_CHECK(s_same(_store, 2 * _i + 1, _expected[_i]));
+    }
+
+    return fumen::tests::result();
+}
\ No newline at end of file
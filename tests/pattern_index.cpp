@@ -0,0 +1,114 @@
+#include <vector>
+#include <string_view>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+using hit = pattern_index::hit;
+
+// A stack of gray cells up to 8 rows high, with holes
+static inner_field s_board(u64& _state) {
+    fumen::field _field;
+
+    for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
+        u32 _height = fumen::tests::next(_state) % 9;
+        for (u32 _y = 0; _y < _height; _y++)
+            if (fumen::tests::next(_state) % 6) _field.set(_x, _y, piece_type::gray);
+    }
+
+    return _field.inner();
+}
+
+// Whether _pattern matches _field with its lowest row at _base, reading
+// the cells one by one
+static bool s_matches_at(const board_pattern& _pattern, const inner_field& _field, u32 _base) {
+    for (u32 _r = 0; _r < _pattern.m_rows.size(); _r++)
+        for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
+            bool _filled = _field.field()[_x + (_base + _r) * FIELD_WIDTH] != piece_type::empty;
+
+            if ((_pattern.m_rows[_r].m_filled >> _x & 1) && !_filled) return false;
+            if ((_pattern.m_rows[_r].m_empty >> _x & 1) && _filled) return false;
+        }
+
+    return true;
+}
+
+// Every page matching _pattern, lowest row first, in fumen and page order
+static std::vector<hit> s_scan(const std::vector<pages>& _fumens, const board_pattern& _pattern) {
+    std::vector<hit> _hits;
+    u32 _height = static_cast<u32>(_pattern.m_rows.size());
+
+    for (u64 _f = 0; _f < _fumens.size(); _f++)
+        for (u32 _p = 0; _p < _fumens[_f].size(); _p++) {
+            u32 _last = _pattern.m_anchored ? 0 : FIELD_HEIGHT - _height;
+
+            for (u32 _base = 0; _base <= _last; _base++)
+                if (s_matches_at(_pattern, _fumens[_f][_p].m_inner_field, _base)) {
+                    _hits.push_back({ _f, _p, _base });
+                    break;
+                }
+        }
+
+    return _hits;
+}
+
+static bool s_same(const std::vector<hit>& _a, const std::vector<hit>& _b) {
+    if (_a.size() != _b.size()) return false;
+
+    for (std::size_t _i = 0; _i < _a.size(); _i++)
+        if (_a[_i].m_fumen != _b[_i].m_fumen || _a[_i].m_page != _b[_i].m_page || _a[_i].m_row != _b[_i].m_row)
+            return false;
+
+    return true;
+}
+
+int main() {
+    // The samples, then fumens of generated boards
+    std::vector<pages> _fumens;
+    for (const char* _data : fumen::tests::samples) {
+        pages& _pages = _fumens.emplace_back();
+        decoder::decode(_data, [&] (page&& _pg) { _pages.push_back(std::move(_pg)); });
+    }
+
+    u64 _state = 1;
+    for (u32 _f = 0; _f < 40; _f++) {
+        pages& _pages = _fumens.emplace_back();
+        for (u32 _p = 0; _p < 25; _p++) {
+            page _page;
+            _page.m_idx = _p;
+            _page.m_inner_field = s_board(_state);
+            _pages.push_back(std::move(_page));
+        }
+    }
+
+    // Pages added in any order, between queries
+    pattern_index _index;
+    for (u64 _f = 0; _f < _fumens.size(); _f += 2) _index.add_pages(_f, _fumens[_f]);
+    for (u64 _f = 1; _f < _fumens.size(); _f += 2) _index.add_pages(_f, _fumens[_f]);
+
+    std::vector<board_pattern> _patterns;
+    for (std::string_view _text : {
+        "X", "_", "..........", "XXXXXXXXX_", "X__X......|XX_XXXXXXX", "_________X|X_________",
+        "XX|XX", "T_|__", "X.X.X.X.X.", "__________|XXXXXXXXXX"
+    }) {
+        _patterns.push_back(board_pattern::parse(_text));
+        _patterns.push_back(board_pattern::parse(_text, true));
+    }
+
+    for (u64 _f = 0; _f < _fumens.size(); _f += 7) {
+        _patterns.push_back(board_pattern::exact(_fumens[_f].back().m_inner_field));
+        _patterns.push_back(board_pattern::exact(_fumens[_f].back().m_inner_field, false));
+    }
+
+    for (const board_pattern& _pattern : _patterns) {
+        std::vector<hit> _expected = s_scan(_fumens, _pattern);
+        FUMEN_CHECK(s_same(_index.query(_pattern), _expected));
+
+        // A limit keeps the first hits
+        if (_expected.size() > 3) _expected.resize(3);
+        FUMEN_CHECK(s_same(_index.query(_pattern, 3), _expected));
+    }
+
+    return fumen::tests::result();
+}
\ No newline at end of file
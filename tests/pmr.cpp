@@ -0,0 +1,93 @@
+#include <new>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <memory_resource>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// Allocations made through the global operator new, which a decode or
+// encode given a resource should not make
+static u64 s_allocs = 0;
+
+void* operator new(std::size_t _size) {
+    s_allocs++;
+    if (void* _ptr = std::malloc(_size ? _size : 1)) return _ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t _size) { return operator new(_size); }
+void operator delete(void* _ptr) noexcept { std::free(_ptr); }
+void operator delete[](void* _ptr) noexcept { std::free(_ptr); }
+void operator delete(void* _ptr, std::size_t) noexcept { std::free(_ptr); }
+void operator delete[](void* _ptr, std::size_t) noexcept { std::free(_ptr); }
+
+// Whether _pages equal _expected, with everything allocated from _resource
+static bool s_check(const fumen::pmr::fumen_pages& _pages, const fumen::fumen_pages& _expected,
+    std::pmr::memory_resource* _resource) {
+    bool _ok = FUMEN_CHECK(_pages.get_allocator().resource() == _resource);
+    if (!FUMEN_CHECK(_pages.size() == _expected.size())) return false;
+
+    for (std::size_t _i = 0; _i < _pages.size(); _i++) {
+        const pmr_inner_field& _a = _pages[_i].m_field.inner();
+        const inner_field& _b = _expected[_i].m_field.inner();
+
+        _ok &= FUMEN_CHECK(std::equal(_a.field().begin(), _a.field().end(), _b.field().begin(), _b.field().end())
+            && std::equal(_a.garbage().begin(), _a.garbage().end(), _b.garbage().begin(), _b.garbage().end()));
+        _ok &= FUMEN_CHECK(std::string_view(_pages[_i].m_comment) == _expected[_i].m_comment);
+        _ok &= FUMEN_CHECK(fumen::tests::same_operation(_pages[_i].m_operation, _expected[_i].m_operation));
+        _ok &= FUMEN_CHECK(_pages[_i].m_flags.all == _expected[_i].m_flags.all);
+
+        _ok &= FUMEN_CHECK(_a.get_allocator().resource() == _resource);
+        _ok &= FUMEN_CHECK(_pages[_i].m_comment.get_allocator().resource() == _resource);
+    }
+
+    return _ok;
+}
+
+int main() {
+    static std::byte _buffer[1 << 20];
+
+    for (const char* _data : fumen::tests::samples) {
+        fumen::fumen_pages _expected = fumen::decode(_data);
+        std::string _encoded = fumen::encode(_expected);
+        bool _ok = true;
+
+        // Given the resource: an arena that cannot grow, so any allocation
+        // made elsewhere than the arena's buffer either fails or is counted
+        {
+            std::pmr::monotonic_buffer_resource _arena(_buffer, sizeof(_buffer), std::pmr::null_memory_resource());
+            u64 _before = s_allocs;
+
+            fumen::pmr::fumen_pages _pages = fumen::pmr::decode(_data, &_arena);
+            std::pmr::string _str = fumen::pmr::encode(_pages, &_arena);
+
+            _ok &= FUMEN_CHECK(s_allocs == _before);
+            _ok &= s_check(_pages, _expected, &_arena);
+            _ok &= FUMEN_CHECK(std::string_view(_str) == _encoded && _str.get_allocator().resource() == &_arena);
+        }
+
+        // The same through the default resource
+        {
+            std::pmr::monotonic_buffer_resource _arena(_buffer, sizeof(_buffer), std::pmr::null_memory_resource());
+            std::pmr::memory_resource* _previous = std::pmr::set_default_resource(&_arena);
+            u64 _before = s_allocs;
+
+            {
+                fumen::pmr::fumen_pages _pages = fumen::pmr::decode(_data);
+                std::pmr::string _str = fumen::pmr::encode(_pages);
+
+                _ok &= FUMEN_CHECK(s_allocs == _before);
+                _ok &= s_check(_pages, _expected, &_arena);
+                _ok &= FUMEN_CHECK(std::string_view(_str) == _encoded && _str.get_allocator().resource() == &_arena);
+            }
+
+            std::pmr::set_default_resource(_previous);
+        }
+
+        if (!_ok) std::cerr << "  for " << _data << "\n";
+    }
+
+    return fumen::tests::result();
+}
@@ -0,0 +1,69 @@
+#include <vector>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+using fumen::tests::same_operation;
+
+// The flags a projection without comments gives: no quiz_bit
+static u8 s_without_quiz(u8 _flags) {
+    page::flags _result; _result.all = _flags;
+    _result.quiz_bit = 0;
+    return _result.all;
+}
+
+// Each projected page of _data against the same page of a full decode
+template <u32 Parts>
+static void s_check(const char* _data, const pages& _full) {
+    constexpr bool _with_field = Parts & decode_parts::field,
+        _with_comment = Parts & decode_parts::comment,
+        _last_only = Parts & decode_parts::last_page;
+
+    std::size_t _count = 0;
+
+    decoder::project<Parts>(_data, [&] (auto&& _pg) {
+        std::size_t _i = _last_only ? _full.size() - 1 : _count;
+        _count++;
+        if (!FUMEN_CHECK(_i < _full.size())) return;
+
+        const page& _expected = _full[_i];
+
+        FUMEN_CHECK(_pg.m_idx == _expected.m_idx);
+        FUMEN_CHECK(same_operation(_pg.m_operation, _expected.m_operation));
+        FUMEN_CHECK(_pg.m_refs.m_field == _expected.m_refs.m_field);
+        FUMEN_CHECK(_pg.m_refs.m_comment == _expected.m_refs.m_comment);
+
+        if constexpr (_with_comment) {
+            FUMEN_CHECK(_pg.m_flags.all == _expected.m_flags.all);
+            FUMEN_CHECK(_pg.m_comment == _expected.m_comment);
+        } else {
+            FUMEN_CHECK(_pg.m_flags.all == s_without_quiz(_expected.m_flags.all));
+            FUMEN_CHECK(!_pg.m_comment);
+        }
+
+        if constexpr (_with_field) {
+            FUMEN_CHECK(_pg.m_inner_field.field() == _expected.m_inner_field.field());
+            FUMEN_CHECK(_pg.m_inner_field.garbage() == _expected.m_inner_field.garbage());
+        }
+    });
+
+    FUMEN_CHECK(_count == (_last_only ? 1 : _full.size()));
+}
+
+int main() {
+    for (const char* _data : fumen::tests::samples) {
+        pages _full;
+        decoder::decode(_data, [&] (page&& _pg) { _full.push_back(std::move(_pg)); });
+
+        s_check<decode_parts::operations>(_data, _full);
+        s_check<decode_parts::field>(_data, _full);
+        s_check<decode_parts::comment>(_data, _full);
+        s_check<decode_parts::all>(_data, _full);
+        s_check<decode_parts::operations | decode_parts::last_page>(_data, _full);
+        s_check<decode_parts::field | decode_parts::last_page>(_data, _full);
+        s_check<decode_parts::comment | decode_parts::last_page>(_data, _full);
+        s_check<decode_parts::all | decode_parts::last_page>(_data, _full);
+    }
+
+    return fumen::tests::result();
+}
\ No newline at end of file
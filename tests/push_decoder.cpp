@@ -0,0 +1,47 @@
+#include <string>
+#include <string_view>
+#include <algorithm>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+int main() {
+    const std::size_t _chunks[] = { 1, 2, 3, 5, 7, 64, SIZE_MAX };
+
+    for (std::string_view _data : fumen::tests::samples) {
+        pages _expected = fumen::tests::decode(_data);
+
+        // However the fumen is cut, the pages are those of decode
+        for (std::size_t _chunk : _chunks) {
+            pages _pages;
+            FUMEN_CHECK(!fumen::tests::feed(_data, _chunk, _pages));
+            FUMEN_CHECK(fumen::tests::same_pages(_pages, _expected));
+        }
+
+        // Cut inside its last page, the fumen fails as it does in try_decode
+        std::string_view _cut = _data.substr(0, _data.size() - 1);
+        decode_error _expected_error = decoder::try_decode(_cut, [] (page&&) {});
+        FUMEN_CHECK(_expected_error.m_code != decode_errc::ok);
+
+        for (std::size_t _chunk : _chunks) {
+            pages _pages;
+            decode_error _error = fumen::tests::feed(_cut, _chunk, _pages);
+            FUMEN_CHECK(_error.m_code == _expected_error.m_code);
+            FUMEN_CHECK(_pages.size() < _expected.size());
+        }
+
+        // And the limits stop it at the same page
+        decode_limits _limits;
+        _limits.m_max_pages = 2;
+        decode_error _limit_error = decoder::try_decode(_data, [] (page&&) {}, _limits);
+
+        for (std::size_t _chunk : _chunks) {
+            pages _pages;
+            FUMEN_CHECK(fumen::tests::feed(_data, _chunk, _pages, _limits).m_code == _limit_error.m_code);
+            FUMEN_CHECK(_pages.size() == std::min<std::size_t>(_expected.size(), 2));
+        }
+    }
+
+    return fumen::tests::result();
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include <string>
+#include <vector>
+#include <optional>
+#include <stdexcept>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+/*
+ * Quiz steps against the comments tetris-fumen's quiz.ts gives for them.
+ * Each step is a piece name, locking that piece as the decoder does
+ * (next_if_end, get_operation, operate), or 'F' for format().
+ */
+struct quiz_case {
+    const char* m_comment;
+    const char* m_steps;
+    // The comment after the steps, nullptr if one of them fails
+    const char* m_expected;
+};
+
+static const quiz_case s_cases[] = {
+    // Direct: the current piece, or the next one when there is none
+    { "#Q=[](T)SZ", "T", "#Q=[](S)Z" },
+    { "#Q=[I]()SZ", "S", "#Q=[I](Z)" },
+    { "#Q=[](T)SZ", "TSZ", "#Q=[]()" },
+    // Swap with the hold piece
+    { "#Q=[I](T)SZ", "I", "#Q=[T](S)Z" },
+    { "#Q=[I](T)", "I", "#Q=[T]()" },
+    // Stock: the next piece is used, the current one goes to hold
+    { "#Q=[](T)SZ", "S", "#Q=[T](Z)" },
+    { "#Q=[](T)S", "S", "#Q=[T]()" },
+    // With an empty hold, the next piece is stocked
+    { "#Q=[]()SZ", "S", "#Q=[](Z)" },
+    { "#Q=[](T)SZ", "O", nullptr },
+    { "#Q=[](T)SZ", "Z", nullptr },
+    // Whitespace is dropped
+    { "#Q=[ I ]( T ) S Z", "", "#Q=[I](T)SZ" },
+    // Crossing the ';' between bags
+    { "#Q=[](T);#Q=[](S)Z", "T", "#Q=[]();#Q=[](S)Z" },
+    { "#Q=[](T);#Q=[](S)Z", "TS", "#Q=[](Z)" },
+    { "#Q=[I](T)S;#Q=[](O)", "TISO", "#Q=[]()" },
+    { "#Q=[S](Z);#Q=[](O)", "S", "#Q=[Z]();#Q=[](O)" },
+    { "#Q=[Z]();#Q=[](O)", "Z", "#Q=[]();#Q=[](O)" },
+    // format() fills an empty current piece, from hold or the queue
+    { "#Q=[](T)SZ", "F", "#Q=[](T)SZ" },
+    { "#Q=[T]()SZ", "F", "#Q=[](T)SZ" },
+    { "#Q=[]()SZ", "F", "#Q=[](S)Z" },
+    { "#Q=[Z]();#Q=[](O)", "F", "#Q=[](Z);#Q=[](O)" },
+    { "#Q=[]();#Q=[](S)Z", "F", "#Q=[](S)Z" },
+    { "#Q=[]();#Q=[]()SZ", "F", "#Q=[](S)Z" },
+    { "#Q=[](T);Z", "TF", "Z" },
+    { "#Q=[]();", "F", "" },
+    // format() on a finished quiz keeps it
+    { "#Q=[]()", "F", "#Q=[]()" },
+    { "#Q=[](T)", "TF", "#Q=[]()" },
+    { "#Q=[](T)", "TFF", "#Q=[]()" },
+    { "#Q=[]();#Q=[]()", "F", "#Q=[]();#Q=[]()" },
+    // A malformed quiz after the ';' fails when the bag is used up
+    { "#Q=[](T);#Q=[TT]()", "T", "#Q=[]();#Q=[TT]()" },
+    { "#Q=[](T);#Q=[TT]()", "TF", nullptr },
+    { "#Q=[](T);#Q=[TT]()", "TS", nullptr },
+};
+
+static std::optional<std::string> s_run(const quiz_case& _case) {
+    std::optional<quiz> _quiz = quiz::parse(_case.m_comment);
+
+    for (const char* _step = _case.m_steps; _quiz && *_step; _step++)
+        _quiz = *_step == 'F' ? _quiz->try_format() : _quiz->try_place(defs::to_piece(*_step));
+
+    if (!_quiz) return std::nullopt;
+    return _quiz->to_string();
+}
+
+// A page locking _piece at (_x, _y), with _comment
+int main() {
+    for (const quiz_case& _case : s_cases) {
+        std::optional<std::string> _result = s_run(_case);
+
+        bool _ok = _case.m_expected ? _result == std::string(_case.m_expected) : !_result;
+        if (!FUMEN_CHECK(_ok))
+            std::cerr << "  for " << _case.m_comment << " after \"" << _case.m_steps << "\": "
+                      << (_result ? *_result : "(failed)") << "\n";
+    }
+
+    // The throwing forms fail where the try_ forms do
+    bool _thrown = false;
+    try {
+        quiz("#Q=[TT]()");
+    } catch (const std::invalid_argument&) {
+        _thrown = true;
+    }
+    FUMEN_CHECK(_thrown);
+    FUMEN_CHECK(!quiz::parse("#Q=[](T").has_value());
+    FUMEN_CHECK(quiz::parse("#Q=[]()")->to_string() == "#Q=[]()");
+
+    // Nothing is placed once the quizzes run out
+    FUMEN_CHECK(!quiz::parse("#Q=[](T);Z")->try_place(piece_type::T)->can_operate());
+    FUMEN_CHECK(!quiz::parse("#Q=[](T)")->try_place(piece_type::T)->can_operate());
+    FUMEN_CHECK(quiz::parse("#Q=[](T);#Q=[](S)")->try_place(piece_type::T)->can_operate());
+
+    // Each page shows the quiz as it stands before its lock. Only the
+    // first comment is stored; the others are the ones the quiz gives.
+    const std::vector<std::string> _comments = {
+        "#Q=[I](T)S;#Q=[](O)",
+        "#Q=[I](S);#Q=[](O)",
+        "#Q=[](I);#Q=[](O)",
+        "#Q=[](O)",
+        "#Q=[]()",
+        "#Q=[]()",
+    };
+
+    fumen::fumen_pages _pages = {
+        fumen::tests::page().comment(_comments[0]).lock(piece_type::T, rotation_type::spawn, 1, 0),
+        fumen::tests::page().comment(_comments[1]).lock(piece_type::S, rotation_type::spawn, 5, 0),
+        fumen::tests::page().comment(_comments[2]).lock(piece_type::I, rotation_type::spawn, 1, 5),
+        fumen::tests::page().comment(_comments[3]).lock(piece_type::O, rotation_type::spawn, 7, 5),
+        fumen::tests::page().comment(_comments[4]),
+        fumen::tests::page().comment(_comments[5]),
+    };
+
+    std::string _data = fumen::encode(_pages);
+    pages _decoded = fumen::tests::decode(_data);
+
+    if (FUMEN_CHECK(_decoded.size() == _comments.size())) {
+        for (std::size_t _i = 0; _i < _comments.size(); _i++) {
+            FUMEN_CHECK(_decoded[_i].m_comment == _comments[_i]);
+            FUMEN_CHECK(_decoded[_i].m_flags.quiz_bit);
+            FUMEN_CHECK(_decoded[_i].m_refs.m_comment == (_i == 0 ? std::nullopt : std::optional<u32>(0)));
+        }
+    }
+
+    // A malformed quiz after the ';' fails the page that needs it
+    const char* const _invalid = "v115@vhBAAtjAFLDmClcJSAVDEHBEooRBFrwRATD88AzZUA?BEYfzBFb2AAAAe";
+    decode_error _error = decoder::try_decode(_invalid, [] (page&&) {});
+    FUMEN_CHECK(_error.m_code == decode_errc::invalid_quiz);
+
+    return fumen::tests::result();
+}
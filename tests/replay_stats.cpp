@@ -0,0 +1,168 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+// Locks of T-spins, a mini, a T that is no spin and a plain line clear
+static std::string s_spins() {
+    fumen::fumen_pages _pages;
+
+    // T-spin double, pointing down into the slot
+    _pages.push_back(fumen::tests::page("___X______" "XXX___XXXX" "XXXX_XXXXX").lock(piece_type::T, rotation_type::reverse, 4, 1));
+    // Mini single: one of the two corners the T points at is filled
+    _pages.push_back(fumen::tests::page("___X______" "XXX___XXXX").lock(piece_type::T, rotation_type::spawn, 4, 0));
+    // Two corners and the floor
+    _pages.push_back(fumen::tests::page("").lock(piece_type::T, rotation_type::spawn, 4, 0));
+    // The wall counts as filled
+    _pages.push_back(fumen::tests::page("_X________").lock(piece_type::T, rotation_type::right, 0, 1));
+    // A single without gray cells
+    _pages.push_back(fumen::tests::page("LLLLLL____").lock(piece_type::I, rotation_type::spawn, 7, 0));
+
+    // Unlocked, so no events
+    _pages.push_back(fumen::tests::page("___X______" "XXX___XXXX" "XXXX_XXXXX").lock(piece_type::T, rotation_type::reverse, 4, 1));
+    _pages.back().m_flags.lock_bit = 0;
+
+    return fumen::encode(_pages);
+}
+
+// Whether (_x, _y) of _cells is filled or off the field, the top excepted
+static bool s_blocked(const std::vector<piece_type>& _cells, i32 _x, i32 _y) {
+    if (_x < 0 || _x >= static_cast<i32>(FIELD_WIDTH) || _y < 0) return true;
+    if (_y >= static_cast<i32>(FIELD_HEIGHT)) return false;
+
+    return _cells[_x + _y * FIELD_WIDTH] != piece_type::empty;
+}
+
+// The events, lines and garbage lines of the lock of _page, from its cells
+static std::array<u8, 3> s_lock(const page& _page) {
+    if (!_page.m_flags.lock_bit) return { 0, 0, 0 };
+
+    std::vector<piece_type> _cells(_page.m_inner_field.field().begin(), _page.m_inner_field.field().end());
+    u8 _events = replay_events::lock;
+
+    if (_page.m_operation) {
+        const field_operation& _op = *_page.m_operation;
+        i32 _x = static_cast<i32>(_op.m_x), _y = static_cast<i32>(_op.m_y);
+
+        if (_op.m_piece == piece_type::T) {
+            // Up-left, up-right, down-right, down-left
+            bool _corners[4] = {
+                s_blocked(_cells, _x - 1, _y + 1), s_blocked(_cells, _x + 1, _y + 1),
+                s_blocked(_cells, _x + 1, _y - 1), s_blocked(_cells, _x - 1, _y - 1)
+            };
+
+            if (_corners[0] + _corners[1] + _corners[2] + _corners[3] >= 3) {
+                // The front corners are the two on the side the T points at
+                u32 _side = 0;
+                switch (_op.m_rotation) {
+                    case rotation_type::spawn:   _side = 0; break;
+                    case rotation_type::right:   _side = 1; break;
+                    case rotation_type::reverse: _side = 2; break;
+                    case rotation_type::left:    _side = 3; break;
+                }
+                bool _front = _corners[_side] && _corners[(_side + 1) % 4];
+
+                _events |= _front ? replay_events::tspin : replay_events::tspin | replay_events::mini;
+            }
+        }
+
+        for (const auto& [_bx, _by] : field_util::get_blocks(_op.m_piece, _op.m_rotation))
+            _cells[(_x + _bx) + (_y + _by) * FIELD_WIDTH] = _op.m_piece;
+    }
+
+    u8 _lines = 0, _garbage = 0;
+    for (u32 _y = 0; _y < FIELD_HEIGHT; _y++) {
+        auto _row = _cells.begin() + _y * FIELD_WIDTH;
+
+        if (std::count(_row, _row + FIELD_WIDTH, piece_type::empty) == 0) {
+            _lines++;
+            _garbage += std::count(_row, _row + FIELD_WIDTH, piece_type::gray) > 0;
+        }
+    }
+
+    return { _events, _lines, _garbage };
+}
+
+// The surface of _field, column by column
+static replay_surface s_surface(const inner_field& _field) {
+    replay_surface _surface;
+    const auto& _cells = _field.field();
+
+    for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
+        for (u32 _y = 0; _y < FIELD_HEIGHT; _y++)
+            if (_cells[_x + _y * FIELD_WIDTH] != piece_type::empty) _surface.m_heights[_x] = _y + 1;
+
+        for (u32 _y = 0; _y < _surface.m_heights[_x]; _y++)
+            _surface.m_holes += _cells[_x + _y * FIELD_WIDTH] == piece_type::empty;
+    }
+
+    for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
+        i32 _h = _surface.m_heights[_x];
+        i32 _left = _x == 0 ? INT32_MAX : _surface.m_heights[_x - 1],
+            _right = _x + 1 == FIELD_WIDTH ? INT32_MAX : _surface.m_heights[_x + 1];
+
+        if (_x + 1 < FIELD_WIDTH) _surface.m_bumpiness += std::abs(_h - _right);
+        if (std::min(_left, _right) > _h)
+            _surface.m_well_depth = std::max<u8>(_surface.m_well_depth, std::min(_left, _right) - _h);
+    }
+
+    return _surface;
+}
+
+static bool s_same_surface(const replay_stats& _stats, u64 _i, const replay_surface& _surface) {
+    return std::equal(_surface.m_heights.begin(), _surface.m_heights.end(), _stats.heights(_i))
+        && _stats.holes()[_i] == _surface.m_holes
+        && _stats.bumpiness()[_i] == _surface.m_bumpiness
+        && _stats.well_depth()[_i] == _surface.m_well_depth;
+}
+
+int main() {
+    std::vector<std::string> _fumens(std::begin(fumen::tests::samples), std::end(fumen::tests::samples));
+    _fumens.push_back(s_spins());
+
+    replay_stats _stats;
+    for (const std::string& _data : _fumens) {
+        pages _pages = fumen::tests::decode(_data);
+        u32 _idx = _stats.decode(_data);
+
+        auto [_first, _last] = _stats.fumen(_idx);
+        if (!FUMEN_CHECK(_last - _first == _pages.size())) continue;
+
+        for (u64 _i = _first; _i < _last; _i++) {
+            const page& _page = _pages[_i - _first];
+
+            std::array<u8, 3> _lock = s_lock(_page);
+            FUMEN_CHECK(_stats.events()[_i] == _lock[0]);
+            FUMEN_CHECK(_stats.lines()[_i] == _lock[1]);
+            FUMEN_CHECK(_stats.garbage_lines()[_i] == _lock[2]);
+
+            // The field a page leaves is its own without a lock, and the
+            // next page's when that has no field diff
+            if (!_page.m_flags.lock_bit)
+                FUMEN_CHECK(s_same_surface(_stats, _i, s_surface(_page.m_inner_field)));
+            else if (_i + 1 < _last && _pages[_i + 1 - _first].m_refs.m_field)
+                FUMEN_CHECK(s_same_surface(_stats, _i, s_surface(_pages[_i + 1 - _first].m_inner_field)));
+        }
+    }
+
+    // The spins above, by name
+    auto [_first, _last] = _stats.fumen(_stats.fumen_count() - 1);
+    const std::vector<u8>& _events = _stats.events();
+
+    FUMEN_CHECK(_last - _first == 6);
+    FUMEN_CHECK(_events[_first] == (replay_events::lock | replay_events::tspin));
+    FUMEN_CHECK(_stats.lines()[_first] == 2);
+    FUMEN_CHECK(_events[_first + 1] == (replay_events::lock | replay_events::tspin | replay_events::mini));
+    FUMEN_CHECK(_stats.lines()[_first + 1] == 1);
+    FUMEN_CHECK(_events[_first + 2] == replay_events::lock);
+    FUMEN_CHECK(_events[_first + 3] == (replay_events::lock | replay_events::tspin | replay_events::mini));
+    FUMEN_CHECK(_events[_first + 4] == replay_events::lock);
+    FUMEN_CHECK(_stats.lines()[_first + 4] == 1 && _stats.garbage_lines()[_first + 4] == 0);
+    FUMEN_CHECK(_events[_first + 5] == 0);
+
+    return fumen::tests::result();
+}
\ No newline at end of file
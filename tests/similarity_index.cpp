@@ -0,0 +1,112 @@
+#include <vector>
+#include <algorithm>
+
+#include <fumen_similarity.hpp>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+using hit = similarity_index::hit;
+
+// Cells filled at random over the whole playfield, so that every key of
+// the index takes many values
+static board_bits s_board(u64& _state) {
+    board_bits _bits;
+
+    for (u32 _bit = 0; _bit < PLAY_BLOCKS; _bit++)
+        if (fumen::tests::next(_state) % 2) _bits.set(_bit);
+
+    return _bits;
+}
+
+// _bits with up to _max cells flipped
+static board_bits s_flip(const board_bits& _bits, u32 _max, u64& _state) {
+    board_bits _flipped = _bits;
+
+    for (u32 _i = fumen::tests::next(_state) % (_max + 1); _i > 0; _i--) {
+        u32 _bit = fumen::tests::next(_state) % PLAY_BLOCKS;
+        _flipped.m_words[_bit >> 6] ^= 1ull << (_bit & 63);
+    }
+
+    return _flipped;
+}
+
+// The cells in which _a and _b differ, counted one by one
+static u32 s_distance(const board_bits& _a, const board_bits& _b) {
+    u32 _d = 0;
+    for (u32 _bit = 0; _bit < 256; _bit++) _d += _a.test(_bit) != _b.test(_bit);
+    return _d;
+}
+
+// The boards within _radius of a query at _distances, nearest first, at
+// most _limit of them
+static std::vector<hit> s_scan(const std::vector<u32>& _distances, u32 _radius, std::size_t _limit) {
+    std::vector<hit> _hits;
+
+    for (u32 _i = 0; _i < _distances.size(); _i++)
+        if (_distances[_i] <= _radius) _hits.push_back({ _i / 100, _i % 100, _distances[_i] });
+
+    std::sort(_hits.begin(), _hits.end(), [] (const hit& _a, const hit& _b) {
+        if (_a.m_distance != _b.m_distance) return _a.m_distance < _b.m_distance;
+        return _a.m_fumen != _b.m_fumen ? _a.m_fumen < _b.m_fumen : _a.m_page < _b.m_page;
+    });
+    if (_hits.size() > _limit) _hits.resize(_limit);
+
+    return _hits;
+}
+
+static bool s_same(const std::vector<hit>& _a, const std::vector<hit>& _b) {
+    if (_a.size() != _b.size()) return false;
+
+    for (std::size_t _i = 0; _i < _a.size(); _i++)
+        if (_a[_i].m_fumen != _b[_i].m_fumen || _a[_i].m_page != _b[_i].m_page || _a[_i].m_distance != _b[_i].m_distance)
+            return false;
+
+    return true;
+}
+
+int main() {
+    u64 _state = 1;
+
+    // Boards in clusters, so that small radii find some
+    std::vector<board_bits> _bases;
+    for (u32 _i = 0; _i < 300; _i++) _bases.push_back(s_board(_state));
+
+    std::vector<board_bits> _boards;
+    for (u32 _i = 0; _i < 5000; _i++)
+        _boards.push_back(s_flip(_bases[fumen::tests::next(_state) % _bases.size()], 12, _state));
+
+    std::vector<board_bits> _queries;
+    for (u32 _i = 0; _i < 40; _i++)
+        _queries.push_back(s_flip(_boards[fumen::tests::next(_state) % _boards.size()], 6, _state));
+
+    const u32 _radii[] = { 0, 4, 15, 16, 31, 40, 48 };
+
+    // Below the scan limit, at it, and with boards added since the tables
+    // were built
+    similarity_index _index;
+    for (u32 _size : { 1000u, 4096u, 4500u, 5000u }) {
+        while (_index.size() < _size) {
+            u32 _i = static_cast<u32>(_index.size());
+            _index.add(_i / 100, _i % 100, _boards[_i]);
+        }
+
+        for (const board_bits& _query : _queries) {
+            std::vector<u32> _distances;
+            for (u32 _i = 0; _i < _size; _i++) _distances.push_back(s_distance(_query, _boards[_i]));
+
+            for (u32 _radius : _radii) {
+                FUMEN_CHECK(s_same(_index.query(_query, _radius), s_scan(_distances, _radius, SIZE_MAX)));
+                FUMEN_CHECK(s_same(_index.query(_query, _radius, 5), s_scan(_distances, _radius, 5)));
+            }
+        }
+    }
+
+    // A batch gives what the queries give one by one
+    std::vector<std::vector<hit>> _batch = _index.query_batch(_queries, 16, 10, 2);
+    for (std::size_t _i = 0; _i < _queries.size(); _i++)
+        FUMEN_CHECK(s_same(_batch[_i], _index.query(_queries[_i], 16, 10)));
+
+    return fumen::tests::result();
+}
\ No newline at end of file
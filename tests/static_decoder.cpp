@@ -0,0 +1,35 @@
+#include <string>
+
+#include <fumen_static.hpp>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+using namespace fumen::literals;
+
+// Pages decoded during compilation against a decode at run time
+template <u32 Pages, u32 Chars>
+static void s_check(const static_fumen<Pages, Chars>& _fumen, const char* _data) {
+    pages _expected;
+    decoder::decode(_data, [&] (page&& _pg) { _expected.push_back(std::move(_pg)); });
+
+    if (!FUMEN_CHECK(fumen::tests::same_pages(_fumen.to_pages(), _expected)))
+        std::cerr << "  for " << _data << "\n";
+}
+
+// The literal and the string of one fumen
+#define FUMEN_CHECK_STATIC(_str) s_check(_str##_fumen, _str)
+
+int main() {
+    // The fumens of fumen::tests::samples
+    FUMEN_CHECK_STATIC("v115@vhGSxQaAFLDmClcJSAVDEHBEooRBMoAVBq+CMCaNBA?AmmBVvB7bBJYBcpB3aB");
+    FUMEN_CHECK_STATIC("v115@HfwwAewh9eglMeg0ueQpBeQpLewhTeQpCecCBvhJAA?AtMBAglykYUAFLDmClcJSAVDEHBEooRBJoAVBmrIAgWMAfo?w2Bl8d3BlyL0CAgWUAFLDmClcJSAVDEHBEooRBJoAVBaTuA?AAgWUAFLDmClcJSAVDEHBEooRBJoAVBAgWAA");
+    FUMEN_CHECK_STATIC("v115@vhLRwgqIIKtAbCJsvZDAQlqBAGHXAAlsIMGPFAooMD?EPBAAAsHPAA95mAgl2af");
+    FUMEN_CHECK_STATIC("v115@vhKEkIbiInaBNhIrYBAgHzlBAAAqtPUAke88Aw0jJE?uXpTASom2AwngHB7sXAA/wA");
+    FUMEN_CHECK_STATIC("v115@RfwwFfAtBeAtAeA8AeAtQ4CeA8CeA8wwQ4KewwGeQp?JeglDewwA8EeglEeAtMeA8EeHGEvhBl3AWhQPAPJtJEFMVA?BBoo2AURdBA");
+    FUMEN_CHECK_STATIC("v115@Vgg0AewwAeglAeAtBeQpAeAtFeQ4FeQpIeA8AeA8Be?QpDewhAeA8JeQpAewhBeAtIeQ4GewwglBeglDe8CBvhDcqI?DmH6TIC8n");
+    FUMEN_CHECK_STATIC("v115@vhCAgHAgHvHe");
+    FUMEN_CHECK_STATIC("v110@neI3qbVRPHA2qm2AA8lCA7eBDaBxXB7eAO0c");
+
+    return fumen::tests::result();
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include <string>
+#include <typeinfo>
+#include <stdexcept>
+
+#include "check.hpp"
+
+using namespace fumen::details;
+
+/*
+ * Failed decodes and the {code, offset} try_decode reports for them. The
+ * offset counts characters of the input as given: the header and any
+ * text before it, whitespace and '?' breaks included.
+ */
+struct error_case {
+    const char* m_data;
+    decode_limits m_limits;
+    decode_errc m_code;
+    u64 m_offset;
+};
+
+static decode_limits s_pages(u64 _max) {
+    decode_limits _limits;
+    _limits.m_max_pages = _max;
+    return _limits;
+}
+
+// "v115@vhARwBehTaMeVrB" is an I locked at (4, 0), then a T at (4, 1).
+// With the second character of the I's action, 'w', read as 0 the I is
+// locked off the field, found after the 6 characters of the page.
+static const error_case s_cases[] = {
+    { "v114@vhARwBehTaMeVrB", {}, decode_errc::unsupported_version, 0 },
+    { "vhARwBehTaMeVrB", {}, decode_errc::unsupported_version, 0 },
+    // Cut inside the second page: the error is at the end of the data
+    { "v115@vhARwBehTaMeVr", {}, decode_errc::invalid_data, 19 },
+    { "v115@vhARwBehTaMeVr \n", {}, decode_errc::invalid_data, 19 },
+    { "v115@vhARwBe?hTaMeVr", {}, decode_errc::invalid_data, 20 },
+    // A bad character, alone and after a '?' break and whitespace
+    { "v115@vhAR!BehTaMeVrB", {}, decode_errc::invalid_data, 11 },
+    { "v115@vhAR?!BehTaMeVrB", {}, decode_errc::invalid_data, 12 },
+    { "v115@vh A\nR?!BehTaMeVrB", {}, decode_errc::invalid_data, 14 },
+    { "http://fumen.zui.jp/?v115@vhAR?!BehTaMeVrB", {}, decode_errc::invalid_data, 33 },
+    // A break right after the error is not counted
+    { "v115@vhAR!B?ehTaMeVrB", {}, decode_errc::invalid_data, 11 },
+    // The quiz after the ';' of the first page is malformed, which the
+    // second page finds once its action is read
+    { "v115@vhBAAtjAFLDmClcJSAVDEHBEooRBFrwRATD88AzZUA?BEYfzBFb2AAAAe", {}, decode_errc::invalid_quiz, 62 },
+    // Limits stop a decode before the page over them is read
+    { "v115@vhARwBehTaMeVrB", s_pages(1), decode_errc::too_many_pages, 11 },
+    { "v115@vhAR?wB?ehTaMeVrB", s_pages(1), decode_errc::too_many_pages, 12 },
+};
+
+// The type of what _fn throws, or of void if it does not
+template <typename Fn>
+static const std::type_info& s_thrown(Fn&& _fn) {
+    try {
+        _fn();
+    } catch (const std::exception& _e) {
+        return typeid(_e);
+    }
+    return typeid(void);
+}
+
+int main() {
+    for (const error_case& _case : s_cases) {
+        u32 _pages = 0;
+        decode_error _error = decoder::try_decode(_case.m_data, [&] (page&&) { _pages++; }, _case.m_limits);
+
+        if (!FUMEN_CHECK(_error.m_code == _case.m_code && _error.m_offset == _case.m_offset))
+            std::cerr << "  for " << _case.m_data << ": " << _error.message() << " at " << _error.m_offset << "\n";
+
+        // Projections stop at the same error, quizzes aside
+        if (_case.m_code != decode_errc::invalid_quiz) {
+            decode_error _projected = decoder::try_project<decode_parts::operations>(
+                _case.m_data, [] (auto&&) {}, _case.m_limits);
+            FUMEN_CHECK(_projected.m_code == _error.m_code && _projected.m_offset == _error.m_offset);
+        }
+
+        // The result API carries the same error, and value() throws what
+        // decode throws
+        fumen::result<fumen::fumen_pages> _result = fumen::try_decode(_case.m_data, _case.m_limits);
+        FUMEN_CHECK(!_result.has_value());
+        FUMEN_CHECK(_result.error().m_code == _error.m_code && _result.error().m_offset == _error.m_offset);
+
+        const std::type_info& _expected = s_thrown([&] { fumen::decode(_case.m_data, _case.m_limits); });
+        FUMEN_CHECK(_expected != typeid(void));
+        FUMEN_CHECK(s_thrown([&] { _result.value(); }) == _expected);
+        FUMEN_CHECK(s_thrown([&] { _error.raise(); }) == _expected);
+    }
+
+    // The samples decode without error, and a result holds their pages
+    for (const char* _data : fumen::tests::samples) {
+        FUMEN_CHECK(!decoder::try_decode(_data, [] (page&&) {}));
+
+        fumen::result<fumen::fumen_pages> _result = fumen::try_decode(_data);
+        FUMEN_CHECK(_result.has_value() && !_result.error());
+        FUMEN_CHECK(_result.value().size() == fumen::tests::decode(_data).size());
+    }
+
+    return fumen::tests::result();
+}
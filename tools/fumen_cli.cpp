@@ -0,0 +1,362 @@
+#include <array>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fumen.hpp>
+
+#include "json.hpp"
+#include "pipeline.hpp"
+#include "render.hpp"
+
+namespace fumen::tools {
+namespace {
+
+struct options {
+    std::string m_command;
+    std::string m_format = "json";
+    u32 m_page = 0, m_cell = 16;
+    u64 m_bloom = 0;
+    double m_error = 0.001;
+    pipeline_options m_pipeline;
+    std::vector<std::string> m_files;
+};
+
+// Output of one input line; m_ok is false if the line could not be processed
+struct line_result {
+    bool m_ok = true;
+    std::string m_text;
+};
+
+template <typename Fn>
+line_result guarded(const std::string& _line, Fn&& _fn) {
+    if (_line.empty()) return {};
+
+    try {
+        return { true, _fn() };
+    } catch (const std::exception& _e) {
+        return { false, std::string("error: ") + _e.what() };
+    }
+}
+
+line_result process(const options& _opts, const std::string& _line) {
+    const std::string& _cmd = _opts.m_command;
+
+    if (_cmd == "validate")
+        return guarded(_line, [&] { fumen::decode(_line); return std::string("ok"); });
+
+    if (_cmd == "normalize")
+        return guarded(_line, [&] { return fumen::normalize(_line); });
+
+    if (_cmd == "encode")
+        return guarded(_line, [&] { return fumen::encode(read_pages(json_parser::parse(_line))); });
+
+    if (_cmd == "render")
+        return guarded(_line, [&] {
+            fumen_pages _pages = fumen::decode(_line);
+            if (_opts.m_page >= _pages.size()) throw std::out_of_range("no page " + std::to_string(_opts.m_page));
+
+            return render_svg(_pages[_opts.m_page], _opts.m_cell);
+        });
+
+    // decode
+    return guarded(_line, [&] {
+        fumen_pages _pages = fumen::decode(_line);
+        std::string _out;
+
+        if (_opts.m_format == "grid") {
+            for (std::size_t _i = 0; _i < _pages.size(); _i++) {
+                if (_i) _out += "\n\n";
+                _out += _pages[_i].m_field.to_string(false);
+                if (!_pages[_i].m_comment.empty()) _out += "\n# " + _pages[_i].m_comment;
+            }
+            _out += '\n';
+        } else write_json(_out, _pages);
+
+        return _out;
+    });
+}
+
+struct corpus_stats {
+    u64 m_lines = 0, m_fumens = 0, m_invalid = 0, m_v110 = 0, m_v115 = 0;
+    u64 m_pages = 0, m_comments = 0, m_operations = 0, m_locks = 0, m_max_pages = 0;
+    std::array<u64, 9> m_pieces {};
+
+    void add(const std::string& _line) {
+        if (_line.empty()) return;
+        m_lines++;
+
+        fumen_pages _pages;
+        if (!fumen::try_decode(_line, _pages)) {
+            m_invalid++;
+            return;
+        }
+
+        m_fumens++;
+        (fumen::details::decoder::version(_line) == 110u ? m_v110 : m_v115)++;
+        m_pages += _pages.size();
+        m_max_pages = std::max<u64>(m_max_pages, _pages.size());
+
+        for (const fumen_page& _page : _pages) {
+            m_comments += !_page.m_comment.empty();
+            m_locks += _page.m_flags.lock_bit;
+
+            if (_page.m_operation) {
+                m_operations++;
+                m_pieces[static_cast<u8>(_page.m_operation->m_piece)]++;
+            }
+        }
+    }
+
+    corpus_stats& operator+=(const corpus_stats& _other) {
+        m_lines += _other.m_lines; m_fumens += _other.m_fumens; m_invalid += _other.m_invalid;
+        m_v110 += _other.m_v110; m_v115 += _other.m_v115;
+        m_pages += _other.m_pages; m_comments += _other.m_comments;
+        m_operations += _other.m_operations; m_locks += _other.m_locks;
+        m_max_pages = std::max(m_max_pages, _other.m_max_pages);
+
+        for (std::size_t _i = 0; _i < m_pieces.size(); _i++) m_pieces[_i] += _other.m_pieces[_i];
+
+        return *this;
+    }
+
+    void write_json(std::ostream& _os) const {
+        _os << "{\n"
+            << "  \"lines\": " << m_lines << ",\n"
+            << "  \"fumens\": " << m_fumens << ",\n"
+            << "  \"invalid\": " << m_invalid << ",\n"
+            << "  \"versions\": { \"110\": " << m_v110 << ", \"115\": " << m_v115 << " },\n"
+            << "  \"pages\": " << m_pages << ",\n"
+            << "  \"max_pages\": " << m_max_pages << ",\n"
+            << "  \"pages_per_fumen\": " << (m_fumens ? (double)m_pages / m_fumens : 0) << ",\n"
+            << "  \"comments\": " << m_comments << ",\n"
+            << "  \"locks\": " << m_locks << ",\n"
+            << "  \"operations\": " << m_operations << ",\n"
+            << "  \"pieces\": {";
+
+        for (u8 _p = 1; _p <= 7; _p++)
+            _os << (_p > 1 ? ", \"" : " \"") << piece_to_char(static_cast<piece_type>(_p)) << "\": " << m_pieces[_p];
+
+        _os << " }\n}\n";
+    }
+};
+
+// Keeps the first line of each content, by fingerprint; invalid lines are dropped
+template <typename Set>
+int dedupe(const options& _opts, const std::vector<std::istream*>& _inputs, Set& _seen) {
+    struct line_print {
+        std::string m_line;
+        std::optional<fingerprint> m_print;
+    };
+
+    std::string _buffer;
+    u64 _kept = 0, _dropped = 0, _invalid = 0;
+
+    run_pipeline<line_print>(_inputs,
+        [&] (const std::string& _line) {
+            line_print _lp { _line, std::nullopt };
+            if (_line.empty()) return _lp;
+
+            try {
+                _lp.m_print = fumen::fingerprint_of(_line);
+            } catch (const std::exception&) {}
+
+            return _lp;
+        },
+        [&] (u64, line_print&& _lp) {
+            if (_lp.m_line.empty()) return;
+            if (!_lp.m_print) {
+                _invalid++;
+                return;
+            }
+            if (!_seen.insert(*_lp.m_print)) {
+                _dropped++;
+                return;
+            }
+
+            _kept++;
+            _buffer += _lp.m_line;
+            _buffer += '\n';
+
+            if (_buffer.size() >= (1u << 16)) {
+                std::cout.write(_buffer.data(), _buffer.size());
+                _buffer.clear();
+            }
+        },
+        _opts.m_pipeline);
+
+    std::cout.write(_buffer.data(), _buffer.size());
+    std::cout.flush();
+
+    std::cerr << "kept " << _kept << ", duplicates " << _dropped << ", invalid " << _invalid << "\n";
+    return 0;
+}
+
+// A decimal option value, saturated instead of wrapped past UINT32_MAX
+u32 parse_u32(const char* _value) {
+    return static_cast<u32>(std::min<unsigned long>(std::strtoul(_value, nullptr, 10), UINT32_MAX));
+}
+
+int run(const options& _opts) {
+    std::vector<std::unique_ptr<std::ifstream>> _files;
+    std::vector<std::istream*> _inputs;
+
+    for (const std::string& _path : _opts.m_files) {
+        if (_path == "-") {
+            _inputs.push_back(&std::cin);
+            continue;
+        }
+
+        _files.push_back(std::make_unique<std::ifstream>(_path));
+        if (!*_files.back()) {
+            std::cerr << "cannot open " << _path << "\n";
+            return 2;
+        }
+
+        _inputs.push_back(_files.back().get());
+    }
+
+    if (_inputs.empty()) _inputs.push_back(&std::cin);
+
+    if (_opts.m_command == "dedupe") {
+        if (_opts.m_bloom) {
+            bloom_filter _seen(_opts.m_bloom, _opts.m_error);
+            return dedupe(_opts, _inputs, _seen);
+        }
+
+        fingerprint_set _seen;
+        return dedupe(_opts, _inputs, _seen);
+    }
+
+    if (_opts.m_command == "stats") {
+        // Lines are reduced to stats on the workers and summed in order
+        corpus_stats _total;
+
+        run_pipeline<corpus_stats>(_inputs,
+            [&] (const std::string& _line) { corpus_stats _s; _s.add(_line); return _s; },
+            [&] (u64, corpus_stats&& _s) { _total += _s; },
+            _opts.m_pipeline);
+
+        // Invalid lines are part of the summary, not a failure of it
+        _total.write_json(std::cout);
+        std::cerr << "invalid " << _total.m_invalid << "\n";
+        return 0;
+    }
+
+    std::string _buffer;
+    u64 _failures = 0;
+
+    run_pipeline<line_result>(_inputs,
+        [&] (const std::string& _line) { return process(_opts, _line); },
+        [&] (u64, line_result&& _r) {
+            _failures += !_r.m_ok;
+            _buffer += _r.m_text;
+            _buffer += '\n';
+
+            if (_buffer.size() >= (1u << 16)) {
+                std::cout.write(_buffer.data(), _buffer.size());
+                _buffer.clear();
+            }
+        },
+        _opts.m_pipeline);
+
+    std::cout.write(_buffer.data(), _buffer.size());
+    std::cout.flush();
+
+    return _failures ? 1 : 0;
+}
+
+constexpr const char* s_usage =
+    "usage: fumen_cli COMMAND [options] [FILE|-]...\n"
+    "\n"
+    "Reads one fumen (or JSON document for encode) per line from the files,\n"
+    "or stdin, and writes one result per line in input order.\n"
+    "\n"
+    "commands:\n"
+    "  validate     ok, or error: <reason>\n"
+    "  decode       pages as JSON, or as text grids with --format grid\n"
+    "  encode       v115 fumen from the JSON written by decode\n"
+    "  normalize    the fumen re-encoded as canonical v115\n"
+    "  dedupe       the first line of each distinct content, in order\n"
+    "  stats        one JSON summary of the whole input\n"
+    "  render       SVG image of one page\n"
+    "\n"
+    "options:\n"
+    "  --threads N  worker threads (default: one per core)\n"
+    "  --batch N    lines per work item (default: 256)\n"
+    "  --window N   work items in flight (default: 4 per thread)\n"
+    "  --format F   json or grid, for decode\n"
+    "  --page N     page to render (default: 0)\n"
+    "  --cell N     cell size in pixels, for render (1 to 256, default: 16)\n"
+    "  --bloom N    dedupe with a Bloom filter sized for N lines instead of\n"
+    "               an exact set; some distinct lines may be dropped\n"
+    "  --error F    false positive rate of the Bloom filter (default: 0.001)\n"
+    "\n"
+    "Exits with 1 if any line failed, 2 on usage errors. stats only counts\n"
+    "invalid lines, and prints that count to stderr.\n";
+
+}
+}
+
+int main(int argc, char** argv) {
+    using namespace fumen::tools;
+
+    std::ios::sync_with_stdio(false);
+
+    if (argc < 2 || std::strcmp(argv[1], "--help") == 0 || std::strcmp(argv[1], "-h") == 0) {
+        std::cout << s_usage;
+        return argc < 2 ? 2 : 0;
+    }
+
+    options _opts;
+    _opts.m_command = argv[1];
+
+    static constexpr const char* s_commands[] = { "validate", "decode", "encode", "normalize", "dedupe", "stats", "render" };
+    if (std::none_of(std::begin(s_commands), std::end(s_commands),
+        [&] (const char* _c) { return _opts.m_command == _c; })) {
+        std::cerr << "unknown command " << _opts.m_command << "\n" << s_usage;
+        return 2;
+    }
+
+    for (int _i = 2; _i < argc; _i++) {
+        std::string _arg = argv[_i];
+
+        if (_arg.size() < 3 || _arg.compare(0, 2, "--") != 0) {
+            _opts.m_files.push_back(_arg);
+            continue;
+        }
+
+        const char* _value = _i + 1 < argc ? argv[++_i] : nullptr;
+        if (!_value) {
+            std::cerr << "missing value for " << _arg << "\n";
+            return 2;
+        }
+
+        if (_arg == "--threads") _opts.m_pipeline.m_threads = parse_u32(_value);
+        else if (_arg == "--batch") _opts.m_pipeline.m_batch = parse_u32(_value);
+        else if (_arg == "--window") _opts.m_pipeline.m_window = parse_u32(_value);
+        else if (_arg == "--page") _opts.m_page = parse_u32(_value);
+        else if (_arg == "--bloom") _opts.m_bloom = std::strtoull(_value, nullptr, 10);
+        else if (_arg == "--error") _opts.m_error = std::clamp(std::strtod(_value, nullptr), 1e-9, 0.5);
+        else if (_arg == "--cell") _opts.m_cell = std::clamp<u32>(parse_u32(_value), 1, 256);
+        else if (_arg == "--format" && (std::strcmp(_value, "json") == 0 || std::strcmp(_value, "grid") == 0))
+            _opts.m_format = _value;
+        else {
+            std::cerr << "unknown option " << _arg << " " << _value << "\n";
+            return 2;
+        }
+    }
+
+    try {
+        return run(_opts);
+    } catch (const std::exception& _e) {
+        std::cerr << "fumen_cli: " << _e.what() << "\n";
+        return 2;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,722 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <fumen_cache.hpp>
+
+#include "http.hpp"
+#include "json.hpp"
+#include "pipeline.hpp"
+#include "render.hpp"
+
+namespace fumen::tools {
+namespace {
+
+struct options {
+    std::string m_host = "127.0.0.1";
+    u16 m_port = 8080;
+    u32 m_threads = 0, m_queue = 1024, m_batch = 16;
+    std::size_t m_cache = 4096, m_cache_bytes = 1 << 26, m_max_body = 1 << 24;
+    std::string m_cache_file;
+
+    // Each input is decoded under these; the pages also bound a /decode
+    // request as a whole, since its output holds every page
+    fumen::decode_limits m_limits = s_default_limits();
+
+    static fumen::decode_limits s_default_limits() {
+        fumen::decode_limits _limits;
+        _limits.m_max_pages = 10000;
+        _limits.m_max_comment_bytes = 1 << 20;
+        _limits.m_max_work = 1 << 26;
+        return _limits;
+    }
+};
+
+u64 now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+/*
+ * Responses by request, shared by all workers. Keys are spread over
+ * shards, each an LRU list under its own lock, so lookups from different
+ * workers rarely contend. Both the entries and the bytes of keys and
+ * bodies are capped; a response larger than a shard's share of the bytes
+ * is not kept.
+ */
+class result_cache {
+public:
+    result_cache(std::size_t _capacity, std::size_t _bytes)
+    : m_shard_capacity(std::max<std::size_t>(1, _capacity / s_shards)), m_shard_bytes(_bytes / s_shards),
+      m_enabled(_capacity != 0 && m_shard_bytes != 0) {}
+
+private:
+    static constexpr std::size_t s_shards = 16;
+
+    using entry = std::pair<std::string, std::shared_ptr<const http_response>>;
+
+    struct shard {
+        std::mutex m_mutex;
+        std::list<entry> m_lru;
+        std::unordered_map<std::string_view, std::list<entry>::iterator> m_index;
+        std::size_t m_bytes = 0;
+    };
+
+    std::array<shard, s_shards> m_shards;
+    std::size_t m_shard_capacity, m_shard_bytes;
+    bool m_enabled;
+
+    static std::size_t s_size(const entry& _e)
+    { return _e.first.size() + _e.second->m_body.size(); }
+
+    shard& m_shard(std::string_view _key)
+    { return m_shards[std::hash<std::string_view>()(_key) % s_shards]; }
+
+public:
+    std::atomic<u64> m_hits { 0 }, m_misses { 0 };
+
+    std::shared_ptr<const http_response> get(std::string_view _key) {
+        if (!m_enabled) return nullptr;
+
+        shard& _s = m_shard(_key);
+        std::lock_guard _lock(_s.m_mutex);
+
+        auto _it = _s.m_index.find(_key);
+        if (_it == _s.m_index.end()) {
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        _s.m_lru.splice(_s.m_lru.begin(), _s.m_lru, _it->second);
+
+        return _it->second->second;
+    }
+
+    void put(std::string _key, std::shared_ptr<const http_response> _res) {
+        if (!m_enabled || _key.size() + _res->m_body.size() > m_shard_bytes) return;
+
+        shard& _s = m_shard(_key);
+        std::lock_guard _lock(_s.m_mutex);
+
+        if (_s.m_index.count(_key)) return;
+
+        _s.m_lru.emplace_front(std::move(_key), std::move(_res));
+        _s.m_index.emplace(_s.m_lru.front().first, _s.m_lru.begin());
+        _s.m_bytes += s_size(_s.m_lru.front());
+
+        while (_s.m_lru.size() > m_shard_capacity || _s.m_bytes > m_shard_bytes) {
+            _s.m_bytes -= s_size(_s.m_lru.back());
+            _s.m_index.erase(_s.m_lru.back().first);
+            _s.m_lru.pop_back();
+        }
+    }
+};
+
+// The last s_size request latencies, for percentiles
+class latency_window {
+private:
+    static constexpr std::size_t s_size = 1 << 16;
+
+    std::vector<u64> m_samples = std::vector<u64>(s_size);
+    u64 m_count = 0;
+
+public:
+    void add(u64 _ns) { m_samples[m_count++ % s_size] = _ns; }
+
+    u64 count() const { return m_count; }
+
+    std::vector<u64> sorted() const {
+        std::vector<u64> _s(m_samples.begin(), m_samples.begin() + std::min<u64>(m_count, s_size));
+        std::sort(_s.begin(), _s.end());
+        return _s;
+    }
+
+    static u64 percentile(const std::vector<u64>& _sorted, double _p) {
+        if (_sorted.empty()) return 0;
+        return _sorted[std::min<std::size_t>(_sorted.size() - 1, _p * _sorted.size())];
+    }
+};
+
+/*
+ * Request handling, run on the workers. A body holds one input per line
+ * and gets one output per line, so clients can batch many fumens into a
+ * single request. A request with a single failing line is a 400.
+ */
+template <typename Fn>
+http_response for_lines(const http_request& _req, const char* _type, bool _json, Fn&& _fn) {
+    std::string_view _body = _req.m_body;
+
+    if (_body.empty()) {
+        auto _it = _req.m_query.find("fumen");
+        if (_it != _req.m_query.end()) _body = _it->second;
+    }
+
+    http_response _res;
+    _res.m_type = _type;
+
+    u32 _lines = 0, _failed = 0;
+    std::string _error;
+
+    while (!_body.empty()) {
+        std::string_view _line = _body.substr(0, _body.find('\n'));
+        _body.remove_prefix(std::min(_body.size(), _line.size() + 1));
+
+        if (!_line.empty() && _line.back() == '\r') _line.remove_suffix(1);
+        if (_line.empty()) continue;
+
+        if (_lines++) _res.m_body += '\n';
+
+        try {
+            _fn(std::string(_line), _res.m_body);
+        } catch (const std::exception& _e) {
+            _failed++;
+            _error = _e.what();
+
+            if (_json) {
+                _res.m_body += "{\"error\":";
+                write_json_string(_res.m_body, _error);
+                _res.m_body += '}';
+            } else _res.m_body += "error: " + _error;
+        }
+    }
+
+    if (_lines == 0) return { 400, "text/plain", "empty request\n" };
+    if (_lines == 1 && _failed) return { 400, "text/plain", _error + "\n" };
+
+    _res.m_body += '\n';
+    return _res;
+}
+
+// Decoded pages, through _decoded when the server keeps one; that holds
+// decodes to the same limits
+fumen_pages decode_with(fumen::decode_cache* _decoded, const fumen::decode_limits& _limits, const std::string& _line)
+{ return _decoded ? fumen::to_pages(*_decoded->decode(_line)) : fumen::decode(_line, _limits); }
+
+// Result cache key of _req; each field is prefixed with its length, so
+// requests with different fields never share a key
+std::string cache_key(const http_request& _req) {
+    std::string _key;
+    auto _add = [&] (std::string_view _field) {
+        _key += std::to_string(_field.size());
+        _key += ':';
+        _key += _field;
+    };
+
+    _add(_req.m_path);
+    for (const auto& [_k, _v] : _req.m_query) {
+        _add(_k);
+        _add(_v);
+    }
+    _add(_req.m_body);
+
+    return _key;
+}
+
+http_response handle(const http_request& _req, fumen::decode_cache* _decoded, const fumen::decode_limits& _limits) {
+    if (_req.m_method != "POST" && _req.m_method != "GET")
+        return { 405, "text/plain", "use GET or POST\n" };
+
+    if (_req.m_path == "/decode") {
+        u64 _budget = _limits.m_max_pages;
+
+        return for_lines(_req, "application/json", true, [&] (const std::string& _line, std::string& _out) {
+            fumen_pages _pages = decode_with(_decoded, _limits, _line);
+            if (_pages.size() > _budget) throw std::length_error("Too many pages");
+
+            _budget -= _pages.size();
+            write_json(_out, _pages);
+        });
+    }
+
+    if (_req.m_path == "/encode")
+        return for_lines(_req, "text/plain", false, [] (const std::string& _line, std::string& _out) {
+            _out += fumen::encode(read_pages(json_parser::parse(_line)));
+        });
+
+    if (_req.m_path == "/validate")
+        return for_lines(_req, "text/plain", false, [&] (const std::string& _line, std::string& _out) {
+            fumen::decode(_line, _limits);
+            _out += "ok";
+        });
+
+    if (_req.m_path == "/render") {
+        u32 _page = _req.query_u32("page", 0), _cell = std::clamp<u32>(_req.query_u32("cell", 16), 1, 256);
+
+        return for_lines(_req, "image/svg+xml", false, [&] (const std::string& _line, std::string& _out) {
+            fumen_pages _pages = decode_with(_decoded, _limits, _line);
+            if (_page >= _pages.size()) throw std::out_of_range("no page " + std::to_string(_page));
+
+            _out += render_svg(_pages[_page], _cell);
+        });
+    }
+
+    return { 404, "text/plain", "endpoints: /decode /encode /validate /render /stats\n" };
+}
+
+/*
+ * One epoll thread owns every socket: it accepts, reads and parses
+ * requests, answers cache hits and /stats itself, and hands the rest to a
+ * fixed pool of workers through a bounded queue (503 when it is full).
+ * Workers take up to m_batch requests per wake-up and post the responses
+ * back through an eventfd. Each connection has at most one request in
+ * flight, so pipelined requests are answered in order.
+ */
+class server {
+public:
+    explicit server(const options& _opts)
+    : m_opts(_opts), m_cache(_opts.m_cache, _opts.m_cache_bytes), m_jobs(_opts.m_queue) {
+        if (!_opts.m_cache_file.empty()) m_decoded = std::make_unique<fumen::decode_cache>(_opts.m_cache, true, 8, _opts.m_limits);
+    }
+
+private:
+    struct connection {
+        u64 m_id = 0;
+        std::string m_in, m_out;
+        bool m_busy = false, m_keep_alive = true, m_closing = false;
+        // The peer sent its FIN; requests already in m_in are still served
+        bool m_peer_closed = false;
+    };
+
+    struct job {
+        int m_fd;
+        u64 m_id, m_start;
+        bool m_keep_alive;
+        std::string m_key;
+        http_request m_req;
+    };
+
+    struct result {
+        int m_fd;
+        u64 m_id, m_start;
+        bool m_keep_alive;
+        std::shared_ptr<const http_response> m_res;
+    };
+
+    options m_opts;
+    result_cache m_cache;
+    bounded_queue<job> m_jobs;
+
+    // Decoded pages, saved to and loaded from --cache-file
+    std::unique_ptr<fumen::decode_cache> m_decoded;
+
+    std::mutex m_results_mutex;
+    std::vector<result> m_results;
+
+    int m_epoll = -1, m_listen = -1, m_event = -1, m_signal = -1;
+    std::unordered_map<int, connection> m_conns;
+    u64 m_next_id = 1;
+
+    latency_window m_latency;
+    u64 m_requests = 0, m_errors = 0, m_rejected = 0;
+    std::atomic<u64> m_batches { 0 }, m_batched { 0 };
+    u32 m_threads = 0;
+
+    [[noreturn]] static void s_throw(const char* _what)
+    { throw std::system_error(errno, std::generic_category(), _what); }
+
+    void m_watch(int _fd, u32 _events, int _op = EPOLL_CTL_ADD) {
+        epoll_event _ev {};
+        _ev.events = _events;
+        _ev.data.fd = _fd;
+        if (::epoll_ctl(m_epoll, _op, _fd, &_ev) != 0) s_throw("epoll_ctl");
+    }
+
+    void m_worker() {
+        std::vector<job> _batch;
+
+        while (m_jobs.pop_some(_batch, m_opts.m_batch)) {
+            m_batches.fetch_add(1, std::memory_order_relaxed);
+            m_batched.fetch_add(_batch.size(), std::memory_order_relaxed);
+
+            std::vector<result> _done;
+            _done.reserve(_batch.size());
+
+            for (job& _job : _batch) {
+                std::shared_ptr<const http_response> _res;
+                try {
+                    _res = std::make_shared<const http_response>(handle(_job.m_req, m_decoded.get(), m_opts.m_limits));
+                } catch (const std::exception& _e) {
+                    _res = std::make_shared<const http_response>(
+                        http_response { 400, "text/plain", std::string(_e.what()) + "\n" });
+                }
+
+                if (_res->m_status == 200) m_cache.put(std::move(_job.m_key), _res);
+                _done.push_back({ _job.m_fd, _job.m_id, _job.m_start, _job.m_keep_alive, std::move(_res) });
+            }
+            _batch.clear();
+
+            {
+                std::lock_guard _lock(m_results_mutex);
+                for (result& _r : _done) m_results.push_back(std::move(_r));
+            }
+
+            u64 _one = 1;
+            [[maybe_unused]] ssize_t _n = ::write(m_event, &_one, sizeof(_one));
+        }
+    }
+
+    std::string m_stats() {
+        std::vector<u64> _sorted = m_latency.sorted();
+        u64 _batches = m_batches.load();
+
+        std::string _out = "{\n";
+        _out += "  \"requests\": " + std::to_string(m_requests) + ",\n";
+        _out += "  \"errors\": " + std::to_string(m_errors) + ",\n";
+        _out += "  \"rejected\": " + std::to_string(m_rejected) + ",\n";
+        _out += "  \"connections\": " + std::to_string(m_conns.size()) + ",\n";
+        _out += "  \"workers\": " + std::to_string(m_threads) + ",\n";
+        _out += "  \"queued\": " + std::to_string(m_jobs.size()) + ",\n";
+        _out += "  \"batch_size\": " + std::to_string(_batches ? (double)m_batched.load() / _batches : 0) + ",\n";
+        _out += "  \"cache\": { \"hits\": " + std::to_string(m_cache.m_hits.load()) +
+            ", \"misses\": " + std::to_string(m_cache.m_misses.load()) + " },\n";
+        if (m_decoded) {
+            fumen::decode_cache::statistics _st = m_decoded->stats();
+            _out += "  \"decoded\": { \"hits\": " + std::to_string(_st.m_hits) +
+                ", \"misses\": " + std::to_string(_st.m_misses) +
+                ", \"file_hits\": " + std::to_string(_st.m_file_hits) + " },\n";
+        }
+        _out += "  \"latency_us\": { \"samples\": " + std::to_string(_sorted.size()) +
+            ", \"p50\": " + std::to_string(latency_window::percentile(_sorted, 0.5) / 1000.0) +
+            ", \"p99\": " + std::to_string(latency_window::percentile(_sorted, 0.99) / 1000.0) +
+            ", \"max\": " + std::to_string(latency_window::percentile(_sorted, 1.0) / 1000.0) + " }\n}\n";
+
+        return _out;
+    }
+
+    void m_respond(connection& _conn, const http_response& _res, bool _keep_alive, u64 _start) {
+        m_requests++;
+        m_errors += _res.m_status >= 400;
+        m_latency.add(now_ns() - _start);
+
+        _conn.m_keep_alive = _conn.m_keep_alive && _keep_alive;
+        http::write(_conn.m_out, _res, _conn.m_keep_alive);
+        _conn.m_busy = false;
+
+        if (!_conn.m_keep_alive) _conn.m_closing = true;
+    }
+
+    // Parses and dispatches buffered requests until one is in flight
+    void m_serve(int _fd, connection& _conn) {
+        while (!_conn.m_busy && !_conn.m_closing) {
+            http_request _req;
+            http::parse_status _status = http::parse(_conn.m_in, _req, m_opts.m_max_body);
+
+            if (_status == http::parse_status::incomplete) break;
+
+            u64 _start = now_ns();
+
+            if (_status != http::parse_status::complete) {
+                bool _large = _status == http::parse_status::too_large;
+                m_respond(_conn, { _large ? 413u : 400u, "text/plain", _large ? "too large\n" : "bad request\n" }, false, _start);
+                break;
+            }
+
+            if (_req.m_path == "/stats") {
+                m_respond(_conn, { 200, "application/json", m_stats() }, _req.m_keep_alive, _start);
+                continue;
+            }
+
+            std::string _key = cache_key(_req);
+
+            if (std::shared_ptr<const http_response> _hit = m_cache.get(_key)) {
+                m_respond(_conn, *_hit, _req.m_keep_alive, _start);
+                continue;
+            }
+
+            bool _keep_alive = _req.m_keep_alive;
+            if (!m_jobs.try_push({ _fd, _conn.m_id, _start, _keep_alive, std::move(_key), std::move(_req) })) {
+                m_rejected++;
+                m_respond(_conn, { 503, "text/plain", "busy\n" }, _keep_alive, _start);
+                continue;
+            }
+
+            _conn.m_busy = true;
+        }
+
+        // Nothing more will arrive, so once no request is in flight what
+        // is left in m_in is at most a request cut short
+        if (_conn.m_peer_closed && !_conn.m_busy) _conn.m_closing = true;
+
+        m_flush(_fd, _conn);
+    }
+
+    // Whether _conn holds more than one request of the largest size; it
+    // is not read again until the requests buffered so far are served
+    bool m_full(const connection& _conn) const
+    { return _conn.m_in.size() > http::max_header + 4 + m_opts.m_max_body; }
+
+    void m_close(int _fd) {
+        ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, _fd, nullptr);
+        ::close(_fd);
+        m_conns.erase(_fd);
+    }
+
+    // Writes what the socket takes; returns false if the connection closed
+    bool m_flush(int _fd, connection& _conn) {
+        while (!_conn.m_out.empty()) {
+            ssize_t _n = ::send(_fd, _conn.m_out.data(), _conn.m_out.size(), MSG_NOSIGNAL);
+            if (_n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                m_close(_fd);
+                return false;
+            }
+            _conn.m_out.erase(0, _n);
+        }
+
+        if (_conn.m_out.empty() && _conn.m_closing && !_conn.m_busy) {
+            m_close(_fd);
+            return false;
+        }
+
+        // A closing or half-closed connection is not read again, or the
+        // socket would wake the loop until its last response is written
+        u32 _events = (_conn.m_closing || _conn.m_peer_closed || m_full(_conn) ? 0u : u32(EPOLLIN | EPOLLRDHUP)) | (_conn.m_out.empty() ? 0u : u32(EPOLLOUT));
+        m_watch(_fd, _events, EPOLL_CTL_MOD);
+        return true;
+    }
+
+    void m_accept() {
+        while (true) {
+            int _fd = ::accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (_fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;
+            }
+
+            int _one = 1;
+            ::setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &_one, sizeof(_one));
+
+            m_conns[_fd].m_id = m_next_id++;
+            m_watch(_fd, EPOLLIN | EPOLLRDHUP);
+        }
+    }
+
+    void m_read(int _fd) {
+        connection& _conn = m_conns[_fd];
+        char _buf[1 << 14];
+
+        while (!m_full(_conn)) {
+            ssize_t _n = ::recv(_fd, _buf, sizeof(_buf), 0);
+            if (_n > 0) {
+                _conn.m_in.append(_buf, _n);
+                continue;
+            }
+            if (_n < 0 && errno == EINTR) continue;
+            if (_n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+            // Peer closed; answer what it sent before, then close
+            _conn.m_peer_closed = true;
+            break;
+        }
+
+        m_serve(_fd, _conn);
+    }
+
+    void m_complete() {
+        u64 _count;
+        [[maybe_unused]] ssize_t _n = ::read(m_event, &_count, sizeof(_count));
+
+        std::vector<result> _results;
+        {
+            std::lock_guard _lock(m_results_mutex);
+            _results.swap(m_results);
+        }
+
+        for (result& _r : _results) {
+            auto _it = m_conns.find(_r.m_fd);
+            if (_it == m_conns.end() || _it->second.m_id != _r.m_id) continue;
+
+            m_respond(_it->second, *_r.m_res, _r.m_keep_alive, _r.m_start);
+            m_serve(_r.m_fd, _it->second);
+        }
+    }
+
+public:
+    void run() {
+        // A missing or damaged file only means a cold start
+        if (m_decoded && ::access(m_opts.m_cache_file.c_str(), F_OK) == 0) {
+            try {
+                m_decoded->load(m_opts.m_cache_file);
+            } catch (const std::exception& _e) {
+                std::cerr << "fumen_server: ignoring " << m_opts.m_cache_file << ": " << _e.what() << "\n";
+            }
+        }
+
+        m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll < 0) s_throw("epoll_create1");
+
+        m_listen = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listen < 0) s_throw("socket");
+
+        int _one = 1;
+        ::setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &_one, sizeof(_one));
+
+        sockaddr_in _addr {};
+        _addr.sin_family = AF_INET;
+        _addr.sin_port = htons(m_opts.m_port);
+        if (::inet_pton(AF_INET, m_opts.m_host.c_str(), &_addr.sin_addr) != 1)
+            throw std::invalid_argument("bad host " + m_opts.m_host);
+
+        if (::bind(m_listen, reinterpret_cast<sockaddr*>(&_addr), sizeof(_addr)) != 0) s_throw("bind");
+        if (::listen(m_listen, SOMAXCONN) != 0) s_throw("listen");
+
+        m_event = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_event < 0) s_throw("eventfd");
+
+        sigset_t _mask;
+        sigemptyset(&_mask);
+        sigaddset(&_mask, SIGINT);
+        sigaddset(&_mask, SIGTERM);
+        ::pthread_sigmask(SIG_BLOCK, &_mask, nullptr);
+
+        m_signal = ::signalfd(-1, &_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (m_signal < 0) s_throw("signalfd");
+
+        m_watch(m_listen, EPOLLIN);
+        m_watch(m_event, EPOLLIN);
+        m_watch(m_signal, EPOLLIN);
+
+        // Started after the signal mask is set, so workers inherit it
+        m_threads = m_opts.m_threads ? m_opts.m_threads : std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> _workers;
+        for (u32 _t = 0; _t < m_threads; _t++) _workers.emplace_back([this] { m_worker(); });
+
+        std::cerr << "fumen_server listening on " << m_opts.m_host << ':' << m_opts.m_port
+                  << " with " << m_threads << " workers\n";
+
+        std::vector<epoll_event> _events(256);
+        for (bool _running = true; _running; ) {
+            int _n = ::epoll_wait(m_epoll, _events.data(), _events.size(), -1);
+            if (_n < 0) {
+                if (errno == EINTR) continue;
+                s_throw("epoll_wait");
+            }
+
+            for (int _i = 0; _i < _n; _i++) {
+                int _fd = _events[_i].data.fd;
+                u32 _ev = _events[_i].events;
+
+                if (_fd == m_listen) m_accept();
+                else if (_fd == m_event) m_complete();
+                else if (_fd == m_signal) _running = false;
+                else if (m_conns.count(_fd)) {
+                    if (_ev & (EPOLLERR | EPOLLHUP)) m_close(_fd);
+                    else if (_ev & (EPOLLIN | EPOLLRDHUP)) m_read(_fd);
+                    else if (_ev & EPOLLOUT) m_flush(_fd, m_conns[_fd]);
+                }
+            }
+        }
+
+        m_jobs.close();
+        for (std::thread& _th : _workers) _th.join();
+
+        if (m_decoded) {
+            try {
+                u32 _saved = m_decoded->save(m_opts.m_cache_file);
+                std::cerr << "fumen_server: saved " << _saved << " fumens to " << m_opts.m_cache_file << "\n";
+            } catch (const std::exception& _e) {
+                std::cerr << "fumen_server: " << _e.what() << "\n";
+            }
+        }
+
+        for (auto& [_fd, _conn] : m_conns) ::close(_fd);
+        m_conns.clear();
+        for (int _fd : { m_listen, m_event, m_signal, m_epoll }) ::close(_fd);
+
+        std::cerr << m_stats();
+    }
+};
+
+constexpr const char* s_usage =
+    "usage: fumen_server [--host ADDR] [--port N] [--threads N] [--queue N]\n"
+    "                    [--batch N] [--cache N] [--cache-bytes BYTES]\n"
+    "                    [--max-body BYTES] [--cache-file PATH] [--max-pages N]\n"
+    "                    [--max-comment-bytes BYTES] [--max-work N]\n"
+    "\n"
+    "endpoints (GET with ?fumen=... or POST with one input per line):\n"
+    "  /decode      pages as JSON\n"
+    "  /encode      v115 fumen from JSON pages\n"
+    "  /validate    ok, or error: <reason>\n"
+    "  /render      SVG image, ?page=N&cell=N\n"
+    "  /stats       counters, cache hits and p50/p99 latency\n"
+    "\n"
+    "Each input is decoded under --max-pages (default: 10000),\n"
+    "--max-comment-bytes (default: 1 MiB) and --max-work (default: 2^26);\n"
+    "--max-pages also bounds the pages of a /decode request.\n";
+
+}
+}
+
+int main(int argc, char** argv) {
+    using namespace fumen::tools;
+
+    options _opts;
+
+    for (int _i = 1; _i < argc; _i++) {
+        std::string _arg = argv[_i];
+
+        if (_arg == "--help" || _arg == "-h") {
+            std::cout << s_usage;
+            return 0;
+        }
+
+        const char* _value = _i + 1 < argc ? argv[++_i] : nullptr;
+        if (!_value) {
+            std::cerr << "missing value for " << _arg << "\n";
+            return 2;
+        }
+
+        if (_arg == "--host") _opts.m_host = _value;
+        else if (_arg == "--port") _opts.m_port = static_cast<u16>(std::strtoul(_value, nullptr, 10));
+        else if (_arg == "--threads") _opts.m_threads = std::strtoul(_value, nullptr, 10);
+        else if (_arg == "--queue") _opts.m_queue = std::max(1ul, std::strtoul(_value, nullptr, 10));
+        else if (_arg == "--batch") _opts.m_batch = std::max(1ul, std::strtoul(_value, nullptr, 10));
+        else if (_arg == "--cache") _opts.m_cache = std::strtoull(_value, nullptr, 10);
+        else if (_arg == "--cache-bytes") _opts.m_cache_bytes = std::strtoull(_value, nullptr, 10);
+        else if (_arg == "--cache-file") _opts.m_cache_file = _value;
+        else if (_arg == "--max-body") _opts.m_max_body = std::strtoull(_value, nullptr, 10);
+        else if (_arg == "--max-pages") _opts.m_limits.m_max_pages = std::strtoull(_value, nullptr, 10);
+        else if (_arg == "--max-comment-bytes") _opts.m_limits.m_max_comment_bytes = std::strtoull(_value, nullptr, 10);
+        else if (_arg == "--max-work") _opts.m_limits.m_max_work = std::strtoull(_value, nullptr, 10);
+        else {
+            std::cerr << "unknown option " << _arg << "\n" << s_usage;
+            return 2;
+        }
+    }
+
+    try {
+        server(_opts).run();
+    } catch (const std::exception& _e) {
+        std::cerr << "fumen_server: " << _e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
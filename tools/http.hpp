@@ -0,0 +1,172 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <cctype>
+#include <algorithm>
+#include <cstdlib>
+#include <optional>
+#include <string_view>
+
+#include <details/intdef.hpp>
+
+namespace fumen::tools {
+
+struct http_request {
+    std::string m_method, m_path;
+    std::map<std::string, std::string, std::less<>> m_query;
+    std::string m_body;
+    bool m_keep_alive = true;
+
+    // Query parameter _key as a number, or _default if missing or invalid
+    u32 query_u32(std::string_view _key, u32 _default) const {
+        auto _it = m_query.find(_key);
+        if (_it == m_query.end()) return _default;
+
+        char* _end = nullptr;
+        unsigned long _value = std::strtoul(_it->second.c_str(), &_end, 10);
+        return _it->second.empty() || *_end ? _default : static_cast<u32>(_value);
+    }
+};
+
+struct http_response {
+    u32 m_status = 200;
+    std::string m_type = "text/plain", m_body;
+};
+
+/* static */ class http {
+public:
+    enum class parse_status { complete, incomplete, bad_request, too_large };
+
+    // Longest request head, up to the blank line, that parse waits for
+    static constexpr std::size_t max_header = 1 << 16;
+
+    static const char* reason(u32 _status) {
+        switch (_status) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 413: return "Payload Too Large";
+            case 503: return "Service Unavailable";
+        }
+        return "Error";
+    }
+
+    // Percent-decoding; '+' is kept, since fumen data uses it
+    static std::optional<std::string> decode_uri(std::string_view _str) {
+        std::string _out;
+        _out.reserve(_str.size());
+
+        for (std::size_t _i = 0; _i < _str.size(); _i++) {
+            if (_str[_i] != '%') {
+                _out += _str[_i];
+                continue;
+            }
+
+            if (_i + 2 >= _str.size() || !std::isxdigit(static_cast<u8>(_str[_i + 1])) ||
+                !std::isxdigit(static_cast<u8>(_str[_i + 2])))
+                return std::nullopt;
+
+            _out += static_cast<char>(std::stoi(std::string(_str.substr(_i + 1, 2)), nullptr, 16));
+            _i += 2;
+        }
+
+        return _out;
+    }
+
+    /*
+     * Parses one request from the front of _buffer and removes it. Only
+     * Content-Length bodies are accepted; chunked uploads are rejected as
+     * bad requests.
+     */
+    static parse_status parse(std::string& _buffer, http_request& _req, std::size_t _max_body) {
+        std::size_t _end = _buffer.find("\r\n\r\n");
+        if (_end == std::string::npos)
+            return _buffer.size() > max_header ? parse_status::too_large : parse_status::incomplete;
+
+        std::string_view _head(_buffer.data(), _end);
+
+        std::size_t _line_end = _head.find("\r\n");
+        std::string_view _line = _head.substr(0, _line_end);
+
+        std::size_t _sp1 = _line.find(' '), _sp2 = _line.rfind(' ');
+        if (_sp1 == std::string_view::npos || _sp1 == _sp2) return parse_status::bad_request;
+
+        std::string_view _version = _line.substr(_sp2 + 1);
+        if (_version != "HTTP/1.1" && _version != "HTTP/1.0") return parse_status::bad_request;
+
+        _req = http_request();
+        _req.m_method = _line.substr(0, _sp1);
+        _req.m_keep_alive = _version == "HTTP/1.1";
+
+        std::string_view _target = _line.substr(_sp1 + 1, _sp2 - _sp1 - 1);
+        std::size_t _q = _target.find('?');
+
+        std::optional<std::string> _path = decode_uri(_target.substr(0, _q));
+        if (!_path) return parse_status::bad_request;
+        _req.m_path = *_path;
+
+        for (std::string_view _rest = _q == std::string_view::npos ? "" : _target.substr(_q + 1); !_rest.empty(); ) {
+            std::string_view _pair = _rest.substr(0, _rest.find('&'));
+            _rest.remove_prefix(std::min(_rest.size(), _pair.size() + 1));
+
+            std::size_t _eq = _pair.find('=');
+            std::optional<std::string> _key = decode_uri(_pair.substr(0, _eq)),
+                _value = decode_uri(_eq == std::string_view::npos ? "" : _pair.substr(_eq + 1));
+            if (!_key || !_value) return parse_status::bad_request;
+
+            _req.m_query[*_key] = *_value;
+        }
+
+        std::size_t _length = 0;
+        for (std::string_view _headers = _line_end == std::string_view::npos ? "" : _head.substr(_line_end + 2);
+             !_headers.empty(); ) {
+            std::string_view _h = _headers.substr(0, _headers.find("\r\n"));
+            _headers.remove_prefix(std::min(_headers.size(), _h.size() + 2));
+
+            std::size_t _colon = _h.find(':');
+            if (_colon == std::string_view::npos) return parse_status::bad_request;
+
+            std::string _name(_h.substr(0, _colon));
+            for (char& _c : _name) _c = static_cast<char>(std::tolower(static_cast<u8>(_c)));
+
+            std::string_view _value = _h.substr(_colon + 1);
+            while (!_value.empty() && (_value.front() == ' ' || _value.front() == '\t')) _value.remove_prefix(1);
+            while (!_value.empty() && (_value.back() == ' ' || _value.back() == '\t')) _value.remove_suffix(1);
+
+            std::string _lower(_value);
+            for (char& _c : _lower) _c = static_cast<char>(std::tolower(static_cast<u8>(_c)));
+
+            if (_name == "content-length") {
+                if (_value.empty() || _value.size() > 18 ||
+                    _value.find_first_not_of("0123456789") != std::string_view::npos)
+                    return parse_status::bad_request;
+                _length = std::stoull(std::string(_value));
+            } else if (_name == "transfer-encoding") return parse_status::bad_request;
+            else if (_name == "connection") {
+                if (_lower == "close") _req.m_keep_alive = false;
+                else if (_lower == "keep-alive") _req.m_keep_alive = true;
+            }
+        }
+
+        if (_length > _max_body) return parse_status::too_large;
+        if (_buffer.size() < _end + 4 + _length) return parse_status::incomplete;
+
+        _req.m_body = _buffer.substr(_end + 4, _length);
+        _buffer.erase(0, _end + 4 + _length);
+
+        return parse_status::complete;
+    }
+
+    static void write(std::string& _out, const http_response& _res, bool _keep_alive) {
+        _out += "HTTP/1.1 " + std::to_string(_res.m_status) + ' ' + reason(_res.m_status) + "\r\n";
+        _out += "Content-Type: " + _res.m_type + "\r\n";
+        _out += "Content-Length: " + std::to_string(_res.m_body.size()) + "\r\n";
+        _out += _keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        _out += _res.m_body;
+    }
+};
+
+}
\ No newline at end of file
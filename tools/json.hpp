@@ -0,0 +1,379 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+
+#include <cstdio>
+#include <cstdlib>
+#include <tuple>
+#include <utility>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#include <fumen.hpp>
+
+/*
+ * JSON form of decoded pages, shared by the command-line tool and the
+ * server. A fumen is an array of pages:
+ *
+ *   { "field": ["___TTT____", ...], "garbage": "__________",
+ *     "comment": "...", "operation": { "piece": "T", "rotation": "spawn",
+ *     "x": 4, "y": 0 }, "flags": { "lock": true, "mirror": false,
+ *     "colorize": true, "rise": false } }
+ *
+ * Field rows run from the top of the stack down to row 0; empty rows above
+ * the stack are left out. "operation" is null if the page has none.
+ */
+
+namespace fumen::tools {
+
+inline const char* rotation_names[] = { "reverse", "right", "spawn", "left" };
+
+inline void write_json_string(std::string& _out, std::string_view _str) {
+    _out += '"';
+
+    for (char _c : _str) {
+        switch (_c) {
+            case '"':  _out += "\\\""; break;
+            case '\\': _out += "\\\\"; break;
+            case '\n': _out += "\\n"; break;
+            case '\r': _out += "\\r"; break;
+            case '\t': _out += "\\t"; break;
+            default:
+                if (static_cast<u8>(_c) < 0x20) {
+                    char _buf[8];
+                    std::snprintf(_buf, sizeof(_buf), "\\u%04x", static_cast<u8>(_c));
+                    _out += _buf;
+                } else _out += _c;
+        }
+    }
+
+    _out += '"';
+}
+
+inline void write_json(std::string& _out, const fumen_page& _page) {
+    std::string _rows = _page.m_field.to_string(true, '\n', false);
+
+    _out += "{\"field\":[";
+    for (std::size_t _i = 0; _i < _rows.size(); _i += details::FIELD_WIDTH + 1) {
+        if (_i) _out += ',';
+        write_json_string(_out, std::string_view(_rows).substr(_i, details::FIELD_WIDTH));
+    }
+
+    _out += "],\"garbage\":\"";
+    for (u32 _x = 0; _x < details::FIELD_WIDTH; _x++)
+        _out += piece_to_char(_page.m_field.at(_x, -1));
+
+    _out += "\",\"comment\":";
+    write_json_string(_out, _page.m_comment);
+
+    _out += ",\"operation\":";
+    if (const std::optional<operation>& _op = _page.m_operation) {
+        _out += "{\"piece\":\"";
+        _out += piece_to_char(_op->m_piece);
+        _out += "\",\"rotation\":\"";
+        _out += rotation_names[static_cast<u8>(_op->m_rotation)];
+        _out += "\",\"x\":" + std::to_string(_op->m_x) + ",\"y\":" + std::to_string(_op->m_y) + '}';
+    } else _out += "null";
+
+    auto _flag = [&] (const char* _name, bool _value, bool _last = false) {
+        _out += '"';
+        _out += _name;
+        _out += _value ? "\":true" : "\":false";
+        if (!_last) _out += ',';
+    };
+
+    _out += ",\"flags\":{";
+    _flag("lock", _page.m_flags.lock_bit);
+    _flag("mirror", _page.m_flags.mirror_bit);
+    _flag("colorize", _page.m_flags.colorize_bit);
+    _flag("rise", _page.m_flags.rise_bit, true);
+    _out += "}}";
+}
+
+inline void write_json(std::string& _out, const fumen_pages& _pages) {
+    _out += '[';
+    for (std::size_t _i = 0; _i < _pages.size(); _i++) {
+        if (_i) _out += ',';
+        write_json(_out, _pages[_i]);
+    }
+    _out += ']';
+}
+
+// A parsed JSON document; numbers are kept as doubles
+struct json_value {
+    enum class kind { null, boolean, number, string, array, object };
+
+    kind m_kind = kind::null;
+    bool m_bool = false;
+    double m_number = 0;
+    std::string m_string;
+    std::vector<json_value> m_array;
+    std::map<std::string, json_value, std::less<>> m_object;
+
+    // Member _key, or nullptr if this is not an object or has no such member
+    const json_value* find(std::string_view _key) const {
+        if (m_kind != kind::object) return nullptr;
+
+        auto _it = m_object.find(_key);
+        return _it == m_object.end() ? nullptr : &_it->second;
+    }
+};
+
+class json_parser {
+public:
+    static json_value parse(std::string_view _text) {
+        json_parser _parser(_text);
+
+        json_value _value = _parser.m_value(0);
+        _parser.m_skip();
+        if (_parser.m_pos != _text.size()) _parser.m_fail("trailing characters");
+
+        return _value;
+    }
+
+private:
+    static constexpr u32 s_max_depth = 64;
+
+    std::string_view m_text;
+    std::size_t m_pos = 0;
+
+    explicit json_parser(std::string_view _text) : m_text(_text) {}
+
+    [[noreturn]] void m_fail(const char* _what) const
+    { throw std::invalid_argument(std::string("Invalid JSON: ") + _what + " at " + std::to_string(m_pos)); }
+
+    void m_skip() {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' ||
+               m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+            m_pos++;
+    }
+
+    bool m_eat(char _c) {
+        m_skip();
+        if (m_pos < m_text.size() && m_text[m_pos] == _c) { m_pos++; return true; }
+        return false;
+    }
+
+    void m_expect(char _c) { if (!m_eat(_c)) m_fail("unexpected character"); }
+
+    bool m_literal(std::string_view _word) {
+        if (m_text.substr(m_pos, _word.size()) != _word) return false;
+        m_pos += _word.size();
+        return true;
+    }
+
+    void m_utf8(std::string& _out, u32 _cp) {
+        if (_cp < 0x80) _out += static_cast<char>(_cp);
+        else if (_cp < 0x800) {
+            _out += static_cast<char>(0xC0 | _cp >> 6);
+            _out += static_cast<char>(0x80 | (_cp & 0x3F));
+        } else if (_cp < 0x10000) {
+            _out += static_cast<char>(0xE0 | _cp >> 12);
+            _out += static_cast<char>(0x80 | (_cp >> 6 & 0x3F));
+            _out += static_cast<char>(0x80 | (_cp & 0x3F));
+        } else {
+            _out += static_cast<char>(0xF0 | _cp >> 18);
+            _out += static_cast<char>(0x80 | (_cp >> 12 & 0x3F));
+            _out += static_cast<char>(0x80 | (_cp >> 6 & 0x3F));
+            _out += static_cast<char>(0x80 | (_cp & 0x3F));
+        }
+    }
+
+    u32 m_hex4() {
+        if (m_pos + 4 > m_text.size()) m_fail("short escape");
+
+        u32 _value = 0;
+        for (u32 _i = 0; _i < 4; _i++) {
+            char _c = m_text[m_pos++];
+            _value <<= 4;
+            if ('0' <= _c && _c <= '9') _value |= _c - '0';
+            else if ('a' <= _c && _c <= 'f') _value |= _c - 'a' + 10;
+            else if ('A' <= _c && _c <= 'F') _value |= _c - 'A' + 10;
+            else m_fail("bad escape");
+        }
+
+        return _value;
+    }
+
+    std::string m_string() {
+        m_expect('"');
+
+        std::string _out;
+        while (true) {
+            if (m_pos >= m_text.size()) m_fail("unterminated string");
+
+            char _c = m_text[m_pos++];
+            if (_c == '"') return _out;
+            if (static_cast<u8>(_c) < 0x20) m_fail("control character in string");
+            if (_c != '\\') { _out += _c; continue; }
+
+            if (m_pos >= m_text.size()) m_fail("unterminated string");
+            switch (m_text[m_pos++]) {
+                case '"':  _out += '"'; break;
+                case '\\': _out += '\\'; break;
+                case '/':  _out += '/'; break;
+                case 'b':  _out += '\b'; break;
+                case 'f':  _out += '\f'; break;
+                case 'n':  _out += '\n'; break;
+                case 'r':  _out += '\r'; break;
+                case 't':  _out += '\t'; break;
+                case 'u': {
+                    u32 _cp = m_hex4();
+                    if (0xD800 <= _cp && _cp < 0xDC00 && m_literal("\\u")) {
+                        u32 _low = m_hex4();
+                        if (_low < 0xDC00 || _low >= 0xE000) m_fail("bad surrogate");
+                        _cp = 0x10000 + ((_cp - 0xD800) << 10) + (_low - 0xDC00);
+                    }
+                    m_utf8(_out, _cp);
+                    break;
+                }
+                default: m_fail("bad escape");
+            }
+        }
+    }
+
+    json_value m_value(u32 _depth) {
+        if (_depth > s_max_depth) m_fail("nested too deeply");
+
+        m_skip();
+        if (m_pos >= m_text.size()) m_fail("unexpected end");
+
+        json_value _value;
+        char _c = m_text[m_pos];
+
+        if (_c == '{') {
+            m_pos++;
+            _value.m_kind = json_value::kind::object;
+
+            if (m_eat('}')) return _value;
+            do {
+                m_skip();
+                std::string _key = m_string();
+                m_expect(':');
+                _value.m_object[std::move(_key)] = m_value(_depth + 1);
+            } while (m_eat(','));
+            m_expect('}');
+        } else if (_c == '[') {
+            m_pos++;
+            _value.m_kind = json_value::kind::array;
+
+            if (m_eat(']')) return _value;
+            do _value.m_array.push_back(m_value(_depth + 1));
+            while (m_eat(','));
+            m_expect(']');
+        } else if (_c == '"') {
+            _value.m_kind = json_value::kind::string;
+            _value.m_string = m_string();
+        } else if (m_literal("true") || m_literal("false")) {
+            _value.m_kind = json_value::kind::boolean;
+            _value.m_bool = _c == 't';
+        } else if (m_literal("null")) {
+            _value.m_kind = json_value::kind::null;
+        } else {
+            std::string _num;
+            while (m_pos < m_text.size() && std::string_view("+-.0123456789eE").find(m_text[m_pos]) != std::string_view::npos)
+                _num += m_text[m_pos++];
+
+            char* _end = nullptr;
+            _value.m_kind = json_value::kind::number;
+            _value.m_number = std::strtod(_num.c_str(), &_end);
+            if (_num.empty() || *_end) m_fail("bad number");
+        }
+
+        return _value;
+    }
+};
+
+// Pages from the JSON form written by write_json; throws invalid_argument
+inline fumen_pages read_pages(const json_value& _json) {
+    auto _fail = [] (const std::string& _what) -> void
+    { throw std::invalid_argument("Invalid page: " + _what); };
+
+    if (_json.m_kind != json_value::kind::array) _fail("expected an array of pages");
+
+    auto _row = [&] (const json_value* _value, const char* _name) {
+        if (!_value || _value->m_kind != json_value::kind::string || _value->m_string.size() != details::FIELD_WIDTH)
+            _fail(std::string(_name) + " rows must be strings of 10 cells");
+
+        for (char _c : _value->m_string)
+            if (!is_valid_piece(_c)) _fail(std::string("unknown cell '") + _c + "'");
+
+        return _value->m_string;
+    };
+
+    fumen_pages _pages;
+    _pages.reserve(_json.m_array.size());
+
+    for (const json_value& _item : _json.m_array) {
+        fumen_page _page;
+
+        std::string _rows;
+        if (const json_value* _field = _item.find("field")) {
+            if (_field->m_kind != json_value::kind::array || _field->m_array.size() > details::FIELD_HEIGHT)
+                _fail("field must be an array of at most 23 rows");
+
+            for (const json_value& _r : _field->m_array) _rows += _row(&_r, "field");
+        }
+
+        // Rows left out above the stack are empty
+        _rows.insert(0, details::FIELD_WIDTH * details::FIELD_HEIGHT - _rows.size(), '_');
+
+        const json_value* _garbage = _item.find("garbage");
+        _page.m_field = field(_rows, _garbage ? _row(_garbage, "garbage") : std::string(details::FIELD_WIDTH, '_'));
+
+        if (const json_value* _comment = _item.find("comment")) {
+            if (_comment->m_kind != json_value::kind::string) _fail("comment must be a string");
+            _page.m_comment = _comment->m_string;
+        }
+
+        const json_value* _op = _item.find("operation");
+        if (_op && _op->m_kind != json_value::kind::null) {
+            const json_value *_piece = _op->find("piece"), *_rot = _op->find("rotation"),
+                *_x = _op->find("x"), *_y = _op->find("y");
+
+            if (!_piece || _piece->m_kind != json_value::kind::string || _piece->m_string.size() != 1 ||
+                !details::defs::is_mino(char_to_piece(_piece->m_string[0])))
+                _fail("operation piece must be one of IJLOSTZ");
+
+            operation _operation {};
+            _operation.m_piece = char_to_piece(_piece->m_string[0]);
+
+            u8 _r = 0;
+            while (_r < 4 && !(_rot && _rot->m_string == rotation_names[_r])) _r++;
+            if (_r == 4) _fail("operation rotation must be reverse, right, spawn or left");
+            _operation.m_rotation = static_cast<rotation>(_r);
+
+            for (auto [_v, _max, _out] : { std::tuple(_x, details::FIELD_WIDTH, &_operation.m_x),
+                                           std::tuple(_y, details::FIELD_HEIGHT, &_operation.m_y) }) {
+                if (!_v || _v->m_kind != json_value::kind::number || _v->m_number < 0 ||
+                    _v->m_number >= _max || _v->m_number != static_cast<u32>(_v->m_number))
+                    _fail("operation x and y must be cells of the field");
+                *_out = static_cast<u32>(_v->m_number);
+            }
+
+            _page.m_operation = _operation;
+        }
+
+        _page.m_flags.lock_bit = 1;
+        if (const json_value* _flags = _item.find("flags")) {
+            auto _get = [&] (const char* _name, bool _default) {
+                const json_value* _f = _flags->find(_name);
+                return _f && _f->m_kind == json_value::kind::boolean ? _f->m_bool : _default;
+            };
+
+            _page.m_flags.lock_bit = _get("lock", true);
+            _page.m_flags.mirror_bit = _get("mirror", false);
+            _page.m_flags.colorize_bit = _get("colorize", true);
+            _page.m_flags.rise_bit = _get("rise", false);
+        } else _page.m_flags.colorize_bit = 1;
+
+        _pages.push_back(std::move(_page));
+    }
+
+    return _pages;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <string>
+
+#include <mutex>
+#include <thread>
+#include <istream>
+#include <utility>
+#include <optional>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <details/intdef.hpp>
+
+namespace fumen::tools {
+
+// A FIFO which blocks producers while full and consumers while empty
+template <typename T>
+class bounded_queue {
+public:
+    explicit bounded_queue(std::size_t _capacity) : m_capacity(_capacity) {}
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_not_full, m_not_empty;
+    std::deque<T> m_items;
+    std::size_t m_capacity;
+    bool m_closed = false;
+
+public:
+    // Returns false if the queue was closed
+    bool push(T _item) {
+        std::unique_lock _lock(m_mutex);
+        m_not_full.wait(_lock, [&] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) return false;
+
+        m_items.push_back(std::move(_item));
+        m_not_empty.notify_one();
+
+        return true;
+    }
+
+    // Returns false instead of waiting if the queue is full or closed
+    bool try_push(T _item) {
+        std::lock_guard _lock(m_mutex);
+        if (m_closed || m_items.size() >= m_capacity) return false;
+
+        m_items.push_back(std::move(_item));
+        m_not_empty.notify_one();
+
+        return true;
+    }
+
+    // Moves up to _max items into _out, waiting for at least one. Returns
+    // false once the queue is closed and drained.
+    bool pop_some(std::vector<T>& _out, std::size_t _max) {
+        std::unique_lock _lock(m_mutex);
+        m_not_empty.wait(_lock, [&] { return m_closed || !m_items.empty(); });
+        if (m_items.empty()) return false;
+
+        for (std::size_t _n = 0; _n < _max && !m_items.empty(); _n++) {
+            _out.push_back(std::move(m_items.front()));
+            m_items.pop_front();
+        }
+        m_not_full.notify_all();
+
+        return true;
+    }
+
+    std::size_t size() {
+        std::lock_guard _lock(m_mutex);
+        return m_items.size();
+    }
+
+    // Returns nothing once the queue is closed and drained
+    std::optional<T> pop() {
+        std::unique_lock _lock(m_mutex);
+        m_not_empty.wait(_lock, [&] { return m_closed || !m_items.empty(); });
+        if (m_items.empty()) return std::nullopt;
+
+        T _item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+
+        return _item;
+    }
+
+    // Wakes everyone; pop() still drains what is left
+    void close() {
+        std::lock_guard _lock(m_mutex);
+        m_closed = true;
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+};
+
+struct pipeline_options {
+    u32 m_threads = 0;      // 0 for one per core
+    u32 m_batch = 256;      // lines per work item
+    u32 m_window = 0;       // batches in flight, 0 for 4 per thread
+};
+
+/*
+ * Runs _work(line) -> Result over the lines of _inputs and hands every
+ * result to _sink(line number, Result&&) in input order.
+ *
+ * A reader thread cuts the input into batches of lines, worker threads
+ * process them, and the calling thread writes them out in order. At most
+ * m_window batches exist at a time, so memory stays bounded however far
+ * a slow batch holds back the ones after it. An exception from any stage
+ * stops the pipeline and is rethrown here.
+ */
+template <typename Result, typename Work, typename Sink>
+void run_pipeline(const std::vector<std::istream*>& _inputs, Work&& _work, Sink&& _sink, pipeline_options _opts = {}) {
+    struct batch {
+        u64 m_seq = 0, m_first = 0;
+        std::vector<std::string> m_lines;
+        std::vector<Result> m_results;
+    };
+
+    u32 _threads = _opts.m_threads ? _opts.m_threads : std::max(1u, std::thread::hardware_concurrency());
+    u32 _window = _opts.m_window ? _opts.m_window : 4 * _threads;
+    u32 _size = std::max(1u, _opts.m_batch);
+
+    bounded_queue<batch> _todo(_window);
+
+    // Finished batches by sequence number modulo the window
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::vector<std::optional<batch>> _done(_window);
+    u64 _issued = 0, _written = 0, _total = ~u64(0);
+
+    std::exception_ptr _error;
+    bool _failed = false;
+
+    auto _fail = [&] {
+        {
+            std::lock_guard _lock(_mutex);
+            if (!_failed) _error = std::current_exception();
+            _failed = true;
+        }
+        _todo.close();
+        _changed.notify_all();
+    };
+
+    std::thread _reader([&] {
+        try {
+            batch _next;
+            u64 _line = 0;
+
+            auto _flush = [&] {
+                {
+                    std::unique_lock _lock(_mutex);
+                    _changed.wait(_lock, [&] { return _failed || _issued - _written < _window; });
+                    if (_failed) return false;
+
+                    _next.m_seq = _issued++;
+                }
+
+                _next.m_results.reserve(_next.m_lines.size());
+                if (!_todo.push(std::move(_next))) return false;
+
+                _next = batch();
+                _next.m_first = _line;
+
+                return true;
+            };
+
+            for (std::istream* _in : _inputs) {
+                for (std::string _str; std::getline(*_in, _str); ) {
+                    if (!_str.empty() && _str.back() == '\r') _str.pop_back();
+
+                    _next.m_lines.push_back(std::move(_str));
+                    _line++;
+
+                    if (_next.m_lines.size() == _size && !_flush()) return;
+                }
+            }
+
+            if (!_next.m_lines.empty() && !_flush()) return;
+
+            {
+                std::lock_guard _lock(_mutex);
+                _total = _issued;
+            }
+            _todo.close();
+            _changed.notify_all();
+        } catch (...) { _fail(); }
+    });
+
+    std::vector<std::thread> _workers;
+    _workers.reserve(_threads);
+
+    for (u32 _t = 0; _t < _threads; _t++) {
+        _workers.emplace_back([&] {
+            try {
+                while (std::optional<batch> _b = _todo.pop()) {
+                    for (const std::string& _line : _b->m_lines)
+                        _b->m_results.push_back(_work(_line));
+
+                    std::lock_guard _lock(_mutex);
+                    u64 _seq = _b->m_seq;
+                    _done[_seq % _window] = std::move(_b);
+                    _changed.notify_all();
+                }
+            } catch (...) { _fail(); }
+        });
+    }
+
+    try {
+        while (true) {
+            batch _b;
+            {
+                std::unique_lock _lock(_mutex);
+                _changed.wait(_lock, [&] {
+                    return _failed || _written == _total || _done[_written % _window].has_value();
+                });
+                if (_failed || _written == _total) break;
+
+                _b = std::move(*_done[_written % _window]);
+                _done[_written % _window].reset();
+            }
+
+            for (std::size_t _i = 0; _i < _b.m_results.size(); _i++)
+                _sink(_b.m_first + _i, std::move(_b.m_results[_i]));
+
+            {
+                std::lock_guard _lock(_mutex);
+                _written++;
+            }
+            _changed.notify_all();
+        }
+    } catch (...) { _fail(); }
+
+    _reader.join();
+    for (std::thread& _th : _workers) _th.join();
+
+    if (_error) std::rethrow_exception(_error);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "check.hpp"
+
+/*
+ * Requests followed at once by the client's FIN must all be answered:
+ * runs the fumen_server given as argv[1] on a free localhost port and
+ * half-closes each connection right after writing to it.
+ */
+
+static const char* const s_request = "GET /validate?fumen=v115@vhAAgH HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+// A port nothing listens on right now
+static u16 s_free_port() {
+    int _fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in _addr {};
+    _addr.sin_family = AF_INET;
+    _addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(_fd, reinterpret_cast<sockaddr*>(&_addr), sizeof(_addr));
+
+    socklen_t _len = sizeof(_addr);
+    ::getsockname(_fd, reinterpret_cast<sockaddr*>(&_addr), &_len);
+    ::close(_fd);
+
+    return ntohs(_addr.sin_port);
+}
+
+static int s_connect(u16 _port) {
+    sockaddr_in _addr {};
+    _addr.sin_family = AF_INET;
+    _addr.sin_port = htons(_port);
+    _addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int _fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(_fd, reinterpret_cast<sockaddr*>(&_addr), sizeof(_addr)) == 0) return _fd;
+
+    ::close(_fd);
+    return -1;
+}
+
+// Sends _data, shuts the write side down and returns all that comes back
+static std::string s_exchange(int _fd, const std::string& _data) {
+    ::send(_fd, _data.data(), _data.size(), MSG_NOSIGNAL);
+    ::shutdown(_fd, SHUT_WR);
+
+    std::string _reply;
+    char _buf[4096];
+    for (ssize_t _n; (_n = ::recv(_fd, _buf, sizeof(_buf), 0)) > 0; ) _reply.append(_buf, _n);
+
+    ::close(_fd);
+    return _reply;
+}
+
+// The number of times _what occurs in _text
+static u32 s_count(const std::string& _text, const std::string& _what) {
+    u32 _count = 0;
+    for (std::size_t _at = _text.find(_what); _at != std::string::npos; _at = _text.find(_what, _at + 1)) _count++;
+    return _count;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return 2;
+
+    u16 _port = s_free_port();
+    std::string _port_arg = std::to_string(_port);
+
+    pid_t _pid = ::fork();
+    if (_pid == 0) {
+        ::execl(argv[1], argv[1], "--port", _port_arg.c_str(), "--threads", "2", static_cast<char*>(nullptr));
+        ::_exit(127);
+    }
+
+    // Waits up to five seconds for the server to listen
+    int _fd = -1;
+    for (u32 _try = 0; _try < 500 && _fd < 0; _try++) {
+        _fd = s_connect(_port);
+        if (_fd < 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if (FUMEN_CHECK(_fd >= 0)) {
+        ::close(_fd);
+
+        // One request, answered whether or not the FIN comes with it
+        for (u32 _i = 0; _i < 50; _i++) {
+            std::string _reply = s_exchange(s_connect(_port), s_request);
+            FUMEN_CHECK(_reply.rfind("HTTP/1.1 200", 0) == 0 && _reply.find("\r\n\r\nok") != std::string::npos);
+        }
+
+        // Pipelined requests, then the FIN: every one is answered in turn
+        for (u32 _i = 0; _i < 20; _i++) {
+            std::string _reply = s_exchange(s_connect(_port), std::string(s_request) + s_request + s_request);
+            FUMEN_CHECK(s_count(_reply, "HTTP/1.1 200") == 3);
+        }
+
+        // A request cut short by the FIN gets no answer, and the server
+        // still closes the connection
+        FUMEN_CHECK(s_exchange(s_connect(_port), "GET /validate?fumen=v115@vhAAgH HTTP/1.1\r\n").empty());
+    }
+
+    ::kill(_pid, SIGTERM);
+    int _status = 0;
+    ::waitpid(_pid, &_status, 0);
+    FUMEN_CHECK(WIFEXITED(_status) && WEXITSTATUS(_status) == 0);
+
+    return fumen::tests::result();
+}
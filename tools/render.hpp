@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <algorithm>
+
+#include <fumen.hpp>
+
+namespace fumen::tools {
+
+/*
+ * Renders a page as an SVG image: the field from its highest block (at
+ * least 4 rows), the piece of the operation in a lighter shade and the
+ * garbage line below a gap. The comment becomes the title of the image.
+ */
+inline std::string render_svg(const fumen_page& _page, u32 _cell = 16) {
+    static constexpr const char* s_colors[] = {
+        "#000000", "#009999", "#996600", "#999900", "#990000", "#990099", "#0000bb", "#009900", "#999999"
+    };
+    static constexpr const char* s_lights[] = {
+        "#000000", "#33ffff", "#ffaa33", "#ffff33", "#ff3333", "#ff33ff", "#3333ff", "#33ff33", "#cccccc"
+    };
+
+    using details::FIELD_WIDTH;
+    using details::FIELD_HEIGHT;
+
+    // Cells covered by the operation, by row and column
+    bool _active[FIELD_HEIGHT][FIELD_WIDTH] = {};
+    if (_page.m_operation) {
+        const operation& _op = *_page.m_operation;
+
+        for (auto [_x, _y] : details::field_util::get_block_positions(_op.m_piece, _op.m_rotation, _op.m_x, _op.m_y))
+            if (0 <= _x && _x < (i32)FIELD_WIDTH && 0 <= _y && _y < (i32)FIELD_HEIGHT)
+                _active[_y][_x] = true;
+    }
+
+    i32 _rows = 4;
+    for (i32 _y = 0; _y < (i32)FIELD_HEIGHT; _y++)
+        for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+            if (_page.m_field.at(_x, _y) != piece_type::empty || _active[_y][_x])
+                _rows = std::max(_rows, _y + 1);
+
+    u32 _width = FIELD_WIDTH * _cell, _height = (_rows + 1) * _cell + _cell / 4;
+
+    std::string _svg = "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" + std::to_string(_width) +
+        "\" height=\"" + std::to_string(_height) + "\" viewBox=\"0 0 " + std::to_string(_width) +
+        ' ' + std::to_string(_height) + "\">";
+
+    if (!_page.m_comment.empty()) {
+        _svg += "<title>";
+        for (char _c : _page.m_comment) {
+            if (_c == '<') _svg += "&lt;";
+            else if (_c == '>') _svg += "&gt;";
+            else if (_c == '&') _svg += "&amp;";
+            else _svg += _c;
+        }
+        _svg += "</title>";
+    }
+
+    _svg += "<rect width=\"100%\" height=\"100%\" fill=\"#000000\"/>";
+
+    auto _rect = [&] (u32 _x, u32 _top, const char* _color) {
+        _svg += "<rect x=\"" + std::to_string(_x * _cell) + "\" y=\"" + std::to_string(_top) +
+            "\" width=\"" + std::to_string(_cell) + "\" height=\"" + std::to_string(_cell) +
+            "\" fill=\"" + _color + "\"/>";
+    };
+
+    for (i32 _y = _rows - 1; _y >= 0; _y--) {
+        u32 _top = (_rows - 1 - _y) * _cell;
+
+        for (u32 _x = 0; _x < FIELD_WIDTH; _x++) {
+            if (_active[_y][_x]) _rect(_x, _top, s_lights[static_cast<u8>(_page.m_operation->m_piece)]);
+            else if (piece_type _p = _page.m_field.at(_x, _y); _p != piece_type::empty)
+                _rect(_x, _top, s_colors[static_cast<u8>(_p)]);
+        }
+    }
+
+    for (u32 _x = 0; _x < FIELD_WIDTH; _x++)
+        if (piece_type _p = _page.m_field.at(_x, -1); _p != piece_type::empty)
+            _rect(_x, _rows * _cell + _cell / 4, s_colors[static_cast<u8>(_p)]);
+
+    _svg += "</svg>";
+
+    return _svg;
+}
+
+}
\ No newline at end of file